@@ -280,6 +280,114 @@ static void validate_memset(void) {
   }
 }
 
+static void validate_memcmp(void) {
+  size_t align1, align2, size;
+  const size_t maxsize = 256;
+
+  printf("testing memcmp for correctness\n");
+
+  for (align1 = 0; align1 < 16; align1++) {
+    for (align2 = 0; align2 < 16; align2++) {
+      for (size = 0; size < maxsize; size++) {
+        fillbuf(src, maxsize * 2, 567);
+        memcpy(dst + align2, src + align1, size);
+
+        if (memcmp(src + align1, dst + align2, size) != 0) {
+          printf("error! equal buffers, align %zu/%zu, size %zu\n", align1, align2, size);
+        }
+
+        // perturb each position in turn and make sure the sign is right
+        for (size_t i = 0; i < size; i++) {
+          uint8_t saved = dst[align2 + i];
+          dst[align2 + i] = src[align1 + i] + 1;
+          int r = memcmp(src + align1, dst + align2, size);
+          bool ok = (src[align1 + i] < dst[align2 + i]) ? (r < 0) : (r > 0);
+          if (!ok) {
+            printf("error! align %zu/%zu, size %zu, diff at %zu, ret %d\n", align1, align2, size,
+                   i, r);
+          }
+          dst[align2 + i] = saved;
+        }
+      }
+    }
+  }
+}
+
+static void validate_strlen(void) {
+  size_t align, len;
+  const size_t maxsize = 256;
+
+  printf("testing strlen for correctness\n");
+
+  for (align = 0; align < 16; align++) {
+    for (len = 0; len < maxsize; len++) {
+      memset(src, 'a', maxsize * 2);
+      src[align + len] = 0;
+      size_t r = strlen((const char *)src + align);
+      if (r != len) {
+        printf("error! align %zu, len %zu, ret %zu\n", align, len, r);
+      }
+    }
+  }
+}
+
+/* run each routine over sizes from 8 bytes to 1MB, moving about 64MB total per size */
+#define BENCH_SIZES_MIN 8
+#define BENCH_SIZES_MAX (1024 * 1024)
+#define BENCH_SIZES_TOTAL (64 * 1024 * 1024)
+
+static void bench_print_rate(const char *name, size_t size, size_t iterations,
+                             lk_bigtime_t usecs) {
+  if (usecs == 0)
+    usecs = 1;
+  printf("%-8s %8zu bytes: %10llu usecs, %6llu MB/sec, %6llu ns/call\n", name, size, usecs,
+         (uint64_t)size * iterations / usecs, usecs * 1000ULL / iterations);
+}
+
+static void bench_sizes(void) {
+  printf("string routine speed test by size\n");
+  thread_sleep(200);  // let the debug string clear the serial port
+
+  // fill the compare buffers identically so memcmp has to walk the whole length
+  fillbuf(src, BUFFER_SIZE, 567);
+  memcpy(src2, src, BUFFER_SIZE);
+  memset(dst2, 'a', BUFFER_SIZE);
+
+  for (size_t size = BENCH_SIZES_MIN; size <= BENCH_SIZES_MAX; size *= 2) {
+    size_t iterations = BENCH_SIZES_TOTAL / size;
+    lk_bigtime_t t0;
+    volatile int sink = 0;
+
+    t0 = current_time_hires();
+    for (size_t i = 0; i < iterations; i++) {
+      memcpy(dst, src, size);
+    }
+    bench_print_rate("memcpy", size, iterations, current_time_hires() - t0);
+
+    t0 = current_time_hires();
+    for (size_t i = 0; i < iterations; i++) {
+      memset(dst, i, size);
+    }
+    bench_print_rate("memset", size, iterations, current_time_hires() - t0);
+
+    t0 = current_time_hires();
+    for (size_t i = 0; i < iterations; i++) {
+      sink += memcmp(src, src2, size);
+    }
+    bench_print_rate("memcmp", size, iterations, current_time_hires() - t0);
+
+    dst2[size] = 0;
+    t0 = current_time_hires();
+    for (size_t i = 0; i < iterations; i++) {
+      sink += strlen((const char *)dst2);
+    }
+    bench_print_rate("strlen", size, iterations, current_time_hires() - t0);
+    dst2[size] = 'a';
+
+    (void)sink;
+  }
+}
+
 static int string_tests(int argc, const cmd_args *argv, uint32_t flags) {
   src = memalign(64, BUFFER_SIZE + 256);
   dst = memalign(64, BUFFER_SIZE + 256);
@@ -299,6 +407,7 @@ static int string_tests(int argc, const cmd_args *argv, uint32_t flags) {
   usage:
     printf("%s validate <routine>\n", argv[0].str);
     printf("%s bench <routine>\n", argv[0].str);
+    printf("routines: memcpy memset memcmp (validate) strlen (validate) sizes (bench)\n");
     goto out;
   }
 
@@ -307,12 +416,18 @@ static int string_tests(int argc, const cmd_args *argv, uint32_t flags) {
       validate_memcpy();
     } else if (!strcmp(argv[2].str, "memset")) {
       validate_memset();
+    } else if (!strcmp(argv[2].str, "memcmp")) {
+      validate_memcmp();
+    } else if (!strcmp(argv[2].str, "strlen")) {
+      validate_strlen();
     }
   } else if (!strcmp(argv[1].str, "bench")) {
     if (!strcmp(argv[2].str, "memcpy")) {
       bench_memcpy();
     } else if (!strcmp(argv[2].str, "memset")) {
       bench_memset();
+    } else if (!strcmp(argv[2].str, "sizes")) {
+      bench_sizes();
     }
   } else {
     goto usage;
@@ -14,6 +14,7 @@
 
 #include <app/tests.h>
 #include <kernel/event.h>
+#include <kernel/mp.h>
 #include <kernel/mutex.h>
 #include <kernel/semaphore.h>
 #include <kernel/thread.h>
@@ -141,6 +142,48 @@ __NO_INLINE static void bench_memcpy(void) {
   free(buf);
 }
 
+#define MALLOC_BENCH_ITER 100000
+#define MALLOC_BENCH_SLOTS 64
+
+static int malloc_bench_thread(void *arg) {
+  void *slots[MALLOC_BENCH_SLOTS] = {};
+  uint seed = (uint)(uintptr_t)arg;
+
+  for (uint i = 0; i < MALLOC_BENCH_ITER; i++) {
+    uint slot = (seed = seed * 1103515245 + 12345) % MALLOC_BENCH_SLOTS;
+    free(slots[slot]);
+    slots[slot] = malloc(16 + (seed >> 8) % 240);
+  }
+  for (uint i = 0; i < MALLOC_BENCH_SLOTS; i++) {
+    free(slots[i]);
+  }
+  return 0;
+}
+
+// Small malloc/free churn from one thread per online cpu, to show heap lock scaling.
+__NO_INLINE static void bench_malloc_threads(void) {
+  thread_t *threads[SMP_MAX_CPUS];
+  const uint cpus = mp_active_cpu_count();
+
+  for (uint nthreads = 1; nthreads <= cpus; nthreads *= 2) {
+    lk_bigtime_t t = current_time_hires();
+    for (uint i = 0; i < nthreads; i++) {
+      threads[i] = thread_create("malloc bench", &malloc_bench_thread, (void *)(uintptr_t)(i + 1),
+                                 DEFAULT_PRIORITY, DEFAULT_STACK_SIZE);
+      thread_set_pinned_cpu(threads[i], mp_active_cpu(i));
+      thread_resume(threads[i]);
+    }
+    for (uint i = 0; i < nthreads; i++) {
+      thread_join(threads[i], NULL, INFINITE_TIME);
+    }
+    t = current_time_hires() - t;
+
+    uint64_t ops = (uint64_t)nthreads * MALLOC_BENCH_ITER * 2;
+    printf("%u threads: %llu malloc+free ops in %llu usecs, %llu ops/sec\n", nthreads, ops, t,
+           ops * 1000000ULL / MAX(t, 1ULL));
+  }
+}
+
 #if ARCH_ARM
 __NO_INLINE static void arm_bench_cset_stm(void) {
   uint32_t *buf = malloc(BUFSIZE);
@@ -246,6 +289,8 @@ int benchmarks(int argc, const cmd_args *argv, uint32_t flags) {
   bench_cset_uint64_t();
   bench_cset_wide();
 
+  bench_malloc_threads();
+
 #if ARCH_ARM
   arm_bench_cset_stm();
 
@@ -8,10 +8,13 @@
 #include <assert.h>
 #include <lib/cbuf.h>
 #include <lib/heap.h>
+#include <platform.h>
 #include <rand.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include <app/tests.h>
+#include <kernel/thread.h>
 #include <lk/console_cmd.h>
 #include <lk/debug.h>
 #include <lk/err.h>
@@ -34,12 +37,12 @@
     }                                                                            \
   } while (0);
 
-int cbuf_tests(int argc, const cmd_args *argv, uint32_t flags) {
+static void cbuf_basic_tests(uint cbuf_flags) {
   cbuf_t cbuf;
 
   printf("running basic tests...\n");
 
-  cbuf_initialize(&cbuf, 16);
+  cbuf_initialize_etc_flags(&cbuf, 16, malloc(16), cbuf_flags);
 
   ASSERT_EQ(15UL, cbuf_space_avail(&cbuf));
 
@@ -117,6 +120,119 @@ int cbuf_tests(int argc, const cmd_args *argv, uint32_t flags) {
   }
 
   free(cbuf.buf);
+}
+
+static void cbuf_reserve_tests(uint cbuf_flags) {
+  cbuf_t cbuf;
+  iovec_t regions[2];
+
+  printf("running reserve/commit tests...\n");
+
+  cbuf_initialize_etc_flags(&cbuf, 16, malloc(16), cbuf_flags);
+
+  ASSERT_EQ(15UL, cbuf_write_reserve(&cbuf, regions));
+  ASSERT_EQ(15UL, regions[0].iov_len);
+  ASSERT_EQ(0UL, regions[1].iov_len);
+
+  // nothing is visible before the commit
+  memcpy(regions[0].iov_base, "abcdefghij", 10);
+  ASSERT_EQ(0UL, cbuf_space_used(&cbuf));
+  cbuf_write_commit(&cbuf, 10, false);
+  ASSERT_EQ(10UL, cbuf_space_used(&cbuf));
+
+  ASSERT_EQ(8UL, cbuf_read(&cbuf, NULL, 8, false));
+
+  // free space now wraps around the end of the buffer
+  ASSERT_EQ(13UL, cbuf_write_reserve(&cbuf, regions));
+  ASSERT_EQ(6UL, regions[0].iov_len);
+  ASSERT_EQ(7UL, regions[1].iov_len);
+  ASSERT_EQ(cbuf.buf, regions[1].iov_base);
+  memcpy(regions[0].iov_base, "klmnop", 6);
+  memcpy(regions[1].iov_base, "qrs", 3);
+  cbuf_write_commit(&cbuf, 9, false);
+
+  // and the data reads back in order through peek
+  ASSERT_EQ(11UL, cbuf_peek(&cbuf, regions));
+  ASSERT_EQ(8UL, regions[0].iov_len);
+  ASSERT_EQ(3UL, regions[1].iov_len);
+  char buf[16];
+  ASSERT_EQ(11UL, cbuf_read(&cbuf, buf, sizeof(buf), false));
+  ASSERT_EQ(0, memcmp(buf, "ijklmnopqrs", 11));
+
+  free(cbuf.buf);
+}
+
+#define STREAM_BYTES (256 * 1024)
+
+static int stream_writer(void *arg) {
+  cbuf_t *cbuf = arg;
+  uint8_t next = 0;
+  size_t pos = 0;
+
+  while (pos < STREAM_BYTES) {
+    iovec_t regions[2];
+    size_t avail = MIN(cbuf_write_reserve(cbuf, regions), STREAM_BYTES - pos);
+    if (avail == 0) {
+      thread_yield();
+      continue;
+    }
+    size_t done = 0;
+    for (uint i = 0; i < 2 && done < avail; i++) {
+      size_t n = MIN(regions[i].iov_len, avail - done);
+      for (size_t j = 0; j < n; j++) {
+        ((uint8_t *)regions[i].iov_base)[j] = next++;
+      }
+      done += n;
+    }
+    cbuf_write_commit(cbuf, done, false);
+    pos += done;
+  }
+  return 0;
+}
+
+// a producer thread and a blocking reader streaming through a small buffer.
+static void cbuf_stream_test(uint cbuf_flags) {
+  cbuf_t cbuf;
+  cbuf_initialize_etc_flags(&cbuf, 64, malloc(64), cbuf_flags);
+
+  printf("running %s stream test...\n", (cbuf_flags & CBUF_FLAG_SPSC) ? "spsc" : "locked");
+
+  lk_bigtime_t t = current_time_hires();
+
+  thread_t *writer =
+      thread_create("cbuf_writer", &stream_writer, &cbuf, DEFAULT_PRIORITY, DEFAULT_STACK_SIZE);
+  thread_resume(writer);
+
+  uint8_t expected = 0;
+  size_t pos = 0;
+  while (pos < STREAM_BYTES) {
+    uint8_t buf[48];
+    size_t n = cbuf_read(&cbuf, buf, sizeof(buf), true);
+    ASSERT_LEQ(1UL, n);
+    for (size_t i = 0; i < n; i++) {
+      ASSERT_EQ(expected, buf[i]);
+      expected++;
+    }
+    pos += n;
+  }
+
+  thread_join(writer, NULL, INFINITE_TIME);
+
+  t = current_time_hires() - t;
+  printf("%u bytes in %llu us\n", STREAM_BYTES, t);
+
+  ASSERT_EQ(0UL, cbuf_space_used(&cbuf));
+  free(cbuf.buf);
+}
+
+int cbuf_tests(int argc, const cmd_args *argv, uint32_t flags) {
+  static const uint modes[] = {0, CBUF_FLAG_SPSC};
+
+  for (uint i = 0; i < countof(modes); i++) {
+    cbuf_basic_tests(modes[i]);
+    cbuf_reserve_tests(modes[i]);
+    cbuf_stream_test(modes[i]);
+  }
 
   printf("cbuf tests passed\n");
 
@@ -0,0 +1,101 @@
+// Copyright 2025 Mist Tecnologia Ltda
+//
+// Use of this source code is governed by a MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT
+
+/*
+ * The mask helpers at a width that spans several words whatever the build is
+ * configured for, with a partial word at the end. Nothing in here may pull in
+ * a header that uses the mask at the real SMP_MAX_CPUS.
+ */
+#undef SMP_MAX_CPUS
+#define SMP_MAX_CPUS 130
+
+#include <assert.h>
+#include <stdio.h>
+
+#include <app/tests.h>
+#include <kernel/cpu_mask.h>
+#include <lk/debug.h>
+
+STATIC_ASSERT(MP_CPU_MASK_WORDS > 1);
+STATIC_ASSERT(SMP_MAX_CPUS % MP_CPU_MASK_BITS_PER_WORD != 0);
+
+static void fill_test(void) {
+  mp_cpu_mask_t m;
+  mp_cpu_mask_fill(&m);
+
+  ASSERT(mp_cpu_mask_count(&m) == SMP_MAX_CPUS);
+  ASSERT(mp_cpu_mask_test(&m, SMP_MAX_CPUS - 1));
+  ASSERT(!mp_cpu_mask_test(&m, SMP_MAX_CPUS));
+
+  /* only the cpus that exist in the last word */
+  ASSERT(m.bits[MP_CPU_MASK_WORDS - 1] ==
+         (1UL << (SMP_MAX_CPUS % MP_CPU_MASK_BITS_PER_WORD)) - 1);
+  for (uint i = 0; i < MP_CPU_MASK_WORDS - 1; i++) {
+    ASSERT(m.bits[i] == ~0UL);
+  }
+}
+
+static void next_test(void) {
+  static const int cpus[] = {0, 63, 64, 127, 128, SMP_MAX_CPUS - 1};
+  mp_cpu_mask_t m;
+
+  mp_cpu_mask_zero(&m);
+  ASSERT(mp_cpu_mask_first(&m) == -1);
+  for (uint i = 0; i < countof(cpus); i++) {
+    mp_cpu_mask_set(&m, cpus[i]);
+  }
+
+  /* walks every word in order, the last one included */
+  uint n = 0;
+  int cpu;
+  mp_cpu_mask_for_each(cpu, &m) {
+    ASSERT(n < countof(cpus) && cpu == cpus[n]);
+    n++;
+  }
+  ASSERT(n == countof(cpus));
+
+  ASSERT(mp_cpu_mask_next(&m, 0) == 63);
+  ASSERT(mp_cpu_mask_next(&m, 1) == 63);
+  ASSERT(mp_cpu_mask_next(&m, 64) == 127);
+  ASSERT(mp_cpu_mask_next(&m, SMP_MAX_CPUS - 1) == -1);
+
+  /* stray bits past the last cpu are not cpus */
+  mp_cpu_mask_clear(&m, SMP_MAX_CPUS - 1);
+  m.bits[MP_CPU_MASK_WORDS - 1] |= 1UL << (MP_CPU_MASK_BITS_PER_WORD - 1);
+  ASSERT(mp_cpu_mask_next(&m, 128) == -1);
+}
+
+static void bits_test(void) {
+  mp_cpu_mask_t m;
+
+  /* a run straddling the first word boundary */
+  mp_cpu_mask_zero(&m);
+  for (uint cpu = 60; cpu < 68; cpu++) {
+    mp_cpu_mask_set(&m, cpu);
+  }
+  ASSERT(mp_cpu_mask_bits(&m, 60, 8) == 0xff);
+  ASSERT(mp_cpu_mask_bits(&m, 62, 4) == 0xf);
+  ASSERT(mp_cpu_mask_bits(&m, 56, 16) == 0xff0);
+  ASSERT(mp_cpu_mask_bits(&m, 64, 8) == 0xf);
+  ASSERT(mp_cpu_mask_bits(&m, 0, 8) == 0);
+
+  /* a full word's worth starting mid word takes from both */
+  mp_cpu_mask_fill(&m);
+  ASSERT(mp_cpu_mask_bits(&m, 32, MP_CPU_MASK_BITS_PER_WORD) == ~0UL);
+
+  /* the end of the mask reads as clear */
+  ASSERT(mp_cpu_mask_bits(&m, 128, 8) == 0x3);
+  ASSERT(mp_cpu_mask_bits(&m, MP_CPU_MASK_WORDS * MP_CPU_MASK_BITS_PER_WORD, 8) == 0);
+}
+
+int cpu_mask_tests(int argc, const cmd_args *argv, uint32_t flags) {
+  fill_test();
+  next_test();
+  bits_test();
+
+  printf("cpu mask tests passed\n");
+  return 0;
+}
@@ -0,0 +1,210 @@
+// Copyright 2025 Mist Tecnologia Ltda
+//
+// Use of this source code is governed by a MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT
+
+#include <lib/dpc.h>
+#include <stdio.h>
+
+#include <app/tests.h>
+#include <arch/ops.h>
+#include <kernel/event.h>
+#include <kernel/mp.h>
+#include <kernel/thread.h>
+#include <kernel/timer.h>
+#include <lk/debug.h>
+#include <lk/err.h>
+
+#define ORDER_COUNT 8
+
+struct dpc_test {
+  dpc_t dpc;
+  event_t done;
+  uint cpu;     /* where it was queued from */
+  uint ran_cpu; /* where the callback ran */
+  bool ran_in_thread;
+};
+
+static void dpc_test_init(struct dpc_test *t, dpc_callback cb) {
+  dpc_init(&t->dpc, cb, t);
+  event_init(&t->done, false, 0);
+  t->cpu = t->ran_cpu = UINT32_MAX;
+  t->ran_in_thread = false;
+}
+
+static void record_cb(void *arg) {
+  struct dpc_test *t = arg;
+
+  t->ran_cpu = arch_curr_cpu_num();
+  t->ran_in_thread = !arch_ints_disabled();
+  event_signal(&t->done, false);
+}
+
+static enum handler_return queue_from_irq(struct timer *timer, lk_time_t now, void *arg) {
+  struct dpc_test *t = arg;
+
+  t->cpu = arch_curr_cpu_num();
+  dpc_queue_etc(&t->dpc, 0);
+  return INT_NO_RESCHEDULE;
+}
+
+/* a dpc queued from a timer runs later, in thread context, on the same cpu */
+static int irq_queue(void) {
+  struct dpc_test t;
+  timer_t timer;
+
+  dpc_test_init(&t, record_cb);
+  timer_initialize(&timer);
+  timer_set_oneshot(&timer, 10, queue_from_irq, &t);
+
+  if (event_wait_timeout(&t.done, 1000) < 0) {
+    timer_cancel(&timer);
+    printf("dpc queued from a timer did not run\n");
+    return __LINE__;
+  }
+  if (!t.ran_in_thread || t.ran_cpu != t.cpu) {
+    printf("dpc queued on cpu %u ran on cpu %u, in thread %d\n", t.cpu, t.ran_cpu,
+           t.ran_in_thread);
+    return __LINE__;
+  }
+
+  event_destroy(&t.done);
+  return 0;
+}
+
+static uint order[ORDER_COUNT];
+static uint order_count;
+static event_t order_done;
+
+static void order_cb(void *arg) {
+  order[order_count++] = (uint)(uintptr_t)arg;
+  if (order_count == ORDER_COUNT)
+    event_signal(&order_done, false);
+}
+
+/* callbacks run in queue order, and a pending dpc cannot be queued twice */
+static int queue_order(void) {
+  dpc_t dpcs[ORDER_COUNT];
+  int result = 0;
+
+  order_count = 0;
+  event_init(&order_done, false, 0);
+  for (uint i = 0; i < ORDER_COUNT; i++) {
+    dpc_init(&dpcs[i], order_cb, (void *)(uintptr_t)i);
+  }
+
+  /* keep the local dpc thread off the cpu until everything is queued */
+  arch_disable_ints();
+  for (uint i = 0; i < ORDER_COUNT; i++) {
+    dpc_queue_etc(&dpcs[i], 0);
+  }
+  status_t err = dpc_queue_etc(&dpcs[0], 0);
+  arch_enable_ints();
+
+  if (err != ERR_ALREADY_EXISTS) {
+    printf("queueing a pending dpc returned %d\n", err);
+    result = __LINE__;
+  }
+
+  if (event_wait_timeout(&order_done, 1000) < 0) {
+    printf("only %u of %u dpcs ran\n", order_count, ORDER_COUNT);
+    return __LINE__;
+  }
+  for (uint i = 0; i < ORDER_COUNT; i++) {
+    if (order[i] != i) {
+      printf("dpc %u ran in slot %u\n", order[i], i);
+      result = __LINE__;
+    }
+  }
+
+  /* it can go again once it has run */
+  event_unsignal(&order_done);
+  order_count = ORDER_COUNT - 1;
+  if (dpc_queue_etc(&dpcs[0], 0) != NO_ERROR || event_wait_timeout(&order_done, 1000) < 0) {
+    printf("dpc could not be queued again\n");
+    return __LINE__;
+  }
+
+  event_destroy(&order_done);
+  return result;
+}
+
+static int queue_on_cpu_thread(void *arg) {
+  struct dpc_test *t = arg;
+
+  t->cpu = arch_curr_cpu_num();
+  return dpc_queue_etc(&t->dpc, 0);
+}
+
+/* every cpu that is up has a dpc thread, and runs what was queued on it */
+static int per_cpu(void) {
+  int result = 0;
+
+  for (uint i = 0; i < mp_active_cpu_count(); i++) {
+    uint cpu = mp_active_cpu(i);
+    struct dpc_test t;
+
+    dpc_test_init(&t, record_cb);
+
+    thread_t *thread = thread_create("dpc queuer", &queue_on_cpu_thread, &t, DEFAULT_PRIORITY,
+                                     DEFAULT_STACK_SIZE);
+    thread_set_pinned_cpu(thread, cpu);
+    thread_resume(thread);
+
+    int ret;
+    thread_join(thread, &ret, INFINITE_TIME);
+    if (ret != NO_ERROR || event_wait_timeout(&t.done, 1000) < 0) {
+      printf("dpc queued on cpu %u did not run\n", cpu);
+      return __LINE__;
+    }
+    if (t.cpu != cpu || t.ran_cpu != cpu) {
+      printf("dpc for cpu %u queued on cpu %u ran on cpu %u\n", cpu, t.cpu, t.ran_cpu);
+      result = __LINE__;
+    }
+    event_destroy(&t.done);
+  }
+
+  return result;
+}
+
+static void signal_cb(void *arg) { event_signal(arg, false); }
+
+/* dpc_queue() allocates the dpc and frees it after the callback */
+static int one_shot(void) {
+  event_t done;
+
+  event_init(&done, false, 0);
+  for (uint i = 0; i < 64; i++) {
+    if (dpc_queue(signal_cb, &done, 0) != NO_ERROR || event_wait_timeout(&done, 1000) < 0) {
+      printf("one shot dpc %u did not run\n", i);
+      return __LINE__;
+    }
+    event_unsignal(&done);
+  }
+  event_destroy(&done);
+
+  return 0;
+}
+
+#define RUN_TEST(t) \
+  result = t();     \
+  if (result)       \
+  goto fail
+
+int dpc_tests(int argc, const cmd_args *argv, uint32_t flags) {
+  int result;
+
+  RUN_TEST(irq_queue);
+  RUN_TEST(queue_order);
+  RUN_TEST(per_cpu);
+  RUN_TEST(one_shot);
+
+  printf("all tests passed\n");
+  return 0;
+fail:
+  printf("test failed at line %d\n", result);
+  return 1;
+}
+
+#undef RUN_TEST
@@ -0,0 +1,346 @@
+/*
+ * Copyright (c) 2025 Mist Tecnologia Ltda
+ *
+ * Use of this source code is governed by a MIT-style
+ * license that can be found in the LICENSE file or at
+ * https://opensource.org/licenses/MIT
+ */
+
+#include <lib/elf.h>
+
+#if WITH_KERNEL_VM
+
+#include <platform.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <app/tests.h>
+#include <kernel/vm.h>
+#include <lk/err.h>
+
+#if WITH_ELF32
+typedef struct Elf32_Ehdr elf_ehdr_t;
+typedef struct Elf32_Phdr elf_phdr_t;
+#else
+typedef struct Elf64_Ehdr elf_ehdr_t;
+typedef struct Elf64_Phdr elf_phdr_t;
+#endif
+
+#if ARCH_ARM
+#define TEST_EM EM_ARM
+#elif ARCH_ARM64
+#define TEST_EM EM_AARCH64
+#elif ARCH_X86
+#define TEST_EM EM_386
+#elif ARCH_X86_64
+#define TEST_EM EM_X86_64
+#elif ARCH_RISCV
+#define TEST_EM EM_RISCV
+#endif
+
+#define IMAGE_BASE (USER_ASPACE_BASE + 0x1000000)
+
+/*
+ * A file made up on the fly: the elf and program headers followed by a pattern
+ * derived from the offset, so that large images take no memory to hold.
+ */
+typedef struct {
+  uint8_t headers[512];
+  uint64_t len;
+} synth_file_t;
+
+#define PATTERN_RUN 256
+
+static uint8_t pattern(uint64_t offset) { return (uint8_t)(offset / PATTERN_RUN) ^ 0xa5; }
+
+static ssize_t synth_read_hook(struct elf_handle *handle, void *buf, uint64_t offset, size_t len) {
+  synth_file_t *f = handle->read_hook_arg;
+  if (offset >= f->len)
+    return 0;
+  len = MIN(len, f->len - offset);
+
+  uint8_t *out = buf;
+  size_t pos = 0;
+  while (pos < len) {
+    uint64_t off = offset + pos;
+    size_t run;
+    if (off < sizeof(f->headers)) {
+      run = MIN(len - pos, sizeof(f->headers) - off);
+      memcpy(out + pos, f->headers + off, run);
+    } else {
+      run = MIN(len - pos, PATTERN_RUN - (off % PATTERN_RUN));
+      memset(out + pos, pattern(off), run);
+    }
+    pos += run;
+  }
+  return len;
+}
+
+static void synth_build(synth_file_t *f, vaddr_t entry, const elf_phdr_t *phdrs, uint count) {
+  memset(f, 0, sizeof(*f));
+
+  elf_ehdr_t *eh = (elf_ehdr_t *)f->headers;
+  memcpy(eh->e_ident, ELF_MAGIC, 4);
+#if WITH_ELF32
+  eh->e_ident[EI_CLASS] = ELFCLASS32;
+#else
+  eh->e_ident[EI_CLASS] = ELFCLASS64;
+#endif
+#if BYTE_ORDER == LITTLE_ENDIAN
+  eh->e_ident[EI_DATA] = ELFDATA2LSB;
+#else
+  eh->e_ident[EI_DATA] = ELFDATA2MSB;
+#endif
+  eh->e_ident[EI_VERSION] = EV_CURRENT;
+  eh->e_type = ET_EXEC;
+  eh->e_machine = TEST_EM;
+  eh->e_version = EV_CURRENT;
+  eh->e_entry = entry;
+  eh->e_phoff = sizeof(elf_ehdr_t);
+  eh->e_ehsize = sizeof(elf_ehdr_t);
+  eh->e_phentsize = sizeof(elf_phdr_t);
+  eh->e_phnum = count;
+  memcpy(f->headers + sizeof(elf_ehdr_t), phdrs, count * sizeof(elf_phdr_t));
+
+  for (uint i = 0; i < count; i++) {
+    f->len = MAX(f->len, (uint64_t)(phdrs[i].p_offset + phdrs[i].p_filesz));
+  }
+}
+
+/* what the vmm would see if the current thread touched va */
+static status_t touch(vaddr_t va, uint pf_flags) {
+  return vmm_page_fault_handler(va, pf_flags | VMM_PF_FLAG_NOT_PRESENT | VMM_PF_FLAG_USER);
+}
+
+static uint8_t *mapped_page(vmm_aspace_t *aspace, vaddr_t va, paddr_t *pa_out) {
+  paddr_t pa;
+  if (arch_mmu_query(&aspace->arch_aspace, va, &pa, NULL) < 0)
+    return NULL;
+  if (pa_out)
+    *pa_out = pa;
+  return paddr_to_kvaddr(pa);
+}
+
+/* check the page at va against what segment ph puts there */
+static bool check_page(const uint8_t *page, vaddr_t va, const elf_phdr_t *ph) {
+  for (uint i = 0; i < PAGE_SIZE; i++) {
+    vaddr_t a = va + i;
+    uint8_t expected = 0;
+    if (a >= ph->p_vaddr && a < ph->p_vaddr + ph->p_filesz)
+      expected = pattern(ph->p_offset + (a - ph->p_vaddr));
+    if (page[i] != expected) {
+      printf("mismatch at 0x%lx: 0x%x != 0x%x\n", a, page[i], expected);
+      return false;
+    }
+  }
+  return true;
+}
+
+static int lazy_load(void) {
+  const vaddr_t data = IMAGE_BASE + 0x10000;
+  const elf_phdr_t phdrs[] = {
+      {.p_type = PT_LOAD,
+       .p_flags = PF_R | PF_X,
+       .p_offset = 0x1000,
+       .p_vaddr = IMAGE_BASE,
+       .p_filesz = 3 * PAGE_SIZE,
+       .p_memsz = 3 * PAGE_SIZE},
+      // not page aligned, with a page and a half of bss after the file data
+      {.p_type = PT_LOAD,
+       .p_flags = PF_R | PF_W,
+       .p_offset = 0x4123,
+       .p_vaddr = data + 0x123,
+       .p_filesz = 0x1000,
+       .p_memsz = 0x3000},
+  };
+
+  synth_file_t *file = malloc(sizeof(*file));
+  if (!file)
+    return __LINE__;
+  synth_build(file, IMAGE_BASE + 0x40, phdrs, countof(phdrs));
+
+  vmm_aspace_t *a, *b;
+  if (vmm_create_aspace(&a, "elf a", 0) < 0)
+    return __LINE__;
+  if (vmm_create_aspace(&b, "elf b", 0) < 0)
+    return __LINE__;
+
+  elf_handle_t elf;
+  if (elf_open_handle(&elf, synth_read_hook, file, false) < 0)
+    return __LINE__;
+  if (elf_load_lazy(&elf, a) < 0)
+    return __LINE__;
+  if (elf.entry != IMAGE_BASE + 0x40)
+    return __LINE__;
+
+  // nothing is read or mapped up front
+  if (mapped_page(a, IMAGE_BASE, NULL))
+    return __LINE__;
+
+  vmm_aspace_t *old = vmm_set_active_aspace(a);
+
+  paddr_t text_a, data_a;
+  if (touch(IMAGE_BASE + PAGE_SIZE + 5, VMM_PF_FLAG_INSTRUCTION) < 0)
+    return __LINE__;
+  uint8_t *page = mapped_page(a, IMAGE_BASE + PAGE_SIZE, &text_a);
+  if (!page || !check_page(page, IMAGE_BASE + PAGE_SIZE, &phdrs[0]))
+    return __LINE__;
+  if (mapped_page(a, IMAGE_BASE, NULL))
+    return __LINE__;
+
+  // text is read only and data is not executable
+  if (touch(IMAGE_BASE, VMM_PF_FLAG_WRITE) != ERR_ACCESS_DENIED)
+    return __LINE__;
+  if (touch(data, VMM_PF_FLAG_INSTRUCTION) != ERR_ACCESS_DENIED)
+    return __LINE__;
+  // and there is nothing past the end
+  if (touch(data + 4 * PAGE_SIZE, 0) != ERR_NOT_FOUND)
+    return __LINE__;
+
+  // partial file pages around the data and the bss after it
+  for (uint i = 0; i < 4; i++) {
+    if (touch(data + i * PAGE_SIZE, VMM_PF_FLAG_WRITE) < 0)
+      return __LINE__;
+    page = mapped_page(a, data + i * PAGE_SIZE, i == 0 ? &data_a : NULL);
+    if (!page || !check_page(page, data + i * PAGE_SIZE, &phdrs[1]))
+      return __LINE__;
+  }
+
+  // a second process shares the text and gets its own data
+  if (elf_load_lazy(&elf, b) < 0)
+    return __LINE__;
+  vmm_set_active_aspace(b);
+
+  paddr_t text_b, data_b;
+  if (touch(IMAGE_BASE + PAGE_SIZE, 0) < 0 || touch(data, 0) < 0)
+    return __LINE__;
+  if (!mapped_page(b, IMAGE_BASE + PAGE_SIZE, &text_b) || !mapped_page(b, data, &data_b))
+    return __LINE__;
+  if (text_a != text_b || data_a == data_b)
+    return __LINE__;
+
+  // the mappings outlive the handle
+  elf_close_handle(&elf);
+  if (touch(IMAGE_BASE + 2 * PAGE_SIZE, 0) < 0)
+    return __LINE__;
+  page = mapped_page(b, IMAGE_BASE + 2 * PAGE_SIZE, NULL);
+  if (!page || !check_page(page, IMAGE_BASE + 2 * PAGE_SIZE, &phdrs[0]))
+    return __LINE__;
+
+  vmm_set_active_aspace(old);
+  vmm_free_aspace(a);
+  vmm_free_aspace(b);
+  free(file);
+  return 0;
+}
+
+static status_t bench_alloc_hook(struct elf_handle *handle, void **ptr, size_t len, uint num,
+                                 uint flags) {
+  void **regions = handle->mem_alloc_hook_arg;
+  status_t err = vmm_alloc(vmm_get_kernel_aspace(), "elf bench", len, ptr, 0, 0, 0);
+  if (err >= 0)
+    regions[num] = *ptr;
+  return err;
+}
+
+/* time from nothing to the entry page being resident, eager against lazy */
+static int elf_benchmark(size_t mb) {
+  const size_t text_size = mb * 1024 * 1024;
+  const elf_phdr_t phdrs[] = {
+      {.p_type = PT_LOAD,
+       .p_flags = PF_R | PF_X,
+       .p_offset = 0x1000,
+       .p_vaddr = IMAGE_BASE,
+       .p_filesz = text_size,
+       .p_memsz = text_size},
+      {.p_type = PT_LOAD,
+       .p_flags = PF_R | PF_W,
+       .p_offset = 0x1000 + text_size,
+       .p_vaddr = IMAGE_BASE + text_size + 0x200000,
+       .p_filesz = 0x10000,
+       .p_memsz = 0x100000},
+  };
+  const vaddr_t entry = IMAGE_BASE + text_size / 2;
+
+  synth_file_t *file = malloc(sizeof(*file));
+  if (!file)
+    return __LINE__;
+  synth_build(file, entry, phdrs, countof(phdrs));
+
+  printf("%zu MB text, %zu KB data + bss\n", mb, (size_t)phdrs[1].p_memsz / 1024);
+
+  // eager: allocate, read and zero everything before jumping
+  void *regions[countof(phdrs)] = {0};
+  elf_handle_t elf;
+  lk_bigtime_t t = current_time_hires();
+  if (elf_open_handle(&elf, synth_read_hook, file, false) < 0)
+    return __LINE__;
+  elf.mem_alloc_hook = bench_alloc_hook;
+  elf.mem_alloc_hook_arg = regions;
+  status_t err = elf_load(&elf);
+  t = current_time_hires() - t;
+  elf_close_handle(&elf);
+  for (uint i = 0; i < countof(regions); i++) {
+    if (regions[i])
+      vmm_free_region(vmm_get_kernel_aspace(), (vaddr_t)regions[i]);
+  }
+  if (err < 0)
+    printf("eager: error %d\n", err);
+  else
+    printf("eager: %llu us to entry\n", t);
+
+  // lazy: map, then fault in the page the entry point is on
+  vmm_aspace_t *aspace;
+  if (vmm_create_aspace(&aspace, "elf bench", 0) < 0)
+    return __LINE__;
+  vmm_aspace_t *old = vmm_set_active_aspace(aspace);
+
+  t = current_time_hires();
+  if (elf_open_handle(&elf, synth_read_hook, file, false) < 0)
+    return __LINE__;
+  if (elf_load_lazy(&elf, aspace) < 0)
+    return __LINE__;
+  if (touch(elf.entry, VMM_PF_FLAG_INSTRUCTION) < 0)
+    return __LINE__;
+  t = current_time_hires() - t;
+  printf("lazy: %llu us to entry\n", t);
+
+  // what the rest of the text costs if it all ends up being touched
+  t = current_time_hires();
+  for (vaddr_t va = IMAGE_BASE; va < IMAGE_BASE + text_size; va += PAGE_SIZE) {
+    if (touch(va, 0) < 0)
+      return __LINE__;
+  }
+  t = current_time_hires() - t;
+  printf("lazy: %llu us to fault in all of the text\n", t);
+
+  elf_close_handle(&elf);
+  vmm_set_active_aspace(old);
+  vmm_free_aspace(aspace);
+  free(file);
+  return 0;
+}
+
+int elf_tests(int argc, const cmd_args *argv, uint32_t flags) {
+  int result;
+
+  if (argc > 1 && !strcmp(argv[1].str, "bench")) {
+    result = elf_benchmark(argc > 2 ? argv[2].u : 100);
+    if (result)
+      goto fail;
+    return 0;
+  }
+
+  result = lazy_load();
+  if (result)
+    goto fail;
+
+  printf("all tests passed\n");
+  return 0;
+fail:
+  printf("test failed at line %d\n", result);
+  return 1;
+}
+
+#endif  // WITH_KERNEL_VM
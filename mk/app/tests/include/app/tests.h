@@ -12,15 +12,20 @@
 #include <lk/console_cmd.h>
 
 int cbuf_tests(int argc, const cmd_args *argv, uint32_t flags);
+int dpc_tests(int argc, const cmd_args *argv, uint32_t flags);
+int elf_tests(int argc, const cmd_args *argv, uint32_t flags);
 int fibo(int argc, const cmd_args *argv, uint32_t flags);
+int poll_tests(int argc, const cmd_args *argv, uint32_t flags);
 int port_tests(int argc, const cmd_args *argv, uint32_t flags);
 int spinner(int argc, const cmd_args *argv, uint32_t flags);
 int thread_tests(int argc, const cmd_args *argv, uint32_t flags);
 int benchmarks(int argc, const cmd_args *argv, uint32_t flags);
 int clock_tests(int argc, const cmd_args *argv, uint32_t flags);
+int cpu_mask_tests(int argc, const cmd_args *argv, uint32_t flags);
 int printf_tests(int argc, const cmd_args *argv, uint32_t flags);
 int printf_tests_float(int argc, const cmd_args *argv, uint32_t flags);
 int v9p_tests(int argc, const cmd_args *argv, uint32_t flags);
 int v9fs_tests(int argc, const cmd_args *argv, uint32_t flags);
+int vmm_tests(int argc, const cmd_args *argv, uint32_t flags);
 
 #endif
@@ -0,0 +1,244 @@
+/*
+ * Copyright (c) 2025 Mist Tecnologia Ltda
+ *
+ * Use of this source code is governed by a MIT-style
+ * license that can be found in the LICENSE file or at
+ * https://opensource.org/licenses/MIT
+ */
+
+#include <lib/cbuf.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <app/tests.h>
+#include <kernel/poll.h>
+#include <kernel/port.h>
+#include <kernel/thread.h>
+#include <lk/err.h>
+
+#define COOKIE(n) ((void *)(uintptr_t)(n))
+
+static int level_triggered(void) {
+  port_t w_port, r_port;
+  if (port_create("poll_lvl", PORT_MODE_UNICAST, &w_port) < 0)
+    return __LINE__;
+  if (port_open("poll_lvl", NULL, &r_port) < 0)
+    return __LINE__;
+
+  poll_set_t *set;
+  if (poll_set_create(&set) < 0)
+    return __LINE__;
+  if (poll_set_add(set, port_poll_source(r_port), POLL_IN, 0, COOKIE(1)) < 0)
+    return __LINE__;
+  if (poll_set_add(set, port_poll_source(r_port), POLL_IN, 0, COOKIE(1)) != ERR_ALREADY_EXISTS)
+    return __LINE__;
+
+  poll_event_t ev;
+  if (poll_set_wait(set, &ev, 1, 0) != ERR_TIMED_OUT)
+    return __LINE__;
+
+  port_packet_t pp = {{0}};
+  if (port_write(w_port, &pp, 1) < 0)
+    return __LINE__;
+
+  // reported for as long as there is a packet to read.
+  for (int i = 0; i < 2; i++) {
+    if (poll_set_wait(set, &ev, 1, 0) != 1)
+      return __LINE__;
+    if (ev.cookie != COOKIE(1) || ev.events != POLL_IN)
+      return __LINE__;
+  }
+
+  port_result_t pr;
+  if (port_read(r_port, 0, &pr) < 0)
+    return __LINE__;
+  if (poll_set_wait(set, &ev, 1, 0) != ERR_TIMED_OUT)
+    return __LINE__;
+
+  // closing and destroying the write side hangs up the read side.
+  port_close(w_port);
+  port_destroy(w_port);
+  if (poll_set_wait(set, &ev, 1, 0) != 1 || !(ev.events & POLL_HUP))
+    return __LINE__;
+
+  // closing the read port takes it out of the set.
+  port_close(r_port);
+  if (poll_set_wait(set, &ev, 1, 0) != ERR_TIMED_OUT)
+    return __LINE__;
+
+  if (poll_set_destroy(set) < 0)
+    return __LINE__;
+  return 0;
+}
+
+static int group_hangup(void) {
+  port_t w_port, r_port, group;
+  if (port_create("poll_grp", PORT_MODE_UNICAST, &w_port) < 0)
+    return __LINE__;
+  if (port_open("poll_grp", NULL, &r_port) < 0)
+    return __LINE__;
+  if (port_group(&r_port, 1, &group) < 0)
+    return __LINE__;
+
+  poll_set_t *set;
+  if (poll_set_create(&set) < 0)
+    return __LINE__;
+  if (poll_set_add(set, port_poll_source(group), POLL_IN, POLL_FLAG_EDGE, COOKIE(8)) < 0)
+    return __LINE__;
+
+  // the group hears about its port losing the write side, edge triggered too.
+  poll_event_t ev;
+  port_close(w_port);
+  port_destroy(w_port);
+  if (poll_set_wait(set, &ev, 1, 0) != 1 || ev.cookie != COOKIE(8) || !(ev.events & POLL_HUP))
+    return __LINE__;
+
+  poll_set_destroy(set);
+  port_close(group);
+  port_close(r_port);
+  return 0;
+}
+
+static int edge_triggered(void) {
+  cbuf_t cbuf;
+  cbuf_initialize(&cbuf, 16);
+
+  poll_set_t *set;
+  if (poll_set_create(&set) < 0)
+    return __LINE__;
+  if (poll_set_add(set, cbuf_poll_source(&cbuf), POLL_IN, POLL_FLAG_EDGE, COOKIE(2)) < 0)
+    return __LINE__;
+
+  poll_event_t ev;
+  if (poll_set_wait(set, &ev, 1, 0) != ERR_TIMED_OUT)
+    return __LINE__;
+
+  cbuf_write(&cbuf, "ab", 2, false);
+
+  // reported once, even though the data is still there.
+  if (poll_set_wait(set, &ev, 1, 0) != 1 || ev.cookie != COOKIE(2) || ev.events != POLL_IN)
+    return __LINE__;
+  if (poll_set_wait(set, &ev, 1, 0) != ERR_TIMED_OUT)
+    return __LINE__;
+
+  // until more arrives.
+  cbuf_write_char(&cbuf, 'c', false);
+  if (poll_set_wait(set, &ev, 1, 0) != 1)
+    return __LINE__;
+
+  // switching to level triggered write interest reports the current state.
+  if (poll_set_modify(set, cbuf_poll_source(&cbuf), POLL_OUT, 0, COOKIE(3)) < 0)
+    return __LINE__;
+  if (poll_set_wait(set, &ev, 1, 0) != 1 || ev.cookie != COOKIE(3) || ev.events != POLL_OUT)
+    return __LINE__;
+
+  if (poll_set_remove(set, cbuf_poll_source(&cbuf)) < 0)
+    return __LINE__;
+  if (poll_set_remove(set, cbuf_poll_source(&cbuf)) != ERR_NOT_FOUND)
+    return __LINE__;
+
+  poll_set_destroy(set);
+  free(cbuf.buf);
+  return 0;
+}
+
+#define BATCH_COUNT 5
+
+static int batched(void) {
+  cbuf_t cbufs[BATCH_COUNT];
+
+  poll_set_t *set;
+  if (poll_set_create(&set) < 0)
+    return __LINE__;
+
+  for (int i = 0; i < BATCH_COUNT; i++) {
+    cbuf_initialize(&cbufs[i], 16);
+    if (poll_set_add(set, cbuf_poll_source(&cbufs[i]), POLL_IN, 0, COOKIE(i)) < 0)
+      return __LINE__;
+    cbuf_write_char(&cbufs[i], 'x', false);
+  }
+
+  // all of them in two calls, in the order they became ready.
+  poll_event_t ev[BATCH_COUNT];
+  if (poll_set_wait(set, ev, 3, 0) != 3)
+    return __LINE__;
+  for (int i = 0; i < 3; i++) {
+    if (ev[i].cookie != COOKIE(i))
+      return __LINE__;
+  }
+
+  // still ready sources were requeued behind the ones not reported yet.
+  if (poll_set_wait(set, ev, BATCH_COUNT, 0) != BATCH_COUNT)
+    return __LINE__;
+  if (ev[0].cookie != COOKIE(3) || ev[1].cookie != COOKIE(4) || ev[2].cookie != COOKIE(0))
+    return __LINE__;
+
+  for (int i = 0; i < BATCH_COUNT; i++) {
+    char c;
+    cbuf_read_char(&cbufs[i], &c, false);
+  }
+  if (poll_set_wait(set, ev, BATCH_COUNT, 0) != ERR_TIMED_OUT)
+    return __LINE__;
+
+  poll_set_destroy(set);
+  for (int i = 0; i < BATCH_COUNT; i++) {
+    free(cbufs[i].buf);
+  }
+  return 0;
+}
+
+static int writer_thread(void *arg) {
+  thread_sleep(20);
+  cbuf_write_char((cbuf_t *)arg, 'x', false);
+  return 0;
+}
+
+static int blocking_wait(void) {
+  cbuf_t cbuf;
+  cbuf_initialize(&cbuf, 16);
+
+  poll_set_t *set;
+  if (poll_set_create(&set) < 0)
+    return __LINE__;
+  if (poll_set_add(set, cbuf_poll_source(&cbuf), POLL_IN, 0, COOKIE(7)) < 0)
+    return __LINE__;
+
+  poll_event_t ev;
+  if (poll_set_wait(set, &ev, 1, 10) != ERR_TIMED_OUT)
+    return __LINE__;
+
+  thread_t *t = thread_create("poll_writer", &writer_thread, &cbuf, DEFAULT_PRIORITY,
+                              DEFAULT_STACK_SIZE);
+  thread_resume(t);
+
+  if (poll_set_wait(set, &ev, 1, INFINITE_TIME) != 1 || ev.cookie != COOKIE(7))
+    return __LINE__;
+
+  thread_join(t, NULL, INFINITE_TIME);
+
+  poll_set_destroy(set);
+  free(cbuf.buf);
+  return 0;
+}
+
+#define RUN_TEST(t) \
+  result = t();     \
+  if (result)       \
+  goto fail
+
+int poll_tests(int argc, const cmd_args *argv, uint32_t flags) {
+  int result;
+  RUN_TEST(level_triggered);
+  RUN_TEST(group_hangup);
+  RUN_TEST(edge_triggered);
+  RUN_TEST(batched);
+  RUN_TEST(blocking_wait);
+
+  printf("all tests passed\n");
+  return 0;
+fail:
+  printf("test failed at line %d\n", result);
+  return 1;
+}
+
+#undef RUN_TEST
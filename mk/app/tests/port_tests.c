@@ -6,8 +6,10 @@
  * https://opensource.org/licenses/MIT
  */
 
+#include <inttypes.h>
 #include <platform.h>
 #include <rand.h>
+#include <stdio.h>
 #include <string.h>
 
 #include <app/tests.h>
@@ -693,6 +695,166 @@ static int group_waiting(void) {
   return 0;
 }
 
+static int depth_and_batch(void) {
+  port_t w_port, r_port;
+  if (port_create_etc("deep_prt", PORT_MODE_UNICAST, 3, &w_port) != ERR_INVALID_ARGS)
+    return __LINE__;
+  if (port_create_etc("deep_prt", PORT_MODE_UNICAST, 256, &w_port) < 0)
+    return __LINE__;
+  if (port_open("deep_prt", NULL, &r_port) < 0)
+    return __LINE__;
+
+  // fill the whole ring in a few batched writes.
+  port_packet_t packets[64];
+  for (size_t ix = 0; ix != countof(packets); ix++) {
+    memset(&packets[ix], 0, sizeof(port_packet_t));
+  }
+  for (int ix = 0; ix != 256; ix++) {
+    packets[ix % 64].value[0] = (char)ix;
+    if ((ix % 64) == 63 && port_write_etc(w_port, packets, 64, PORT_WRITE_FLAG_NORESCHED) < 0)
+      return __LINE__;
+  }
+  if (port_write(w_port, packets, 1) != ERR_PARTIAL_WRITE)
+    return __LINE__;
+
+  // and drain it in order, in uneven batches.
+  port_result_t results[100];
+  int next = 0;
+  while (next < 256) {
+    ssize_t count = port_read_many(r_port, 0, results, countof(results));
+    if (count <= 0)
+      return __LINE__;
+    for (ssize_t ix = 0; ix != count; ix++) {
+      if (results[ix].packet.value[0] != (char)next++)
+        return __LINE__;
+    }
+  }
+  if (port_read_many(r_port, 0, results, countof(results)) != ERR_TIMED_OUT)
+    return __LINE__;
+
+  port_close(w_port);
+  port_destroy(w_port);
+  port_close(r_port);
+  return 0;
+}
+
+static int payload_basic(void) {
+  port_t w_port, r_port;
+  if (port_create("pay_prt", PORT_MODE_PAYLOAD | PORT_MODE_BROADCAST, &w_port) != ERR_INVALID_ARGS)
+    return __LINE__;
+  if (port_create("pay_prt", PORT_MODE_PAYLOAD | PORT_MODE_UNICAST, &w_port) < 0)
+    return __LINE__;
+  if (port_open("pay_prt", NULL, &r_port) < 0)
+    return __LINE__;
+
+  // payload ports don't take inline packets.
+  port_packet_t pk = {{0}};
+  if (port_write(w_port, &pk, 1) != ERR_NOT_ALLOWED)
+    return __LINE__;
+
+  char *buf = port_payload_alloc(4096);
+  if (!buf)
+    return __LINE__;
+  memset(buf, 0x5a, 4096);
+  if (port_write_payload(w_port, buf, 4096, 0) < 0)
+    return __LINE__;
+
+  // the reader gets the very same buffer.
+  port_result_t result;
+  if (port_read(r_port, 0, &result) < 0)
+    return __LINE__;
+  port_payload_t payload = port_packet_to_payload(&result.packet);
+  if (payload.buf != buf || payload.len != 4096 || buf[4095] != 0x5a)
+    return __LINE__;
+  port_payload_free(payload.buf);
+
+  // payloads nobody read go away with the port.
+  for (int ix = 0; ix != 4; ix++) {
+    if (port_write_payload(w_port, port_payload_alloc(128), 128, 0) < 0)
+      return __LINE__;
+  }
+
+  port_close(w_port);
+  port_destroy(w_port);
+  port_close(r_port);
+  return 0;
+}
+
+/* throughput of one writer thread feeding one reader through a port */
+
+#define BENCH_PACKETS 100000
+
+typedef struct {
+  port_t port;
+  size_t batch;
+  uint flags;
+} bench_writer_args_t;
+
+static int bench_writer_thread(void *arg) {
+  bench_writer_args_t *args = (bench_writer_args_t *)arg;
+  port_packet_t packets[64] = {{{0}}};
+
+  for (size_t sent = 0; sent < BENCH_PACKETS; sent += args->batch) {
+    // back off while the reader's ring is full.
+    while (port_write_etc(args->port, packets, args->batch, args->flags) == ERR_PARTIAL_WRITE) {
+      thread_yield();
+    }
+  }
+  return 0;
+}
+
+static int port_bench_one(uint depth, size_t write_batch, size_t read_batch, uint flags) {
+  port_t w_port, r_port;
+  if (port_create_etc("bench_prt", PORT_MODE_UNICAST, depth, &w_port) < 0)
+    return __LINE__;
+  if (port_open("bench_prt", NULL, &r_port) < 0)
+    return __LINE__;
+
+  bench_writer_args_t args = {.port = w_port, .batch = write_batch, .flags = flags};
+  thread_t *t = thread_create("bench_writer", &bench_writer_thread, &args, DEFAULT_PRIORITY,
+                              DEFAULT_STACK_SIZE);
+
+  port_result_t results[64];
+  lk_bigtime_t start = current_time_hires();
+  thread_resume(t);
+
+  size_t received = 0;
+  while (received < BENCH_PACKETS) {
+    ssize_t count = port_read_many(r_port, INFINITE_TIME, results, read_batch);
+    if (count < 0)
+      return __LINE__;
+    received += count;
+  }
+
+  lk_bigtime_t elapsed = current_time_hires() - start;
+  thread_join(t, NULL, INFINITE_TIME);
+
+  printf("depth %4u, write batch %2zu, read batch %2zu, %-9s: %6llu us, %" PRIu64
+         " packets/sec\n",
+         depth, write_batch, read_batch, (flags & PORT_WRITE_FLAG_NORESCHED) ? "noresched" : "yield",
+         elapsed, elapsed ? (uint64_t)BENCH_PACKETS * 1000000 / elapsed : 0);
+
+  port_close(w_port);
+  port_destroy(w_port);
+  port_close(r_port);
+  return 0;
+}
+
+static int port_benchmark(void) {
+  int result;
+  if ((result = port_bench_one(8, 1, 1, 0)))
+    return result;
+  if ((result = port_bench_one(64, 1, 1, 0)))
+    return result;
+  if ((result = port_bench_one(64, 1, 64, PORT_WRITE_FLAG_NORESCHED)))
+    return result;
+  if ((result = port_bench_one(256, 16, 64, 0)))
+    return result;
+  if ((result = port_bench_one(256, 16, 64, PORT_WRITE_FLAG_NORESCHED)))
+    return result;
+  return 0;
+}
+
 #define RUN_TEST(t) \
   result = t();     \
   if (result)       \
@@ -700,12 +862,20 @@ static int group_waiting(void) {
 
 int port_tests(int argc, const cmd_args *argv, uint32_t flags) {
   int result;
+
+  if (argc > 1 && !strcmp(argv[1].str, "bench")) {
+    RUN_TEST(port_benchmark);
+    return 0;
+  }
+
   int count = 3;
   while (count--) {
     RUN_TEST(single_thread_basic);
     RUN_TEST(two_threads_basic);
     RUN_TEST(group_basic);
     RUN_TEST(group_dynamic);
+    RUN_TEST(depth_and_batch);
+    RUN_TEST(payload_basic);
   }
 
   printf("all tests passed\n");
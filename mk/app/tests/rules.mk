@@ -6,13 +6,18 @@ MODULE_SRCS := \
     $(LOCAL_DIR)/cache_tests.c \
     $(LOCAL_DIR)/cbuf_tests.c \
     $(LOCAL_DIR)/clock_tests.c \
+    $(LOCAL_DIR)/cpu_mask_tests.c \
+    $(LOCAL_DIR)/dpc_tests.c \
+    $(LOCAL_DIR)/elf_tests.c \
     $(LOCAL_DIR)/fibo.c \
     $(LOCAL_DIR)/mem_tests.c \
     $(LOCAL_DIR)/tests.c \
     $(LOCAL_DIR)/thread_tests.c \
+    $(LOCAL_DIR)/poll_tests.c \
     $(LOCAL_DIR)/port_tests.c \
     $(LOCAL_DIR)/v9p_tests.c \
     $(LOCAL_DIR)/v9fs_tests.c \
+    $(LOCAL_DIR)/vmm_tests.c \
 
 MODULE_FLOAT_SRCS := \
     $(LOCAL_DIR)/benchmarks.c \
@@ -23,6 +28,8 @@ MODULE_FLOAT_SRCS := \
 
 MODULE_DEPS += \
     lib/cbuf \
+    lib/dpc \
+    lib/elf \
     lib/pretty
 
 MODULE_COMPILEFLAGS += -fno-builtin
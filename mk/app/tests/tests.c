@@ -17,11 +17,18 @@ STATIC_COMMAND("printf_tests", "test printf", &printf_tests)
 STATIC_COMMAND("printf_tests_float", "test printf with floating point", &printf_tests_float)
 STATIC_COMMAND("thread_tests", "test the scheduler", &thread_tests)
 STATIC_COMMAND("port_tests", "test the ports", &port_tests)
+STATIC_COMMAND("poll_tests", "test poll sets", &poll_tests)
 STATIC_COMMAND("clock_tests", "test clocks", &clock_tests)
+STATIC_COMMAND("cpu_mask_tests", "test multi word cpu masks", &cpu_mask_tests)
 STATIC_COMMAND("bench", "miscellaneous benchmarks", &benchmarks)
 STATIC_COMMAND("fibo", "threaded fibonacci", &fibo)
 STATIC_COMMAND("spinner", "create a spinning thread", &spinner)
 STATIC_COMMAND("cbuf_tests", "test lib/cbuf", &cbuf_tests)
+STATIC_COMMAND("dpc_tests", "test lib/dpc", &dpc_tests)
 STATIC_COMMAND("v9p_tests", "test dev/virtio/9p", &v9p_tests)
 STATIC_COMMAND("v9fs_tests", "test lib/fs/9p", &v9fs_tests)
+#if WITH_KERNEL_VM
+STATIC_COMMAND("elf_tests", "test demand paged elf loading", &elf_tests)
+STATIC_COMMAND("vmm_tests", "test the virtual memory manager", &vmm_tests)
+#endif
 STATIC_COMMAND_END(tests);
@@ -8,11 +8,14 @@
 #include <assert.h>
 #include <platform.h>
 #include <rand.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include <app/tests.h>
 #include <arch/atomic.h>
+#include <kernel/cpuset.h>
 #include <kernel/event.h>
+#include <kernel/mp.h>
 #include <kernel/mutex.h>
 #include <kernel/semaphore.h>
 #include <kernel/thread.h>
@@ -625,6 +628,323 @@ static void spinlock_test(void) {
 #undef COUNT
 }
 
+static int affinity_thread(void *arg) {
+  const mp_cpu_mask_t *allowed = arg;
+  for (int i = 0; i < 100; i++) {
+    ASSERT(mp_cpu_mask_test(allowed, arch_curr_cpu_num()));
+    thread_yield();
+  }
+  return 0;
+}
+
+static void affinity_test(void) {
+  printf("testing cpu affinity and cpusets\n");
+
+  /* cpu lists go back and forth */
+  mp_cpu_mask_t mask;
+  char buf[32];
+  ASSERT(cpuset_parse_cpus("0", &mask) == NO_ERROR);
+  ASSERT(mp_cpu_mask_count(&mask) == 1 && mp_cpu_mask_test(&mask, 0));
+  cpuset_format_cpus(&mask, buf, sizeof(buf));
+  ASSERT(!strcmp(buf, "0"));
+  ASSERT(cpuset_parse_cpus("all", &mask) == NO_ERROR);
+  ASSERT(mp_cpu_mask_count(&mask) == SMP_MAX_CPUS);
+  ASSERT(cpuset_parse_cpus("1-0", &mask) == ERR_INVALID_ARGS);
+  ASSERT(cpuset_parse_cpus("0,", &mask) == ERR_INVALID_ARGS);
+  ASSERT(cpuset_parse_cpus("4096", &mask) == ERR_OUT_OF_RANGE);
+#if SMP_MAX_CPUS >= 4
+  ASSERT(cpuset_parse_cpus("0-1,3", &mask) == NO_ERROR);
+  cpuset_format_cpus(&mask, buf, sizeof(buf));
+  ASSERT(!strcmp(buf, "0-1,3"));
+#endif
+
+  /* a set with only the boot cpu, threads created from it stay in it */
+  cpuset_t *set;
+  mp_cpu_mask_t boot = mp_cpu_mask_of(0);
+  ASSERT(cpuset_create("test", &boot, &set) == NO_ERROR);
+  ASSERT(cpuset_find("test") == set);
+  ASSERT(cpuset_create("test", &boot, NULL) == ERR_ALREADY_EXISTS);
+
+  thread_t *self = get_current_thread();
+  cpuset_t *old = thread_get_cpuset(self);
+  ASSERT(thread_set_cpuset(self, set) == NO_ERROR);
+  thread_t *t = thread_create("affinity", &affinity_thread, &boot, DEFAULT_PRIORITY,
+                              DEFAULT_STACK_SIZE);
+  ASSERT(thread_set_cpuset(self, old) == NO_ERROR);
+  ASSERT(thread_get_cpuset(t) == set);
+
+  /* affinity outside of the set is refused */
+#if SMP_MAX_CPUS > 1
+  mp_cpu_mask_t other = mp_cpu_mask_of(1);
+  ASSERT(thread_set_affinity(t, &other) == ERR_INVALID_ARGS);
+#endif
+  mp_cpu_mask_fill(&mask);
+  ASSERT(thread_set_affinity(t, &mask) == NO_ERROR);
+  thread_get_cpus_allowed(t, &mask);
+  ASSERT(mp_cpu_mask_count(&mask) == 1 && mp_cpu_mask_test(&mask, 0));
+
+  thread_resume(t);
+  ASSERT(thread_join(t, NULL, INFINITE_TIME) == NO_ERROR);
+
+  ASSERT(cpuset_set_cpus(cpuset_root(), &boot) == ERR_ACCESS_DENIED);
+  ASSERT(cpuset_destroy(set) == NO_ERROR);
+  ASSERT(cpuset_find("test") == NULL);
+
+  printf("affinity test done\n");
+}
+
+static void mp_call_count(void *arg) {
+  ASSERT(arch_ints_disabled());
+  atomic_add((volatile int *)arg, 1);
+}
+
+/* every cpu syncing with every other at once, each waits with interrupts off
+ * and has to run the others' calls by hand */
+static int mp_sync_thread(void *arg) {
+  mp_cpu_mask_t all;
+  mp_cpu_mask_fill(&all);
+  for (uint i = 0; i < 100; i++) {
+    mp_sync_exec(&all, &mp_call_count, arg);
+  }
+  return 0;
+}
+
+static void mp_call_test(void) {
+  printf("testing cross cpu calls\n");
+
+  mp_cpu_mask_t all;
+  mp_cpu_mask_fill(&all);
+  uint active = 0;
+  for (uint i = 0; i < SMP_MAX_CPUS; i++) {
+    if (mp_is_cpu_active(i))
+      active++;
+  }
+
+  volatile int count = 0;
+  mp_sync_exec(&all, &mp_call_count, (void *)&count);
+  ASSERT(count == (int)active);
+
+  /* a batch in flight at once, queued behind each other on every cpu */
+  static mp_call_t calls[8];
+  count = 0;
+  for (uint i = 0; i < countof(calls); i++) {
+    mp_async_exec(&all, &calls[i], &mp_call_count, (void *)&count);
+  }
+  for (uint i = 0; i < countof(calls); i++) {
+    mp_call_wait(&calls[i]);
+  }
+  ASSERT(count == (int)(active * countof(calls)));
+
+  /* more in flight than a cpu has queue nodes for */
+  static mp_call_t many[40];
+  count = 0;
+  for (uint i = 0; i < countof(many); i++) {
+    mp_async_exec(&all, &many[i], &mp_call_count, (void *)&count);
+  }
+  for (uint i = 0; i < countof(many); i++) {
+    mp_call_wait(&many[i]);
+  }
+  ASSERT(count == (int)(active * countof(many)));
+
+  /* nobody to run it */
+  mp_cpu_mask_t none;
+  mp_cpu_mask_zero(&none);
+  count = 0;
+  mp_sync_exec(&none, &mp_call_count, (void *)&count);
+  ASSERT(count == 0);
+
+  static thread_t *threads[SMP_MAX_CPUS];
+  count = 0;
+  for (uint i = 0; i < active; i++) {
+    threads[i] = thread_create("mp sync", &mp_sync_thread, (void *)&count, DEFAULT_PRIORITY,
+                               DEFAULT_STACK_SIZE);
+    thread_set_pinned_cpu(threads[i], mp_active_cpu(i));
+    thread_resume(threads[i]);
+  }
+  for (uint i = 0; i < active; i++) {
+    thread_join(threads[i], NULL, INFINITE_TIME);
+  }
+  ASSERT(count == (int)(active * active * 100));
+
+  printf("%u cpus ran the calls\n", active);
+}
+
+static volatile bool fair_running;
+
+static int fair_spinner(void *arg) {
+  volatile ulong *count = arg;
+  while (fair_running)
+    (*count)++;
+  return 0;
+}
+
+static void fair_share_test(void) {
+  /* two spinners a few priority levels apart. with fixed priorities the
+   * lower one would not get to run at all, here both make progress, in
+   * proportion to their weights */
+  printf("testing fair share scheduling\n");
+
+  static volatile ulong counts[2];
+  counts[0] = counts[1] = 0;
+  fair_running = true;
+
+  thread_t *high = thread_create("fair high", &fair_spinner, (void *)&counts[0], DEFAULT_PRIORITY,
+                                 DEFAULT_STACK_SIZE);
+  thread_t *low = thread_create("fair low", &fair_spinner, (void *)&counts[1], DEFAULT_PRIORITY - 4,
+                                DEFAULT_STACK_SIZE);
+  /* on a cpu each the weights would not matter */
+  thread_set_pinned_cpu(high, arch_curr_cpu_num());
+  thread_set_pinned_cpu(low, arch_curr_cpu_num());
+  thread_resume(high);
+  thread_resume(low);
+
+  thread_sleep(1000);
+  fair_running = false;
+  thread_join(high, NULL, INFINITE_TIME);
+  thread_join(low, NULL, INFINITE_TIME);
+
+  printf("high %lu, low %lu iterations\n", counts[0], counts[1]);
+  ASSERT(counts[1] > 0);
+
+  /* within a factor of two of the 1024:423 weights of the two levels */
+  const uint64_t high_weight = 1024, low_weight = 423;
+  ASSERT((uint64_t)counts[0] * low_weight * 2 > (uint64_t)counts[1] * high_weight);
+  ASSERT((uint64_t)counts[0] * low_weight < (uint64_t)counts[1] * high_weight * 2);
+}
+
+static void idle_priority_test(void) {
+  /* a thread at IDLE_PRIORITY only gets the cpu nobody else wants, it must
+   * not hold off the fair share threads */
+  printf("testing idle priority threads\n");
+
+  static volatile ulong counts[2];
+  counts[0] = counts[1] = 0;
+  fair_running = true;
+
+  thread_t *idle = thread_create("idle spinner", &fair_spinner, (void *)&counts[0], IDLE_PRIORITY,
+                                 DEFAULT_STACK_SIZE);
+  thread_t *normal = thread_create("normal spinner", &fair_spinner, (void *)&counts[1],
+                                   DEFAULT_PRIORITY, DEFAULT_STACK_SIZE);
+  thread_resume(idle);
+  thread_resume(normal);
+
+  thread_sleep(200);
+  ulong normal_count = counts[1];
+  fair_running = false;
+  thread_join(normal, NULL, INFINITE_TIME);
+  thread_join(idle, NULL, INFINITE_TIME);
+
+  printf("idle %lu, normal %lu iterations\n", counts[0], normal_count);
+  ASSERT(normal_count > 0);
+}
+
+static volatile bool dl_running;
+
+static int dl_spinner(void *arg) {
+  volatile ulong *count = arg;
+  while (dl_running) {
+    (*count)++;
+  }
+  return 0;
+}
+
+static void deadline_test(void) {
+  /* a thread that would spin forever, held to 2ms out of every 10 by its
+   * budget. this one gets to run in between */
+  printf("testing deadline scheduling\n");
+
+  static volatile ulong count;
+  count = 0;
+  dl_running = true;
+
+  thread_t *t = thread_create("deadline", &dl_spinner, (void *)&count, DEFAULT_PRIORITY,
+                              DEFAULT_STACK_SIZE);
+  ASSERT(thread_set_deadline(t, 10000, 5000, 10000) == ERR_INVALID_ARGS);
+  ASSERT(thread_set_deadline(t, 2000, 10000, 10000) == NO_ERROR);
+
+  /* no cpu takes all of itself */
+  thread_t *greedy = thread_create("deadline greedy", &dl_spinner, (void *)&count,
+                                   DEFAULT_PRIORITY, DEFAULT_STACK_SIZE);
+  ASSERT(thread_set_deadline(greedy, 10000, 10000, 10000) == ERR_NO_RESOURCES);
+  thread_resume(t);
+
+  thread_sleep(200);
+  ulong overruns = t->dl.overruns;
+  dl_running = false;
+  thread_join(t, NULL, INFINITE_TIME);
+
+  /* never resumed, it returns straight away */
+  thread_resume(greedy);
+  thread_join(greedy, NULL, INFINITE_TIME);
+
+  printf("%lu iterations, throttled %lu times\n", count, overruns);
+  ASSERT(count > 0);
+  ASSERT(overruns > 0);
+}
+
+#if THREAD_STATS
+static int yield_thread(void *arg) {
+  for (uint i = 0; i < 1000; i++) {
+    thread_yield();
+  }
+  *(volatile ulong *)arg = get_current_thread()->stats.involuntary_switches;
+  return 0;
+}
+
+static void sched_latency_test(void) {
+  printf("testing scheduler latency histograms\n");
+
+  /* every value lands in a bucket that starts at or below it, and no more
+   * than a quarter below it */
+  for (uint64_t v = 0; v < (1ull << SCHED_HIST_MAX_SHIFT); v = v * 2 + 3) {
+    uint b = sched_hist_bucket(v);
+    ASSERT(b < SCHED_HIST_BUCKETS);
+    ASSERT(sched_hist_bucket_min(b) <= v);
+    ASSERT(v - sched_hist_bucket_min(b) <= v / 4);
+    ASSERT(b == SCHED_HIST_BUCKETS - 1 || sched_hist_bucket_min(b + 1) > v);
+  }
+  ASSERT(sched_hist_bucket(UINT64_MAX) == SCHED_HIST_BUCKETS - 1);
+
+  /* waking up from a sleep is a sample */
+  thread_t *t = get_current_thread();
+  uint64_t before = sched_hist_count(&t->stats.wakeup_latency);
+  for (uint i = 0; i < 5; i++) {
+    thread_sleep(2);
+  }
+  ASSERT(sched_hist_count(&t->stats.wakeup_latency) >= before + 5);
+
+  /* giving up the cpu is not involuntary, only the odd tick preempts them */
+  volatile ulong involuntary[2];
+  thread_t *yielders[2];
+  for (uint i = 0; i < countof(yielders); i++) {
+    yielders[i] = thread_create("yielder", &yield_thread, (void *)&involuntary[i],
+                                DEFAULT_PRIORITY, DEFAULT_STACK_SIZE);
+    thread_set_pinned_cpu(yielders[i], mp_active_cpu(0));
+    thread_resume(yielders[i]);
+  }
+  for (uint i = 0; i < countof(yielders); i++) {
+    thread_join(yielders[i], NULL, INFINITE_TIME);
+    ASSERT(involuntary[i] < 100);
+  }
+
+  ssize_t len = sched_latency_export(NULL, 0);
+  ASSERT(len > (ssize_t)sizeof(struct sched_latency_export_header));
+  len += 8 * sizeof(struct sched_latency_export_record);
+  struct sched_latency_export_header *header = malloc(len);
+  ASSERT(header);
+  ASSERT(sched_latency_export(header, len) > 0);
+  ASSERT(header->magic == SCHED_LATENCY_EXPORT_MAGIC);
+  ASSERT(header->bucket_count == SCHED_HIST_BUCKETS);
+  ASSERT(header->record_count > SMP_MAX_CPUS);
+  ASSERT(sched_latency_export(header, sizeof(*header)) == ERR_NOT_ENOUGH_BUFFER);
+  free(header);
+
+  printf("wakeup latency p50 %llu p99 %llu usecs\n",
+         sched_hist_percentile(&t->stats.wakeup_latency, 50),
+         sched_hist_percentile(&t->stats.wakeup_latency, 99));
+}
+#endif
+
 int thread_tests(int argc, const cmd_args *argv, uint32_t flags) {
   mutex_test();
   semaphore_test();
@@ -637,9 +957,19 @@ int thread_tests(int argc, const cmd_args *argv, uint32_t flags) {
   context_switch_test();
 
   preempt_test();
+  fair_share_test();
+  idle_priority_test();
+  deadline_test();
 
   join_test();
 
+  affinity_test();
+  mp_call_test();
+
+#if THREAD_STATS
+  sched_latency_test();
+#endif
+
   return 0;
 }
 
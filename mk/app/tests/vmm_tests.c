@@ -0,0 +1,542 @@
+/*
+ * Copyright (c) 2025 Mist Tecnologia Ltda
+ *
+ * Use of this source code is governed by a MIT-style
+ * license that can be found in the LICENSE file or at
+ * https://opensource.org/licenses/MIT
+ */
+
+#include <app/tests.h>
+
+#if WITH_KERNEL_VM
+
+#include <platform.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <kernel/thread.h>
+#include <kernel/vm.h>
+#include <lk/err.h>
+
+#define LAZY_PAGES 64
+
+#define PF_READ_MISSING (VMM_PF_FLAG_USER | VMM_PF_FLAG_NOT_PRESENT)
+#define PF_WRITE_MISSING (VMM_PF_FLAG_USER | VMM_PF_FLAG_WRITE | VMM_PF_FLAG_NOT_PRESENT)
+#define PF_WRITE_PROTECTED (VMM_PF_FLAG_USER | VMM_PF_FLAG_WRITE)
+
+/* kernel view of the page user address va is mapped to, NULL if none. user
+ * pages cannot be dereferenced directly with SMAP on */
+static uint8_t *mapped_page(vmm_aspace_t *aspace, vaddr_t va, uint *flags) {
+  paddr_t pa;
+  if (arch_mmu_query(&aspace->arch_aspace, ROUNDDOWN(va, PAGE_SIZE), &pa, flags) < 0)
+    return NULL;
+  return paddr_to_kvaddr(pa);
+}
+
+/* kernel memory, paged in by the real fault path of the arch */
+static int lazy_kernel(void) {
+  vmm_aspace_t *aspace = vmm_get_kernel_aspace();
+  vmm_fault_stats_t before = aspace->fault_stats;
+
+  uint8_t *ptr;
+  if (vmm_alloc(aspace, "lazy test", LAZY_PAGES * PAGE_SIZE, (void **)&ptr, 0, VMM_FLAG_LAZY,
+                ARCH_MMU_FLAG_PERM_NO_EXECUTE) < 0)
+    return __LINE__;
+
+  // nothing backs it yet
+  for (uint i = 0; i < LAZY_PAGES; i++) {
+    if (vaddr_to_paddr(ptr + i * PAGE_SIZE))
+      return __LINE__;
+  }
+
+  // every other page, read first so the write that follows does not fault again
+  for (uint i = 0; i < LAZY_PAGES; i += 2) {
+    if (ptr[i * PAGE_SIZE + 7] != 0)
+      return __LINE__;
+    ptr[i * PAGE_SIZE] = i;
+  }
+
+  for (uint i = 0; i < LAZY_PAGES; i++) {
+    bool mapped = vaddr_to_paddr(ptr + i * PAGE_SIZE) != 0;
+    if (mapped != !(i & 1))
+      return __LINE__;
+    if (mapped && ptr[i * PAGE_SIZE] != i)
+      return __LINE__;
+  }
+
+  if (aspace->fault_stats.zero_fill - before.zero_fill != LAZY_PAGES / 2)
+    return __LINE__;
+  if (aspace->fault_stats.faults - before.faults < LAZY_PAGES / 2)
+    return __LINE__;
+
+  if (vmm_free_region(aspace, (vaddr_t)ptr) < 0)
+    return __LINE__;
+  return 0;
+}
+
+/* user memory, faults as a user access would report them */
+static int lazy_user(void) {
+  vmm_aspace_t *aspace;
+  if (vmm_create_aspace(&aspace, "lazy test", 0) < 0)
+    return __LINE__;
+  vmm_aspace_t *old = vmm_set_active_aspace(aspace);
+
+  void *rw, *ro;
+  if (vmm_alloc(aspace, "lazy rw", LAZY_PAGES * PAGE_SIZE, &rw, 0, VMM_FLAG_LAZY,
+                ARCH_MMU_FLAG_PERM_USER) < 0)
+    return __LINE__;
+  if (vmm_alloc(aspace, "lazy ro", PAGE_SIZE, &ro, 0, VMM_FLAG_LAZY,
+                ARCH_MMU_FLAG_PERM_USER | ARCH_MMU_FLAG_PERM_RO) < 0)
+    return __LINE__;
+
+  vaddr_t va = (vaddr_t)rw + 5 * PAGE_SIZE + 123;
+  if (vmm_page_fault_handler(va, PF_WRITE_MISSING) < 0)
+    return __LINE__;
+  // a second fault on a page that is already there is harmless
+  if (vmm_page_fault_handler(va, PF_WRITE_MISSING) < 0)
+    return __LINE__;
+  if (vmm_page_fault_handler(va, PF_WRITE_PROTECTED) < 0)
+    return __LINE__;
+  if (vmm_page_fault_handler((vaddr_t)ro, PF_WRITE_MISSING) != ERR_ACCESS_DENIED)
+    return __LINE__;
+
+  const uint8_t *page = mapped_page(aspace, va, NULL);
+  if (!page)
+    return __LINE__;
+  for (uint i = 0; i < PAGE_SIZE; i++) {
+    if (page[i])
+      return __LINE__;
+  }
+
+  const vmm_fault_stats_t *stats = &aspace->fault_stats;
+  if (stats->faults != 4 || stats->zero_fill != 1 || stats->spurious != 2 || stats->failed != 1)
+    return __LINE__;
+
+  vmm_set_active_aspace(old);
+  vmm_free_aspace(aspace);
+  return 0;
+}
+
+static bool page_is_zero(vm_page_t *p) {
+  const uint8_t *kva = paddr_to_kvaddr(vm_page_to_paddr(p));
+  for (uint i = 0; i < PAGE_SIZE; i++) {
+    if (kva[i])
+      return false;
+  }
+  return true;
+}
+
+/* pages asked for zeroed come back zeroed, from the pool if the idle threads kept up */
+static int zeroed_pages(void) {
+  // hand back a few dirty pages
+  for (uint i = 0; i < 16; i++) {
+    vm_page_t *p = pmm_alloc_page();
+    if (!p)
+      return __LINE__;
+    memset(paddr_to_kvaddr(vm_page_to_paddr(p)), 0xff, PAGE_SIZE);
+    pmm_free_page(p);
+  }
+
+  pmm_zero_stats_t before, after;
+  pmm_get_zero_stats(&before);
+  vm_page_t *p = pmm_alloc_page_etc(PMM_ALLOC_FLAG_ZEROED);
+  if (!p || !page_is_zero(p))
+    return __LINE__;
+  pmm_free_page(p);
+  pmm_get_zero_stats(&after);
+  if (after.requested != before.requested + 1)
+    return __LINE__;
+
+  // give the idle threads a moment to zero what was just freed
+  thread_sleep(100);
+  pmm_get_zero_stats(&before);
+  if (before.pool == 0)
+    return __LINE__;
+  p = pmm_alloc_page_etc(PMM_ALLOC_FLAG_ZEROED);
+  if (!p || !page_is_zero(p))
+    return __LINE__;
+  pmm_get_zero_stats(&after);
+  if (after.hits != before.hits + 1)
+    return __LINE__;
+
+  memset(paddr_to_kvaddr(vm_page_to_paddr(p)), 0xff, PAGE_SIZE);
+  pmm_free_page(p);
+
+  // and so is memory from vmm_alloc() when asked
+
+  void *ptr;
+  if (vmm_alloc(vmm_get_kernel_aspace(), "zeroed", 8 * PAGE_SIZE, &ptr, 0, VMM_FLAG_ZEROED, 0) < 0)
+    return __LINE__;
+  for (uint i = 0; i < 8 * PAGE_SIZE; i++) {
+    if (((uint8_t *)ptr)[i])
+      return __LINE__;
+  }
+  vmm_free_region(vmm_get_kernel_aspace(), (vaddr_t)ptr);
+  return 0;
+}
+
+/* NUMA placement. with a single node it checks the policies are harmless, the
+ * node checks only apply to nodes that have memory to give */
+static int numa_policy(void) {
+  const uint nodes = pmm_numa_node_count();
+  if (nodes == 0 || nodes > PMM_MAX_NUMA_NODES)
+    return __LINE__;
+  if (pmm_cpu_numa_node(arch_curr_cpu_num()) >= nodes)
+    return __LINE__;
+  for (uint n = 0; n < nodes; n++) {
+    if (pmm_numa_distance(n, n) != PMM_NUMA_DISTANCE_LOCAL)
+      return __LINE__;
+  }
+
+  // the node asked for while it has memory
+  for (uint n = 0; n < nodes; n++) {
+    if (pmm_numa_free_count(n) == 0)
+      continue;
+    vm_page_t *p = pmm_alloc_page_etc(PMM_ALLOC_FLAG_NODE(n));
+    if (!p || pmm_page_numa_node(p) != n)
+      return __LINE__;
+    pmm_free_page(p);
+  }
+
+  // one that does not exist is no preference at all
+  if (nodes < PMM_MAX_NUMA_NODES) {
+    vm_page_t *p = pmm_alloc_page_etc(PMM_ALLOC_FLAG_NODE(nodes));
+    if (!p)
+      return __LINE__;
+    pmm_free_page(p);
+  }
+
+  // interleaving reaches every node with memory
+  struct list_node list = LIST_INITIAL_VALUE(list);
+  if (pmm_alloc_pages_etc(nodes * 4, PMM_ALLOC_FLAG_INTERLEAVE, &list) != nodes * 4)
+    return __LINE__;
+  uint per_node[PMM_MAX_NUMA_NODES] = {0};
+  vm_page_t *p;
+  list_for_every_entry (&list, p, vm_page_t, node) {
+    per_node[pmm_page_numa_node(p)]++;
+  }
+  pmm_free(&list);
+  for (uint n = 0; n < nodes; n++) {
+    if (per_node[n] == 0 && pmm_numa_free_count(n) >= 4)
+      return __LINE__;
+  }
+
+  // lazy regions interleave by offset as they are touched
+  vmm_aspace_t *aspace = vmm_get_kernel_aspace();
+  uint8_t *ptr;
+  if (vmm_alloc(aspace, "numa test", nodes * 2 * PAGE_SIZE, (void **)&ptr, 0,
+                VMM_FLAG_LAZY | VMM_FLAG_INTERLEAVE, ARCH_MMU_FLAG_PERM_NO_EXECUTE) < 0)
+    return __LINE__;
+  for (uint i = 0; i < nodes * 2; i++) {
+    const uint n = i % nodes;
+    const bool has_memory = pmm_numa_free_count(n) > 0;
+    ptr[i * PAGE_SIZE] = i;
+
+    vm_page_t *page = paddr_to_vm_page(vaddr_to_paddr(ptr + i * PAGE_SIZE));
+    if (!page || (has_memory && pmm_page_numa_node(page) != n))
+      return __LINE__;
+  }
+  if (vmm_free_region(aspace, (vaddr_t)ptr) < 0)
+    return __LINE__;
+
+  // and regions allocated up front stick to the node asked for
+  const uint last = nodes - 1;
+  if (pmm_numa_free_count(last) >= 4) {
+    if (vmm_alloc(aspace, "numa test", 4 * PAGE_SIZE, (void **)&ptr, 0, VMM_FLAG_NODE(last),
+                  ARCH_MMU_FLAG_PERM_NO_EXECUTE) < 0)
+      return __LINE__;
+    for (uint i = 0; i < 4; i++) {
+      vm_page_t *page = paddr_to_vm_page(vaddr_to_paddr(ptr + i * PAGE_SIZE));
+      if (!page || pmm_page_numa_node(page) != last)
+        return __LINE__;
+    }
+    if (vmm_free_region(aspace, (vaddr_t)ptr) < 0)
+      return __LINE__;
+  }
+  return 0;
+}
+
+/* fork style clone of private anonymous memory */
+static int cow_clone(void) {
+  vmm_aspace_t *a, *b;
+  if (vmm_create_aspace(&a, "cow parent", 0) < 0)
+    return __LINE__;
+  vmm_aspace_t *old = vmm_set_active_aspace(a);
+
+  void *ptr;
+  if (vmm_alloc(a, "cow heap", 4 * PAGE_SIZE, &ptr, 0, VMM_FLAG_LAZY, ARCH_MMU_FLAG_PERM_USER) < 0)
+    return __LINE__;
+  const vaddr_t base = (vaddr_t)ptr;
+
+  for (uint i = 0; i < 2; i++) {
+    if (vmm_page_fault_handler(base + i * PAGE_SIZE, PF_WRITE_MISSING) < 0)
+      return __LINE__;
+    memset(mapped_page(a, base + i * PAGE_SIZE, NULL), 'a' + i, PAGE_SIZE);
+  }
+
+  if (vmm_clone_aspace(a, "cow child", &b) < 0)
+    return __LINE__;
+
+  // the parent's pages are write protected, the child maps nothing yet
+  uint flags;
+  uint8_t *a0 = mapped_page(a, base, &flags);
+  if (!a0 || !(flags & ARCH_MMU_FLAG_PERM_RO))
+    return __LINE__;
+  if (mapped_page(b, base, NULL))
+    return __LINE__;
+
+  // reading in the child maps the same page
+  vmm_set_active_aspace(b);
+  if (vmm_page_fault_handler(base, PF_READ_MISSING) < 0)
+    return __LINE__;
+  if (mapped_page(b, base, NULL) != a0)
+    return __LINE__;
+
+  // writing in the parent copies it, the child keeps the original
+  vmm_set_active_aspace(a);
+  if (vmm_page_fault_handler(base, PF_WRITE_PROTECTED) < 0)
+    return __LINE__;
+  uint8_t *a0_copy = mapped_page(a, base, &flags);
+  if (!a0_copy || a0_copy == a0 || (flags & ARCH_MMU_FLAG_PERM_RO) || a0_copy[0] != 'a')
+    return __LINE__;
+  a0_copy[0] = 'x';
+  if (a0[0] != 'a' || a->fault_stats.cow_copied != 1)
+    return __LINE__;
+
+  // and so does writing in the child
+  vmm_set_active_aspace(b);
+  if (vmm_page_fault_handler(base + PAGE_SIZE, PF_WRITE_MISSING) < 0)
+    return __LINE__;
+  uint8_t *b1 = mapped_page(b, base + PAGE_SIZE, NULL);
+  if (!b1 || b1 == mapped_page(a, base + PAGE_SIZE, NULL) || b1[PAGE_SIZE - 1] != 'b')
+    return __LINE__;
+
+  // with the parent gone, the last page it shared is taken over rather than copied
+  vmm_free_aspace(a);
+  if (vmm_page_fault_handler(base, PF_WRITE_PROTECTED) < 0)
+    return __LINE__;
+  if (mapped_page(b, base, &flags) != a0 || (flags & ARCH_MMU_FLAG_PERM_RO))
+    return __LINE__;
+
+  // memory nobody touched before the clone is zero filled as usual
+  if (vmm_page_fault_handler(base + 2 * PAGE_SIZE, PF_WRITE_MISSING) < 0)
+    return __LINE__;
+
+  const vmm_fault_stats_t *stats = &b->fault_stats;
+  if (stats->paged_in != 1 || stats->cow_copied != 1 || stats->cow_reused != 1 ||
+      stats->zero_fill != 1)
+    return __LINE__;
+
+  vmm_set_active_aspace(old);
+  vmm_free_aspace(b);
+  return 0;
+}
+
+/* memory nobody touched yet, cloned and then cloned again */
+static int clone_untouched(void) {
+  vmm_aspace_t *a, *b, *c;
+  if (vmm_create_aspace(&a, "untouched parent", 0) < 0)
+    return __LINE__;
+  vmm_aspace_t *old = vmm_set_active_aspace(a);
+
+  void *ptr;
+  if (vmm_alloc(a, "untouched", 2 * PAGE_SIZE, &ptr, 0, VMM_FLAG_LAZY | VMM_FLAG_INTERLEAVE,
+                ARCH_MMU_FLAG_PERM_USER) < 0)
+    return __LINE__;
+  const vaddr_t base = (vaddr_t)ptr;
+
+  if (vmm_clone_aspace(a, "untouched child", &b) < 0)
+    return __LINE__;
+  if (vmm_clone_aspace(b, "untouched grandchild", &c) < 0)
+    return __LINE__;
+
+  // each one still zero fills on its own
+  vmm_aspace_t *spaces[] = {a, b, c};
+  for (uint i = 0; i < countof(spaces); i++) {
+    vmm_set_active_aspace(spaces[i]);
+    if (vmm_page_fault_handler(base, PF_WRITE_MISSING) < 0)
+      return __LINE__;
+    uint8_t *page = mapped_page(spaces[i], base, NULL);
+    if (!page || page[0] != 0)
+      return __LINE__;
+    page[0] = 'a' + i;
+    if (spaces[i]->fault_stats.zero_fill != 1 || spaces[i]->fault_stats.cow_copied != 0)
+      return __LINE__;
+  }
+  for (uint i = 0; i < countof(spaces); i++) {
+    if (mapped_page(spaces[i], base, NULL)[0] != 'a' + i)
+      return __LINE__;
+  }
+
+  vmm_set_active_aspace(old);
+  vmm_free_aspace(b);
+  vmm_free_aspace(a);
+  vmm_free_aspace(c);
+  return 0;
+}
+
+/* shared objects, physical memory and memory allocated up front */
+static int clone_regions(void) {
+  vmm_aspace_t *a, *b;
+  if (vmm_create_aspace(&a, "clone parent", 0) < 0)
+    return __LINE__;
+  vmm_aspace_t *old = vmm_set_active_aspace(a);
+
+  vm_object_t *obj;
+  void *shared;
+  if (vm_object_create_anon(2 * PAGE_SIZE, &obj) < 0)
+    return __LINE__;
+  if (vmm_map_object(a, "shared", obj, 0, 2 * PAGE_SIZE, &shared, 0, VMM_FLAG_SHARED,
+                     ARCH_MMU_FLAG_PERM_USER) < 0)
+    return __LINE__;
+  vm_object_release(obj);
+  if (vmm_page_fault_handler((vaddr_t)shared, PF_WRITE_MISSING) < 0)
+    return __LINE__;
+
+  vm_page_t *p = pmm_alloc_page();
+  if (!p)
+    return __LINE__;
+  void *phys;
+  if (vm_object_create_physical(vm_page_to_paddr(p), PAGE_SIZE, &obj) < 0)
+    return __LINE__;
+  if (vmm_map_object(a, "physical", obj, 0, PAGE_SIZE, &phys, 0, 0, ARCH_MMU_FLAG_PERM_USER) < 0)
+    return __LINE__;
+  vm_object_release(obj);
+
+  void *eager;
+  if (vmm_alloc(a, "eager", PAGE_SIZE, &eager, 0, 0, ARCH_MMU_FLAG_PERM_USER) < 0)
+    return __LINE__;
+  uint8_t *a_eager = mapped_page(a, (vaddr_t)eager, NULL);
+  memset(a_eager, 0x5a, PAGE_SIZE);
+
+  if (vmm_clone_aspace(a, "clone child", &b) < 0)
+    return __LINE__;
+  vmm_set_active_aspace(b);
+
+  // the shared page is still writable in the parent and the same page in the child
+  uint flags;
+  uint8_t *a_shared = mapped_page(a, (vaddr_t)shared, &flags);
+  if (!a_shared || (flags & ARCH_MMU_FLAG_PERM_RO))
+    return __LINE__;
+  if (vmm_page_fault_handler((vaddr_t)shared, PF_WRITE_MISSING) < 0)
+    return __LINE__;
+  if (mapped_page(b, (vaddr_t)shared, NULL) != a_shared)
+    return __LINE__;
+
+  // physical memory is mapped straight away
+  if (mapped_page(b, (vaddr_t)phys, NULL) != paddr_to_kvaddr(vm_page_to_paddr(p)))
+    return __LINE__;
+
+  // memory allocated up front is copied up front
+  uint8_t *b_eager = mapped_page(b, (vaddr_t)eager, NULL);
+  if (!b_eager || b_eager == a_eager || memcmp(b_eager, a_eager, PAGE_SIZE))
+    return __LINE__;
+
+  vmm_set_active_aspace(old);
+  vmm_free_aspace(a);
+  vmm_free_aspace(b);
+  pmm_free_page(p);
+
+  // nor can the kernel be forked
+  if (vmm_clone_aspace(vmm_get_kernel_aspace(), "kernel clone", &b) != ERR_INVALID_ARGS)
+    return __LINE__;
+  return 0;
+}
+
+/* fork of a process with a big, fully resident heap, against copying it all */
+static int fork_benchmark(size_t mb) {
+  const size_t size = mb * 1024 * 1024;
+
+  vmm_aspace_t *a, *b;
+  if (vmm_create_aspace(&a, "fork bench", 0) < 0)
+    return __LINE__;
+  vmm_aspace_t *old = vmm_set_active_aspace(a);
+
+  void *ptr;
+  if (vmm_alloc(a, "heap", size, &ptr, 0, VMM_FLAG_LAZY, ARCH_MMU_FLAG_PERM_USER) < 0)
+    return __LINE__;
+  const vaddr_t base = (vaddr_t)ptr;
+
+  for (size_t off = 0; off < size; off += PAGE_SIZE) {
+    if (vmm_page_fault_handler(base + off, PF_WRITE_MISSING) < 0) {
+      printf("out of memory after %zu of %zu MB\n", off / (1024 * 1024), mb);
+      goto out;
+    }
+  }
+  printf("%zu MB heap resident\n", mb);
+
+  lk_bigtime_t t = current_time_hires();
+  if (vmm_clone_aspace(a, "fork bench child", &b) < 0)
+    return __LINE__;
+  t = current_time_hires() - t;
+  printf("cow: %llu us to fork\n", t);
+
+  // the first write to each page after the fork pays for its copy
+  const size_t sample = MIN(size, 1024 * PAGE_SIZE);
+  t = current_time_hires();
+  for (size_t off = 0; off < sample; off += PAGE_SIZE) {
+    if (vmm_page_fault_handler(base + off, PF_WRITE_PROTECTED) < 0)
+      return __LINE__;
+  }
+  t = current_time_hires() - t;
+  printf("cow: %llu us to write to the first %zu pages after\n", t, sample / PAGE_SIZE);
+
+  vmm_set_active_aspace(old);
+  t = current_time_hires();
+  vmm_free_aspace(b);
+  t = current_time_hires() - t;
+  printf("cow: %llu us to tear the child down\n", t);
+
+  // an eager fork copies every page before returning, and has to find the
+  // memory for it as well. this only times the copying
+  vm_page_t *scratch = pmm_alloc_page();
+  if (!scratch)
+    return __LINE__;
+  void *dst = paddr_to_kvaddr(vm_page_to_paddr(scratch));
+  t = current_time_hires();
+  for (size_t off = 0; off < size; off += PAGE_SIZE) {
+    memcpy(dst, mapped_page(a, base + off, NULL), PAGE_SIZE);
+  }
+  t = current_time_hires() - t;
+  printf("eager: at least %llu us to fork\n", t);
+  pmm_free_page(scratch);
+
+out:
+  vmm_set_active_aspace(old);
+  vmm_free_aspace(a);
+  return 0;
+}
+
+#define RUN_TEST(t) \
+  result = t();     \
+  if (result)       \
+  goto fail
+
+int vmm_tests(int argc, const cmd_args *argv, uint32_t flags) {
+  int result;
+
+  if (argc > 1 && !strcmp(argv[1].str, "bench")) {
+    result = fork_benchmark(argc > 2 ? argv[2].u : 1024);
+    if (result)
+      goto fail;
+    return 0;
+  }
+
+  RUN_TEST(lazy_kernel);
+  RUN_TEST(lazy_user);
+  RUN_TEST(cow_clone);
+  RUN_TEST(clone_untouched);
+  RUN_TEST(clone_regions);
+  RUN_TEST(zeroed_pages);
+  RUN_TEST(numa_policy);
+
+  printf("all tests passed\n");
+  return 0;
+fail:
+  printf("test failed at line %d\n", result);
+  return 1;
+}
+
+#undef RUN_TEST
+
+#endif  // WITH_KERNEL_VM
@@ -9,8 +9,12 @@
 
 #include <arch/arch_ops.h>
 #include <arch/arm64.h>
+#if WITH_KERNEL_VM
+#include <kernel/vm.h>
+#endif
 #include <lk/bits.h>
 #include <lk/debug.h>
+#include <lk/err.h>
 
 #define SHUTDOWN_ON_FATAL 1
 
@@ -96,6 +100,40 @@ static void dump_iframe(const struct arm64_iframe_long *iframe) {
   arch_stacktrace(iframe->r[29], iframe->elr);
 }
 
+#if WITH_KERNEL_VM
+/* let the vmm page in demand paged memory, returns true if the access can be retried */
+static bool arm64_page_fault(struct arm64_iframe_long *iframe, uint32_t ec, uint32_t iss) {
+  /* the vmm blocks, which is only possible if the faulting context could */
+  if (iframe->spsr & (1 << 7)) /* PSTATE.I */
+    return false;
+
+  /* FAR does not hold the address, nothing to page in */
+  if (BIT(iss, 10)) /* FnV */
+    return false;
+
+  uint32_t fsc = BITS(iss, 5, 0);
+  bool instruction = (ec == 0b100000 || ec == 0b100001);
+
+  uint pf_flags = 0;
+  if (fsc >= 0b000100 && fsc <= 0b000111) /* translation fault, level 0-3 */
+    pf_flags |= VMM_PF_FLAG_NOT_PRESENT;
+  if (ec == 0b100000 || ec == 0b100100) /* from lower level */
+    pf_flags |= VMM_PF_FLAG_USER;
+  if (instruction)
+    pf_flags |= VMM_PF_FLAG_INSTRUCTION;
+  else if (BIT(iss, 6)) /* WnR */
+    pf_flags |= VMM_PF_FLAG_WRITE;
+
+  vaddr_t far = ARM64_READ_SYSREG(far_el1);
+
+  arch_enable_ints();
+  status_t err = vmm_page_fault_handler(far, pf_flags);
+  arch_disable_ints();
+
+  return err == NO_ERROR;
+}
+#endif
+
 __WEAK void arm64_syscall(struct arm64_iframe_long *iframe, bool is_64bit) {
   panic("unhandled syscall vector\n");
 }
@@ -126,11 +164,20 @@ void arm64_sync_exception(struct arm64_iframe_long *iframe) {
 #endif
     case 0b100000: /* instruction abort from lower level */
     case 0b100001: /* instruction abort from same level */
+#if WITH_KERNEL_VM
+      if (arm64_page_fault(iframe, ec, iss))
+        return;
+#endif
       printf("instruction abort: PC at 0x%llx\n", iframe->elr);
       print_fault_msg(BITS(iss, 5, 0));
       break;
     case 0b100100:   /* data abort from lower level */
     case 0b100101: { /* data abort from same level */
+#if WITH_KERNEL_VM
+      /* before the fixups, a user copy may just need the page brought in */
+      if (arm64_page_fault(iframe, ec, iss))
+        return;
+#endif
       for (fault_handler = __fault_handler_table_start; fault_handler < __fault_handler_table_end;
            fault_handler++) {
         if (fault_handler->pc == iframe->elr) {
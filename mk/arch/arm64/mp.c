@@ -6,6 +6,7 @@
  * https://opensource.org/licenses/MIT
  */
 #include <assert.h>
+#include <stdlib.h>
 
 #include <arch/mp.h>
 #include <arch/ops.h>
@@ -26,23 +27,35 @@ extern void bcm28xx_send_ipi(uint irq, uint cpu_mask);
 
 #define GIC_IPI_BASE (14)
 
-status_t arch_mp_send_ipi(mp_cpu_mask_t target, mp_ipi_t ipi) {
-  LTRACEF("target 0x%x, ipi %u\n", target, ipi);
+status_t arch_mp_send_ipi(const mp_cpu_mask_t *target, mp_ipi_t ipi) {
+  LTRACEF("target 0x%lx, ipi %u\n", target->bits[0], ipi);
 
 #if WITH_DEV_INTERRUPT_ARM_GIC
   uint gic_ipi_num = ipi + GIC_IPI_BASE;
 
-  /* filter out targets outside of the range of cpus we care about */
-  target &= ((1UL << SMP_MAX_CPUS) - 1);
-  if (target != 0) {
-    LTRACEF("target 0x%x, gic_ipi %u\n", target, gic_ipi_num);
-    arm_gic_sgi(gic_ipi_num, ARM_GIC_SGI_FLAG_NS, target);
+  /* one SGI per cluster, cpu numbers are laid out as cluster << SMP_CPU_CLUSTER_SHIFT | aff0
+   * so a cluster's cpus are a contiguous run of the mask. the GICv2 distributor takes an
+   * 8 bit target list and only reaches the cpu interfaces of the first cluster */
+  for (uint first = 0; first < SMP_MAX_CPUS; first += 1U << SMP_CPU_CLUSTER_SHIFT) {
+    u_int list = mp_cpu_mask_bits(target, first, MIN(1U << SMP_CPU_CLUSTER_SHIFT, 32U));
+    if (list == 0)
+      continue;
+    if (first > 0 || list > 0xff) {
+      TRACEF("cpus 0x%x of cluster %u out of reach of the GIC\n", list,
+             first >> SMP_CPU_CLUSTER_SHIFT);
+      list &= 0xff;
+      if (first > 0 || list == 0)
+        continue;
+    }
+
+    LTRACEF("target list 0x%x, gic_ipi %u\n", list, gic_ipi_num);
+    arm_gic_sgi(gic_ipi_num, ARM_GIC_SGI_FLAG_NS, list);
   }
 #elif PLATFORM_BCM28XX
   /* filter out targets outside of the range of cpus we care about */
-  target &= ((1UL << SMP_MAX_CPUS) - 1);
-  if (target != 0) {
-    bcm28xx_send_ipi(ipi, target);
+  uint cpu_mask = mp_cpu_mask_bits(target, 0, MIN(SMP_MAX_CPUS, 32U));
+  if (cpu_mask != 0) {
+    bcm28xx_send_ipi(ipi, cpu_mask);
   }
 #endif
 
@@ -52,7 +65,7 @@ status_t arch_mp_send_ipi(mp_cpu_mask_t target, mp_ipi_t ipi) {
 static enum handler_return arm_ipi_generic_handler(void *arg) {
   LTRACEF("cpu %u, arg %p\n", arch_curr_cpu_num(), arg);
 
-  return INT_NO_RESCHEDULE;
+  return mp_mbx_generic_irq();
 }
 
 static enum handler_return arm_ipi_reschedule_handler(void *arg) {
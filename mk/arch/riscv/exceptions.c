@@ -11,7 +11,11 @@
 #include <arch/riscv.h>
 #include <arch/riscv/iframe.h>
 #include <kernel/thread.h>
+#if WITH_KERNEL_VM
+#include <kernel/vm.h>
+#endif
 #include <lk/compiler.h>
+#include <lk/err.h>
 #include <lk/trace.h>
 
 #define LOCAL_TRACE 0
@@ -106,6 +110,36 @@ void riscv_syscall_handler(struct riscv_short_iframe *frame) {
   platform_halt(HALT_ACTION_HALT, HALT_REASON_SW_PANIC);
 }
 
+#if WITH_KERNEL_VM
+// let the vmm page in demand paged memory, returns true if the access can be retried
+static bool riscv_page_fault(long cause, struct riscv_short_iframe *frame, bool kernel) {
+  // the vmm blocks, which is only possible if the faulting context could
+  if (!(frame->status & RISCV_CSR_XSTATUS_PIE))
+    return false;
+
+  vaddr_t va = riscv_csr_read(RISCV_CSR_XTVAL);
+
+  // without SUM the kernel cannot touch user pages at all, mapping one would not help
+  if (kernel && is_user_address(va) && !(frame->status & RISCV_CSR_XSTATUS_SUM))
+    return false;
+
+  // the cause does not tell a missing page from a protection fault, the vmm checks the mapping
+  uint pf_flags = VMM_PF_FLAG_NOT_PRESENT;
+  if (!kernel)
+    pf_flags |= VMM_PF_FLAG_USER;
+  if (cause == RISCV_EXCEPTION_STORE_PAGE_FAULT)
+    pf_flags |= VMM_PF_FLAG_WRITE;
+  else if (cause == RISCV_EXCEPTION_INS_PAGE_FAULT)
+    pf_flags |= VMM_PF_FLAG_INSTRUCTION;
+
+  arch_enable_ints();
+  status_t err = vmm_page_fault_handler(va, pf_flags);
+  arch_disable_ints();
+
+  return err == NO_ERROR;
+}
+#endif
+
 // called from assembly
 void riscv_exception_handler(long cause, ulong epc, struct riscv_short_iframe *frame, bool kernel);
 void riscv_exception_handler(long cause, ulong epc, struct riscv_short_iframe *frame, bool kernel) {
@@ -137,6 +171,14 @@ void riscv_exception_handler(long cause, ulong epc, struct riscv_short_iframe *f
       case RISCV_EXCEPTION_ENV_CALL_U_MODE:  // ecall from user mode
         riscv_syscall_handler(frame);
         break;
+#if WITH_KERNEL_VM
+      case RISCV_EXCEPTION_INS_PAGE_FAULT:
+      case RISCV_EXCEPTION_LOAD_PAGE_FAULT:
+      case RISCV_EXCEPTION_STORE_PAGE_FAULT:
+        if (!riscv_page_fault(cause, frame, kernel))
+          fatal_exception(cause, epc, frame, kernel);
+        break;
+#endif
       default:
         fatal_exception(cause, epc, frame, kernel);
     }
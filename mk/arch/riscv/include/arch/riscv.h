@@ -224,9 +224,11 @@ static inline uint riscv_current_hart(void) {
 }
 
 // Platform should pass in a list of secondary harts to start, not
-// including the boot hart. Will be trimmed to SMP_MAX_CPUS - 1.
+// including the boot hart, and the numa node of each or NULL. Will be
+// trimmed to SMP_MAX_CPUS - 1.
 // Machine mode will always get all of the secondaries released (for now).
-void riscv_set_secondary_harts_to_start(const uint *harts, size_t count);
+void riscv_set_secondary_harts_to_start(const uint *harts, const uint *numa_nodes,
+                                        size_t count);
 
 void riscv_exception_entry(void);
 enum handler_return riscv_timer_exception(void);
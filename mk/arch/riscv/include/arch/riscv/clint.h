@@ -47,15 +47,18 @@ static inline void clint_set_timer(uint64_t ticks) {
 
 static inline uint64_t riscv_get_time(void) { return *REG64(CLINT_MTIME); }
 
-static inline void clint_send_ipis(const unsigned long *hart_mask) {
-  unsigned long cur_hart = riscv_current_hart(), h, m = *hart_mask;
-  for (h = 0; h < SMP_MAX_CPUS && m; h++, m >>= 1) {
+// harts are base + the bit numbers set in hart_mask
+static inline void clint_send_ipis(unsigned long hart_mask, unsigned long hart_mask_base) {
+  unsigned long cur_hart = riscv_current_hart(), h, m = hart_mask;
+  for (h = hart_mask_base; h < SMP_MAX_CPUS && m; h++, m >>= 1) {
     if ((m & 1) && (h != cur_hart)) {
       clint_ipi_send(h);
     }
   }
 
-  if (*hart_mask & (1 << riscv_current_hart())) {
+  // the local hart goes last
+  if (cur_hart >= hart_mask_base && cur_hart - hart_mask_base < sizeof(hart_mask) * 8 &&
+      (hart_mask & (1ul << (cur_hart - hart_mask_base)))) {
     clint_ipi_send(cur_hart);
   }
 }
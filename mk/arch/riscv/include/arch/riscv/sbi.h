@@ -71,7 +71,7 @@ void sbi_early_init(void);
 void sbi_init(void);
 
 void sbi_set_timer(uint64_t stime_value);
-void sbi_send_ipis(const unsigned long *hart_mask);
+void sbi_send_ipis(unsigned long hart_mask, unsigned long hart_mask_base);
 void sbi_clear_ipi(void);
 status_t sbi_boot_hart(uint hartid, paddr_t start_addr, ulong arg);
 
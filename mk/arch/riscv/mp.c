@@ -7,14 +7,19 @@
  * https://opensource.org/licenses/MIT
  */
 
+#include <limits.h>
 #include <stdlib.h>
 #include <string.h>
 
+#include <align.h>
 #include <arch/atomic.h>
 #include <arch/mp.h>
 #include <arch/ops.h>
 #include <arch/riscv.h>
 #include <arch/riscv/clint.h>
+#if WITH_KERNEL_VM
+#include <kernel/vm.h>
+#endif
 #include <lk/compiler.h>
 #include <lk/debug.h>
 #include <lk/err.h>
@@ -39,35 +44,53 @@ static spin_lock_t boot_cpu_lock = 1;
 
 // list of cpus to boot, passed from platform
 static uint harts_to_boot[SMP_MAX_CPUS];
+static uint harts_to_boot_node[SMP_MAX_CPUS];
 static uint harts_to_boot_count = 0;
 
 // modified in start.S to save the physical address of _start as the first cpu boots
 uintptr_t _start_physical;
 
-status_t arch_mp_send_ipi(mp_cpu_mask_t target, mp_ipi_t ipi) {
-  LTRACEF("target 0x%x, ipi %u\n", target, ipi);
+// interrupt a batch of harts, all within a word's worth of hart ids from base
+static void send_ipis(ulong hart_mask, ulong hart_base) {
+  LTRACEF("hart mask %#lx base %lu\n", hart_mask, hart_base);
 
-  mp_cpu_mask_t m = target;
-  ulong hart_mask = 0;
-  for (uint c = 0; c < SMP_MAX_CPUS && m; c++, m >>= 1) {
-    if (m & 1) {
-      int h = cpu_to_hart_map[c];
-      LTRACEF("c %u h %d m %#x\n", c, h, m);
+  mb();
+#if RISCV_M_MODE
+  clint_send_ipis(hart_mask, hart_base);
+#else
+  sbi_send_ipis(hart_mask, hart_base);
+#endif
+}
 
-      // record a pending hart to notify
-      hart_mask |= (1ul << h);
+status_t arch_mp_send_ipi(const mp_cpu_mask_t *target, mp_ipi_t ipi) {
+  LTRACEF("target 0x%lx, ipi %u\n", target->bits[0], ipi);
 
-      // set the ipi_data based on the incoming ipi
-      atomic_or(&ipi_data[h], (1u << ipi));
+  // hart ids usually follow cpu numbers, so consecutive targets mostly land in the
+  // same window and go out with a single call
+  ulong hart_mask = 0;
+  ulong hart_base = 0;
+  int c;
+  mp_cpu_mask_for_each(c, target) {
+    ulong h = cpu_to_hart_map[c];
+    ulong base = ROUNDDOWN(h, sizeof(ulong) * CHAR_BIT);
+    LTRACEF("c %d h %lu\n", c, h);
+
+    if (hart_mask && base != hart_base) {
+      send_ipis(hart_mask, hart_base);
+      hart_mask = 0;
     }
+
+    // record a pending hart to notify
+    hart_base = base;
+    hart_mask |= (1ul << (h - base));
+
+    // set the ipi_data based on the incoming ipi, read back by the target cpu
+    atomic_or(&ipi_data[c], (1u << ipi));
   }
 
-  mb();
-#if RISCV_M_MODE
-  clint_send_ipis(&hart_mask);
-#else
-  sbi_send_ipis(&hart_mask);
-#endif
+  if (hart_mask) {
+    send_ipis(hart_mask, hart_base);
+  }
 
   return NO_ERROR;
 }
@@ -93,7 +116,8 @@ enum handler_return riscv_software_exception(void) {
     reason &= ~(1u << MP_IPI_RESCHEDULE);
   }
   if (reason & (1u << MP_IPI_GENERIC)) {
-    panic("unimplemented MP_IPI_GENERIC\n");
+    if (mp_mbx_generic_irq() == INT_RESCHEDULE)
+      ret = INT_RESCHEDULE;
     reason &= ~(1u << MP_IPI_GENERIC);
   }
 
@@ -127,6 +151,17 @@ void riscv_secondary_entry(uint hart_id, uint __unused, uint cpu_id) {
   spin_lock(&boot_cpu_lock);
   spin_unlock(&boot_cpu_lock);
 
+#if WITH_KERNEL_VM
+  // harts take cpu numbers in the order they get here, so this is the first
+  // point where it is known which numa node the cpu is in
+  for (uint i = 0; i < harts_to_boot_count; i++) {
+    if (harts_to_boot[i] == hart_id) {
+      pmm_set_cpu_numa_node(cpu_id, harts_to_boot_node[i]);
+      break;
+    }
+  }
+#endif
+
 #if RISCV_MMU
   // let the mmu code configure per cpu bits
   riscv_mmu_init_secondaries();
@@ -147,9 +182,13 @@ void riscv_secondary_entry(uint hart_id, uint __unused, uint cpu_id) {
 
 // platform hands the arch layer a list of harts to start, these will be
 // started later in riscv_boot_secondaries()
-void riscv_set_secondary_harts_to_start(const uint *harts, size_t count) {
+void riscv_set_secondary_harts_to_start(const uint *harts, const uint *numa_nodes,
+                                        size_t count) {
   harts_to_boot_count = MIN(count, SMP_MAX_CPUS);
   memcpy(harts_to_boot, harts, harts_to_boot_count * sizeof(harts[0]));
+  for (uint i = 0; i < harts_to_boot_count; i++) {
+    harts_to_boot_node[i] = numa_nodes ? numa_nodes[i] : 0;
+  }
 }
 
 // start any secondary cpus we are set to start. called on the boot processor
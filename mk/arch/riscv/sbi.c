@@ -76,13 +76,15 @@ void sbi_set_timer(uint64_t stime_value) {
   }
 }
 
-void sbi_send_ipis(const unsigned long *hart_mask) {
+void sbi_send_ipis(unsigned long hart_mask, unsigned long hart_mask_base) {
   // use the new IPI extension
   if (likely(sbi_ext_present(SBI_EXTENSION_IPI))) {
-    sbi_call(SBI_EXT_IPI_SIG, 0, *hart_mask, -1);
+    sbi_call(SBI_EXT_IPI_SIG, 0, hart_mask, hart_mask_base);
+  } else if (hart_mask_base == 0) {
+    // legacy ipi call, takes a pointer to a mask starting at hart 0
+    sbi_call(SBI_SEND_IPI, &hart_mask);
   } else {
-    // legacy ipi call
-    sbi_call(SBI_SEND_IPI, hart_mask);
+    TRACEF("legacy sbi cannot reach harts %#lx from %lu\n", hart_mask, hart_mask_base);
   }
 }
 
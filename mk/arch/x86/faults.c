@@ -9,7 +9,9 @@
 #include <arch/fpu.h>
 #include <arch/x86.h>
 #include <kernel/thread.h>
+#include <kernel/vm.h>
 #include <lk/debug.h>
+#include <lk/err.h>
 #include <lk/trace.h>
 #include <pretty/hexdump.h>
 
@@ -86,12 +88,38 @@ static void x86_unhandled_exception(x86_iframe_t *frame) {
   exception_die(frame, "unhandled exception, halting\n");
 }
 
+/* let the vmm page in demand paged memory, returns true if the access can be retried */
+static bool x86_pfe_resolve(x86_iframe_t *frame) {
+  uint32_t error_code = frame->err_code;
+
+  /* the vmm blocks, which is only possible if the faulting context could */
+  if (!(frame->flags & X86_FLAGS_IF))
+    return false;
+
+  uint pf_flags = 0;
+  pf_flags |= (error_code & PFEX_W) ? VMM_PF_FLAG_WRITE : 0;
+  pf_flags |= (error_code & PFEX_U) ? VMM_PF_FLAG_USER : 0;
+  pf_flags |= (error_code & PFEX_I) ? VMM_PF_FLAG_INSTRUCTION : 0;
+  pf_flags |= (error_code & PFEX_P) ? 0 : VMM_PF_FLAG_NOT_PRESENT;
+
+  vaddr_t va = x86_get_cr2();
+
+  arch_enable_ints();
+  status_t err = vmm_page_fault_handler(va, pf_flags);
+  arch_disable_ints();
+
+  return err == NO_ERROR;
+}
+
 static void x86_pfe_handler(x86_iframe_t *frame) {
   /* Handle a page fault exception */
   uint32_t error_code;
   thread_t *current_thread;
   error_code = frame->err_code;
 
+  if (x86_pfe_resolve(frame))
+    return;
+
 #ifdef PAGE_FAULT_DEBUG_INFO
   addr_t v_addr, ssp, esp, ip, rip;
   v_addr = x86_get_cr2();
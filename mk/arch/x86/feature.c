@@ -46,6 +46,9 @@ uint32_t max_cpuid_leaf = 0;
 uint32_t max_cpuid_leaf_hyp = 0;
 uint32_t max_cpuid_leaf_ext = 0;
 
+/* selects the rep movsb/stosb path in the string routines, see lib/libc/string/arch/x86 */
+uint8_t x86_has_erms = 0;
+
 static enum x86_cpu_vendor match_cpu_vendor_string(const char* str) {
   // from table at https://www.sandpile.org/x86/cpuid.htm#level_0000_0000h
   if (!strcmp(str, "GenuineIntel")) {
@@ -214,6 +217,8 @@ void x86_feature_early_init(void) {
       }
     }
   }
+
+  x86_has_erms = x86_feature_test(X86_FEATURE_ERMS);
 }
 
 /* later feature init hook, called after the kernel is able to schedule */
@@ -246,6 +251,8 @@ void x86_feature_init(void) {
   printf("X86: processor model info type %#x family %#x model %#x stepping %#x\n",
          model->processor_type, model->family, model->model, model->stepping);
   printf("\tdisplay_family %#x display_model %#x\n", model->display_family, model->display_model);
+  dprintf(INFO, "X86: string ops using %s\n",
+          x86_has_erms ? "rep movsb/stosb (ERMS)" : "rep movsq/stosq");
 }
 
 bool x86_get_cpuid_subleaf(enum x86_cpuid_leaf_num num, uint32_t subleaf,
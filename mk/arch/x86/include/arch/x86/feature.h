@@ -44,6 +44,9 @@ enum x86_cpu_level {
 };
 extern enum x86_cpu_level __x86_cpu_level;
 
+/* set at early init if the cpu has enhanced rep movsb/stosb */
+extern uint8_t x86_has_erms;
+
 static inline enum x86_cpu_level x86_get_cpu_level(void) { return __x86_cpu_level; }
 
 enum x86_cpu_vendor {
@@ -300,11 +300,27 @@ status_t pci_bus_mgr_allocate_msi(const pci_location_t loc, size_t num_requested
     return ERR_NOT_FOUND;
   }
 
-  if (!d->has_msi()) {
-    return ERR_NO_RESOURCES;
+  // plain MSI only handles a single vector here, anything more needs MSI-X
+  if (d->has_msi() && (num_requested == 1 || !d->has_msix())) {
+    return d->allocate_msi(num_requested, irqbase);
+  }
+  if (d->has_msix()) {
+    return d->allocate_msix(num_requested, irqbase);
+  }
+
+  return ERR_NO_RESOURCES;
+}
+
+status_t pci_bus_mgr_free_msi(const pci_location_t loc, uint irqbase, size_t count) {
+  char str[14];
+  LTRACEF("%s irqbase %u count %zu\n", pci_loc_string(loc, str), irqbase, count);
+
+  device *d = lookup_device_by_loc(loc);
+  if (!d) {
+    return ERR_NOT_FOUND;
   }
 
-  return d->allocate_msi(num_requested, irqbase);
+  return d->free_msi(irqbase, count);
 }
 
 status_t pci_bus_mgr_allocate_irq(const pci_location_t loc, uint *irqbase) {
@@ -8,6 +8,7 @@
 
 #include "device.h"
 
+#include <align.h>
 #include <assert.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -22,6 +23,9 @@
 #include <lk/pow2.h>
 #include <lk/trace.h>
 #include <platform/interrupts.h>
+#if WITH_KERNEL_VM
+#include <kernel/vm.h>
+#endif
 
 #define LOCAL_TRACE 0
 
@@ -292,7 +296,7 @@ status_t device::allocate_msi(size_t num_requested, uint *msi_base) {
   uint16_t msi_data = 0;
   err = platform_compute_msi_values(vector_base, 0, true, &msi_address, &msi_data);
   if (err != NO_ERROR) {
-    // TODO: return the allocated msi
+    platform_free_interrupts(vector_base, num_requested);
     return err;
   }
 
@@ -324,6 +328,113 @@ status_t device::allocate_msi(size_t num_requested, uint *msi_base) {
   return NO_ERROR;
 }
 
+status_t device::allocate_msix(size_t num_requested, uint *msi_base) {
+  LTRACEF("num_requested %zu\n", num_requested);
+
+  if (!has_msix()) {
+    return ERR_NOT_SUPPORTED;
+  }
+
+  DEBUG_ASSERT(msix_cap_ && msix_cap_->is_msix());
+
+  const uint16_t cap_offset = msix_cap_->config_offset;
+
+  uint16_t control;
+  pci_read_config_half(loc(), cap_offset + 2, &control);
+  const size_t table_size = (control & 0x7ff) + 1;
+  if (num_requested == 0 || num_requested > table_size) {
+    return ERR_NO_RESOURCES;
+  }
+
+  if (!msix_table_) {
+    // the table lives in one of the bars, at an offset given by the capability
+    uint32_t table_offset;
+    pci_read_config_word(loc(), cap_offset + 4, &table_offset);
+    const uint bir = table_offset & 0x7;
+    table_offset &= ~0x7U;
+
+    if (bir >= countof(bars_) || !bars_[bir].valid || bars_[bir].io || bars_[bir].addr == 0) {
+      return ERR_NOT_FOUND;
+    }
+
+    const paddr_t table_pa = bars_[bir].addr + table_offset;
+#if WITH_KERNEL_VM
+    const paddr_t map_pa = ROUNDDOWN(table_pa, (paddr_t)PAGE_SIZE);
+    const size_t map_size = ROUNDUP(table_pa + table_size * 16 - map_pa, (size_t)PAGE_SIZE);
+    void *ptr;
+    status_t err = vmm_alloc_physical(vmm_get_kernel_aspace(), "pci msix", map_size, &ptr, 0,
+                                      map_pa, 0, ARCH_MMU_FLAG_UNCACHED_DEVICE);
+    if (err != NO_ERROR) {
+      return err;
+    }
+    msix_table_ = (volatile uint32_t *)((uint8_t *)ptr + (table_pa - map_pa));
+#else
+    msix_table_ = (volatile uint32_t *)table_pa;
+#endif
+  }
+
+  // ask the platform for interrupts
+  uint vector_base;
+  status_t err = platform_allocate_interrupts(num_requested, 0, true, &vector_base);
+  if (err != NO_ERROR) {
+    return err;
+  }
+
+  // enable MSI-X with the whole function masked while the table is rewritten
+  pci_write_config_half(loc(), cap_offset + 2, control | (1 << 15) | (1 << 14));
+
+  for (size_t i = 0; i < table_size; i++) {
+    volatile uint32_t *entry = &msix_table_[i * 4];
+    if (i >= num_requested) {
+      entry[3] = 1;  // vector control: masked
+      continue;
+    }
+
+    uint64_t msi_address = 0;
+    uint16_t msi_data = 0;
+    err = platform_compute_msi_values(vector_base + i, 0, true, &msi_address, &msi_data);
+    if (err != NO_ERROR) {
+      // put the capability back the way it was and give the vectors back
+      pci_write_config_half(loc(), cap_offset + 2, control);
+      platform_free_interrupts(vector_base, num_requested);
+      return err;
+    }
+
+    entry[0] = msi_address & 0xffff'ffff;
+    entry[1] = msi_address >> 32;
+    entry[2] = msi_data;
+    entry[3] = 0;  // unmasked
+  }
+
+  // drop the function mask, leave MSI-X enabled
+  pci_write_config_half(loc(), cap_offset + 2, (control & ~(1 << 14)) | (1 << 15));
+
+  *msi_base = vector_base;
+
+  return NO_ERROR;
+}
+
+status_t device::free_msi(uint msi_base, size_t count) {
+  LTRACEF("msi_base %u count %zu\n", msi_base, count);
+
+  // whichever of the two is on, switch it off before the vectors go away
+  uint16_t control;
+  if (msix_cap_) {
+    pci_read_config_half(loc(), msix_cap_->config_offset + 2, &control);
+    if (control & (1 << 15)) {
+      pci_write_config_half(loc(), msix_cap_->config_offset + 2, control & ~(1 << 15));
+    }
+  }
+  if (msi_cap_) {
+    pci_read_config_half(loc(), msi_cap_->config_offset + 2, &control);
+    if (control & 1) {
+      pci_write_config_half(loc(), msi_cap_->config_offset + 2, control & ~1);
+    }
+  }
+
+  return platform_free_interrupts(msi_base, count);
+}
+
 status_t device::load_bars() {
   size_t num_bars;
 
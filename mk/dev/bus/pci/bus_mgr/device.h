@@ -35,6 +35,8 @@ class device {
 
   status_t allocate_irq(uint *irq);
   status_t allocate_msi(size_t num_requested, uint *msi_base);
+  status_t allocate_msix(size_t num_requested, uint *msi_base);
+  status_t free_msi(uint msi_base, size_t count);
   status_t load_config();
   status_t load_bars();
 
@@ -112,6 +114,9 @@ class device {
   list_node capability_list_ = LIST_INITIAL_VALUE(capability_list_);
   capability *msi_cap_ = nullptr;
   capability *msix_cap_ = nullptr;
+
+  // MSI-X vector table, mapped on first allocation
+  volatile uint32_t *msix_table_ = nullptr;
 };
 
 struct capability {
@@ -96,8 +96,13 @@ status_t pci_bus_mgr_enable_device(const pci_location_t loc);
 status_t pci_bus_mgr_read_bars(const pci_location_t loc, pci_bar_t bar[6]);
 
 // try to allocate one or more msi vectors for this device
+// uses MSI-X when more than one vector is requested or the device has no plain MSI,
+// in which case table entry N is routed to vector irqbase + N
 status_t pci_bus_mgr_allocate_msi(const pci_location_t loc, size_t num_requested, uint *irqbase);
 
+// turn msi back off for this device and give back the vectors pci_bus_mgr_allocate_msi returned
+status_t pci_bus_mgr_free_msi(const pci_location_t loc, uint irqbase, size_t count);
+
 // allocate a regular irq for this device and return it in irqbase
 status_t pci_bus_mgr_allocate_irq(const pci_location_t loc, uint *irqbase);
 
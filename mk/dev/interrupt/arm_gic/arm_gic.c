@@ -11,6 +11,7 @@
 #include <arch/ops.h>
 #include <dev/interrupt/arm_gic.h>
 #include <kernel/debug.h>
+#include <kernel/ktrace.h>
 #include <kernel/thread.h>
 #include <lk/bits.h>
 #include <lk/debug.h>
@@ -382,6 +383,7 @@ static enum handler_return __platform_irq(struct iframe *frame) {
 
   THREAD_STATS_INC(interrupts);
   KEVLOG_IRQ_ENTER(vector);
+  KTRACE_IRQ_ENTER(vector);
 
   uint cpu = arch_curr_cpu_num();
 
@@ -401,6 +403,7 @@ static enum handler_return __platform_irq(struct iframe *frame) {
   LTRACEF_LEVEL(2, "cpu %u exit %d\n", cpu, ret);
 
   KEVLOG_IRQ_EXIT(vector);
+  KTRACE_IRQ_EXIT(vector);
 
   return ret;
 }
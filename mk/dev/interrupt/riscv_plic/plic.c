@@ -9,6 +9,7 @@
 
 #include <dev/interrupt/riscv_plic.h>
 #include <kernel/debug.h>
+#include <kernel/ktrace.h>
 #include <kernel/thread.h>
 #include <lk/debug.h>
 #include <lk/err.h>
@@ -144,6 +145,7 @@ enum handler_return riscv_platform_irq(void) {
 
   THREAD_STATS_INC(interrupts);
   KEVLOG_IRQ_ENTER(vector);
+  KTRACE_IRQ_ENTER(vector);
 
   enum handler_return ret = INT_NO_RESCHEDULE;
   if (handlers[vector].handler) {
@@ -154,6 +156,7 @@ enum handler_return riscv_platform_irq(void) {
   *REG32(PLIC_COMPLETE(riscv_current_hart())) = vector;
 
   KEVLOG_IRQ_EXIT(vector);
+  KTRACE_IRQ_EXIT(vector);
 
   return ret;
 }
@@ -77,14 +77,21 @@ class e1000 {
   static const size_t txring_len = 64;
   static const size_t rxbuffer_len = 2048;
 
+  // rx descriptors handled per poll pass before the ring is refilled and the worker yields
+  static const size_t rx_budget = 16;
+  // RXO and RXT0, masked while the rx worker is polling the ring
+  static const uint32_t rx_irq_mask = (1 << 7) | (1 << 6);
+
   uint32_t read_reg(e1000_reg reg);
   void write_reg(e1000_reg reg, uint32_t val);
   uint16_t read_eeprom(uint8_t offset);
 
   handler_return irq_handler();
 
-  void add_pktbuf_to_rxring(pktbuf_t *pkt);
   void add_pktbuf_to_rxring_locked(pktbuf_t *pkt);
+  void refill_rxring(list_node *list);
+  size_t rx_poll(size_t budget);
+  bool rx_pending();
 
   // counter of configured deices
   static volatile int global_count_;
@@ -107,7 +114,6 @@ class e1000 {
   uint8_t *rx_buf_ = nullptr;  // rxbuffer_len * rxring_len byte buffer that rx_pktbuf[] points to
 
   // rx worker thread
-  list_node rx_queue_ = LIST_INITIAL_VALUE(rx_queue_);
   event_t rx_event_ = EVENT_INITIAL_VALUE(rx_event_, 0, EVENT_FLAG_AUTOUNSIGNAL);
   thread_t *rx_worker_thread_ = nullptr;
   int rx_worker_routine();
@@ -180,87 +186,95 @@ handler_return e1000::irq_handler() {
   if (icr & (1 << 6)) {
     printf("e1000: RX OVERRUN\n");
   }
-  if (icr & (1 << 7)) {  // RXTO - rx timer interrupt
-    // rx timer fired, packets are probably ready
-    auto rdh = read_reg(e1000_reg::RDH);
-    auto rdt = read_reg(e1000_reg::RDT);
-
-    while (rx_last_head_ != rdh) {
-      // copy the current rx descriptor locally for better cache performance
-      rdesc rxd;
-      copy(&rxd, rxring_ + rx_last_head_);
-
-      LTRACEF("last_head %#x RDH %#x RDT %#x\n", rx_last_head_, rdh, rdt);
-      if (LOCAL_TRACE)
-        rxd.dump();
-
-      // recover the pktbuf we queued in this spot
-      DEBUG_ASSERT(rx_pktbuf_[rx_last_head_]);
-      DEBUG_ASSERT(pktbuf_data_phys(rx_pktbuf_[rx_last_head_]) == rxd.addr);
-      pktbuf_t *pkt = rx_pktbuf_[rx_last_head_];
-
-      bool consumed_pkt = false;
-      if (rxd.status & (1 << 0)) {    // descriptor done, we own it now
-        if (rxd.status & (1 << 1)) {  // end of packet
-          if (rxd.errors == 0) {
-            // good packet, trim data len according to the rx descriptor
-            pkt->dlen = rxd.length;
-            pkt->flags |= PKTBUF_FLAG_EOF;  // just to make sure
-
-            // queue it in the rx queue
-            list_add_tail(&rx_queue_, &pkt->list);
-
-            // wake up the rx worker
-            event_signal(&rx_event_, false);
-            ret = INT_RESCHEDULE;
-            consumed_pkt = true;
-          }
-        }
-      }
-      if (!consumed_pkt) {
-        // TODO: return the pkt to the ring
-        add_pktbuf_to_rxring_locked(pkt);
-      }
+  if (icr & rx_irq_mask) {  // RXO or RXT0 - rx timer interrupt
+    // rx timer fired, packets are probably ready. mask rx interrupts and let
+    // the rx worker pull packets straight off the ring until it goes idle.
+    write_reg(e1000_reg::IMC, rx_irq_mask);
 
-      rx_last_head_ = (rx_last_head_ + 1) % rxring_len;
-    }
+    event_signal(&rx_event_, false);
+    ret = INT_RESCHEDULE;
   }
   return ret;
 }
 
-int e1000::rx_worker_routine() {
-  for (;;) {
-    event_wait(&rx_event_);
+// returns true if the descriptor at the head of the rx ring has been written back
+bool e1000::rx_pending() {
+  volatile rdesc *rxd = rxring_ + rx_last_head_;
 
-    // pull some packets from the received queue
-    for (;;) {
-      pktbuf_t *p;
+  return rxd->status & (1 << 0);
+}
 
-      {
-        AutoSpinLock guard(&lock_);
+size_t e1000::rx_poll(size_t budget) {
+  list_node consumed = LIST_INITIAL_VALUE(consumed);
 
-        p = list_remove_head_type(&rx_queue_, pktbuf_t, list);
-      }
+  size_t count = 0;
+  while (count < budget) {
+    // copy the current rx descriptor locally for better cache performance
+    rdesc rxd;
+    copy(&rxd, rxring_ + rx_last_head_);
 
-      if (!p) {
-        break;  // nothing left in the queue, go back to waiting
-      }
+    if ((rxd.status & (1 << 0)) == 0) {  // descriptor not done, the device still owns it
+      break;
+    }
+
+    LTRACEF("last_head %#x RDT %#x\n", rx_last_head_, rx_tail_);
+    if (LOCAL_TRACE)
+      rxd.dump();
+
+    // recover the pktbuf we queued in this spot
+    DEBUG_ASSERT(rx_pktbuf_[rx_last_head_]);
+    DEBUG_ASSERT(pktbuf_data_phys(rx_pktbuf_[rx_last_head_]) == rxd.addr);
+    pktbuf_t *pkt = rx_pktbuf_[rx_last_head_];
+
+    rx_last_head_ = (rx_last_head_ + 1) % rxring_len;
+    count++;
+
+    if ((rxd.status & (1 << 1)) && rxd.errors == 0) {  // end of packet
+      // good packet, trim data len according to the rx descriptor
+      pkt->dlen = rxd.length;
+      pkt->flags |= PKTBUF_FLAG_EOF;  // just to make sure
 
       if (LOCAL_TRACE) {
         LTRACEF("got packet: ");
-        pktbuf_dump(p);
+        pktbuf_dump(pkt);
       }
 
       // push it up the stack
-      minip_rx_driver_callback(p);
+      minip_rx_driver_callback(pkt);
 
       // we own the pktbuf again
 
       // set the data pointer to the start of the buffer and set dlen to 0
-      pktbuf_reset(p, 0);
+      pktbuf_reset(pkt, 0);
+    }
+
+    list_add_tail(&consumed, &pkt->list);
+  }
+
+  // add them back to the rx ring at the current tail
+  refill_rxring(&consumed);
+
+  return count;
+}
 
-      // add it back to the rx ring at the current tail
-      add_pktbuf_to_rxring(p);
+int e1000::rx_worker_routine() {
+  for (;;) {
+    event_wait(&rx_event_);
+
+    // the irq handler left rx interrupts masked, drain the ring in budgeted passes
+    for (;;) {
+      if (rx_poll(rx_budget) == rx_budget) {
+        // still busy, stay in polling mode but let other threads run
+        thread_yield();
+        continue;
+      }
+
+      // idle, go back to interrupts unless a packet raced with unmasking
+      write_reg(e1000_reg::IMS, rx_irq_mask);
+      if (!rx_pending()) {
+        break;
+      }
+      write_reg(e1000_reg::IMC, rx_irq_mask);
     }
   }
 
@@ -305,17 +319,24 @@ void e1000::add_pktbuf_to_rxring_locked(pktbuf_t *p) {
   // save a copy of the pktbuf in our list
   rx_pktbuf_[rx_tail_] = p;
 
-  // bump tail forward
+  // bump tail forward, the caller hands the new tail to the device
   rx_tail_ = (rx_tail_ + 1) % rxring_len;
-  write_reg(e1000_reg::RDT, rx_tail_);
-
-  LTRACEF("after RDH %#x RDT %#x\n", read_reg(e1000_reg::RDH), read_reg(e1000_reg::RDT));
 }
 
-void e1000::add_pktbuf_to_rxring(pktbuf_t *pkt) {
+void e1000::refill_rxring(list_node *list) {
+  if (list_is_empty(list)) {
+    return;
+  }
+
   AutoSpinLock guard(&lock_);
 
-  add_pktbuf_to_rxring_locked(pkt);
+  pktbuf_t *pkt;
+  while ((pkt = list_remove_head_type(list, pktbuf_t, list)) != nullptr) {
+    add_pktbuf_to_rxring_locked(pkt);
+  }
+  write_reg(e1000_reg::RDT, rx_tail_);
+
+  LTRACEF("after RDH %#x RDT %#x\n", read_reg(e1000_reg::RDH), read_reg(e1000_reg::RDT));
 }
 
 status_t e1000::init_device(pci_location_t loc, const e1000_id_features *id) {
@@ -483,6 +504,7 @@ status_t e1000::init_device(pci_location_t loc, const e1000_id_features *id) {
 
     add_pktbuf_to_rxring_locked(pkt);
   }
+  write_reg(e1000_reg::RDT, rx_tail_);
   // hexdump(rxring_, rxring_len * sizeof(rdesc));
 
   // start rx worker thread
@@ -500,7 +522,7 @@ status_t e1000::init_device(pci_location_t loc, const e1000_id_features *id) {
 
   // unmask receive irq
   auto ims = read_reg(e1000_reg::IMS);
-  write_reg(e1000_reg::IMS, ims | (1 << 7) | (1 << 6));  // RXO, RXTO
+  write_reg(e1000_reg::IMS, ims | rx_irq_mask);  // RXO, RXTO
 
   // set up the tx path
   write_reg(e1000_reg::TDH, 0);
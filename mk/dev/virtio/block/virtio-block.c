@@ -313,104 +313,100 @@ static enum handler_return virtio_block_irq_driver_callback(struct virtio_device
   return INT_RESCHEDULE;
 }
 
-ssize_t virtio_block_read_write(struct virtio_device *dev, void *buf, const off_t offset,
-                                const size_t len, const bool write) {
-  struct virtio_block_dev *bdev = (struct virtio_block_dev *)dev->priv;
-
-  uint16_t i;
-  struct vring_desc *desc;
-
-  LTRACEF("dev %p, buf %p, offset 0x%llx, len %zu\n", dev, buf, offset, len);
+/* a physically contiguous piece of an io buffer */
+struct virtio_block_seg {
+  paddr_t pa;
+  size_t len;
+};
 
-  mutex_acquire(&bdev->lock);
+/* request header and response take a descriptor each */
+#define VIRTIO_BLOCK_MAX_SEGS (VIRTIO_INDIRECT_MAX_DESC - 2)
 
-  /* set up the request */
-  bdev->blk_req->type = write ? VIRTIO_BLK_T_OUT : VIRTIO_BLK_T_IN;
-  bdev->blk_req->ioprio = 0;
-  bdev->blk_req->sector = offset / 512;
-  LTRACEF("blk_req type %u ioprio %u sector %llu\n", bdev->blk_req->type, bdev->blk_req->ioprio,
-          bdev->blk_req->sector);
+/* split the front of a buffer into at most max_segs physical segments, returns the number of
+ * bytes covered */
+static size_t virtio_block_gather(void *buf, size_t len, struct virtio_block_seg *segs,
+                                  uint max_segs, uint *seg_count) {
+#if WITH_KERNEL_VM
+  vaddr_t va = (vaddr_t)buf;
+  size_t done = 0;
+  uint count = 0;
 
-  /* put together a transfer */
-  desc = virtio_alloc_desc_chain(dev, 0, 3, &i);
-  LTRACEF("after alloc chain desc %p, i %u\n", desc, i);
+  while (done < len) {
+    /* amount of the buffer in this page */
+    size_t chunk = MIN(PAGE_ALIGN(va + 1) - va, len - done);
+    paddr_t pa = vaddr_to_paddr((void *)va);
 
-  // XXX not cache safe.
-  // At the moment only tested on arm qemu, which doesn't emulate cache.
+    if (count > 0 && segs[count - 1].pa + segs[count - 1].len == pa) {
+      /* physically contiguous with the last one, simply extend it */
+      segs[count - 1].len += chunk;
+    } else {
+      if (count == max_segs)
+        break;
+      segs[count].pa = pa;
+      segs[count].len = chunk;
+      count++;
+    }
 
-  /* set up the descriptor pointing to the head */
-  desc->addr = bdev->blk_req_phys;
-  desc->len = sizeof(struct virtio_blk_req);
-  desc->flags |= VRING_DESC_F_NEXT;
+    va += chunk;
+    done += chunk;
+  }
 
-  /* set up the descriptor pointing to the buffer */
-  desc = virtio_desc_index_to_desc(dev, 0, desc->next);
-#if WITH_KERNEL_VM
-  /* translate the first buffer */
-  vaddr_t va = (vaddr_t)buf;
-  paddr_t pa = vaddr_to_paddr((void *)va);
-  desc->addr = (uint64_t)pa;
-  /* desc->len is filled in below */
+  *seg_count = count;
+  return done;
 #else
   /* non VM world simply queues a single buffer that transfers the whole thing */
-  desc->addr = (uint64_t)(uintptr_t)buf;
-  desc->len = len;
+  segs[0].pa = (paddr_t)buf;
+  segs[0].len = len;
+  *seg_count = 1;
+  return len;
 #endif
-  desc->flags |= write ? 0 : VRING_DESC_F_WRITE; /* mark buffer as write-only if its a block read */
-  desc->flags |= VRING_DESC_F_NEXT;
+}
 
-#if WITH_KERNEL_VM
-  /* see if we need to add more descriptors due to scatter gather */
-  paddr_t next_pa = PAGE_ALIGN(pa + 1);
-  desc->len = MIN(next_pa - pa, len);
-  LTRACEF("first descriptor va 0x%lx desc->addr 0x%llx desc->len %u\n", va, desc->addr, desc->len);
-
-  size_t remaining_len = len;
-  remaining_len -= desc->len;
-  while (remaining_len > 0) {
-    /* amount of source buffer handled by this iteration of the loop */
-    size_t len_tohandle = MIN(remaining_len, PAGE_SIZE);
-
-    /* translate the next page in the buffer */
-    va = PAGE_ALIGN(va + 1);
-    pa = vaddr_to_paddr((void *)va);
-    LTRACEF("va now 0x%lx, pa 0x%lx, next_pa 0x%lx, remaining len %zu\n", va, pa, next_pa,
-            remaining_len);
-
-    /* is the new translated physical address contiguous to the last one? */
-    if (next_pa == pa) {
-      /* we can simply extend the previous descriptor by another page */
-      LTRACEF("extending last one by %zu bytes\n", len_tohandle);
-      desc->len += len_tohandle;
-    } else {
-      /* new physical page needed, allocate a new descriptor and start again */
-      uint16_t next_i = virtio_alloc_desc(dev, 0);
-      struct vring_desc *next_desc = virtio_desc_index_to_desc(dev, 0, next_i);
-      DEBUG_ASSERT(next_desc);
-
-      LTRACEF("doesn't extend, need new desc, allocated desc %i (%p)\n", next_i, next_desc);
-
-      /* fill this descriptor in and put it after the last one but before the response descriptor */
-      next_desc->addr = (uint64_t)pa;
-      next_desc->len = len_tohandle;
-      next_desc->flags =
-          write ? 0 : VRING_DESC_F_WRITE; /* mark buffer as write-only if its a block read */
-      next_desc->flags |= VRING_DESC_F_NEXT;
-      next_desc->next = desc->next;
-      desc->next = next_i;
-
-      desc = next_desc;
+/* issue a single request for a buffer that fits in one chain, with the lock held */
+static status_t virtio_block_do_request(struct virtio_block_dev *bdev,
+                                    const struct virtio_block_seg *segs, uint seg_count,
+                                    bool write) {
+  struct virtio_device *dev = bdev->dev;
+  const uint count = seg_count + 2;
+  uint16_t i;
+
+  // XXX not cache safe.
+  // At the moment only tested on arm qemu, which doesn't emulate cache.
+
+  /* with indirect descriptors the whole request takes a single ring slot */
+  struct vring_desc *table = virtio_alloc_indirect_chain(dev, 0, count, &i);
+
+  struct vring_desc *desc;
+  if (table) {
+    desc = &table[0];
+  } else {
+    desc = virtio_alloc_desc_chain(dev, 0, count, &i);
+    if (!desc) {
+      TRACEF("no room in the ring for %u descriptors\n", count);
+      return ERR_NO_RESOURCES;
     }
-    remaining_len -= len_tohandle;
-    next_pa += PAGE_SIZE;
   }
-#endif
+  LTRACEF("request %u descriptors, indirect %d, head %u\n", count, table != NULL, i);
+
+  /* walk the chain, filling in the request header, the buffer and the response */
+  for (uint n = 0; n < count; n++) {
+    if (n == 0) {
+      desc->addr = bdev->blk_req_phys;
+      desc->len = sizeof(struct virtio_blk_req);
+    } else if (n < count - 1) {
+      desc->addr = (uint64_t)segs[n - 1].pa;
+      desc->len = segs[n - 1].len;
+      /* mark buffer as write-only if its a block read */
+      desc->flags |= write ? 0 : VRING_DESC_F_WRITE;
+    } else {
+      desc->addr = bdev->blk_response_phys;
+      desc->len = 1;
+      desc->flags |= VRING_DESC_F_WRITE;
+      break;
+    }
 
-  /* set up the descriptor pointing to the response */
-  desc = virtio_desc_index_to_desc(dev, 0, desc->next);
-  desc->addr = bdev->blk_response_phys;
-  desc->len = 1;
-  desc->flags = VRING_DESC_F_WRITE;
+    desc = table ? &table[desc->next] : virtio_desc_index_to_desc(dev, 0, desc->next);
+  }
 
   /* submit the transfer */
   virtio_submit_chain(dev, 0, i);
@@ -423,11 +419,46 @@ ssize_t virtio_block_read_write(struct virtio_device *dev, void *buf, const off_
 
   LTRACEF("status 0x%hhx\n", bdev->blk_response);
 
-  /* TODO: handle transfer errors and return error */
+  return bdev->blk_response == VIRTIO_BLK_S_OK ? NO_ERROR : ERR_IO;
+}
+
+ssize_t virtio_block_read_write(struct virtio_device *dev, void *buf, const off_t offset,
+                                const size_t len, const bool write) {
+  struct virtio_block_dev *bdev = (struct virtio_block_dev *)dev->priv;
+  struct virtio_block_seg segs[VIRTIO_BLOCK_MAX_SEGS];
+
+  LTRACEF("dev %p, buf %p, offset 0x%llx, len %zu\n", dev, buf, offset, len);
+
+  mutex_acquire(&bdev->lock);
+
+  /* requests go one at a time, so the whole ring is free here. a chain has to
+   * fit in it even if there is no indirect table to put it in, buffers too
+   * scattered for that are split into several requests */
+  uint free_count = dev->ring[0].free_count;
+  uint max_segs = free_count > 2 ? MIN(VIRTIO_BLOCK_MAX_SEGS, free_count - 2) : 0;
+
+  size_t done = 0;
+  status_t err = max_segs ? NO_ERROR : ERR_NO_RESOURCES;
+  while (err == NO_ERROR && done < len) {
+    uint seg_count;
+    size_t chunk =
+        virtio_block_gather((uint8_t *)buf + done, len - done, segs, max_segs, &seg_count);
+
+    /* set up the request */
+    bdev->blk_req->type = write ? VIRTIO_BLK_T_OUT : VIRTIO_BLK_T_IN;
+    bdev->blk_req->ioprio = 0;
+    bdev->blk_req->sector = (offset + done) / 512;
+    LTRACEF("blk_req type %u ioprio %u sector %llu\n", bdev->blk_req->type,
+            bdev->blk_req->ioprio, bdev->blk_req->sector);
+
+    err = virtio_block_do_request(bdev, segs, seg_count, write);
+
+    done += chunk;
+  }
 
   mutex_release(&bdev->lock);
 
-  return len;
+  return err < 0 ? err : (ssize_t)len;
 }
 
 static ssize_t virtio_bdev_read_block(struct bdev *bdev, void *buf, bnum_t block, uint count) {
@@ -18,9 +18,11 @@
  * returns number of devices found */
 int virtio_mmio_detect(void *ptr, uint count, const uint irqs[], size_t stride);
 
-#define MAX_VIRTIO_RINGS 4
+/* enough for a multiqueue net device with eight queue pairs and its control queue */
+#define MAX_VIRTIO_RINGS 17
 
 struct virtio_mmio_config;
+struct virtio_transport;
 
 struct virtio_device {
   bool valid;
@@ -28,6 +30,21 @@ struct virtio_device {
   uint index;
   uint irq;
 
+  /* register access for the bus the device was found on (mmio or pci) */
+  const struct virtio_transport *transport;
+  /* VIRTIO_F_VERSION_1 is negotiated, always the case on the pci transport */
+  bool version_1;
+
+  /* ring features negotiated by the core on behalf of the driver */
+  bool event_idx;
+  bool indirect_desc;
+  bool features_set;
+  bool features_ok;
+
+  /* virtio device type of the attached driver */
+  uint device_id;
+  struct list_node node;
+
   volatile struct virtio_mmio_config *mmio_config;
   void *config_ptr;
 
@@ -37,8 +54,13 @@ struct virtio_device {
                                              const struct vring_used_elem *e);
   enum handler_return (*config_change_callback)(struct virtio_device *dev);
 
+  /* rings in polled_rings_bitmap are drained by the driver with virtio_poll_ring().
+   * an interrupt on one masks the ring and calls ring_poll_callback instead. */
+  enum handler_return (*ring_poll_callback)(struct virtio_device *dev, uint ring);
+
   /* virtio rings */
   uint32_t active_rings_bitmap;
+  uint32_t polled_rings_bitmap;
   struct vring ring[MAX_VIRTIO_RINGS];
 };
 
@@ -61,6 +83,17 @@ uint16_t virtio_alloc_desc(struct virtio_device *dev, uint ring_index);
 struct vring_desc *virtio_alloc_desc_chain(struct virtio_device *dev, uint ring_index, size_t count,
                                            uint16_t *start_index);
 
+/* largest chain an indirect table can hold */
+#define VIRTIO_INDIRECT_MAX_DESC 64
+
+/* allocate a chain of count descriptors that occupies a single ring slot.
+ * returns the first entry of the table, entries are linked in order with the
+ * last one terminating the chain. start_index is the ring slot to submit, and
+ * freeing it releases the table. returns NULL if indirect descriptors were not
+ * negotiated, count is too large or out of resources. thread context only. */
+struct vring_desc *virtio_alloc_indirect_chain(struct virtio_device *dev, uint ring_index,
+                                               size_t count, uint16_t *start_index);
+
 static inline struct vring_desc *virtio_desc_index_to_desc(struct virtio_device *dev,
                                                            uint ring_index, uint16_t desc_index) {
   DEBUG_ASSERT(desc_index != 0xffff);
@@ -72,4 +105,25 @@ void virtio_dump_desc(const struct vring_desc *desc);
 /* submit a chain to the avail list */
 void virtio_submit_chain(struct virtio_device *dev, uint ring_index, uint16_t desc_index);
 
+/* notify the device of new chains, unless it said it does not need to know */
 void virtio_kick(struct virtio_device *dev, uint ring_idnex);
+
+/* ask the device not to interrupt on completions on a ring, for drivers that poll */
+void virtio_ring_disable_irq(struct virtio_device *dev, uint ring_index);
+
+/* turn completion interrupts back on. returns true if completions arrived in
+ * the meantime, in which case the caller should poll once more. */
+bool virtio_ring_enable_irq(struct virtio_device *dev, uint ring_index);
+
+/* hand completions on a ring over to the driver. the driver must set
+ * ring_poll_callback first and is the only consumer of the ring from then on. */
+void virtio_ring_set_polled(struct virtio_device *dev, uint ring_index);
+
+typedef void (*virtio_poll_callback)(struct virtio_device *dev, uint ring,
+                                     const struct vring_used_elem *e, void *arg);
+
+/* consume up to budget completions off a polled ring, calling cb on each one
+ * from the calling thread. returns the number consumed, a return equal to
+ * budget means more work may be pending. */
+uint virtio_poll_ring(struct virtio_device *dev, uint ring_index, uint budget,
+                      virtio_poll_callback cb, void *arg);
@@ -32,6 +32,7 @@
  * SUCH DAMAGE.
  *
  * Copyright Rusty Russell IBM Corporation 2007. */
+#include <stdbool.h>
 #include <stdint.h>
 
 #include <lk/pow2.h>
@@ -100,13 +101,29 @@ struct vring {
   uint16_t free_list; /* head of a free list of descriptors per ring. 0xffff is NULL */
   uint16_t free_count;
 
-  uint16_t last_used;
+  uint16_t last_used;    /* free running, like used->idx */
+  uint16_t kicked_avail; /* avail->idx the last time the device was considered for a kick */
+  bool irq_disabled;     /* driver is polling, leave the used event index alone */
 
   struct vring_desc *desc;
 
   struct vring_avail *avail;
 
   struct vring_used *used;
+
+  /* indirect descriptor table hanging off each head descriptor, if any */
+  struct vring_desc **indirect;
+
+  /* notification accounting */
+  struct vring_stats {
+    uint64_t submitted;
+    uint64_t notifies;
+    uint64_t notifies_suppressed;
+    uint64_t irqs;
+    uint64_t completions;
+    uint64_t polls;
+    uint64_t polls_exhausted;
+  } stats;
 };
 
 /* The standard layout for the ring is a continuous chunk of memory which looks
@@ -136,7 +153,9 @@ struct vring {
 /* We publish the used event index at the end of the available ring, and vice
  * versa. They are at the end for backwards compatibility. */
 #define vring_used_event(vr) ((vr)->avail->ring[(vr)->num])
-#define vring_avail_event(vr) (*(uint16_t *)&(vr)->used->ring[(vr)->num])
+#define vring_avail_event(vr)                                 \
+  (*(volatile uint16_t *)((uintptr_t)(vr)->used->ring +       \
+                          (vr)->num * sizeof(struct vring_used_elem)))
 
 static inline void vring_init(struct vring *vr, unsigned int num, void *p, unsigned long align) {
   vr->num = num;
@@ -144,6 +163,8 @@ static inline void vring_init(struct vring *vr, unsigned int num, void *p, unsig
   vr->free_list = 0xffff;
   vr->free_count = 0;
   vr->last_used = 0;
+  vr->kicked_avail = 0;
+  vr->irq_disabled = false;
   vr->desc = p;
   vr->avail = p + num * sizeof(struct vring_desc);
   vr->used = (void *)(((unsigned long)&vr->avail->ring[num] + sizeof(uint16_t) + align - 1) &
@@ -9,16 +9,20 @@
 #include <inttypes.h>
 #include <lib/minip.h>
 #include <lib/pktbuf.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
 #include <dev/virtio/net.h>
 #include <kernel/event.h>
+#include <kernel/mp.h>
 #include <kernel/spinlock.h>
 #include <kernel/thread.h>
 #include <lk/compiler.h>
 #include <lk/debug.h>
+#include <kernel/mutex.h>
 #include <lk/err.h>
+#include <lk/init.h>
 #include <lk/list.h>
 #include <lk/trace.h>
 
@@ -103,17 +107,43 @@ STATIC_ASSERT(sizeof(struct virtio_net_hdr) == 12);
 
 #define TX_RING_SIZE 16
 #define RX_RING_SIZE 16
+#define CTRL_RING_SIZE 8
 
-#define RING_RX 0
-#define RING_TX 1
+/* queue pair n uses rings 2n (rx) and 2n + 1 (tx), the control queue follows the last pair */
+#define RING_RX(q) ((q) * 2)
+#define RING_TX(q) ((q) * 2 + 1)
+#define RING_IS_TX(r) ((r) & 1)
+#define RING_TO_QUEUE(r) ((r) / 2)
+
+/* at most one queue pair per cpu, bounded by the rings the virtio core tracks */
+#ifndef VIRTIO_NET_MAX_QUEUES
+#define VIRTIO_NET_MAX_QUEUES MIN(SMP_MAX_CPUS, (MAX_VIRTIO_RINGS - 1) / 2)
+#endif
 
 #define VIRTIO_NET_MSS 1514
 
-struct virtio_net_dev {
-  struct virtio_device *dev;
-  bool started;
+/* completions handled per poll pass before the rx ring is refilled and the worker yields */
+#define VIRTIO_NET_RX_BUDGET (RX_RING_SIZE / 2)
 
-  struct virtio_net_config *config;
+/* control virtqueue commands */
+struct virtio_net_ctrl_hdr {
+  uint8_t class;
+  uint8_t cmd;
+};
+STATIC_ASSERT(sizeof(struct virtio_net_ctrl_hdr) == 2);
+
+#define VIRTIO_NET_CTRL_MQ 4
+#define VIRTIO_NET_CTRL_MQ_VQ_PAIRS_SET 0
+
+#define VIRTIO_NET_OK 0
+#define VIRTIO_NET_ERR 1
+
+struct virtio_net_dev;
+
+/* a rx/tx ring pair, each with its own lock and rx worker pinned to one cpu */
+struct virtio_net_queue {
+  struct virtio_net_dev *ndev;
+  uint index;
 
   spin_lock_t lock;
   event_t rx_event;
@@ -123,17 +153,44 @@ struct virtio_net_dev {
   pktbuf_t *pending_rx_packet[RX_RING_SIZE];
 
   uint tx_pending_count;
-  struct list_node completed_rx_queue;
+
+  /* rx buffers kept by the stack that could not be replaced yet, rx worker only */
+  uint rx_deficit;
+};
+
+struct virtio_net_dev {
+  struct virtio_device *dev;
+  bool started;
+
+  struct virtio_net_config *config;
+
+  /* num_buffers is only present on legacy devices with MRG_RXBUF, and always on 1.x devices */
+  size_t hdr_len;
+
+  /* control queue, only with VIRTIO_NET_F_CTRL_VQ */
+  bool has_ctrl;
+  uint ctrl_ring;
+
+  /* pairs in use, and pairs that have rings, enough for every cpu that may come up */
+  uint num_queues;
+  uint max_queues;
+  struct virtio_net_queue queue[VIRTIO_NET_MAX_QUEUES];
+
+  /* serializes start and growing the queue count as cpus come up */
+  mutex_t queue_lock;
 };
 
 static enum handler_return virtio_net_irq_driver_callback(struct virtio_device *dev, uint ring,
                                                           const struct vring_used_elem *e);
+static enum handler_return virtio_net_rx_poll_schedule(struct virtio_device *dev, uint ring);
 static int virtio_net_rx_worker(void *arg);
-static status_t virtio_net_queue_rx(struct virtio_net_dev *ndev, pktbuf_t *p);
+static void virtio_net_refill_rx(struct virtio_net_queue *q, struct list_node *list);
 
 // XXX remove need for this
 static struct virtio_net_dev *the_ndev;
 
+static void virtio_net_set_queues(struct virtio_net_dev *ndev, uint count);
+
 static void dump_feature_bits(uint64_t feature) {
   printf("virtio-net host features (%#" PRIx64 "):", feature);
   if (feature & VIRTIO_NET_F_CSUM)
@@ -207,6 +264,90 @@ static void dump_feature_bits(uint64_t feature) {
   printf("\n");
 }
 
+/* called from virtio_net_ctrl_cmd() polling the control queue */
+static void virtio_net_ctrl_poll_callback(struct virtio_device *dev, uint ring,
+                                          const struct vring_used_elem *e, void *arg) {
+  bool *done = (bool *)arg;
+
+  uint16_t i = e->id;
+  for (;;) {
+    struct vring_desc *desc = virtio_desc_index_to_desc(dev, ring, i);
+    int next = (desc->flags & VRING_DESC_F_NEXT) ? desc->next : -1;
+
+    virtio_free_desc(dev, ring, i);
+
+    if (next < 0)
+      break;
+    i = next;
+  }
+
+  *done = true;
+}
+
+/* synchronously issue a command on the control queue, thread context only */
+static status_t virtio_net_ctrl_cmd(struct virtio_net_dev *ndev, uint8_t class, uint8_t cmd,
+                                    const void *data, size_t len) {
+  struct virtio_device *vdev = ndev->dev;
+
+  if (!ndev->has_ctrl)
+    return ERR_NOT_SUPPORTED;
+
+  /* header, command specific data and the ack byte all live in one pktbuf */
+  pktbuf_t *p = pktbuf_alloc();
+  if (!p)
+    return ERR_NO_MEMORY;
+
+  p->data = p->buffer;
+  struct virtio_net_ctrl_hdr *hdr = (struct virtio_net_ctrl_hdr *)p->data;
+  hdr->class = class;
+  hdr->cmd = cmd;
+  memcpy(p->data + sizeof(*hdr), data, len);
+  volatile uint8_t *ack = p->data + sizeof(*hdr) + len;
+  *ack = VIRTIO_NET_ERR;
+
+  uint16_t i;
+  struct vring_desc *desc = virtio_alloc_desc_chain(vdev, ndev->ctrl_ring, 3, &i);
+  if (!desc) {
+    pktbuf_free(p, true);
+    return ERR_NO_MEMORY;
+  }
+
+  desc->addr = pktbuf_data_phys(p);
+  desc->len = sizeof(*hdr);
+  desc->flags |= VRING_DESC_F_NEXT;
+
+  desc = virtio_desc_index_to_desc(vdev, ndev->ctrl_ring, desc->next);
+  desc->addr = pktbuf_data_phys(p) + sizeof(*hdr);
+  desc->len = len;
+  desc->flags |= VRING_DESC_F_NEXT;
+
+  desc = virtio_desc_index_to_desc(vdev, ndev->ctrl_ring, desc->next);
+  desc->addr = pktbuf_data_phys(p) + sizeof(*hdr) + len;
+  desc->len = 1;
+  desc->flags = VRING_DESC_F_WRITE;
+
+  virtio_submit_chain(vdev, ndev->ctrl_ring, i);
+  virtio_kick(vdev, ndev->ctrl_ring);
+
+  /* the device answers control commands right away, don't bother with interrupts */
+  bool done = false;
+  for (uint tries = 0; !done && tries < 1000; tries++) {
+    if (virtio_poll_ring(vdev, ndev->ctrl_ring, 1, &virtio_net_ctrl_poll_callback, &done) == 0)
+      thread_sleep(1);
+  }
+
+  if (!done) {
+    /* the descriptors are still owned by the device, leak the buffer */
+    TRACEF("control command %u:%u timed out\n", class, cmd);
+    return ERR_TIMED_OUT;
+  }
+
+  status_t err = (*ack == VIRTIO_NET_OK) ? NO_ERROR : ERR_IO;
+  pktbuf_free(p, true);
+
+  return err;
+}
+
 status_t virtio_net_init(struct virtio_device *dev) {
   LTRACEF("dev %p\n", dev);
 
@@ -219,99 +360,247 @@ status_t virtio_net_init(struct virtio_device *dev) {
   dev->priv = ndev;
   ndev->started = false;
 
-  ndev->lock = SPIN_LOCK_INITIAL_VALUE;
-  event_init(&ndev->rx_event, false, EVENT_FLAG_AUTOUNSIGNAL);
-  list_initialize(&ndev->completed_rx_queue);
-
   ndev->config = (struct virtio_net_config *)dev->config_ptr;
+  ndev->hdr_len =
+      dev->version_1 ? sizeof(struct virtio_net_hdr) : sizeof(struct virtio_net_hdr) - 2;
 
   /* ack and set the driver status bit */
   virtio_status_acknowledge_driver(dev);
 
-  // XXX check features bits and ack/nak them
   uint64_t host_features =
       virtio_read_host_feature_word(dev, 0) | (uint64_t)virtio_read_host_feature_word(dev, 1) << 32;
   dump_feature_bits(host_features);
 
-  /* set our irq handler */
+  /* ask for a queue pair per cpu if the device has a control queue to configure them with */
+  uint32_t features = host_features & VIRTIO_NET_F_MAC;
+  ndev->num_queues = 1;
+  ndev->max_queues = 1;
+  mutex_init(&ndev->queue_lock);
+  if ((host_features & VIRTIO_NET_F_CTRL_VQ) && (host_features & VIRTIO_NET_F_MQ)) {
+    uint max_pairs = ndev->config->max_virtqueue_pairs;
+
+    /* the control queue sits after all the pairs the device supports */
+    if (max_pairs >= 1 && max_pairs * 2 < MAX_VIRTIO_RINGS) {
+      features |= VIRTIO_NET_F_CTRL_VQ | VIRTIO_NET_F_MQ;
+      ndev->has_ctrl = true;
+      ndev->ctrl_ring = max_pairs * 2;
+      ndev->max_queues = MIN(max_pairs, (uint)VIRTIO_NET_MAX_QUEUES);
+    } else {
+      /* control queue index past the rings the core tracks, stay on one pair */
+      printf("virtio-net: device has %u queue pairs, more than the %u rings supported, "
+             "multiqueue disabled\n",
+             max_pairs, MAX_VIRTIO_RINGS);
+      features |= VIRTIO_NET_F_CTRL_VQ;
+      ndev->has_ctrl = true;
+      ndev->ctrl_ring = 2;
+    }
+  } else if (host_features & VIRTIO_NET_F_CTRL_VQ) {
+    features |= VIRTIO_NET_F_CTRL_VQ;
+    ndev->has_ctrl = true;
+    ndev->ctrl_ring = 2;
+  }
+  virtio_set_guest_features(dev, 0, features);
+
+  /* set our irq handler, the rx rings are drained by the rx workers */
   dev->irq_driver_callback = &virtio_net_irq_driver_callback;
+  dev->ring_poll_callback = &virtio_net_rx_poll_schedule;
+
+  /* allocate a pair of virtio rings per queue, the device wants them all before DRIVER_OK */
+  for (uint q = 0; q < ndev->max_queues; q++) {
+    struct virtio_net_queue *queue = &ndev->queue[q];
+    queue->ndev = ndev;
+    queue->index = q;
+    queue->lock = SPIN_LOCK_INITIAL_VALUE;
+    event_init(&queue->rx_event, false, EVENT_FLAG_AUTOUNSIGNAL);
+
+    virtio_ring_set_polled(dev, RING_RX(q));
+    virtio_alloc_ring(dev, RING_RX(q), RX_RING_SIZE);  // rx
+    virtio_alloc_ring(dev, RING_TX(q), TX_RING_SIZE);  // tx
+  }
+  if (ndev->has_ctrl) {
+    virtio_ring_set_polled(dev, ndev->ctrl_ring);
+    virtio_alloc_ring(dev, ndev->ctrl_ring, CTRL_RING_SIZE);
+  }
 
   /* set DRIVER_OK */
   virtio_status_driver_ok(dev);
 
-  /* allocate a pair of virtio rings */
-  virtio_alloc_ring(dev, RING_RX, RX_RING_SIZE);  // rx
-  virtio_alloc_ring(dev, RING_TX, TX_RING_SIZE);  // tx
+  /* the device starts out with a single pair, switch it over to one per cpu that is up */
+  virtio_net_set_queues(ndev, mp_active_cpu_count());
 
   the_ndev = ndev;
 
   return NO_ERROR;
 }
 
+static void virtio_net_start_queue(struct virtio_net_queue *queue) {
+  /* start the rx worker thread, on the cpu its queue is steered to */
+  char name[32];
+  snprintf(name, sizeof(name), "virtio_net_rx %u", queue->index);
+  thread_t *t =
+      thread_create(name, &virtio_net_rx_worker, queue, HIGH_PRIORITY, DEFAULT_STACK_SIZE);
+  thread_set_pinned_cpu(t, mp_active_cpu(queue->index));
+  thread_resume(t);
+
+  /* queue up a bunch of rxes */
+  pktbuf_t *pkts[RX_RING_SIZE - 1];
+  size_t count = pktbuf_alloc_bulk(pkts, countof(pkts));
+
+  struct list_node list = LIST_INITIAL_VALUE(list);
+  for (size_t i = 0; i < count; i++) {
+    list_add_tail(&list, &pkts[i]->list);
+  }
+  virtio_net_refill_rx(queue, &list);
+}
+
+/* grow the pairs in use to count, as far as the rings set up at init allow */
+static void virtio_net_set_queues(struct virtio_net_dev *ndev, uint count) {
+  mutex_acquire(&ndev->queue_lock);
+
+  count = MIN(count, ndev->max_queues);
+  if (count > ndev->num_queues) {
+    uint16_t pairs = count;
+    status_t err = virtio_net_ctrl_cmd(ndev, VIRTIO_NET_CTRL_MQ, VIRTIO_NET_CTRL_MQ_VQ_PAIRS_SET,
+                                       &pairs, sizeof(pairs));
+    if (err < 0) {
+      TRACEF("failed to enable %u queue pairs, err %d\n", pairs, err);
+    } else {
+      /* the new queues are running before tx can pick them */
+      for (uint q = ndev->num_queues; ndev->started && q < count; q++) {
+        virtio_net_start_queue(&ndev->queue[q]);
+      }
+      ndev->num_queues = count;
+      printf("virtio-net: %u queue pair%s\n", count, count > 1 ? "s" : "");
+    }
+  }
+
+  mutex_release(&ndev->queue_lock);
+}
+
 status_t virtio_net_start(void) {
-  if (the_ndev->started)
+  mutex_acquire(&the_ndev->queue_lock);
+
+  if (the_ndev->started) {
+    mutex_release(&the_ndev->queue_lock);
     return ERR_ALREADY_STARTED;
+  }
 
   the_ndev->started = true;
 
-  /* start the rx worker thread */
-  thread_resume(thread_create("virtio_net_rx", &virtio_net_rx_worker, (void *)the_ndev,
-                              HIGH_PRIORITY, DEFAULT_STACK_SIZE));
-
-  /* queue up a bunch of rxes */
-  for (uint i = 0; i < RX_RING_SIZE - 1; i++) {
-    pktbuf_t *p = pktbuf_alloc();
-    if (p) {
-      virtio_net_queue_rx(the_ndev, p);
-    }
+  for (uint q = 0; q < the_ndev->num_queues; q++) {
+    virtio_net_start_queue(&the_ndev->queue[q]);
   }
 
+  mutex_release(&the_ndev->queue_lock);
+
   return NO_ERROR;
 }
 
-static status_t virtio_net_queue_tx_pktbuf(struct virtio_net_dev *ndev, pktbuf_t *p2) {
-  struct virtio_device *vdev = ndev->dev;
+/*
+ * The device is found at platform init, which on some arches runs before the
+ * secondary cpus are up. Each cpu that comes up after that gets a pair too,
+ * and the boot cpu catches the ones that came up while the device was probed.
+ */
+static void virtio_net_cpu_up(uint level) {
+  if (the_ndev)
+    virtio_net_set_queues(the_ndev, mp_active_cpu_count());
+}
+
+LK_INIT_HOOK_FLAGS(virtio_net_cpu_up, &virtio_net_cpu_up, LK_INIT_LEVEL_APPS - 1,
+                   LK_INIT_FLAG_ALL_CPUS);
+
+static inline uint32_t virtio_net_load_be32(const uint8_t *p) {
+  return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+/*
+ * Hash the addresses, protocol and ports of an outgoing ipv4 frame so every
+ * packet of a flow goes out the same tx queue and stays in order. Anything
+ * that isn't ipv4 hashes to 0.
+ */
+static uint32_t virtio_net_flow_hash(const uint8_t *frame, size_t len) {
+  const size_t eth_len = 14;
+
+  if (len < eth_len + 20)
+    return 0;
+  if (frame[12] != 0x08 || frame[13] != 0x00) /* ethertype ipv4 */
+    return 0;
+
+  const uint8_t *ip = frame + eth_len;
+  size_t ihl = (ip[0] & 0xf) * 4;
+  uint8_t proto = ip[9];
+
+  uint32_t h = virtio_net_load_be32(ip + 12) * 0x9e3779b1;
+  h ^= virtio_net_load_be32(ip + 16) + proto;
+
+  /* only the first fragment carries the ports */
+  bool fragment = ((ip[6] & 0x3f) | ip[7]) != 0;
+  if ((proto == 6 || proto == 17) && !fragment && len >= eth_len + ihl + 4)
+    h ^= virtio_net_load_be32(ip + ihl) * 0x85ebca6b;
+
+  /* murmur3 finalizer */
+  h ^= h >> 16;
+  h *= 0x85ebca6b;
+  h ^= h >> 13;
+  h *= 0xc2b2ae35;
+  h ^= h >> 16;
+
+  return h;
+}
+
+static struct virtio_net_queue *virtio_net_select_tx_queue(struct virtio_net_dev *ndev,
+                                                           pktbuf_t *p) {
+  if (ndev->num_queues == 1)
+    return &ndev->queue[0];
+
+  return &ndev->queue[virtio_net_flow_hash(p->data, p->dlen) % ndev->num_queues];
+}
+
+static status_t virtio_net_queue_tx_pktbuf(struct virtio_net_queue *q, pktbuf_t *p2) {
+  struct virtio_device *vdev = q->ndev->dev;
+  uint ring = RING_TX(q->index);
 
   uint16_t i;
   pktbuf_t *p;
 
-  DEBUG_ASSERT(ndev);
+  DEBUG_ASSERT(q);
 
   p = pktbuf_alloc();
   if (!p)
     return ERR_NO_MEMORY;
 
   /* point our header to the base of the first pktbuf */
-  struct virtio_net_hdr *hdr = pktbuf_append(p, sizeof(struct virtio_net_hdr) - 2);
+  struct virtio_net_hdr *hdr = pktbuf_append(p, q->ndev->hdr_len);
   memset(hdr, 0, p->dlen);
 
   spin_lock_saved_state_t state;
-  spin_lock_irqsave(&ndev->lock, state);
+  spin_lock_irqsave(&q->lock, state);
 
   /* only queue if we have enough tx descriptors */
-  if (ndev->tx_pending_count + 2 > TX_RING_SIZE)
+  if (q->tx_pending_count + 2 > TX_RING_SIZE)
     goto nodesc;
 
   /* allocate a chain of descriptors for our transfer */
-  struct vring_desc *desc = virtio_alloc_desc_chain(vdev, RING_TX, 2, &i);
+  struct vring_desc *desc = virtio_alloc_desc_chain(vdev, ring, 2, &i);
   if (!desc) {
-    spin_unlock_irqrestore(&ndev->lock, state);
-
   nodesc:
-    TRACEF("out of virtio tx descriptors, tx_pending_count %u\n", ndev->tx_pending_count);
+    spin_unlock_irqrestore(&q->lock, state);
+
+    TRACEF("out of virtio tx descriptors, queue %u tx_pending_count %u\n", q->index,
+           q->tx_pending_count);
     pktbuf_free(p, true);
 
     return ERR_NO_MEMORY;
   }
 
-  ndev->tx_pending_count += 2;
+  q->tx_pending_count += 2;
 
   /* save a pointer to our pktbufs for the irq handler to free */
   LTRACEF("saving pointer to pkt in index %u and %u\n", i, desc->next);
-  DEBUG_ASSERT(ndev->pending_tx_packet[i] == NULL);
-  DEBUG_ASSERT(ndev->pending_tx_packet[desc->next] == NULL);
-  ndev->pending_tx_packet[i] = p;
-  ndev->pending_tx_packet[desc->next] = p2;
+  DEBUG_ASSERT(q->pending_tx_packet[i] == NULL);
+  DEBUG_ASSERT(q->pending_tx_packet[desc->next] == NULL);
+  q->pending_tx_packet[i] = p;
+  q->pending_tx_packet[desc->next] = p2;
 
   /* set up the descriptor pointing to the header */
   desc->addr = pktbuf_data_phys(p);
@@ -319,18 +608,18 @@ static status_t virtio_net_queue_tx_pktbuf(struct virtio_net_dev *ndev, pktbuf_t
   desc->flags |= VRING_DESC_F_NEXT;
 
   /* set up the descriptor pointing to the buffer */
-  desc = virtio_desc_index_to_desc(vdev, RING_TX, desc->next);
+  desc = virtio_desc_index_to_desc(vdev, ring, desc->next);
   desc->addr = pktbuf_data_phys(p2);
   desc->len = p2->dlen;
   desc->flags = 0;
 
   /* submit the transfer */
-  virtio_submit_chain(vdev, RING_TX, i);
+  virtio_submit_chain(vdev, ring, i);
 
   /* kick it off */
-  virtio_kick(vdev, RING_TX);
+  virtio_kick(vdev, ring);
 
-  spin_unlock_irqrestore(&ndev->lock, state);
+  spin_unlock_irqrestore(&q->lock, state);
 
   return NO_ERROR;
 }
@@ -350,7 +639,7 @@ static status_t virtio_net_queue_tx(struct virtio_net_dev *ndev, const void *buf
   memcpy(p->data, buf, len);
 
   /* call through to the variant of the function that takes a pre-populated pktbuf */
-  status_t err = virtio_net_queue_tx_pktbuf(ndev, p);
+  status_t err = virtio_net_queue_tx_pktbuf(virtio_net_select_tx_queue(ndev, p), p);
   if (err < 0) {
     pktbuf_free(p, true);
   }
@@ -358,30 +647,31 @@ static status_t virtio_net_queue_tx(struct virtio_net_dev *ndev, const void *buf
   return err;
 }
 
-static status_t virtio_net_queue_rx(struct virtio_net_dev *ndev, pktbuf_t *p) {
-  struct virtio_device *vdev = ndev->dev;
+static void virtio_net_queue_rx_locked(struct virtio_net_queue *q, pktbuf_t *p) {
+  struct virtio_device *vdev = q->ndev->dev;
+  uint ring = RING_RX(q->index);
 
-  DEBUG_ASSERT(ndev);
+  DEBUG_ASSERT(q);
   DEBUG_ASSERT(p);
 
   /* point our header to the base of the pktbuf */
   p->data = p->buffer;
   struct virtio_net_hdr *hdr = (struct virtio_net_hdr *)p->data;
-  memset(hdr, 0, sizeof(struct virtio_net_hdr) - 2);
+  memset(hdr, 0, q->ndev->hdr_len);
 
-  p->dlen = sizeof(struct virtio_net_hdr) - 2 + VIRTIO_NET_MSS;
+  p->dlen = q->ndev->hdr_len + VIRTIO_NET_MSS;
 
-  spin_lock_saved_state_t state;
-  spin_lock_irqsave(&ndev->lock, state);
+  /* let the stack queue the buffer on a socket rather than copy out of it */
+  p->flags |= PKTBUF_FLAG_DETACHABLE;
 
   /* allocate a chain of descriptors for our transfer */
   uint16_t i;
-  struct vring_desc *desc = virtio_alloc_desc_chain(vdev, RING_RX, 1, &i);
+  struct vring_desc *desc = virtio_alloc_desc_chain(vdev, ring, 1, &i);
   DEBUG_ASSERT(desc); /* shouldn't be possible not to have a descriptor ready */
 
   /* save a pointer to our pktbufs for the irq handler to use */
-  DEBUG_ASSERT(ndev->pending_rx_packet[i] == NULL);
-  ndev->pending_rx_packet[i] = p;
+  DEBUG_ASSERT(q->pending_rx_packet[i] == NULL);
+  q->pending_rx_packet[i] = p;
 
   /* set up the descriptor pointing to the header */
   desc->addr = pktbuf_data_phys(p);
@@ -389,14 +679,24 @@ static status_t virtio_net_queue_rx(struct virtio_net_dev *ndev, pktbuf_t *p) {
   desc->flags = VRING_DESC_F_WRITE;
 
   /* submit the transfer */
-  virtio_submit_chain(vdev, RING_RX, i);
+  virtio_submit_chain(vdev, ring, i);
+}
 
-  /* kick it off */
-  virtio_kick(vdev, RING_RX);
+/* give a list of consumed pktbufs back to the device with a single notification */
+static void virtio_net_refill_rx(struct virtio_net_queue *q, struct list_node *list) {
+  if (list_is_empty(list))
+    return;
 
-  spin_unlock_irqrestore(&ndev->lock, state);
+  spin_lock_saved_state_t state;
+  spin_lock_irqsave(&q->lock, state);
 
-  return NO_ERROR;
+  pktbuf_t *p;
+  while ((p = list_remove_head_type(list, pktbuf_t, list)) != NULL) {
+    virtio_net_queue_rx_locked(q, p);
+  }
+  virtio_kick(q->ndev->dev, RING_RX(q->index));
+
+  spin_unlock_irqrestore(&q->lock, state);
 }
 
 static enum handler_return virtio_net_irq_driver_callback(struct virtio_device *dev, uint ring,
@@ -405,7 +705,11 @@ static enum handler_return virtio_net_irq_driver_callback(struct virtio_device *
 
   LTRACEF("dev %p, ring %u, e %p, id %u, len %u\n", dev, ring, e, e->id, e->len);
 
-  spin_lock(&ndev->lock);
+  /* only the tx rings complete at irq time, rx is polled by the rx workers */
+  DEBUG_ASSERT(RING_IS_TX(ring) && RING_TO_QUEUE(ring) < ndev->num_queues);
+  struct virtio_net_queue *q = &ndev->queue[RING_TO_QUEUE(ring)];
+
+  spin_lock(&q->lock);
 
   /* parse our descriptor chain, add back to the free queue */
   uint16_t i = e->id;
@@ -422,79 +726,136 @@ static enum handler_return virtio_net_irq_driver_callback(struct virtio_device *
 
     virtio_free_desc(dev, ring, i);
 
-    if (ring == RING_RX) {
-      /* put the freed rx buffer in a queue */
-      pktbuf_t *p = ndev->pending_rx_packet[i];
-      ndev->pending_rx_packet[i] = NULL;
-
-      DEBUG_ASSERT(p);
-      LTRACEF("rx pktbuf %p filled\n", p);
-
-      /* trim the pktbuf according to the written length in the used element descriptor */
-      if (e->len > (sizeof(struct virtio_net_hdr) - 2 + VIRTIO_NET_MSS)) {
-        TRACEF("bad used len on RX %u\n", e->len);
-        p->dlen = 0;
-      } else {
-        p->dlen = e->len;
-      }
-
-      list_add_tail(&ndev->completed_rx_queue, &p->list);
-    } else {  // ring == RING_TX
-      /* free the pktbuf associated with the tx packet we just consumed */
-      pktbuf_t *p = ndev->pending_tx_packet[i];
-      ndev->pending_tx_packet[i] = NULL;
-      ndev->tx_pending_count--;
+    /* free the pktbuf associated with the tx packet we just consumed */
+    pktbuf_t *p = q->pending_tx_packet[i];
+    q->pending_tx_packet[i] = NULL;
+    q->tx_pending_count--;
 
-      DEBUG_ASSERT(p);
-      LTRACEF("freeing pktbuf %p\n", p);
+    DEBUG_ASSERT(p);
+    LTRACEF("freeing pktbuf %p\n", p);
 
-      pktbuf_free(p, false);
-    }
+    pktbuf_free(p, false);
 
     if (next < 0)
       break;
     i = next;
   }
 
-  spin_unlock(&ndev->lock);
+  spin_unlock(&q->lock);
 
-  /* if rx ring, signal our event */
-  if (ring == 0) {
-    event_signal(&ndev->rx_event, false);
-  }
+  return INT_NO_RESCHEDULE;
+}
+
+/* first rx interrupt of a burst, the ring is masked until the worker goes idle again */
+static enum handler_return virtio_net_rx_poll_schedule(struct virtio_device *dev, uint ring) {
+  struct virtio_net_dev *ndev = (struct virtio_net_dev *)dev->priv;
+
+  /* the control queue is polled by whoever issued the command */
+  if (ndev->has_ctrl && ring == ndev->ctrl_ring)
+    return INT_NO_RESCHEDULE;
+
+  event_signal(&ndev->queue[RING_TO_QUEUE(ring)].rx_event, false);
 
   return INT_RESCHEDULE;
 }
 
+/* buffers one rx poll pass is done with */
+struct virtio_net_rx_batch {
+  struct list_node consumed; /* handed back to the device as is */
+  uint kept;                 /* kept by the stack, need replacing */
+};
+
+/* called from the rx worker for every filled rx buffer */
+static void virtio_net_rx_poll_callback(struct virtio_device *dev, uint ring,
+                                        const struct vring_used_elem *e, void *arg) {
+  struct virtio_net_dev *ndev = (struct virtio_net_dev *)dev->priv;
+  struct virtio_net_queue *q = &ndev->queue[RING_TO_QUEUE(ring)];
+  struct virtio_net_rx_batch *batch = (struct virtio_net_rx_batch *)arg;
+
+  spin_lock_saved_state_t state;
+  spin_lock_irqsave(&q->lock, state);
+
+  /* rx chains are a single descriptor */
+  uint16_t i = e->id;
+  virtio_free_desc(dev, ring, i);
+
+  pktbuf_t *p = q->pending_rx_packet[i];
+  q->pending_rx_packet[i] = NULL;
+
+  spin_unlock_irqrestore(&q->lock, state);
+
+  DEBUG_ASSERT(p);
+  LTRACEF("rx pktbuf %p filled, len %u\n", p, e->len);
+
+  /* trim the pktbuf according to the written length in the used element descriptor */
+  if (e->len > ndev->hdr_len + VIRTIO_NET_MSS) {
+    TRACEF("bad used len on RX %u\n", e->len);
+    p->dlen = 0;
+  } else {
+    p->dlen = e->len;
+  }
+
+  /* process our packet */
+  struct virtio_net_hdr *hdr = pktbuf_consume(p, ndev->hdr_len);
+  if (hdr) {
+    /* call up into the stack, which may keep the buffer until the data is read */
+    if (minip_rx_driver_callback(p)) {
+      batch->kept++;
+      return;
+    }
+  }
+
+  list_add_tail(&batch->consumed, &p->list);
+}
+
 static int virtio_net_rx_worker(void *arg) {
-  struct virtio_net_dev *ndev = (struct virtio_net_dev *)arg;
+  struct virtio_net_queue *q = (struct virtio_net_queue *)arg;
+  struct virtio_device *vdev = q->ndev->dev;
+  uint ring = RING_RX(q->index);
 
   for (;;) {
-    event_wait(&ndev->rx_event);
+    event_wait(&q->rx_event);
 
-    /* pull some packets from the received queue */
+    /* the interrupt left the ring masked, drain it in budgeted passes */
     for (;;) {
-      spin_lock_saved_state_t state;
-      spin_lock_irqsave(&ndev->lock, state);
-
-      pktbuf_t *p = list_remove_head_type(&ndev->completed_rx_queue, pktbuf_t, list);
-
-      spin_unlock_irqrestore(&ndev->lock, state);
+      struct virtio_net_rx_batch batch = {
+          .consumed = LIST_INITIAL_VALUE(batch.consumed),
+          .kept = 0,
+      };
+
+      uint count = virtio_poll_ring(vdev, ring, VIRTIO_NET_RX_BUDGET,
+                                    &virtio_net_rx_poll_callback, &batch);
+
+      /* replace the buffers the stack kept, retrying any we came up short on last time */
+      q->rx_deficit += batch.kept;
+      if (q->rx_deficit > 0) {
+        pktbuf_t *pkts[RX_RING_SIZE];
+        size_t n = pktbuf_alloc_bulk(pkts, MIN(q->rx_deficit, countof(pkts)));
+        for (size_t i = 0; i < n; i++) {
+          list_add_tail(&batch.consumed, &pkts[i]->list);
+        }
+        q->rx_deficit -= n;
+      }
 
-      if (!p)
-        break; /* nothing left in the queue, go back to waiting */
+      /* requeue the pktbufs in the rx queue */
+      virtio_net_refill_rx(q, &batch.consumed);
 
-      LTRACEF("got packet len %u\n", p->dlen);
+      if (count == VIRTIO_NET_RX_BUDGET) {
+        /* still busy, stay in polling mode but let other threads run */
+        thread_yield();
+        continue;
+      }
 
-      /* process our packet */
-      struct virtio_net_hdr *hdr = pktbuf_consume(p, sizeof(struct virtio_net_hdr) - 2);
-      if (hdr) {
-        /* call up into the stack */
-        minip_rx_driver_callback(p);
+      if (q->rx_deficit > 0) {
+        /* the pool is dry, keep polling until readers free enough buffers to refill the ring */
+        thread_sleep(1);
+        continue;
       }
 
-      /* requeue the pktbuf in the rx queue */
-      virtio_net_queue_rx(ndev, p);
+      /* idle, go back to interrupts unless a packet raced with unmasking */
+      if (!virtio_ring_enable_irq(vdev, ring))
+        break;
+      virtio_ring_disable_irq(vdev, ring);
     }
   }
   return 0;
@@ -524,7 +885,7 @@ status_t virtio_net_send_minip_pkt(void *arg, pktbuf_t *p) {
   }
 
   /* hand the pktbuf off to the nic, it owns the pktbuf from now on out unless it fails */
-  status_t err = virtio_net_queue_tx_pktbuf(the_ndev, p);
+  status_t err = virtio_net_queue_tx_pktbuf(virtio_net_select_tx_queue(the_ndev, p), p);
   if (err < 0) {
     pktbuf_free(p, true);
   }
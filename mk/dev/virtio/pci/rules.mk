@@ -0,0 +1,17 @@
+LOCAL_DIR := $(GET_LOCAL_DIR)
+
+# The device bars have to be mapped, so this needs the vm.
+ifeq (true,$(call TOBOOL,$(WITH_KERNEL_VM)))
+
+MODULE := $(LOCAL_DIR)
+
+MODULE_SRCS += \
+	$(LOCAL_DIR)/virtio-pci.c
+
+MODULE_DEPS += \
+	dev/bus/pci \
+	dev/virtio
+
+include make/module.mk
+
+endif # WITH_KERNEL_VM
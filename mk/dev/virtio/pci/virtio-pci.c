@@ -0,0 +1,448 @@
+/*
+ * Copyright (c) 2025 Mist Tecnologia Ltda
+ *
+ * Use of this source code is governed by a MIT-style
+ * license that can be found in the LICENSE file or at
+ * https://opensource.org/licenses/MIT
+ */
+#include <align.h>
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <dev/bus/pci.h>
+#include <dev/virtio.h>
+#include <kernel/vm.h>
+#include <lk/compiler.h>
+#include <lk/debug.h>
+#include <lk/err.h>
+#include <lk/init.h>
+#include <lk/list.h>
+#include <lk/trace.h>
+#include <platform/interrupts.h>
+
+#include "../virtio_priv.h"
+
+#define LOCAL_TRACE 0
+
+#define PCI_CAP_ID_VENDOR 0x09
+
+/*
+ * Virtio 1.x over pci. The register blocks are described by vendor specific
+ * capabilities pointing into the device bars. With MSI-X the config change
+ * interrupt gets vector 0 and ring n gets vector n + 1, so a completion only
+ * ever walks its own ring. Without it the device falls back to the legacy
+ * INTx line and the ISR status register.
+ */
+struct virtio_pci_dev;
+
+struct virtio_pci_vector {
+  struct virtio_pci_dev *pdev;
+  uint ring;
+};
+
+struct virtio_pci_dev {
+  struct virtio_device dev;
+  pci_location_t loc;
+
+  volatile struct virtio_pci_common_cfg *common;
+  volatile uint8_t *notify_base;
+  uint32_t notify_off_multiplier;
+  volatile uint8_t *isr;
+
+  volatile uint16_t *queue_notify[MAX_VIRTIO_RINGS];
+  uint32_t guest_features[2];
+
+  bool msix;
+  uint irq_base;
+  uint irq_count;
+  struct virtio_pci_vector vectors[MAX_VIRTIO_RINGS];
+
+  /* bars mapped so far, capabilities frequently share one */
+  void *bar_map[6];
+};
+
+static uint virtio_pci_count;
+
+static struct virtio_pci_dev *to_pci_dev(struct virtio_device *dev) {
+  return containerof(dev, struct virtio_pci_dev, dev);
+}
+
+static uint8_t virtio_pci_get_status(struct virtio_device *dev) {
+  return to_pci_dev(dev)->common->device_status;
+}
+
+static void virtio_pci_set_status(struct virtio_device *dev, uint8_t status) {
+  struct virtio_pci_dev *pdev = to_pci_dev(dev);
+
+  pdev->common->device_status = status;
+
+  /* a reset is only complete once the device reads back 0 */
+  if (status == 0) {
+    while (pdev->common->device_status != 0)
+      ;
+  }
+}
+
+static uint32_t virtio_pci_read_host_feature_word(struct virtio_device *dev, uint32_t word) {
+  struct virtio_pci_dev *pdev = to_pci_dev(dev);
+
+  pdev->common->device_feature_select = word;
+  return pdev->common->device_feature;
+}
+
+static void virtio_pci_set_guest_features(struct virtio_device *dev, uint32_t word,
+                                          uint32_t features) {
+  struct virtio_pci_dev *pdev = to_pci_dev(dev);
+
+  if (word < countof(pdev->guest_features))
+    pdev->guest_features[word] = features;
+
+  pdev->common->driver_feature_select = word;
+  pdev->common->driver_feature = features;
+}
+
+static status_t virtio_pci_features_ok(struct virtio_device *dev) {
+  struct virtio_pci_dev *pdev = to_pci_dev(dev);
+
+  /* drivers written against the legacy interface never ask for VERSION_1 themselves */
+  virtio_pci_set_guest_features(dev, 1,
+                                pdev->guest_features[1] | (1U << (VIRTIO_F_VERSION_1 - 32)));
+
+  pdev->common->device_status |= VIRTIO_STATUS_FEATURES_OK;
+  if ((pdev->common->device_status & VIRTIO_STATUS_FEATURES_OK) == 0)
+    return ERR_NOT_SUPPORTED;
+
+  return NO_ERROR;
+}
+
+static status_t virtio_pci_setup_ring(struct virtio_device *dev, uint index, paddr_t pa) {
+  struct virtio_pci_dev *pdev = to_pci_dev(dev);
+  volatile struct virtio_pci_common_cfg *common = pdev->common;
+  const struct vring *ring = &dev->ring[index];
+
+  common->queue_select = index;
+  if (common->queue_size == 0)
+    return ERR_NOT_FOUND;
+  if (common->queue_size < ring->num)
+    return ERR_INVALID_ARGS;
+
+  /* the split ring is laid out contiguously, hand the device each part */
+  paddr_t desc = pa;
+  paddr_t avail = pa + ((uintptr_t)ring->avail - (uintptr_t)ring->desc);
+  paddr_t used = pa + ((uintptr_t)ring->used - (uintptr_t)ring->desc);
+
+  common->queue_size = ring->num;
+  common->queue_desc_lo = (uint32_t)desc;
+  common->queue_desc_hi = (uint32_t)((uint64_t)desc >> 32);
+  common->queue_driver_lo = (uint32_t)avail;
+  common->queue_driver_hi = (uint32_t)((uint64_t)avail >> 32);
+  common->queue_device_lo = (uint32_t)used;
+  common->queue_device_hi = (uint32_t)((uint64_t)used >> 32);
+
+  if (pdev->msix) {
+    if (index + 1 >= pdev->irq_count)
+      return ERR_NO_RESOURCES;
+
+    common->queue_msix_vector = index + 1;
+    if (common->queue_msix_vector != index + 1)
+      return ERR_NO_RESOURCES;
+  }
+
+  uint32_t notify_off = common->queue_notify_off * pdev->notify_off_multiplier;
+  pdev->queue_notify[index] = (volatile uint16_t *)(pdev->notify_base + notify_off);
+
+  common->queue_enable = 1;
+
+  return NO_ERROR;
+}
+
+static void virtio_pci_kick(struct virtio_device *dev, uint ring_index) {
+  struct virtio_pci_dev *pdev = to_pci_dev(dev);
+
+  DEBUG_ASSERT(pdev->queue_notify[ring_index]);
+  *pdev->queue_notify[ring_index] = ring_index;
+}
+
+static void virtio_pci_unmask_irq(struct virtio_device *dev) {
+  struct virtio_pci_dev *pdev = to_pci_dev(dev);
+
+  for (uint i = 0; i < pdev->irq_count; i++) {
+    unmask_interrupt(pdev->irq_base + i);
+  }
+}
+
+static const struct virtio_transport virtio_pci_transport = {
+    .get_status = virtio_pci_get_status,
+    .set_status = virtio_pci_set_status,
+    .read_host_feature_word = virtio_pci_read_host_feature_word,
+    .set_guest_features = virtio_pci_set_guest_features,
+    .features_ok = virtio_pci_features_ok,
+    .setup_ring = virtio_pci_setup_ring,
+    .kick = virtio_pci_kick,
+    .unmask_irq = virtio_pci_unmask_irq,
+};
+
+static enum handler_return virtio_pci_config_irq(void *arg) {
+  struct virtio_pci_dev *pdev = arg;
+
+  return virtio_config_changed(&pdev->dev);
+}
+
+static enum handler_return virtio_pci_ring_irq(void *arg) {
+  struct virtio_pci_vector *v = arg;
+  struct virtio_device *dev = &v->pdev->dev;
+
+  if ((dev->active_rings_bitmap & (1 << v->ring)) == 0)
+    return INT_NO_RESCHEDULE;
+
+  return virtio_process_ring(dev, v->ring);
+}
+
+static enum handler_return virtio_pci_intx_irq(void *arg) {
+  struct virtio_pci_dev *pdev = arg;
+  struct virtio_device *dev = &pdev->dev;
+
+  /* reading the isr acks it */
+  uint8_t isr = *pdev->isr;
+  LTRACEF("isr 0x%x\n", isr);
+
+  enum handler_return ret = INT_NO_RESCHEDULE;
+  if (isr & VIRTIO_ISR_QUEUE) {
+    for (uint r = 0; r < MAX_VIRTIO_RINGS; r++) {
+      if (dev->active_rings_bitmap & (1 << r))
+        ret |= virtio_process_ring(dev, r);
+    }
+  }
+  if (isr & VIRTIO_ISR_CONFIG)
+    ret |= virtio_config_changed(dev);
+
+  return ret;
+}
+
+static volatile void *virtio_pci_map_cap(struct virtio_pci_dev *pdev, const pci_bar_t bars[6],
+                                         uint bar, uint32_t offset, uint32_t length) {
+  if (bar >= 6 || !bars[bar].valid || bars[bar].io || bars[bar].addr == 0)
+    return NULL;
+  if ((uint64_t)offset + length > bars[bar].size)
+    return NULL;
+
+  if (!pdev->bar_map[bar]) {
+    char name[32];
+    snprintf(name, sizeof(name), "virtio-pci %u bar%u", virtio_pci_count, bar);
+    size_t size = ROUNDUP(bars[bar].size, (size_t)PAGE_SIZE);
+    status_t err = vmm_alloc_physical(vmm_get_kernel_aspace(), name, size, &pdev->bar_map[bar], 0,
+                                      bars[bar].addr, 0, ARCH_MMU_FLAG_UNCACHED_DEVICE);
+    if (err != NO_ERROR) {
+      pdev->bar_map[bar] = NULL;
+      return NULL;
+    }
+  }
+
+  return (volatile uint8_t *)pdev->bar_map[bar] + offset;
+}
+
+/* walk the capability list looking for the virtio register blocks */
+static status_t virtio_pci_find_caps(struct virtio_pci_dev *pdev, const pci_bar_t bars[6]) {
+  uint16_t status;
+  pci_read_config_half(pdev->loc, PCI_CONFIG_STATUS, &status);
+  if ((status & PCI_STATUS_NEW_CAPS) == 0)
+    return ERR_NOT_FOUND;
+
+  uint8_t cap_ptr;
+  pci_read_config_byte(pdev->loc, PCI_CONFIG_CAPABILITIES, &cap_ptr);
+  for (uint loops = 0; cap_ptr != 0 && loops < 48; loops++) {
+    uint8_t cap_id, next, cfg_type, bar;
+    uint32_t offset, length;
+
+    cap_ptr &= ~0x3;
+    pci_read_config_byte(pdev->loc, cap_ptr, &cap_id);
+    pci_read_config_byte(pdev->loc, cap_ptr + offsetof(struct virtio_pci_cap, cap_next), &next);
+    if (cap_id != PCI_CAP_ID_VENDOR)
+      goto next;
+
+    pci_read_config_byte(pdev->loc, cap_ptr + offsetof(struct virtio_pci_cap, cfg_type),
+                         &cfg_type);
+    pci_read_config_byte(pdev->loc, cap_ptr + offsetof(struct virtio_pci_cap, bar), &bar);
+    pci_read_config_word(pdev->loc, cap_ptr + offsetof(struct virtio_pci_cap, offset), &offset);
+    pci_read_config_word(pdev->loc, cap_ptr + offsetof(struct virtio_pci_cap, length), &length);
+    LTRACEF("virtio cap type %u bar %u offset %#x length %#x\n", cfg_type, bar, offset, length);
+
+    /* the first capability of each type is the preferred one */
+    switch (cfg_type) {
+      case VIRTIO_PCI_CAP_COMMON_CFG:
+        if (!pdev->common && length >= sizeof(struct virtio_pci_common_cfg))
+          pdev->common = virtio_pci_map_cap(pdev, bars, bar, offset, length);
+        break;
+      case VIRTIO_PCI_CAP_NOTIFY_CFG:
+        if (!pdev->notify_base) {
+          pci_read_config_word(pdev->loc,
+                               cap_ptr + offsetof(struct virtio_pci_cap, notify_off_multiplier),
+                               &pdev->notify_off_multiplier);
+          pdev->notify_base = virtio_pci_map_cap(pdev, bars, bar, offset, length);
+        }
+        break;
+      case VIRTIO_PCI_CAP_ISR_CFG:
+        if (!pdev->isr)
+          pdev->isr = virtio_pci_map_cap(pdev, bars, bar, offset, length);
+        break;
+      case VIRTIO_PCI_CAP_DEVICE_CFG:
+        if (!pdev->dev.config_ptr)
+          pdev->dev.config_ptr = (void *)virtio_pci_map_cap(pdev, bars, bar, offset, length);
+        break;
+      default:
+        break;
+    }
+
+  next:
+    cap_ptr = next;
+  }
+
+  /* the device specific block is optional, some device types have no config */
+  if (!pdev->common || !pdev->notify_base || !pdev->isr)
+    return ERR_NOT_FOUND;
+
+  return NO_ERROR;
+}
+
+static status_t virtio_pci_setup_irqs(struct virtio_pci_dev *pdev) {
+  /* one vector for config changes and one per ring the drivers may use */
+  uint rings = MIN(pdev->common->num_queues, MAX_VIRTIO_RINGS);
+  uint irq_base;
+  if (pci_bus_mgr_allocate_msi(pdev->loc, rings + 1, &irq_base) == NO_ERROR) {
+    pdev->msix = true;
+    pdev->irq_base = irq_base;
+    pdev->irq_count = rings + 1;
+
+    register_int_handler_msi(irq_base, &virtio_pci_config_irq, pdev, true);
+    for (uint i = 0; i < rings; i++) {
+      pdev->vectors[i].pdev = pdev;
+      pdev->vectors[i].ring = i;
+      register_int_handler_msi(irq_base + 1 + i, &virtio_pci_ring_irq, &pdev->vectors[i], true);
+    }
+
+    pdev->common->msix_config = 0;
+    if (pdev->common->msix_config != 0)
+      TRACEF("device refused the config change vector\n");
+
+    return NO_ERROR;
+  }
+
+  status_t err = pci_bus_mgr_allocate_irq(pdev->loc, &irq_base);
+  if (err != NO_ERROR)
+    return err;
+
+  pdev->msix = false;
+  pdev->irq_base = irq_base;
+  pdev->irq_count = 1;
+  pdev->dev.irq = irq_base;
+
+  mask_interrupt(irq_base);
+  register_int_handler(irq_base, &virtio_pci_intx_irq, pdev);
+
+  return NO_ERROR;
+}
+
+static void virtio_pci_free_irqs(struct virtio_pci_dev *pdev) {
+  for (uint i = 0; i < pdev->irq_count; i++) {
+    mask_interrupt(pdev->irq_base + i);
+    register_int_handler(pdev->irq_base + i, NULL, NULL);
+  }
+  if (pdev->msix)
+    pci_bus_mgr_free_msi(pdev->loc, pdev->irq_base, pdev->irq_count);
+  pdev->irq_count = 0;
+}
+
+static status_t virtio_pci_probe(pci_location_t loc, uint device_type) {
+  char str[14];
+
+  struct virtio_pci_dev *pdev = calloc(1, sizeof(*pdev));
+  if (!pdev)
+    return ERR_NO_MEMORY;
+
+  pdev->loc = loc;
+  pdev->dev.index = virtio_pci_count;
+  pdev->dev.transport = &virtio_pci_transport;
+  pdev->dev.version_1 = true;
+
+  pci_bar_t bars[6];
+  status_t err = pci_bus_mgr_read_bars(loc, bars);
+  if (err != NO_ERROR)
+    goto err;
+
+  err = virtio_pci_find_caps(pdev, bars);
+  if (err != NO_ERROR) {
+    dprintf(INFO, "virtio-pci %s: no 1.x capabilities, legacy only device?\n",
+            pci_loc_string(loc, str));
+    goto err;
+  }
+
+  pci_bus_mgr_enable_device(loc);
+
+  /* legacy only devices do not offer VERSION_1 */
+  virtio_reset_device(&pdev->dev);
+  if ((virtio_read_host_feature_word(&pdev->dev, 1) & (1U << (VIRTIO_F_VERSION_1 - 32))) == 0) {
+    err = ERR_NOT_SUPPORTED;
+    goto err;
+  }
+
+  err = virtio_pci_setup_irqs(pdev);
+  if (err != NO_ERROR)
+    goto err;
+
+  dprintf(INFO, "virtio-pci %s: type %u, %u queues, %s irq %u\n", pci_loc_string(loc, str),
+          device_type, pdev->common->num_queues, pdev->msix ? "msi-x" : "intx", pdev->irq_base);
+
+  err = virtio_probe_driver(&pdev->dev, device_type);
+  if (err < 0) {
+    /* no driver took it, quiet the device before letting go of it */
+    virtio_reset_device(&pdev->dev);
+    virtio_pci_free_irqs(pdev);
+    goto err;
+  }
+
+  virtio_pci_count++;
+
+  return NO_ERROR;
+
+err:
+  for (uint i = 0; i < countof(pdev->bar_map); i++) {
+    if (pdev->bar_map[i])
+      vmm_free_region(vmm_get_kernel_aspace(), (vaddr_t)pdev->bar_map[i]);
+  }
+  free(pdev);
+  return err;
+}
+
+static void virtio_pci_init(uint level) {
+  LTRACE_ENTRY;
+
+  for (size_t i = 0;; i++) {
+    pci_location_t loc;
+    status_t err = pci_bus_mgr_find_device(&loc, 0xffff, VIRTIO_PCI_VENDOR_ID, i);
+    if (err != NO_ERROR)
+      break;
+
+    uint16_t device_id;
+    pci_read_config_half(loc, PCI_CONFIG_DEVICE_ID, &device_id);
+
+    /* transitional devices carry the virtio type in the subsystem id */
+    uint device_type;
+    if (device_id >= VIRTIO_PCI_DEVICE_ID_MODERN_BASE &&
+        device_id <= VIRTIO_PCI_DEVICE_ID_MODERN_LAST) {
+      device_type = device_id - VIRTIO_PCI_DEVICE_ID_MODERN_BASE;
+    } else if (device_id >= VIRTIO_PCI_DEVICE_ID_LEGACY_BASE &&
+               device_id <= VIRTIO_PCI_DEVICE_ID_LEGACY_LAST) {
+      uint16_t subsys_id;
+      pci_read_config_half(loc, PCI_CONFIG_SUBSYS_ID, &subsys_id);
+      device_type = subsys_id;
+    } else {
+      continue;
+    }
+
+    virtio_pci_probe(loc, device_type);
+  }
+}
+
+LK_INIT_HOOK(virtio_pci, &virtio_pci_init, LK_INIT_LEVEL_PLATFORM + 1);
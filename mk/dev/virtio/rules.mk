@@ -5,4 +5,7 @@ MODULE := $(LOCAL_DIR)
 MODULE_SRCS += \
 	$(LOCAL_DIR)/virtio.c
 
+MODULE_DEPS += \
+	lib/slab
+
 include make/module.mk
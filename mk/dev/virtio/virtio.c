@@ -6,6 +6,8 @@
  * https://opensource.org/licenses/MIT
  */
 #include <assert.h>
+#include <inttypes.h>
+#include <lib/slab.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -13,6 +15,7 @@
 #include <dev/virtio/virtio_ring.h>
 #include <kernel/thread.h>
 #include <lk/compiler.h>
+#include <lk/console_cmd.h>
 #include <lk/debug.h>
 #include <lk/err.h>
 #include <lk/init.h>
@@ -43,6 +46,15 @@
 
 static struct virtio_device *devices;
 
+/* every device with a driver attached, on any transport */
+static struct list_node virtio_devices = LIST_INITIAL_VALUE(virtio_devices);
+
+/* indirect tables are naturally aligned so they never straddle a page */
+#define VIRTIO_INDIRECT_TABLE_SIZE (VIRTIO_INDIRECT_MAX_DESC * sizeof(struct vring_desc))
+static slab_cache_t indirect_cache =
+    SLAB_CACHE_INITIAL_VALUE(indirect_cache, "virtio_indirect", VIRTIO_INDIRECT_TABLE_SIZE,
+                             VIRTIO_INDIRECT_TABLE_SIZE, NULL, NULL);
+
 static void dump_mmio_config(const volatile struct virtio_mmio_config *mmio) {
   printf("mmio at %p\n", mmio);
   printf("\tmagic 0x%x\n", mmio->magic);
@@ -68,6 +80,114 @@ void virtio_dump_desc(const struct vring_desc *desc) {
   printf("\tnext  0x%hx\n", desc->next);
 }
 
+enum handler_return virtio_process_ring(struct virtio_device *dev, uint ring_index) {
+  struct vring *ring = &dev->ring[ring_index];
+  LTRACEF("ring %u: used flags 0x%hx idx 0x%hx last_used %u\n", ring_index, ring->used->flags,
+          ring->used->idx, ring->last_used);
+
+  ring->stats.irqs++;
+
+  if (dev->polled_rings_bitmap & (1 << ring_index)) {
+    /* the driver drains it, just keep the device quiet until it is done */
+    virtio_ring_disable_irq(dev, ring_index);
+    DEBUG_ASSERT(dev->ring_poll_callback);
+    return dev->ring_poll_callback(dev, ring_index);
+  }
+
+  enum handler_return ret = INT_NO_RESCHEDULE;
+  for (;;) {
+    uint16_t cur_idx = ring->used->idx;
+    mb();
+    while (ring->last_used != cur_idx) {
+      uint i = ring->last_used & ring->num_mask;
+      LTRACEF("looking at idx %u\n", i);
+
+      // process chain
+      struct vring_used_elem *used_elem = &ring->used->ring[i];
+      LTRACEF("id %u, len %u\n", used_elem->id, used_elem->len);
+
+      DEBUG_ASSERT(dev->irq_driver_callback);
+      ret |= dev->irq_driver_callback(dev, ring_index, used_elem);
+
+      ring->last_used++;
+      ring->stats.completions++;
+    }
+
+    if (!dev->event_idx || ring->irq_disabled)
+      break;
+
+    /* ask for an interrupt on the next completion, then close the race with the device */
+    vring_used_event(ring) = ring->last_used;
+    mb();
+    if (ring->used->idx == ring->last_used)
+      break;
+  }
+
+  return ret;
+}
+
+void virtio_ring_disable_irq(struct virtio_device *dev, uint ring_index) {
+  struct vring *ring = &dev->ring[ring_index];
+
+  /* with event indexes the device simply won't pass the stale used event again */
+  ring->irq_disabled = true;
+  ring->avail->flags |= VRING_AVAIL_F_NO_INTERRUPT;
+}
+
+bool virtio_ring_enable_irq(struct virtio_device *dev, uint ring_index) {
+  struct vring *ring = &dev->ring[ring_index];
+
+  ring->irq_disabled = false;
+  ring->avail->flags &= ~VRING_AVAIL_F_NO_INTERRUPT;
+  if (dev->event_idx)
+    vring_used_event(ring) = ring->last_used;
+  mb();
+
+  return ring->used->idx != ring->last_used;
+}
+
+void virtio_ring_set_polled(struct virtio_device *dev, uint ring_index) {
+  DEBUG_ASSERT(ring_index < MAX_VIRTIO_RINGS);
+  DEBUG_ASSERT(dev->ring_poll_callback);
+
+  dev->polled_rings_bitmap |= (1 << ring_index);
+}
+
+uint virtio_poll_ring(struct virtio_device *dev, uint ring_index, uint budget,
+                      virtio_poll_callback cb, void *arg) {
+  struct vring *ring = &dev->ring[ring_index];
+
+  DEBUG_ASSERT(dev->polled_rings_bitmap & (1 << ring_index));
+
+  ring->stats.polls++;
+
+  uint count = 0;
+  uint16_t cur_idx = ring->used->idx;
+  mb();
+  while (count < budget && ring->last_used != cur_idx) {
+    struct vring_used_elem *used_elem = &ring->used->ring[ring->last_used & ring->num_mask];
+    LTRACEF("ring %u: id %u, len %u\n", ring_index, used_elem->id, used_elem->len);
+
+    cb(dev, ring_index, used_elem, arg);
+
+    ring->last_used++;
+    ring->stats.completions++;
+    count++;
+  }
+
+  if (count == budget)
+    ring->stats.polls_exhausted++;
+
+  return count;
+}
+
+enum handler_return virtio_config_changed(struct virtio_device *dev) {
+  if (dev->config_change_callback) {
+    return dev->config_change_callback(dev);
+  }
+  return INT_NO_RESCHEDULE;
+}
+
 static enum handler_return virtio_mmio_irq(void *arg) {
   struct virtio_device *dev = (struct virtio_device *)arg;
   LTRACEF("dev %p, index %u\n", dev, dev->index);
@@ -76,41 +196,22 @@ static enum handler_return virtio_mmio_irq(void *arg) {
   LTRACEF("status 0x%x\n", irq_status);
 
   enum handler_return ret = INT_NO_RESCHEDULE;
-  if (irq_status & 0x1) { /* used ring update */
+  if (irq_status & VIRTIO_ISR_QUEUE) { /* used ring update */
     // XXX is this safe?
-    dev->mmio_config->interrupt_ack = 0x1;
+    dev->mmio_config->interrupt_ack = VIRTIO_ISR_QUEUE;
 
     /* cycle through all the active rings */
     for (uint r = 0; r < MAX_VIRTIO_RINGS; r++) {
       if ((dev->active_rings_bitmap & (1 << r)) == 0)
         continue;
 
-      struct vring *ring = &dev->ring[r];
-      LTRACEF("ring %u: used flags 0x%hx idx 0x%hx last_used %u\n", r, ring->used->flags,
-              ring->used->idx, ring->last_used);
-
-      uint cur_idx = ring->used->idx;
-      for (uint i = ring->last_used; i != (cur_idx & ring->num_mask);
-           i = (i + 1) & ring->num_mask) {
-        LTRACEF("looking at idx %u\n", i);
-
-        // process chain
-        struct vring_used_elem *used_elem = &ring->used->ring[i];
-        LTRACEF("id %u, len %u\n", used_elem->id, used_elem->len);
-
-        DEBUG_ASSERT(dev->irq_driver_callback);
-        ret |= dev->irq_driver_callback(dev, r, used_elem);
-
-        ring->last_used = (ring->last_used + 1) & ring->num_mask;
-      }
+      ret |= virtio_process_ring(dev, r);
     }
   }
-  if (irq_status & 0x2) { /* config change */
-    dev->mmio_config->interrupt_ack = 0x2;
+  if (irq_status & VIRTIO_ISR_CONFIG) { /* config change */
+    dev->mmio_config->interrupt_ack = VIRTIO_ISR_CONFIG;
 
-    if (dev->config_change_callback) {
-      ret |= dev->config_change_callback(dev);
-    }
+    ret |= virtio_config_changed(dev);
   }
 
   LTRACEF("exiting irq\n");
@@ -118,6 +219,107 @@ static enum handler_return virtio_mmio_irq(void *arg) {
   return ret;
 }
 
+static uint8_t virtio_mmio_get_status(struct virtio_device *dev) {
+  return dev->mmio_config->status;
+}
+
+static void virtio_mmio_set_status(struct virtio_device *dev, uint8_t status) {
+  dev->mmio_config->status = status;
+}
+
+static uint32_t virtio_mmio_read_host_feature_word(struct virtio_device *dev, uint32_t word) {
+  dev->mmio_config->host_features_sel = word;
+  return dev->mmio_config->host_features;
+}
+
+static void virtio_mmio_set_guest_features(struct virtio_device *dev, uint32_t word,
+                                           uint32_t features) {
+  dev->mmio_config->guest_features_sel = word;
+  dev->mmio_config->guest_features = features;
+}
+
+static status_t virtio_mmio_setup_ring(struct virtio_device *dev, uint index, paddr_t pa) {
+  DEBUG_ASSERT(dev->mmio_config);
+  dev->mmio_config->guest_page_size = PAGE_SIZE;
+  dev->mmio_config->queue_sel = index;
+  dev->mmio_config->queue_num = dev->ring[index].num;
+  dev->mmio_config->queue_align = PAGE_SIZE;
+  dev->mmio_config->queue_pfn = pa / PAGE_SIZE;
+
+  return NO_ERROR;
+}
+
+static void virtio_mmio_kick(struct virtio_device *dev, uint ring_index) {
+  dev->mmio_config->queue_notify = ring_index;
+}
+
+static void virtio_mmio_unmask_irq(struct virtio_device *dev) { unmask_interrupt(dev->irq); }
+
+static const struct virtio_transport virtio_mmio_transport = {
+    .get_status = virtio_mmio_get_status,
+    .set_status = virtio_mmio_set_status,
+    .read_host_feature_word = virtio_mmio_read_host_feature_word,
+    .set_guest_features = virtio_mmio_set_guest_features,
+    .setup_ring = virtio_mmio_setup_ring,
+    .kick = virtio_mmio_kick,
+    .unmask_irq = virtio_mmio_unmask_irq,
+};
+
+status_t virtio_probe_driver(struct virtio_device *dev, uint device_id) {
+  status_t err = ERR_NOT_SUPPORTED;
+
+  switch (device_id) {
+#if WITH_DEV_VIRTIO_BLOCK
+    case 2:  // block device
+      LTRACEF("found block device\n");
+      err = virtio_block_init(dev, virtio_read_host_feature_word(dev, 0));
+      break;
+#endif  // WITH_DEV_VIRTIO_BLOCK
+#if WITH_DEV_VIRTIO_NET
+    case 1:  // network device
+      LTRACEF("found net device\n");
+      err = virtio_net_init(dev);
+      break;
+#endif  // WITH_DEV_VIRTIO_NET
+#if WITH_DEV_VIRTIO_9P
+    case 9:  // 9p device
+      LTRACEF("found 9p device\n");
+      err = virtio_9p_init(dev, virtio_read_host_feature_word(dev, 0));
+      break;
+#endif  // WITH_DEV_VIRTIO_9P
+#if WITH_DEV_VIRTIO_GPU
+    case 0x10:  // virtio-gpu
+      LTRACEF("found gpu device\n");
+      err = virtio_gpu_init(dev, virtio_read_host_feature_word(dev, 0));
+      break;
+#endif  // WITH_DEV_VIRTIO_GPU
+    default:
+      break;
+  }
+
+  if (err < 0)
+    return err;
+
+  // good device
+  dev->valid = true;
+  dev->device_id = device_id;
+  list_add_tail(&virtio_devices, &dev->node);
+
+  if (dev->irq_driver_callback)
+    dev->transport->unmask_irq(dev);
+
+#if WITH_DEV_VIRTIO_9P
+  if (device_id == 9)
+    virtio_9p_start(dev);
+#endif
+#if WITH_DEV_VIRTIO_GPU
+  if (device_id == 0x10)
+    virtio_gpu_start(dev);
+#endif
+
+  return NO_ERROR;
+}
+
 int virtio_mmio_detect(void *ptr, uint count, const uint irqs[], size_t stride) {
   LTRACEF("ptr %p, count %u\n", ptr, count);
 
@@ -138,6 +340,7 @@ int virtio_mmio_detect(void *ptr, uint count, const uint irqs[], size_t stride)
 
     dev->index = i;
     dev->irq = irqs[i];
+    dev->transport = &virtio_mmio_transport;
 
     mask_interrupt(irqs[i]);
     register_int_handler(irqs[i], &virtio_mmio_irq, (void *)dev);
@@ -157,78 +360,16 @@ int virtio_mmio_detect(void *ptr, uint count, const uint irqs[], size_t stride)
     }
 #endif
 
-#if WITH_DEV_VIRTIO_BLOCK
-    if (mmio->device_id == 2) {  // block device
-      LTRACEF("found block device\n");
-
-      dev->mmio_config = mmio;
-      dev->config_ptr = (void *)mmio->config;
-
-      status_t err = virtio_block_init(dev, virtio_read_host_feature_word(dev, 0));
-      if (err >= 0) {
-        // good device
-        dev->valid = true;
-
-        if (dev->irq_driver_callback)
-          unmask_interrupt(dev->irq);
-      }
-    }
-#endif  // WITH_DEV_VIRTIO_BLOCK
-#if WITH_DEV_VIRTIO_NET
-    if (mmio->device_id == 1) {  // network device
-      LTRACEF("found net device\n");
-
-      dev->mmio_config = mmio;
-      dev->config_ptr = (void *)mmio->config;
-
-      status_t err = virtio_net_init(dev);
-      if (err >= 0) {
-        // good device
-        dev->valid = true;
-
-        if (dev->irq_driver_callback)
-          unmask_interrupt(dev->irq);
-      }
-    }
-#endif  // WITH_DEV_VIRTIO_NET
-#if WITH_DEV_VIRTIO_9P
-    if (mmio->device_id == 9) {  // 9p device
-      LTRACEF("found 9p device\n");
-
-      dev->mmio_config = mmio;
-      dev->config_ptr = (void *)mmio->config;
-
-      status_t err = virtio_9p_init(dev, mmio->host_features);
-      if (err >= 0) {
-        // good device
-        dev->valid = true;
-
-        if (dev->irq_driver_callback)
-          unmask_interrupt(dev->irq);
-
-        virtio_9p_start(dev);
-      }
-    }
-#endif  // WITH_DEV_VIRTIO_9P
-#if WITH_DEV_VIRTIO_GPU
-    if (mmio->device_id == 0x10) {  // virtio-gpu
-      LTRACEF("found gpu device\n");
-
-      dev->mmio_config = mmio;
-      dev->config_ptr = (void *)mmio->config;
-
-      status_t err = virtio_gpu_init(dev, virtio_read_host_feature_word(dev, 0));
-      if (err >= 0) {
-        // good device
-        dev->valid = true;
+    if (mmio->device_id == 0)
+      continue;
 
-        if (dev->irq_driver_callback)
-          unmask_interrupt(dev->irq);
+    dev->mmio_config = mmio;
+    dev->config_ptr = (void *)mmio->config;
 
-        virtio_gpu_start(dev);
-      }
+    if (virtio_probe_driver(dev, mmio->device_id) < 0) {
+      dev->mmio_config = NULL;
+      dev->config_ptr = NULL;
     }
-#endif  // WITH_DEV_VIRTIO_GPU
 
     if (dev->valid)
       found++;
@@ -240,6 +381,12 @@ int virtio_mmio_detect(void *ptr, uint count, const uint irqs[], size_t stride)
 void virtio_free_desc(struct virtio_device *dev, uint ring_index, uint16_t desc_index) {
   LTRACEF("dev %p ring %u index %u free_count %u\n", dev, ring_index, desc_index,
           dev->ring[ring_index].free_count);
+  struct vring *ring = &dev->ring[ring_index];
+  if (ring->indirect && ring->indirect[desc_index]) {
+    slab_cache_free(&indirect_cache, ring->indirect[desc_index]);
+    ring->indirect[desc_index] = NULL;
+  }
+
   dev->ring[ring_index].desc[desc_index].next = dev->ring[ring_index].free_list;
   dev->ring[ring_index].free_list = desc_index;
   dev->ring[ring_index].free_count++;
@@ -294,6 +441,45 @@ struct vring_desc *virtio_alloc_desc_chain(struct virtio_device *dev, uint ring_
   return last;
 }
 
+struct vring_desc *virtio_alloc_indirect_chain(struct virtio_device *dev, uint ring_index,
+                                               size_t count, uint16_t *start_index) {
+  struct vring *ring = &dev->ring[ring_index];
+
+  if (!ring->indirect || count == 0 || count > VIRTIO_INDIRECT_MAX_DESC)
+    return NULL;
+
+  struct vring_desc *table = slab_cache_alloc(&indirect_cache);
+  if (!table)
+    return NULL;
+
+  uint16_t i = virtio_alloc_desc(dev, ring_index);
+  if (i == 0xffff) {
+    slab_cache_free(&indirect_cache, table);
+    return NULL;
+  }
+
+  for (size_t n = 0; n < count; n++) {
+    table[n].flags = (n + 1 < count) ? VRING_DESC_F_NEXT : 0;
+    table[n].next = n + 1 < count ? n + 1 : 0;
+  }
+
+  struct vring_desc *desc = &ring->desc[i];
+#if WITH_KERNEL_VM
+  desc->addr = vaddr_to_paddr(table);
+#else
+  desc->addr = (uint64_t)(uintptr_t)table;
+#endif
+  desc->len = count * sizeof(struct vring_desc);
+  desc->flags = VRING_DESC_F_INDIRECT;
+  desc->next = 0;
+  ring->indirect[i] = table;
+
+  if (start_index)
+    *start_index = i;
+
+  return table;
+}
+
 void virtio_submit_chain(struct virtio_device *dev, uint ring_index, uint16_t desc_index) {
   LTRACEF("dev %p, ring %u, desc %u\n", dev, ring_index, desc_index);
 
@@ -303,6 +489,7 @@ void virtio_submit_chain(struct virtio_device *dev, uint ring_index, uint16_t de
   avail->ring[avail->idx & dev->ring[ring_index].num_mask] = desc_index;
   mb();
   avail->idx++;
+  dev->ring[ring_index].stats.submitted++;
 
 #if LOCAL_TRACE
   hexdump(avail, 16);
@@ -312,10 +499,57 @@ void virtio_submit_chain(struct virtio_device *dev, uint ring_index, uint16_t de
 void virtio_kick(struct virtio_device *dev, uint ring_index) {
   LTRACEF("dev %p, ring %u\n", dev, ring_index);
 
-  dev->mmio_config->queue_notify = ring_index;
+  struct vring *ring = &dev->ring[ring_index];
+
+  /* publish avail->idx before looking at what the device asked for */
+  mb();
+
+  uint16_t new_idx = ring->avail->idx;
+  uint16_t old_idx = ring->kicked_avail;
+  ring->kicked_avail = new_idx;
+
+  bool notify;
+  if (dev->event_idx) {
+    notify = vring_need_event(vring_avail_event(ring), new_idx, old_idx);
+  } else {
+    notify = !(ring->used->flags & VRING_USED_F_NO_NOTIFY);
+  }
+
+  if (!notify) {
+    ring->stats.notifies_suppressed++;
+    return;
+  }
+
+  ring->stats.notifies++;
+  dev->transport->kick(dev, ring_index);
   mb();
 }
 
+/*
+ * Legacy drivers set their features and go straight to ring setup, so the
+ * rest of the handshake (ring features, FEATURES_OK on 1.x devices) is done
+ * on their behalf the first time it is needed.
+ */
+static status_t virtio_features_ok(struct virtio_device *dev) {
+  if (dev->features_ok)
+    return NO_ERROR;
+
+  if (!dev->features_set)
+    virtio_set_guest_features(dev, 0, 0);
+
+  if (dev->transport->features_ok) {
+    status_t err = dev->transport->features_ok(dev);
+    if (err < 0) {
+      TRACEF("device %u rejected the feature set\n", dev->index);
+      dev->transport->set_status(dev, dev->transport->get_status(dev) | VIRTIO_STATUS_FAILED);
+      return err;
+    }
+  }
+
+  dev->features_ok = true;
+  return NO_ERROR;
+}
+
 status_t virtio_alloc_ring(struct virtio_device *dev, uint index, uint16_t len) {
   LTRACEF("dev %p, index %u, len %u\n", dev, index, len);
 
@@ -328,14 +562,19 @@ status_t virtio_alloc_ring(struct virtio_device *dev, uint index, uint16_t len)
 
   struct vring *ring = &dev->ring[index];
 
+  /* features are frozen once a ring is live on 1.x devices, and decide the ring layout */
+  status_t err = virtio_features_ok(dev);
+  if (err < 0)
+    return err;
+
   /* allocate a ring */
   size_t size = vring_size(len, PAGE_SIZE);
   LTRACEF("need %zu bytes\n", size);
 
 #if WITH_KERNEL_VM
   void *vptr;
-  status_t err = vmm_alloc_contiguous(vmm_get_kernel_aspace(), "virtio_ring", size, &vptr, 0, 0,
-                                      ARCH_MMU_FLAG_UNCACHED_DEVICE);
+  err = vmm_alloc_contiguous(vmm_get_kernel_aspace(), "virtio_ring", size, &vptr, 0, 0,
+                             ARCH_MMU_FLAG_UNCACHED_DEVICE);
   if (err < 0)
     return ERR_NO_MEMORY;
 
@@ -371,13 +610,18 @@ status_t virtio_alloc_ring(struct virtio_device *dev, uint index, uint16_t len)
     virtio_free_desc(dev, index, i);
   }
 
+  memset(&ring->stats, 0, sizeof(ring->stats));
+  ring->indirect = NULL;
+  if (dev->indirect_desc) {
+    ring->indirect = calloc(len, sizeof(struct vring_desc *));
+    if (!ring->indirect)
+      return ERR_NO_MEMORY;
+  }
+
   /* register the ring with the device */
-  DEBUG_ASSERT(dev->mmio_config);
-  dev->mmio_config->guest_page_size = PAGE_SIZE;
-  dev->mmio_config->queue_sel = index;
-  dev->mmio_config->queue_num = len;
-  dev->mmio_config->queue_align = PAGE_SIZE;
-  dev->mmio_config->queue_pfn = pa / PAGE_SIZE;
+  err = dev->transport->setup_ring(dev, index, pa);
+  if (err < 0)
+    return err;
 
   /* mark the ring active */
   dev->active_rings_bitmap |= (1 << index);
@@ -385,26 +629,115 @@ status_t virtio_alloc_ring(struct virtio_device *dev, uint index, uint16_t len)
   return NO_ERROR;
 }
 
-void virtio_reset_device(struct virtio_device *dev) { dev->mmio_config->status = 0; }
+void virtio_reset_device(struct virtio_device *dev) {
+  dev->transport->set_status(dev, 0);
+  dev->features_set = false;
+  dev->features_ok = false;
+  dev->event_idx = false;
+  dev->indirect_desc = false;
+}
 
 void virtio_status_acknowledge_driver(struct virtio_device *dev) {
-  dev->mmio_config->status |= VIRTIO_STATUS_ACKNOWLEDGE | VIRTIO_STATUS_DRIVER;
+  dev->transport->set_status(
+      dev, dev->transport->get_status(dev) | VIRTIO_STATUS_ACKNOWLEDGE | VIRTIO_STATUS_DRIVER);
 }
 
 void virtio_status_driver_ok(struct virtio_device *dev) {
-  dev->mmio_config->status |= VIRTIO_STATUS_DRIVER_OK;
+  if (virtio_features_ok(dev) < 0)
+    return;
+
+  dev->transport->set_status(dev, dev->transport->get_status(dev) | VIRTIO_STATUS_DRIVER_OK);
 }
 
 void virtio_set_guest_features(struct virtio_device *dev, uint32_t word, uint32_t features) {
-  dev->mmio_config->guest_features_sel = word;
-  dev->mmio_config->guest_features = features;
+  if (word == 0) {
+    /* ring features are handled here, whatever the driver */
+    uint32_t host_features = virtio_read_host_feature_word(dev, 0);
+    dev->event_idx = host_features & (1U << VIRTIO_RING_F_EVENT_IDX);
+    dev->indirect_desc = host_features & (1U << VIRTIO_RING_F_INDIRECT_DESC);
+    if (dev->event_idx)
+      features |= 1U << VIRTIO_RING_F_EVENT_IDX;
+    if (dev->indirect_desc)
+      features |= 1U << VIRTIO_RING_F_INDIRECT_DESC;
+    dev->features_set = true;
+  }
+
+  dev->transport->set_guest_features(dev, word, features);
 }
 
 uint32_t virtio_read_host_feature_word(struct virtio_device *dev, uint32_t word) {
-  dev->mmio_config->host_features_sel = word;
-  return dev->mmio_config->host_features;
+  return dev->transport->read_host_feature_word(dev, word);
+}
+
+static const char *virtio_device_name(uint device_id) {
+  switch (device_id) {
+    case 1:
+      return "net";
+    case 2:
+      return "block";
+    case 9:
+      return "9p";
+    case 0x10:
+      return "gpu";
+    default:
+      return "unknown";
+  }
 }
 
+static void virtio_dump_stats(void) {
+  struct virtio_device *dev;
+  list_for_every_entry (&virtio_devices, dev, struct virtio_device, node) {
+    printf("virtio %u (%s): event_idx %d indirect %d\n", dev->index,
+           virtio_device_name(dev->device_id), dev->event_idx, dev->indirect_desc);
+    for (uint r = 0; r < MAX_VIRTIO_RINGS; r++) {
+      if ((dev->active_rings_bitmap & (1 << r)) == 0)
+        continue;
+
+      const struct vring_stats *st = &dev->ring[r].stats;
+      uint64_t exits = st->notifies + st->irqs;
+      printf("\tring %u: submitted %" PRIu64 " completed %" PRIu64 " notifies %" PRIu64
+             " (suppressed %" PRIu64 ") irqs %" PRIu64 " exits/100 chains %" PRIu64 "\n",
+             r, st->submitted, st->completions, st->notifies, st->notifies_suppressed, st->irqs,
+             st->submitted ? exits * 100 / st->submitted : 0);
+      if (dev->polled_rings_bitmap & (1 << r)) {
+        printf("\t\tpolls %" PRIu64 " (budget exhausted %" PRIu64 ") completions/poll %" PRIu64
+               "\n",
+               st->polls, st->polls_exhausted, st->polls ? st->completions / st->polls : 0);
+      }
+    }
+  }
+}
+
+static int cmd_virtio(int argc, const cmd_args *argv, uint32_t flags) {
+  if (argc < 2) {
+  usage:
+    printf("usage:\n");
+    printf("\t%s stats\n", argv[0].str);
+    printf("\t%s reset\n", argv[0].str);
+    return -1;
+  }
+
+  if (!strcmp(argv[1].str, "stats")) {
+    virtio_dump_stats();
+  } else if (!strcmp(argv[1].str, "reset")) {
+    struct virtio_device *dev;
+    list_for_every_entry (&virtio_devices, dev, struct virtio_device, node) {
+      for (uint r = 0; r < MAX_VIRTIO_RINGS; r++) {
+        memset(&dev->ring[r].stats, 0, sizeof(dev->ring[r].stats));
+      }
+    }
+  } else {
+    printf("unrecognized command\n");
+    goto usage;
+  }
+
+  return 0;
+}
+
+STATIC_COMMAND_START
+STATIC_COMMAND("virtio", "virtio ring stats", &cmd_virtio)
+STATIC_COMMAND_END(virtio);
+
 static void virtio_init(uint level) {}
 
 LK_INIT_HOOK(virtio, &virtio_init, LK_INIT_LEVEL_THREADING);
@@ -8,7 +8,9 @@
 #pragma once
 
 #include <stdint.h>
+#include <sys/types.h>
 
+#include <dev/virtio.h>
 #include <lk/compiler.h>
 
 // V1 config
@@ -59,3 +61,95 @@ STATIC_ASSERT(sizeof(struct virtio_mmio_config) == 0x100);
 #define VIRTIO_STATUS_FEATURES_OK (1 << 3)
 #define VIRTIO_STATUS_DEVICE_NEEDS_RESET (1 << 6)
 #define VIRTIO_STATUS_FAILED (1 << 7)
+
+#define VIRTIO_F_VERSION_1 32
+
+/* V1.x pci transport, located through vendor specific pci capabilities */
+#define VIRTIO_PCI_VENDOR_ID 0x1af4
+#define VIRTIO_PCI_DEVICE_ID_LEGACY_BASE 0x1000
+#define VIRTIO_PCI_DEVICE_ID_LEGACY_LAST 0x103f
+#define VIRTIO_PCI_DEVICE_ID_MODERN_BASE 0x1040
+#define VIRTIO_PCI_DEVICE_ID_MODERN_LAST 0x107f
+
+#define VIRTIO_PCI_CAP_COMMON_CFG 1
+#define VIRTIO_PCI_CAP_NOTIFY_CFG 2
+#define VIRTIO_PCI_CAP_ISR_CFG 3
+#define VIRTIO_PCI_CAP_DEVICE_CFG 4
+#define VIRTIO_PCI_CAP_PCI_CFG 5
+
+struct virtio_pci_cap {
+  uint8_t cap_vndr;
+  uint8_t cap_next;
+  uint8_t cap_len;
+  uint8_t cfg_type;
+  uint8_t bar;
+  uint8_t id;
+  uint8_t padding[2];
+  uint32_t offset;
+  uint32_t length;
+  /* VIRTIO_PCI_CAP_NOTIFY_CFG only */
+  uint32_t notify_off_multiplier;
+};
+
+struct virtio_pci_common_cfg {
+  /* 0x00 */
+  uint32_t device_feature_select;
+  uint32_t device_feature;
+  uint32_t driver_feature_select;
+  uint32_t driver_feature;
+  /* 0x10 */
+  uint16_t msix_config;
+  uint16_t num_queues;
+  uint8_t device_status;
+  uint8_t config_generation;
+  /* per queue, selected by queue_select */
+  uint16_t queue_select;
+  uint16_t queue_size;
+  uint16_t queue_msix_vector;
+  uint16_t queue_enable;
+  uint16_t queue_notify_off;
+  /* 0x20, 64bit registers written as two halves */
+  uint32_t queue_desc_lo;
+  uint32_t queue_desc_hi;
+  uint32_t queue_driver_lo;
+  uint32_t queue_driver_hi;
+  /* 0x30 */
+  uint32_t queue_device_lo;
+  uint32_t queue_device_hi;
+};
+
+STATIC_ASSERT(sizeof(struct virtio_pci_common_cfg) == 0x38);
+
+#define VIRTIO_PCI_NO_VECTOR 0xffff
+
+#define VIRTIO_ISR_QUEUE (1 << 0)
+#define VIRTIO_ISR_CONFIG (1 << 1)
+
+/*
+ * Bus specific half of a virtio device. The generic code in virtio.c drives
+ * the status/feature handshake and ring layout, the transport only knows how
+ * to reach the registers.
+ */
+struct virtio_transport {
+  uint8_t (*get_status)(struct virtio_device *dev);
+  void (*set_status)(struct virtio_device *dev, uint8_t status);
+  uint32_t (*read_host_feature_word)(struct virtio_device *dev, uint32_t word);
+  void (*set_guest_features)(struct virtio_device *dev, uint32_t word, uint32_t features);
+
+  /* optional, finish feature negotiation (FEATURES_OK) before the first ring goes live */
+  status_t (*features_ok)(struct virtio_device *dev);
+
+  /* hand an initialized ring at physical address pa to the device */
+  status_t (*setup_ring)(struct virtio_device *dev, uint index, paddr_t pa);
+  void (*kick)(struct virtio_device *dev, uint ring_index);
+
+  /* called once a driver has attached and installed its callbacks */
+  void (*unmask_irq)(struct virtio_device *dev);
+};
+
+/* find and start the driver for a virtio device type, marks the device valid on success */
+status_t virtio_probe_driver(struct virtio_device *dev, uint device_id);
+
+/* interrupt time helpers shared by the transports */
+enum handler_return virtio_process_ring(struct virtio_device *dev, uint ring_index);
+enum handler_return virtio_config_changed(struct virtio_device *dev);
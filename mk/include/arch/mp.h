@@ -17,7 +17,7 @@
 __BEGIN_CDECLS
 
 /* send inter processor interrupt, if supported */
-status_t arch_mp_send_ipi(mp_cpu_mask_t target, mp_ipi_t ipi);
+status_t arch_mp_send_ipi(const mp_cpu_mask_t *target, mp_ipi_t ipi);
 
 void arch_mp_init_percpu(void);
 
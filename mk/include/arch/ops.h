@@ -40,6 +40,9 @@ void arch_clean_invalidate_cache_range(addr_t start, size_t len);
 void arch_invalidate_cache_range(addr_t start, size_t len);
 void arch_sync_cache_range(addr_t start, size_t len);
 
+/* zero a page, bypassing the cache where possible. used on pages nobody is about to touch */
+void arch_zero_page(void *ptr);
+
 void arch_idle(void);
 
 __END_CDECLS
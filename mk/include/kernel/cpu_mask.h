@@ -0,0 +1,161 @@
+// Copyright 2025 Mist Tecnologia Ltda
+//
+// Use of this source code is governed by a MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT
+
+#ifndef MK_INCLUDE_KERNEL_CPU_MASK_H_
+#define MK_INCLUDE_KERNEL_CPU_MASK_H_
+
+#include <limits.h>
+#include <stdbool.h>
+#include <sys/types.h>
+
+#include <lk/compiler.h>
+
+__BEGIN_CDECLS
+
+/* a set of cpus, one bit for each of the SMP_MAX_CPUS */
+#define MP_CPU_MASK_BITS_PER_WORD (sizeof(unsigned long) * CHAR_BIT)
+#define MP_CPU_MASK_WORDS \
+  ((SMP_MAX_CPUS + MP_CPU_MASK_BITS_PER_WORD - 1) / MP_CPU_MASK_BITS_PER_WORD)
+
+typedef struct mp_cpu_mask {
+  unsigned long bits[MP_CPU_MASK_WORDS];
+} mp_cpu_mask_t;
+
+static inline void mp_cpu_mask_zero(mp_cpu_mask_t *m) {
+  for (uint i = 0; i < MP_CPU_MASK_WORDS; i++) {
+    m->bits[i] = 0;
+  }
+}
+
+/* every cpu there can be, the bits past SMP_MAX_CPUS stay clear */
+static inline void mp_cpu_mask_fill(mp_cpu_mask_t *m) {
+  for (uint i = 0; i < MP_CPU_MASK_WORDS; i++) {
+    m->bits[i] = ~0UL;
+  }
+  if (SMP_MAX_CPUS % MP_CPU_MASK_BITS_PER_WORD)
+    m->bits[MP_CPU_MASK_WORDS - 1] = (1UL << (SMP_MAX_CPUS % MP_CPU_MASK_BITS_PER_WORD)) - 1;
+}
+
+static inline void mp_cpu_mask_set(mp_cpu_mask_t *m, uint cpu) {
+  m->bits[cpu / MP_CPU_MASK_BITS_PER_WORD] |= 1UL << (cpu % MP_CPU_MASK_BITS_PER_WORD);
+}
+
+static inline void mp_cpu_mask_clear(mp_cpu_mask_t *m, uint cpu) {
+  m->bits[cpu / MP_CPU_MASK_BITS_PER_WORD] &= ~(1UL << (cpu % MP_CPU_MASK_BITS_PER_WORD));
+}
+
+static inline bool mp_cpu_mask_test(const mp_cpu_mask_t *m, uint cpu) {
+  if (cpu >= SMP_MAX_CPUS)
+    return false;
+  return m->bits[cpu / MP_CPU_MASK_BITS_PER_WORD] & (1UL << (cpu % MP_CPU_MASK_BITS_PER_WORD));
+}
+
+/* for masks other cpus change under us without a common lock */
+static inline void mp_cpu_mask_set_atomic(mp_cpu_mask_t *m, uint cpu) {
+  __atomic_fetch_or(&m->bits[cpu / MP_CPU_MASK_BITS_PER_WORD],
+                    1UL << (cpu % MP_CPU_MASK_BITS_PER_WORD), __ATOMIC_RELAXED);
+}
+
+static inline bool mp_cpu_mask_test_atomic(const mp_cpu_mask_t *m, uint cpu) {
+  if (cpu >= SMP_MAX_CPUS)
+    return false;
+  return __atomic_load_n(&m->bits[cpu / MP_CPU_MASK_BITS_PER_WORD], __ATOMIC_RELAXED) &
+         (1UL << (cpu % MP_CPU_MASK_BITS_PER_WORD));
+}
+
+static inline mp_cpu_mask_t mp_cpu_mask_of(uint cpu) {
+  mp_cpu_mask_t m;
+  mp_cpu_mask_zero(&m);
+  mp_cpu_mask_set(&m, cpu);
+  return m;
+}
+
+/* dst may be the same as either source */
+static inline void mp_cpu_mask_and(mp_cpu_mask_t *dst, const mp_cpu_mask_t *a,
+                                   const mp_cpu_mask_t *b) {
+  for (uint i = 0; i < MP_CPU_MASK_WORDS; i++) {
+    dst->bits[i] = a->bits[i] & b->bits[i];
+  }
+}
+
+static inline void mp_cpu_mask_or(mp_cpu_mask_t *dst, const mp_cpu_mask_t *a,
+                                  const mp_cpu_mask_t *b) {
+  for (uint i = 0; i < MP_CPU_MASK_WORDS; i++) {
+    dst->bits[i] = a->bits[i] | b->bits[i];
+  }
+}
+
+static inline void mp_cpu_mask_andnot(mp_cpu_mask_t *dst, const mp_cpu_mask_t *a,
+                                      const mp_cpu_mask_t *b) {
+  for (uint i = 0; i < MP_CPU_MASK_WORDS; i++) {
+    dst->bits[i] = a->bits[i] & ~b->bits[i];
+  }
+}
+
+static inline bool mp_cpu_mask_is_empty(const mp_cpu_mask_t *m) {
+  for (uint i = 0; i < MP_CPU_MASK_WORDS; i++) {
+    if (m->bits[i])
+      return false;
+  }
+  return true;
+}
+
+static inline bool mp_cpu_mask_intersects(const mp_cpu_mask_t *a, const mp_cpu_mask_t *b) {
+  for (uint i = 0; i < MP_CPU_MASK_WORDS; i++) {
+    if (a->bits[i] & b->bits[i])
+      return true;
+  }
+  return false;
+}
+
+static inline uint mp_cpu_mask_count(const mp_cpu_mask_t *m) {
+  uint count = 0;
+  for (uint i = 0; i < MP_CPU_MASK_WORDS; i++) {
+    count += __builtin_popcountl(m->bits[i]);
+  }
+  return count;
+}
+
+/* the first cpu in the mask after cpu, -1 if there is none */
+static inline int mp_cpu_mask_next(const mp_cpu_mask_t *m, int cpu) {
+  uint next = cpu + 1;
+  for (uint i = next / MP_CPU_MASK_BITS_PER_WORD; i < MP_CPU_MASK_WORDS; i++) {
+    unsigned long word = m->bits[i];
+    if (i == next / MP_CPU_MASK_BITS_PER_WORD)
+      word &= ~0UL << (next % MP_CPU_MASK_BITS_PER_WORD);
+    if (word) {
+      uint found = i * MP_CPU_MASK_BITS_PER_WORD + __builtin_ctzl(word);
+      return found < SMP_MAX_CPUS ? (int)found : -1;
+    }
+  }
+  return -1;
+}
+
+static inline int mp_cpu_mask_first(const mp_cpu_mask_t *m) { return mp_cpu_mask_next(m, -1); }
+
+/* iterate an int over the cpus in the mask */
+#define mp_cpu_mask_for_each(cpu, m) \
+  for ((cpu) = mp_cpu_mask_first(m); (cpu) >= 0; (cpu) = mp_cpu_mask_next(m, cpu))
+
+/* count bits of the mask from cpu first on, at most a word's worth. for handing
+ * interrupt controllers the targets of one cluster at a time */
+static inline unsigned long mp_cpu_mask_bits(const mp_cpu_mask_t *m, uint first, uint count) {
+  const uint word = first / MP_CPU_MASK_BITS_PER_WORD;
+  const uint shift = first % MP_CPU_MASK_BITS_PER_WORD;
+  if (word >= MP_CPU_MASK_WORDS)
+    return 0;
+
+  unsigned long bits = m->bits[word] >> shift;
+  if (shift && word + 1 < MP_CPU_MASK_WORDS)
+    bits |= m->bits[word + 1] << (MP_CPU_MASK_BITS_PER_WORD - shift);
+  if (count < MP_CPU_MASK_BITS_PER_WORD)
+    bits &= (1UL << count) - 1;
+  return bits;
+}
+
+__END_CDECLS
+
+#endif  // MK_INCLUDE_KERNEL_CPU_MASK_H_
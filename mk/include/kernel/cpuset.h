@@ -0,0 +1,62 @@
+// Copyright 2025 Mist Tecnologia Ltda
+//
+// Use of this source code is governed by a MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT
+
+#ifndef MK_INCLUDE_KERNEL_CPUSET_H_
+#define MK_INCLUDE_KERNEL_CPUSET_H_
+
+#include <stddef.h>
+#include <sys/types.h>
+
+#include <kernel/cpu_mask.h>
+#include <kernel/thread.h>
+#include <lk/compiler.h>
+#include <lk/list.h>
+
+__BEGIN_CDECLS
+
+#define CPUSET_NAME_LEN 16
+
+/* a named group of cpus that confines the threads in it, for instance to keep
+ * housekeeping off cores set aside for some workload. every thread is in one
+ * set, the root set spans every cpu and cannot be changed. new threads start
+ * out in the set of the thread that created them.
+ *
+ * sets are on a list protected by the thread lock. a set handed out by
+ * cpuset_find() stays valid until someone destroys it. */
+struct cpuset {
+  struct list_node node;
+  char name[CPUSET_NAME_LEN];
+  mp_cpu_mask_t cpus;
+};
+
+void cpuset_init_early(void);
+
+cpuset_t *cpuset_root(void);
+cpuset_t *cpuset_find(const char *name);
+
+status_t cpuset_create(const char *name, const mp_cpu_mask_t *cpus, cpuset_t **set);
+
+/* threads whose affinity no longer overlaps the set run anywhere in it */
+status_t cpuset_set_cpus(cpuset_t *set, const mp_cpu_mask_t *cpus);
+
+/* the threads left in the set move to the root set */
+status_t cpuset_destroy(cpuset_t *set);
+
+status_t thread_set_cpuset(thread_t *t, cpuset_t *set);
+cpuset_t *thread_get_cpuset(thread_t *t);
+
+/* cpu lists in the "0-3,6" form, "all" for every cpu */
+status_t cpuset_parse_cpus(const char *str, mp_cpu_mask_t *cpus);
+size_t cpuset_format_cpus(const mp_cpu_mask_t *cpus, char *buf, size_t len);
+
+/* called by the cpuset code with the thread lock held, see kernel/thread.c */
+void thread_update_cpus_allowed_locked(thread_t *t);
+status_t thread_set_affinity_locked(thread_t *t, const mp_cpu_mask_t *affinity);
+void thread_get_cpus_allowed_locked(thread_t *t, mp_cpu_mask_t *allowed);
+
+__END_CDECLS
+
+#endif  // MK_INCLUDE_KERNEL_CPUSET_H_
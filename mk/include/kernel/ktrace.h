@@ -0,0 +1,92 @@
+// Copyright 2025 Mist Tecnologia Ltda
+//
+// Use of this source code is governed by a MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT
+
+#ifndef MK_INCLUDE_KERNEL_KTRACE_H_
+#define MK_INCLUDE_KERNEL_KTRACE_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <lk/compiler.h>
+
+__BEGIN_CDECLS
+
+/*
+ * Binary kernel event trace.
+ *
+ * Every cpu owns a ring of fixed size records (timestamp, cpu/id, two
+ * arguments) built on lib/evlog. Slots are claimed with an atomic bump of
+ * the ring head, so tracepoints take no locks and may fire from interrupt
+ * context. Tracepoints cost a single predicted branch while tracing is off.
+ */
+
+enum {
+  KTRACE_EV_NULL = 0,
+  KTRACE_EV_CONTEXT_SWITCH, /* old thread, new thread */
+  KTRACE_EV_IRQ_ENTER,      /* vector */
+  KTRACE_EV_IRQ_EXIT,       /* vector */
+  KTRACE_EV_WAIT_BLOCK,     /* wait queue, timeout */
+  KTRACE_EV_PMM_ALLOC,      /* pages requested, pages allocated */
+  KTRACE_EV_PMM_FREE,       /* pages freed */
+  KTRACE_EV_BIO_READ,       /* bytes, duration in us */
+  KTRACE_EV_BIO_WRITE,      /* bytes, duration in us */
+  KTRACE_EV_COUNT,
+};
+
+#if WITH_KERNEL_KTRACE
+
+#ifndef KTRACE_DEFAULT_RECORDS
+#define KTRACE_DEFAULT_RECORDS 4096 /* per cpu */
+#endif
+
+extern volatile bool ktrace_enabled;
+
+void ktrace_add(uint id, uintptr_t arg0, uintptr_t arg1);
+lk_bigtime_t ktrace_timestamp(void);
+
+status_t ktrace_start(uint records);
+void ktrace_stop(void);
+void ktrace_dump(void);
+void ktrace_dump_json(void);
+
+#define KTRACE(id, arg0, arg1)                                    \
+  do {                                                            \
+    if (unlikely(ktrace_enabled))                                 \
+      ktrace_add((id), (uintptr_t)(arg0), (uintptr_t)(arg1));     \
+  } while (0)
+
+#define KTRACE_TIMESTAMP() (unlikely(ktrace_enabled) ? ktrace_timestamp() : 0)
+
+#else  // !WITH_KERNEL_KTRACE
+
+#define KTRACE(id, arg0, arg1) \
+  do {                         \
+  } while (0)
+
+#define KTRACE_TIMESTAMP() ((lk_bigtime_t)0)
+
+#endif
+
+#define KTRACE_THREAD_SWITCH(from, to) KTRACE(KTRACE_EV_CONTEXT_SWITCH, from, to)
+#define KTRACE_IRQ_ENTER(vector) KTRACE(KTRACE_EV_IRQ_ENTER, vector, 0)
+#define KTRACE_IRQ_EXIT(vector) KTRACE(KTRACE_EV_IRQ_EXIT, vector, 0)
+#define KTRACE_WAIT_BLOCK(wait, timeout) KTRACE(KTRACE_EV_WAIT_BLOCK, wait, timeout)
+#define KTRACE_PMM_ALLOC(count, allocated) KTRACE(KTRACE_EV_PMM_ALLOC, count, allocated)
+#define KTRACE_PMM_FREE(count) KTRACE(KTRACE_EV_PMM_FREE, count, 0)
+
+/* operations with a duration, timed from a KTRACE_TIMESTAMP() taken at the start */
+#define KTRACE_DURATION(id, start, arg)                    \
+  do {                                                     \
+    if (start)                                             \
+      KTRACE(id, arg, ktrace_timestamp() - (start));       \
+  } while (0)
+#define KTRACE_BIO_READ(start, bytes) KTRACE_DURATION(KTRACE_EV_BIO_READ, start, bytes)
+#define KTRACE_BIO_WRITE(start, bytes) KTRACE_DURATION(KTRACE_EV_BIO_WRITE, start, bytes)
+
+__END_CDECLS
+
+#endif  // MK_INCLUDE_KERNEL_KTRACE_H_
@@ -8,19 +8,15 @@
 #ifndef MK_INCLUDE_KERNEL_MP_H_
 #define MK_INCLUDE_KERNEL_MP_H_
 
-#include <limits.h>
 #include <stdbool.h>
 #include <stdint.h>
 
+#include <kernel/cpu_mask.h>
 #include <kernel/thread.h>
 #include <lk/compiler.h>
 
 __BEGIN_CDECLS
 
-typedef uint32_t mp_cpu_mask_t;
-
-#define MP_CPU_ALL_BUT_LOCAL (UINT32_MAX)
-
 /* by default, mp_mbx_reschedule does not signal to cpus that are running realtime
  * threads. Override this behavior.
  */
@@ -31,18 +27,52 @@ typedef enum {
   MP_IPI_RESCHEDULE,
 } mp_ipi_t;
 
+/* a function to run on other cpus, in interrupt context with interrupts disabled */
+typedef void (*mp_call_func_t)(void *arg);
+
+/* a call to some cpus, in flight until every one of them ran it. it sits on
+ * every target's queue at once, in nodes that belong to the targets */
+typedef struct mp_call {
+  mp_call_func_t func;
+  void *arg;
+  int pending; /* target cpus that have not run it yet */
+} mp_call_t;
+
+/* run func(arg) on the active cpus in target, the local one included if it is
+ * in there, and wait for all of them to finish. calls queued up for a cpu go
+ * out with a single ipi and run in the order they were made.
+ *
+ * waits with interrupts disabled. must not be called from func, or with a
+ * spinlock held that a target cpu may be spinning on with interrupts disabled,
+ * that cpu would never take the ipi */
+void mp_sync_exec(const mp_cpu_mask_t *target, mp_call_func_t func, void *arg);
+
+/* same without the wait. call is owned by the caller and has to stay around
+ * until mp_call_done() says so, or mp_call_wait() returns */
+void mp_async_exec(const mp_cpu_mask_t *target, mp_call_t *call, mp_call_func_t func, void *arg);
+
+static inline bool mp_call_done(const mp_call_t *call) {
+  return __atomic_load_n(&call->pending, __ATOMIC_ACQUIRE) == 0;
+}
+
+void mp_call_wait(mp_call_t *call);
+
 #ifdef WITH_SMP
 void mp_init(void);
 
-void mp_reschedule(mp_cpu_mask_t target, uint flags);
+void mp_reschedule(const mp_cpu_mask_t *target, uint flags);
 void mp_set_curr_cpu_active(bool active);
 
 /* called from arch code during reschedule irq */
 enum handler_return mp_mbx_reschedule_irq(void);
 
+/* called from arch code during generic irq, runs the queued calls */
+enum handler_return mp_mbx_generic_irq(void);
+
 /* global mp state to track what the cpus are up to */
 struct mp_state {
-  volatile mp_cpu_mask_t active_cpus;
+  /* set by each cpu as it comes up, read with atomics */
+  mp_cpu_mask_t active_cpus;
 
   /* only safely accessible with thread lock held */
   mp_cpu_mask_t idle_cpus;
@@ -51,31 +81,58 @@ struct mp_state {
 
 extern struct mp_state mp;
 
-static inline bool mp_is_cpu_active(uint cpu) { return mp.active_cpus & (1UL << cpu); }
+static inline bool mp_is_cpu_active(uint cpu) {
+  return mp_cpu_mask_test_atomic(&mp.active_cpus, cpu);
+}
+
+static inline uint mp_active_cpu_count(void) {
+  uint count = 0;
+  for (uint i = 0; i < SMP_MAX_CPUS; i++) {
+    count += mp_is_cpu_active(i);
+  }
+  return count;
+}
+
+/* the n'th cpu that is up, wrapping around, to spread per cpu work over the
+ * cpus that can run it */
+static inline uint mp_active_cpu(uint n) {
+  uint count = mp_active_cpu_count();
+  n %= count ? count : 1;
+  for (uint i = 0; i < SMP_MAX_CPUS; i++) {
+    if (mp_is_cpu_active(i) && n-- == 0)
+      return i;
+  }
+  return 0;
+}
 
-static inline bool mp_is_cpu_idle(uint cpu) { return mp.idle_cpus & (1UL << cpu); }
+static inline bool mp_is_cpu_idle(uint cpu) { return mp_cpu_mask_test(&mp.idle_cpus, cpu); }
 
 /* must be called with the thread lock held */
-static inline void mp_set_cpu_idle(uint cpu) { mp.idle_cpus |= 1UL << cpu; }
+static inline void mp_set_cpu_idle(uint cpu) { mp_cpu_mask_set(&mp.idle_cpus, cpu); }
 
-static inline void mp_set_cpu_busy(uint cpu) { mp.idle_cpus &= ~(1UL << cpu); }
+static inline void mp_set_cpu_busy(uint cpu) { mp_cpu_mask_clear(&mp.idle_cpus, cpu); }
 
-static inline mp_cpu_mask_t mp_get_idle_mask(void) { return mp.idle_cpus; }
+static inline const mp_cpu_mask_t *mp_get_idle_mask(void) { return &mp.idle_cpus; }
 
-static inline void mp_set_cpu_realtime(uint cpu) { mp.realtime_cpus |= 1UL << cpu; }
+static inline void mp_set_cpu_realtime(uint cpu) { mp_cpu_mask_set(&mp.realtime_cpus, cpu); }
 
-static inline void mp_set_cpu_non_realtime(uint cpu) { mp.realtime_cpus &= ~(1UL << cpu); }
+static inline void mp_set_cpu_non_realtime(uint cpu) {
+  mp_cpu_mask_clear(&mp.realtime_cpus, cpu);
+}
 
-static inline mp_cpu_mask_t mp_get_realtime_mask(void) { return mp.realtime_cpus; }
+static inline const mp_cpu_mask_t *mp_get_realtime_mask(void) { return &mp.realtime_cpus; }
 #else
 static inline void mp_init(void) {}
-static inline void mp_reschedule(mp_cpu_mask_t target, uint flags) {}
+static inline void mp_reschedule(const mp_cpu_mask_t *target, uint flags) {}
 static inline void mp_set_curr_cpu_active(bool active) {}
 
 static inline enum handler_return mp_mbx_reschedule_irq(void) { return INT_NO_RESCHEDULE; }
+static inline enum handler_return mp_mbx_generic_irq(void) { return INT_NO_RESCHEDULE; }
 
 // only one cpu exists in UP and if you're calling these functions, it's active...
 static inline int mp_is_cpu_active(uint cpu) { return 1; }
+static inline uint mp_active_cpu_count(void) { return 1; }
+static inline uint mp_active_cpu(uint n) { return 0; }
 static inline int mp_is_cpu_idle(uint cpu) {
   return (get_current_thread()->flags & THREAD_FLAG_IDLE) != 0;
 }
@@ -83,12 +140,18 @@ static inline int mp_is_cpu_idle(uint cpu) {
 static inline void mp_set_cpu_idle(uint cpu) {}
 static inline void mp_set_cpu_busy(uint cpu) {}
 
-static inline mp_cpu_mask_t mp_get_idle_mask(void) { return 0; }
+static inline const mp_cpu_mask_t *mp_get_idle_mask(void) {
+  static const mp_cpu_mask_t none;
+  return &none;
+}
 
 static inline void mp_set_cpu_realtime(uint cpu) {}
 static inline void mp_set_cpu_non_realtime(uint cpu) {}
 
-static inline mp_cpu_mask_t mp_get_realtime_mask(void) { return 0; }
+static inline const mp_cpu_mask_t *mp_get_realtime_mask(void) {
+  static const mp_cpu_mask_t none;
+  return &none;
+}
 #endif
 
 __END_CDECLS
@@ -0,0 +1,87 @@
+// Copyright 2025 Mist Tecnologia Ltda
+//
+// Use of this source code is governed by a MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT
+
+#ifndef MK_INCLUDE_KERNEL_POLL_H_
+#define MK_INCLUDE_KERNEL_POLL_H_
+
+#include <sys/types.h>
+
+#include <lk/compiler.h>
+#include <lk/list.h>
+
+__BEGIN_CDECLS
+
+/*
+ * Readiness notification.
+ *
+ * Objects that can become readable or writable embed a poll_source_t and call
+ * poll_source_notify() when their state changes. A poll set watches any number
+ * of sources and hands the ready ones back in batches, so one thread can drive
+ * many sockets, cbufs and ports instead of blocking on each of them.
+ *
+ * Level triggered registrations are reported for as long as the source's query
+ * says it is ready, edge triggered ones once per notification.
+ *
+ * Like ports, poll sets and the watcher lists of sources are protected by the
+ * thread lock.
+ */
+
+/* readiness bits */
+#define POLL_IN (1U << 0)  /* data to read, or a connection to accept */
+#define POLL_OUT (1U << 1) /* room to write */
+#define POLL_HUP (1U << 2) /* other side is gone, reads drain what is left */
+#define POLL_ERR (1U << 3)
+
+/* registration flags */
+#define POLL_FLAG_EDGE (1U << 0) /* report notifications rather than state */
+
+typedef struct poll_source poll_source_t;
+
+/* return the current readiness bits. called with the thread lock held, must not block */
+typedef uint (*poll_query_t)(poll_source_t *source);
+
+struct poll_source {
+  struct list_node watchers;
+  poll_query_t query;
+};
+
+typedef struct poll_set poll_set_t;
+
+typedef struct {
+  void *cookie;
+  uint events;
+} poll_event_t;
+
+void poll_source_init(poll_source_t *source, poll_query_t query);
+
+/* detach the source from every poll set watching it, before the object goes away */
+void poll_source_destroy(poll_source_t *source);
+
+/* report that some of events may have become ready. the _locked version is
+ * for callers already holding the thread lock */
+void poll_source_notify(poll_source_t *source, uint events);
+void poll_source_notify_locked(poll_source_t *source, uint events);
+
+status_t poll_set_create(poll_set_t **set);
+
+/* wakes up waiters with ERR_OBJECT_DESTROYED, the sources are left alone */
+status_t poll_set_destroy(poll_set_t *set);
+
+/* watch source for events (POLL_HUP and POLL_ERR are always reported). cookie is
+ * handed back with every event. a source can only be added to a given set once */
+status_t poll_set_add(poll_set_t *set, poll_source_t *source, uint events, uint flags,
+                      void *cookie);
+status_t poll_set_modify(poll_set_t *set, poll_source_t *source, uint events, uint flags,
+                         void *cookie);
+status_t poll_set_remove(poll_set_t *set, poll_source_t *source);
+
+/* wait for at least one source to be ready and return up to count events.
+ * returns the number of events, or ERR_TIMED_OUT. a zero timeout does not block */
+ssize_t poll_set_wait(poll_set_t *set, poll_event_t *events, size_t count, lk_time_t timeout);
+
+__END_CDECLS
+
+#endif  // MK_INCLUDE_KERNEL_POLL_H_
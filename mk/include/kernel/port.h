@@ -8,8 +8,10 @@
 #ifndef MK_INCLUDE_KERNEL_PORT_H_
 #define MK_INCLUDE_KERNEL_PORT_H_
 
+#include <string.h>
 #include <sys/types.h>
 
+#include <kernel/poll.h>
 #include <lk/compiler.h>
 
 __BEGIN_CDECLS
@@ -38,8 +40,35 @@ typedef enum {
   PORT_MODE_BROADCAST = 0,
   PORT_MODE_UNICAST = 1,
   PORT_MODE_BIG_BUFFER = 2,
+  PORT_MODE_PAYLOAD = 4, /* unicast only, packets carry out-of-line payloads */
 } port_mode_t;
 
+/* Deepest ring port_create_etc() accepts.
+ */
+#define PORT_MAX_DEPTH 4096
+
+/* Don't yield to the readers a write woke up, they run once the writer blocks
+ * or is preempted. Lets a producer batch up work, and makes the write safe to
+ * call with interrupts disabled.
+ */
+#define PORT_WRITE_FLAG_NORESCHED 0x1
+
+/* An out-of-line payload travels through a payload port as a packet holding
+ * the buffer and its length. Ownership of the buffer moves with the packet,
+ * the data itself is never copied.
+ */
+typedef struct {
+  void *buf;
+  size_t len;
+} port_payload_t;
+STATIC_ASSERT(sizeof(port_payload_t) <= PORT_PACKET_LEN);
+
+static inline port_payload_t port_packet_to_payload(const port_packet_t *packet) {
+  port_payload_t payload;
+  memcpy(&payload, packet->value, sizeof(payload));
+  return payload;
+}
+
 /* Inits the port subsystem
  */
 void port_init(void);
@@ -50,6 +79,12 @@ void port_init(void);
  */
 status_t port_create(const char *name, port_mode_t mode, port_t *port);
 
+/* Same as port_create() with a ring of |depth| packets, a power of two up to
+ * PORT_MAX_DEPTH. Zero picks the default for |mode|. The ring goes to the first
+ * reader, later readers of a broadcast port get the default small ring.
+ */
+status_t port_create_etc(const char *name, port_mode_t mode, uint depth, port_t *port);
+
 /* Make a read-side port. Only non-destroyed existing write ports can
  * be opened with this api. Unicast ports can only be opened once. For
  * broadcast ports, each call if successful returns a new port.
@@ -72,6 +107,19 @@ status_t port_group_remove(port_t group, port_t port);
 /* Write to a port |count| packets, non-blocking, all or none atomic success.
  */
 status_t port_write(port_t port, const port_packet_t *pk, size_t count);
+status_t port_write_etc(port_t port, const port_packet_t *pk, size_t count, uint flags);
+
+/* Allocate and free buffers to send through payload ports.
+ */
+void *port_payload_alloc(size_t len);
+void port_payload_free(void *buf);
+
+/* Send |buf| through a payload port. On success the port owns the buffer until
+ * a reader gets it with port_read(), after which it belongs to the reader. On
+ * failure it stays with the caller. Payloads still queued when the port goes
+ * away are freed with it.
+ */
+status_t port_write_payload(port_t port, void *buf, size_t len, uint flags);
 
 /* Read one packet from the port or port group, blocking. The |result| contains
  * the port that the message was read from. If |timeout| is zero the call
@@ -79,11 +127,23 @@ status_t port_write(port_t port, const port_packet_t *pk, size_t count);
  */
 status_t port_read(port_t port, lk_time_t timeout, port_result_t *result);
 
+/* Read up to |count| packets from the port or port group, blocking until at
+ * least one is available. Returns the number of packets read.
+ */
+ssize_t port_read_many(port_t port, lk_time_t timeout, port_result_t *results, size_t count);
+
 /* Destroy the write-side port, flush queued packets and release all resources,
  * all calls will now fail on that port. Only a closed port can be destroyed.
  */
 status_t port_destroy(port_t port);
 
+/* Returns the readiness source of a read-side port or port group, to add it
+ * to a poll set. Ports report POLL_IN when a packet can be read and POLL_HUP
+ * once their write port is destroyed, groups the same for any of their ports.
+ * Returns NULL for write-side ports.
+ */
+poll_source_t *port_poll_source(port_t port);
+
 /* Close the read-side port or the write side port. A closed write side port
  * can be opened and the pending packets read. closing a port group does not
  * close the included ports.
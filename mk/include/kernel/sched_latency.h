@@ -0,0 +1,121 @@
+// Copyright 2025 Mist Tecnologia Ltda
+//
+// Use of this source code is governed by a MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT
+
+#ifndef MK_INCLUDE_KERNEL_SCHED_LATENCY_H_
+#define MK_INCLUDE_KERNEL_SCHED_LATENCY_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <lk/compiler.h>
+
+__BEGIN_CDECLS
+
+/*
+ * Log linear histograms of scheduler latencies in usecs, kept per thread and
+ * per cpu while THREAD_STATS is on.
+ *
+ * Values under 2^SCHED_HIST_SUB_BITS get a bucket each, above that every
+ * power of two is split in 2^SCHED_HIST_SUB_BITS linear buckets, so a bucket
+ * is never wider than a quarter of the values in it. Values of
+ * 2^SCHED_HIST_MAX_SHIFT usecs and up all land in the last bucket.
+ *
+ * Counters are bumped with relaxed atomics, without any lock, and can be read
+ * at any time. A reader may see one histogram a few events ahead of another.
+ */
+#define SCHED_HIST_SUB_BITS 2
+#define SCHED_HIST_MAX_SHIFT 24 /* ~16.7 seconds */
+#define SCHED_HIST_BUCKETS ((SCHED_HIST_MAX_SHIFT - SCHED_HIST_SUB_BITS + 1) << SCHED_HIST_SUB_BITS)
+
+struct sched_hist {
+  uint32_t counts[SCHED_HIST_BUCKETS];
+};
+
+static inline uint sched_hist_bucket(uint64_t value) {
+  const uint sub_count = 1u << SCHED_HIST_SUB_BITS;
+
+  if (value >= (1ull << SCHED_HIST_MAX_SHIFT))
+    return SCHED_HIST_BUCKETS - 1;
+  if (value < sub_count)
+    return value;
+
+  uint msb = 63 - __builtin_clzll(value);
+  uint shift = msb - SCHED_HIST_SUB_BITS;
+  return ((shift + 1) << SCHED_HIST_SUB_BITS) + (uint)(value >> shift) - sub_count;
+}
+
+/* smallest value that lands in a bucket */
+static inline uint64_t sched_hist_bucket_min(uint bucket) {
+  const uint sub_count = 1u << SCHED_HIST_SUB_BITS;
+
+  if (bucket < sub_count)
+    return bucket;
+
+  uint shift = (bucket >> SCHED_HIST_SUB_BITS) - 1;
+  return (uint64_t)(sub_count + (bucket & (sub_count - 1))) << shift;
+}
+
+static inline void sched_hist_add(struct sched_hist *h, uint64_t value) {
+  __atomic_fetch_add(&h->counts[sched_hist_bucket(value)], 1, __ATOMIC_RELAXED);
+}
+
+/* value below which percent (0-100) of the samples are, to bucket
+ * resolution. 0 if the histogram is empty */
+uint64_t sched_hist_percentile(const struct sched_hist *h, uint percent);
+uint64_t sched_hist_count(const struct sched_hist *h);
+
+/*
+ * Binary export, for pulling the histograms off the machine in one piece.
+ * A header followed by a record for every cpu and then every thread, in the
+ * byte order of the machine. Both are laid out so the compiler adds no
+ * padding.
+ */
+#define SCHED_LATENCY_EXPORT_MAGIC 0x54414c53 /* 'SLAT' */
+#define SCHED_LATENCY_EXPORT_VERSION 1
+
+enum {
+  SCHED_LATENCY_RECORD_CPU = 0,
+  SCHED_LATENCY_RECORD_THREAD,
+};
+
+struct sched_latency_export_header {
+  uint32_t magic;
+  uint16_t version;
+  uint16_t header_size;
+  uint32_t record_size;
+  uint32_t bucket_count;
+  uint32_t record_count;
+  uint8_t sub_bits; /* histogram layout, see above */
+  uint8_t max_shift;
+  uint16_t reserved;
+  uint64_t timestamp; /* current_time_hires() at export */
+};
+
+struct sched_latency_export_record {
+  uint32_t type;
+  uint32_t cpu;     /* for a thread, the cpu it is running on or -1 */
+  uint64_t thread;  /* address of the thread, 0 for a cpu */
+  char name[32];
+  uint64_t run_time;
+  uint64_t schedules;
+  uint64_t preemptions;
+  uint64_t involuntary_switches;
+  uint32_t wakeup_latency[SCHED_HIST_BUCKETS];
+  uint32_t queue_wait[SCHED_HIST_BUCKETS];
+};
+
+/* write the export to buf. returns the bytes written, or the bytes needed if
+ * buf is NULL. ERR_NOT_ENOUGH_BUFFER if it does not fit, threads may come and
+ * go between the two calls so leave some room */
+ssize_t sched_latency_export(void *buf, size_t len);
+
+/* start every histogram and counter over */
+void sched_latency_reset(void);
+
+__END_CDECLS
+
+#endif  // MK_INCLUDE_KERNEL_SCHED_LATENCY_H_
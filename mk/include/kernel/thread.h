@@ -15,7 +15,10 @@
 #include <arch/defines.h>
 #include <arch/ops.h>
 #include <arch/thread.h>
+#include <kernel/cpu_mask.h>
+#include <kernel/sched_latency.h>
 #include <kernel/spinlock.h>
+#include <kernel/timer.h>
 #include <kernel/wait.h>
 #include <lk/compiler.h>
 #include <lk/debug.h>
@@ -25,6 +28,7 @@
 /* forward declaration */
 typedef struct vmm_aspace vmm_aspace_t;
 #endif
+typedef struct cpuset cpuset_t;
 
 __BEGIN_CDECLS
 
@@ -69,6 +73,7 @@ enum thread_tls_list {
 #define THREAD_FLAG_REAL_TIME (1 << 3)
 #define THREAD_FLAG_IDLE (1 << 4)
 #define THREAD_FLAG_DEBUG_STACK_BOUNDS_CHECK (1 << 5)
+#define THREAD_FLAG_DEADLINE (1 << 6)
 
 #define THREAD_MAGIC (0x74687264)  // 'thrd'
 
@@ -77,9 +82,48 @@ struct thread_specific_stats {
   lk_bigtime_t total_run_time;
   lk_bigtime_t last_run_timestamp;
   ulong schedules;  // times this thread is scheduled to run.
+  lk_bigtime_t last_ready_timestamp;
+  lk_bigtime_t total_wait_time;  // time spent ready to run but not running.
+  lk_bigtime_t max_wait_time;
+  bool woken;  // ready after blocking, sleeping or being suspended.
+  bool preempted;  // in thread_preempt(), switching away now is involuntary.
+  ulong preemptions;
+  ulong involuntary_switches;  // switched out by a preemption.
+  struct sched_hist wakeup_latency;
+  struct sched_hist queue_wait;
 };
 #endif
 
+/* weighted fair share state of threads at DEFAULT_PRIORITY and below that are
+ * not real time, see kernel/thread.c */
+struct thread_fair {
+  bool active; /* competing for the cpu, ready or running */
+  uint weight;
+  int64_t vruntime; /* run time scaled by weight, usecs */
+  int64_t deadline; /* vruntime at the end of the current slice */
+  int64_t lag;      /* service it was owed when it last stopped competing */
+  lk_bigtime_t last_update;
+};
+
+/* deadline class state, see thread_set_deadline() */
+struct thread_deadline {
+  /* parameters, usecs. the deadline is relative to the start of a period */
+  lk_bigtime_t runtime;
+  lk_bigtime_t deadline;
+  lk_bigtime_t period;
+  uint cpu; /* the cpu its bandwidth is reserved on, the one it runs on */
+
+  /* the constant bandwidth server */
+  int64_t remaining;         /* budget left until abs_deadline */
+  lk_bigtime_t abs_deadline; /* current scheduling deadline */
+  lk_bigtime_t last_update;
+  bool throttled;   /* out of budget, off the run queue until the next period */
+  timer_t throttle; /* ends the throttling */
+
+  ulong misses;    /* deadlines passed while it still had budget to run */
+  ulong overruns;  /* budgets used up before the deadline */
+};
+
 typedef struct thread {
   int magic;
   struct list_node thread_list_node;
@@ -89,11 +133,18 @@ typedef struct thread {
   int priority;
   enum thread_state state;
   int remaining_quantum;
+  struct thread_fair fair;
+  struct thread_deadline dl;
   unsigned int flags;
 #if WITH_SMP
   int curr_cpu;
   int pinned_cpu; /* only run on pinned_cpu if >= 0 */
 #endif
+  /* cpus the thread may run on when not pinned: its own affinity within the
+   * cpus of its cpuset, protected by the thread lock */
+  mp_cpu_mask_t affinity;
+  cpuset_t *cpuset;
+  mp_cpu_mask_t cpus_allowed;
 #if WITH_KERNEL_VM
   vmm_aspace_t *aspace;
 #endif
@@ -180,12 +231,35 @@ status_t thread_join(thread_t *t, int *retcode, lk_time_t timeout);
 status_t thread_detach_and_resume(thread_t *t);
 status_t thread_set_real_time(thread_t *t);
 
+/* confine a thread to a set of cpus. the affinity is intersected with the cpus
+ * of the thread's cpuset, see kernel/cpuset.h, and must overlap them. a pinned
+ * cpu takes precedence over both */
+status_t thread_set_affinity(thread_t *t, const mp_cpu_mask_t *affinity);
+void thread_get_affinity(thread_t *t, mp_cpu_mask_t *affinity);
+void thread_get_cpus_allowed(thread_t *t, mp_cpu_mask_t *allowed);
+
+/* move a thread to the deadline class, which goes before every other: it
+ * gets runtime usecs of cpu time by deadline usecs into every period. it is
+ * admitted on one of the cpus it may run on with enough bandwidth left, and
+ * throttled until its next period when it uses up its runtime. a runtime of
+ * zero moves it back to its priority.
+ *
+ * @return NO_ERROR on success, ERR_INVALID_ARGS unless
+ * runtime <= deadline <= period, ERR_NO_RESOURCES if no cpu has room for it.
+ */
+status_t thread_set_deadline(thread_t *t, lk_bigtime_t runtime, lk_bigtime_t deadline,
+                             lk_bigtime_t period);
+
 void dump_thread(thread_t *t);
 void arch_dump_thread(thread_t *t);
 void dump_all_threads(void);
 void dump_all_threads_unlocked(void);
 void dump_threads_stats(void);
 
+/* p if it is a live thread, else NULL. for console commands that take a thread
+ * address, must be called with the thread lock held */
+thread_t *find_thread_locked(void *p);
+
 /* scheduler routines */
 void thread_yield(void);   /* give up the cpu voluntarily */
 void thread_preempt(void); /* get preempted (inserted into head of run queue) */
@@ -250,7 +324,12 @@ struct thread_stats {
 
 #if WITH_SMP
   ulong reschedule_ipis;
+  ulong generic_ipis;
 #endif
+
+  ulong involuntary_switches;
+  struct sched_hist wakeup_latency;
+  struct sched_hist queue_wait;
 };
 
 extern struct thread_stats thread_stats[SMP_MAX_CPUS];
@@ -78,6 +78,7 @@ typedef struct vm_page {
 } vm_page_t;
 
 #define VM_PAGE_FLAG_NONFREE (0x1)
+#define VM_PAGE_FLAG_ZEROED (0x2) /* free and known to be all zeroes */
 
 /* kernel address space */
 #ifndef KERNEL_ASPACE_BASE
@@ -115,14 +116,17 @@ typedef struct pmm_arena {
 
   uint flags;
   uint priority;
+  uint numa_node; /* node the memory is attached to, 0 unless the platform says otherwise */
 
   paddr_t base;
   size_t size;
 
-  size_t free_count;
+  size_t free_count;   /* zeroed pages included */
+  size_t zeroed_count;
 
   struct vm_page *page_array;
   struct list_node free_list;
+  struct list_node zeroed_list;
 } pmm_arena_t;
 
 #define PMM_ARENA_FLAG_KMAP (0x1) /* this arena is already mapped and useful for kallocs */
@@ -139,6 +143,18 @@ size_t pmm_alloc_pages(uint count, struct list_node *list) __NONNULL((2));
 /* Allocate a single page */
 vm_page_t *pmm_alloc_page(void);
 
+/* flags for the _etc versions of the allocation routines */
+#define PMM_ALLOC_FLAG_ZEROED (1U << 0) /* zeroed pages, out of the pool the idle threads keep */
+#define PMM_ALLOC_FLAG_INTERLEAVE (1U << 1) /* spread the pages round robin over the NUMA nodes */
+/* prefer NUMA node n to the current cpu's, other nodes are still used nearest first */
+#define PMM_ALLOC_FLAG_NODE_SHIFT 8
+#define PMM_ALLOC_FLAG_NODE_MASK (0xffU << PMM_ALLOC_FLAG_NODE_SHIFT)
+#define PMM_ALLOC_FLAG_NODE(n) \
+  ((((uint)(n) + 1) << PMM_ALLOC_FLAG_NODE_SHIFT) & PMM_ALLOC_FLAG_NODE_MASK)
+
+size_t pmm_alloc_pages_etc(uint count, uint alloc_flags, struct list_node *list) __NONNULL((3));
+vm_page_t *pmm_alloc_page_etc(uint alloc_flags);
+
 /* Allocate a specific range of physical pages, adding to the tail of the passed list.
  * The list must be initialized.
  * Returns the number of pages allocated.
@@ -164,11 +180,49 @@ size_t pmm_alloc_contiguous(uint count, uint8_t align_log2, paddr_t *pa, struct
  */
 void *pmm_alloc_kpages(uint count, struct list_node *list);
 
+void *pmm_alloc_kpages_etc(uint count, uint alloc_flags, struct list_node *list);
+
 /* Helper routine for pmm_alloc_kpages. */
 static inline void *pmm_alloc_kpage(void) { return pmm_alloc_kpages(1, NULL); }
 
 size_t pmm_free_kpages(void *ptr, uint count);
 
+/* how well the pool of zeroed pages keeps up */
+typedef struct pmm_zero_stats {
+  uint64_t requested; /* pages allocated with PMM_ALLOC_FLAG_ZEROED */
+  uint64_t hits;      /* of those, already zeroed */
+  uint64_t zeroed;    /* pages zeroed in the background */
+  size_t pool;        /* zeroed pages free right now */
+} pmm_zero_stats_t;
+
+void pmm_get_zero_stats(pmm_zero_stats_t *stats) __NONNULL((1));
+
+/* NUMA. Arenas carry the node their memory is attached to, set when they are
+ * added or afterwards with pmm_set_numa_node() once the platform has read its
+ * firmware tables. Allocations take pages from the node of the cpu asking and
+ * fall back to the other nodes in order of distance. */
+#ifndef PMM_MAX_NUMA_NODES
+#define PMM_MAX_NUMA_NODES 8
+#endif
+
+/* relative distances as in the ACPI SLIT, used until the platform sets its own */
+#define PMM_NUMA_DISTANCE_LOCAL 10
+#define PMM_NUMA_DISTANCE_REMOTE 20
+
+/* move the memory in [base, base + size) to node, splitting arenas that straddle the range */
+status_t pmm_set_numa_node(paddr_t base, size_t size, uint node);
+status_t pmm_set_numa_distance(uint from, uint to, uint distance);
+uint pmm_numa_distance(uint from, uint to);
+/* a node cpus can be in, whether or not it has memory */
+status_t pmm_add_numa_node(uint node);
+/* takes no lock once the node has been added, so a cpu can set its own before
+ * it runs threads */
+status_t pmm_set_cpu_numa_node(uint cpu, uint node);
+uint pmm_cpu_numa_node(uint cpu);
+uint pmm_numa_node_count(void);
+uint pmm_page_numa_node(const vm_page_t *page) __NONNULL((1));
+size_t pmm_numa_free_count(uint node);
+
 /* physical to virtual */
 void *paddr_to_kvaddr(paddr_t pa);
 
@@ -184,6 +238,17 @@ paddr_t vm_page_to_paddr(const vm_page_t *page);
 /* paddr to vm_page_t */
 vm_page_t *paddr_to_vm_page(paddr_t addr);
 
+/* per address space page fault counters, see vmm_page_fault_handler() */
+typedef struct vmm_fault_stats {
+  uint64_t faults;    /* handed to the vmm */
+  uint64_t zero_fill;  /* resolved with a new zeroed page of anonymous memory */
+  uint64_t paged_in;   /* resolved with an existing page, from a pager, object or clone parent */
+  uint64_t cow_copied; /* a write to a page shared with a clone, copied */
+  uint64_t cow_reused; /* the same, but nothing else could see the page anymore */
+  uint64_t spurious;   /* already mapped by the time the vmm looked */
+  uint64_t failed;     /* not resolved, the fault is real */
+} vmm_fault_stats_t;
+
 /* virtual allocator */
 typedef struct vmm_aspace {
   struct list_node node;
@@ -196,12 +261,39 @@ typedef struct vmm_aspace {
 
   struct list_node region_list;
 
+  vmm_fault_stats_t fault_stats;
+
   arch_aspace_t arch_aspace;
 } vmm_aspace_t;
 
 #define VMM_ASPACE_FLAG_KERNEL 0x1
 
-typedef struct vmm_region {
+typedef struct vmm_region vmm_region_t;
+
+/* refcounted memory that regions map windows of, see vmm_map_object(). anonymous
+   objects are filled with zeroed pages as they are touched, physical ones cover
+   a fixed range of physical address space */
+typedef struct vm_object vm_object_t;
+
+status_t vm_object_create_anon(size_t size, vm_object_t **obj);
+status_t vm_object_create_physical(paddr_t paddr, size_t size, vm_object_t **obj);
+void vm_object_acquire(vm_object_t *obj) __NONNULL((1));
+void vm_object_release(vm_object_t *obj);
+size_t vm_object_size(const vm_object_t *obj) __NONNULL((1));
+
+/* source of the pages of a demand paged region, see vmm_alloc_pager() */
+typedef struct vmm_pager_ops {
+  /* return the page to map at offset into the region, called with the vmm lock
+   * held so it must not call back into the vmm. a page handed back with *owned
+   * set goes on the region's page list and is freed with it, otherwise it stays
+   * the pager's, which may map it into more than one region */
+  status_t (*get_page)(vmm_region_t *r, size_t offset, vm_page_t **page, bool *owned);
+
+  /* the region is going away and none of its pages are mapped anymore */
+  void (*close)(vmm_region_t *r);
+} vmm_pager_ops_t;
+
+struct vmm_region {
   struct list_node node;
   char name[32];
 
@@ -212,10 +304,21 @@ typedef struct vmm_region {
   size_t size;
 
   struct list_node page_list;
-} vmm_region_t;
+
+  /* VMM_REGION_FLAG_PAGER only */
+  const vmm_pager_ops_t *pager;
+  void *pager_arg;
+
+  /* VMM_REGION_FLAG_OBJECT only, maps object from object_offset on */
+  vm_object_t *object;
+  size_t object_offset;
+};
 
 #define VMM_REGION_FLAG_RESERVED 0x1
 #define VMM_REGION_FLAG_PHYSICAL 0x2
+#define VMM_REGION_FLAG_PAGER 0x4
+#define VMM_REGION_FLAG_OBJECT 0x8
+#define VMM_REGION_FLAG_SHARED 0x10
 
 /* grab a handle to the kernel address space */
 extern vmm_aspace_t _kernel_aspace;
@@ -243,11 +346,33 @@ status_t vmm_alloc_contiguous(vmm_aspace_t *aspace, const char *name, size_t siz
 status_t vmm_alloc(vmm_aspace_t *aspace, const char *name, size_t size, void **ptr,
                    uint8_t align_log2, uint vmm_flags, uint arch_mmu_flags) __NONNULL((1));
 
+/* allocate a region of virtual space whose pages are supplied by pager on first touch.
+   nothing is mapped up front, see vmm_page_fault_handler() */
+status_t vmm_alloc_pager(vmm_aspace_t *aspace, const char *name, size_t size, void **ptr,
+                         uint8_t align_log2, uint vmm_flags, uint arch_mmu_flags,
+                         const vmm_pager_ops_t *pager, void *pager_arg) __NONNULL((1, 8));
+
+/* map size bytes of obj from offset on, taking a reference to it. anonymous
+   memory is paged in on first touch, physical memory is mapped up front */
+status_t vmm_map_object(vmm_aspace_t *aspace, const char *name, vm_object_t *obj, size_t offset,
+                        size_t size, void **ptr, uint8_t align_log2, uint vmm_flags,
+                        uint arch_mmu_flags) __NONNULL((1, 3));
+
 /* Unmap previously allocated region and free physical memory pages backing it (if any) */
 status_t vmm_free_region(vmm_aspace_t *aspace, vaddr_t va);
 
 /* For the above region creation routines. Allocate virtual space at the passed in pointer. */
 #define VMM_FLAG_VALLOC_SPECIFIC 0x1
+/* For vmm_alloc(). Map nothing up front, each page is allocated and zeroed on first touch. */
+#define VMM_FLAG_LAZY 0x2
+/* For vmm_map_object(). Share the object with clones of the aspace rather than copy it. */
+#define VMM_FLAG_SHARED 0x4
+/* For vmm_alloc(). Zero the memory, with pages from the pmm's zeroed pool where it can. */
+#define VMM_FLAG_ZEROED 0x8
+/* For vmm_alloc(). Spread the pages over the NUMA nodes, or prefer node n with
+   VMM_FLAG_NODE(n). Lazy regions keep the policy for the pages faulted in later. */
+#define VMM_FLAG_INTERLEAVE 0x10
+#define VMM_FLAG_NODE(n) PMM_ALLOC_FLAG_NODE(n)
 
 /* allocate a new address space */
 status_t vmm_create_aspace(vmm_aspace_t **aspace, const char *name, uint flags) __NONNULL((1));
@@ -255,6 +380,27 @@ status_t vmm_create_aspace(vmm_aspace_t **aspace, const char *name, uint flags)
 /* destroy everything in the address space */
 status_t vmm_free_aspace(vmm_aspace_t *aspace) __NONNULL((1));
 
+/* duplicate a user address space the way fork() does. private anonymous memory
+   is copied on write, shared objects and device memory are shared, and memory
+   allocated up front is copied right away. demand paged regions with a pager of
+   their own cannot be cloned, ERR_NOT_SUPPORTED */
+status_t vmm_clone_aspace(vmm_aspace_t *aspace, const char *name, vmm_aspace_t **clone)
+    __NONNULL((1, 3));
+
+/* flags for vmm_page_fault_handler() */
+#define VMM_PF_FLAG_WRITE (1U << 0)
+#define VMM_PF_FLAG_USER (1U << 1)
+#define VMM_PF_FLAG_INSTRUCTION (1U << 2)
+#define VMM_PF_FLAG_NOT_PRESENT (1U << 3)
+
+/* Try to resolve a fault at vaddr in the address space that contains it, by
+   paging in from the region's pager or object, or by breaking copy on write
+   sharing with a clone. Called from each arch's fault path with
+   interrupts enabled. Arches that cannot tell a missing page from a protection
+   fault pass VMM_PF_FLAG_NOT_PRESENT, the existing mapping is checked against
+   the access. Returns NO_ERROR if the faulting access can be retried. */
+status_t vmm_page_fault_handler(vaddr_t vaddr, uint pf_flags);
+
 /* internal routine by the scheduler to swap mmu contexts */
 void vmm_context_switch(vmm_aspace_t *oldspace, vmm_aspace_t *newaspace);
 
@@ -0,0 +1,346 @@
+// Copyright 2025 Mist Tecnologia Ltda
+//
+// Use of this source code is governed by a MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT
+
+#include <kernel/cpuset.h>
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <kernel/thread.h>
+#include <lk/console_cmd.h>
+#include <lk/debug.h>
+#include <lk/err.h>
+#include <lk/trace.h>
+
+#define LOCAL_TRACE 0
+
+static cpuset_t root_set = {
+    .name = "root",
+};
+
+/* protected by the thread lock */
+static struct list_node cpusets = LIST_INITIAL_VALUE(cpusets);
+
+void cpuset_init_early(void) {
+  mp_cpu_mask_fill(&root_set.cpus);
+  list_add_head(&cpusets, &root_set.node);
+}
+
+cpuset_t *cpuset_root(void) { return &root_set; }
+
+static cpuset_t *find_locked(const char *name) {
+  cpuset_t *set;
+  list_for_every_entry (&cpusets, set, cpuset_t, node) {
+    if (!strcmp(set->name, name))
+      return set;
+  }
+  return NULL;
+}
+
+cpuset_t *cpuset_find(const char *name) {
+  THREAD_LOCK(state);
+  cpuset_t *set = find_locked(name);
+  THREAD_UNLOCK(state);
+  return set;
+}
+
+status_t cpuset_create(const char *name, const mp_cpu_mask_t *cpus, cpuset_t **set) {
+  if (!name || !name[0] || strlen(name) >= CPUSET_NAME_LEN || mp_cpu_mask_is_empty(cpus))
+    return ERR_INVALID_ARGS;
+
+  cpuset_t *s = calloc(1, sizeof(cpuset_t));
+  if (!s)
+    return ERR_NO_MEMORY;
+
+  strlcpy(s->name, name, sizeof(s->name));
+  s->cpus = *cpus;
+
+  THREAD_LOCK(state);
+  if (find_locked(name)) {
+    THREAD_UNLOCK(state);
+    free(s);
+    return ERR_ALREADY_EXISTS;
+  }
+  list_add_tail(&cpusets, &s->node);
+  THREAD_UNLOCK(state);
+
+  LTRACEF("%s cpus %#lx\n", name, cpus->bits[0]);
+
+  if (set)
+    *set = s;
+  return NO_ERROR;
+}
+
+static status_t set_cpus_locked(cpuset_t *set, const mp_cpu_mask_t *cpus) {
+  if (set == &root_set)
+    return ERR_ACCESS_DENIED;
+  if (mp_cpu_mask_is_empty(cpus))
+    return ERR_INVALID_ARGS;
+
+  set->cpus = *cpus;
+
+  thread_t *t;
+  list_for_every_entry (&thread_list, t, thread_t, thread_list_node) {
+    if (t->cpuset == set)
+      thread_update_cpus_allowed_locked(t);
+  }
+  return NO_ERROR;
+}
+
+status_t cpuset_set_cpus(cpuset_t *set, const mp_cpu_mask_t *cpus) {
+  THREAD_LOCK(state);
+  status_t err = set_cpus_locked(set, cpus);
+  THREAD_UNLOCK(state);
+  return err;
+}
+
+/* takes the set off the list, the caller frees it once the lock is dropped */
+static status_t destroy_locked(cpuset_t *set) {
+  if (set == &root_set)
+    return ERR_ACCESS_DENIED;
+
+  list_delete(&set->node);
+
+  thread_t *t;
+  list_for_every_entry (&thread_list, t, thread_t, thread_list_node) {
+    if (t->cpuset == set) {
+      t->cpuset = &root_set;
+      thread_update_cpus_allowed_locked(t);
+    }
+  }
+  return NO_ERROR;
+}
+
+status_t cpuset_destroy(cpuset_t *set) {
+  THREAD_LOCK(state);
+  status_t err = destroy_locked(set);
+  THREAD_UNLOCK(state);
+
+  if (err == NO_ERROR)
+    free(set);
+  return err;
+}
+
+static void set_thread_cpuset_locked(thread_t *t, cpuset_t *set) {
+  t->cpuset = set;
+  thread_update_cpus_allowed_locked(t);
+}
+
+status_t thread_set_cpuset(thread_t *t, cpuset_t *set) {
+  DEBUG_ASSERT(t->magic == THREAD_MAGIC);
+
+  if (!set)
+    return ERR_INVALID_ARGS;
+
+  THREAD_LOCK(state);
+  set_thread_cpuset_locked(t, set);
+  THREAD_UNLOCK(state);
+
+  return NO_ERROR;
+}
+
+cpuset_t *thread_get_cpuset(thread_t *t) { return t->cpuset; }
+
+status_t cpuset_parse_cpus(const char *str, mp_cpu_mask_t *cpus) {
+  mp_cpu_mask_zero(cpus);
+
+  if (!strcmp(str, "all")) {
+    mp_cpu_mask_fill(cpus);
+    return NO_ERROR;
+  }
+
+  const char *s = str;
+  for (;;) {
+    char *end;
+    unsigned long first = strtoul(s, &end, 0);
+    if (end == s)
+      return ERR_INVALID_ARGS;
+
+    unsigned long last = first;
+    s = end;
+    if (*s == '-') {
+      last = strtoul(++s, &end, 0);
+      if (end == s || last < first)
+        return ERR_INVALID_ARGS;
+      s = end;
+    }
+    if (last >= SMP_MAX_CPUS)
+      return ERR_OUT_OF_RANGE;
+
+    for (unsigned long cpu = first; cpu <= last; cpu++) {
+      mp_cpu_mask_set(cpus, cpu);
+    }
+
+    if (*s == '\0')
+      return NO_ERROR;
+    if (*s++ != ',')
+      return ERR_INVALID_ARGS;
+  }
+}
+
+size_t cpuset_format_cpus(const mp_cpu_mask_t *cpus, char *buf, size_t len) {
+  size_t pos = 0;
+  buf[0] = '\0';
+
+  int cpu = mp_cpu_mask_first(cpus);
+  while (cpu >= 0) {
+    /* collapse runs of consecutive cpus into a range */
+    int last = cpu;
+    int next;
+    while ((next = mp_cpu_mask_next(cpus, last)) == last + 1) {
+      last = next;
+    }
+
+    int n;
+    if (last == cpu)
+      n = snprintf(buf + pos, len - pos, "%s%d", pos ? "," : "", cpu);
+    else
+      n = snprintf(buf + pos, len - pos, "%s%d-%d", pos ? "," : "", cpu, last);
+    if (n < 0 || (size_t)n >= len - pos)
+      break;
+    pos += n;
+
+    cpu = next;
+  }
+
+  if (pos == 0)
+    pos = strlcpy(buf, "none", len);
+  return pos;
+}
+
+static void dump_cpusets(void) {
+  char buf[64];
+
+  THREAD_LOCK(state);
+  cpuset_t *set;
+  list_for_every_entry (&cpusets, set, cpuset_t, node) {
+    uint count = 0;
+    thread_t *t;
+    list_for_every_entry (&thread_list, t, thread_t, thread_list_node) {
+      if (t->cpuset == set)
+        count++;
+    }
+
+    cpuset_format_cpus(&set->cpus, buf, sizeof(buf));
+    printf("%-*s cpus %s, %u thread%s\n", CPUSET_NAME_LEN, set->name, buf, count,
+           count == 1 ? "" : "s");
+  }
+  THREAD_UNLOCK(state);
+}
+
+static int cmd_cpuset(int argc, const cmd_args *argv, uint32_t flags) {
+  if (argc < 2) {
+    dump_cpusets();
+    return NO_ERROR;
+  }
+
+  /* sets and threads named on the console can go away at any time, so they
+   * are looked up and used without dropping the thread lock in between */
+  mp_cpu_mask_t cpus;
+  status_t err;
+  if (!strcmp(argv[1].str, "create") && argc == 4) {
+    err = cpuset_parse_cpus(argv[3].str, &cpus);
+    if (err == NO_ERROR)
+      err = cpuset_create(argv[2].str, &cpus, NULL);
+  } else if (!strcmp(argv[1].str, "cpus") && argc == 4) {
+    err = cpuset_parse_cpus(argv[3].str, &cpus);
+    if (err == NO_ERROR) {
+      THREAD_LOCK(state);
+      cpuset_t *set = find_locked(argv[2].str);
+      err = set ? set_cpus_locked(set, &cpus) : ERR_NOT_FOUND;
+      THREAD_UNLOCK(state);
+    }
+  } else if (!strcmp(argv[1].str, "destroy") && argc == 3) {
+    THREAD_LOCK(state);
+    cpuset_t *set = find_locked(argv[2].str);
+    err = set ? destroy_locked(set) : ERR_NOT_FOUND;
+    THREAD_UNLOCK(state);
+    if (err == NO_ERROR)
+      free(set);
+  } else if (!strcmp(argv[1].str, "add") && argc == 4) {
+    THREAD_LOCK(state);
+    cpuset_t *set = find_locked(argv[2].str);
+    thread_t *t = find_thread_locked(argv[3].p);
+    if (set && t) {
+      set_thread_cpuset_locked(t, set);
+      err = NO_ERROR;
+    } else {
+      err = ERR_NOT_FOUND;
+    }
+    THREAD_UNLOCK(state);
+  } else {
+    printf("usage:\n");
+    printf("\t%s\n", argv[0].str);
+    printf("\t%s create <name> <cpus>\n", argv[0].str);
+    printf("\t%s cpus <name> <cpus>\n", argv[0].str);
+    printf("\t%s destroy <name>\n", argv[0].str);
+    printf("\t%s add <name> <thread>\n", argv[0].str);
+    printf("cpus are a list like 0-3,6 or all\n");
+    return ERR_INVALID_ARGS;
+  }
+
+  if (err < 0)
+    printf("error %d\n", err);
+  return err;
+}
+
+static int cmd_affinity(int argc, const cmd_args *argv, uint32_t flags) {
+  if (argc < 2) {
+    printf("usage: %s <thread> [cpus]\n", argv[0].str);
+    return ERR_INVALID_ARGS;
+  }
+
+  mp_cpu_mask_t cpus;
+  if (argc > 2) {
+    status_t err = cpuset_parse_cpus(argv[2].str, &cpus);
+    if (err < 0) {
+      printf("error %d\n", err);
+      return err;
+    }
+  }
+
+  /* the thread may exit as soon as the lock is dropped, copy out what is printed */
+  char name[sizeof(((thread_t *)0)->name)];
+  char set_name[CPUSET_NAME_LEN];
+  mp_cpu_mask_t affinity, allowed;
+
+  THREAD_LOCK(state);
+  thread_t *t = find_thread_locked(argv[1].p);
+  status_t err = t ? NO_ERROR : ERR_NOT_FOUND;
+  if (t && argc > 2)
+    err = thread_set_affinity_locked(t, &cpus);
+  if (err == NO_ERROR) {
+    strlcpy(name, t->name, sizeof(name));
+    strlcpy(set_name, t->cpuset->name, sizeof(set_name));
+    affinity = t->affinity;
+    thread_get_cpus_allowed_locked(t, &allowed);
+  }
+  THREAD_UNLOCK(state);
+
+  if (err == ERR_NOT_FOUND) {
+    printf("no thread %p\n", argv[1].p);
+    return err;
+  }
+  if (err < 0) {
+    printf("error %d\n", err);
+    return err;
+  }
+
+  char affinity_str[64], allowed_str[64];
+  cpuset_format_cpus(&affinity, affinity_str, sizeof(affinity_str));
+  cpuset_format_cpus(&allowed, allowed_str, sizeof(allowed_str));
+  printf("%p (%s): cpuset %s, affinity %s, runs on %s\n", argv[1].p, name, set_name,
+         affinity_str, allowed_str);
+
+  return NO_ERROR;
+}
+
+STATIC_COMMAND_START
+STATIC_COMMAND("cpuset", "list and manage cpusets", &cmd_cpuset)
+STATIC_COMMAND("affinity", "show or set the cpu affinity of a thread", &cmd_affinity)
+STATIC_COMMAND_END(cpuset);
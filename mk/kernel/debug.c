@@ -78,6 +78,7 @@ static int cmd_threadstats(int argc, const cmd_args *argv, uint32_t flags) {
     printf("\treschedules: %lu\n", thread_stats[i].reschedules);
 #if WITH_SMP
     printf("\treschedule_ipis: %lu\n", thread_stats[i].reschedule_ipis);
+    printf("\tgeneric_ipis: %lu\n", thread_stats[i].generic_ipis);
 #endif
     printf("\tcontext_switches: %lu\n", thread_stats[i].context_switches);
     printf("\tpreempts: %lu\n", thread_stats[i].preempts);
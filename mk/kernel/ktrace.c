@@ -0,0 +1,267 @@
+// Copyright 2025 Mist Tecnologia Ltda
+//
+// Use of this source code is governed by a MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT
+
+#include <kernel/ktrace.h>
+
+#if WITH_KERNEL_KTRACE
+
+#include <lib/evlog.h>
+#include <platform.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <arch/ops.h>
+#include <kernel/mp.h>
+#include <kernel/mutex.h>
+#include <kernel/spinlock.h>
+#include <kernel/thread.h>
+#include <lk/console_cmd.h>
+#include <lk/debug.h>
+#include <lk/err.h>
+#include <lk/pow2.h>
+
+#define KTRACE_RECORD_WORDS 4
+
+static evlog_t ktrace_log[SMP_MAX_CPUS];
+static uint ktrace_records;
+static mutex_t ktrace_lock = MUTEX_INITIAL_VALUE(ktrace_lock);
+volatile bool ktrace_enabled;
+
+lk_bigtime_t ktrace_timestamp(void) { return current_time_hires(); }
+
+void ktrace_add(uint id, uintptr_t arg0, uintptr_t arg1) {
+  /* with interrupts off the record is written before this cpu can take the
+   * call ktrace_stop() waits for, so the buffers cannot go away under it */
+  spin_lock_saved_state_t state;
+  arch_interrupt_save(&state, SPIN_LOCK_FLAG_INTERRUPTS);
+
+  if (ktrace_enabled) {
+    uint cpu = arch_curr_cpu_num();
+    evlog_t *e = &ktrace_log[cpu];
+    uint index = evlog_bump_head_atomic(e);
+
+    e->items[index] = (uintptr_t)current_time_hires();
+    e->items[index + 1] = (cpu << 16) | id;
+    e->items[index + 2] = arg0;
+    e->items[index + 3] = arg1;
+  }
+
+  arch_interrupt_restore(state, SPIN_LOCK_FLAG_INTERRUPTS);
+}
+
+static void ktrace_free_buffers(void) {
+  for (uint i = 0; i < SMP_MAX_CPUS; i++) {
+    free(ktrace_log[i].items);
+    ktrace_log[i].items = NULL;
+  }
+  ktrace_records = 0;
+}
+
+status_t ktrace_start(uint records) {
+  if (records == 0)
+    records = KTRACE_DEFAULT_RECORDS;
+  if (!ispow2(records))
+    return ERR_INVALID_ARGS;
+
+  mutex_acquire(&ktrace_lock);
+
+  ktrace_stop();
+
+  /* reallocating also throws away the previous trace */
+  ktrace_free_buffers();
+  for (uint i = 0; i < SMP_MAX_CPUS; i++) {
+    status_t err = evlog_init(&ktrace_log[i], records * KTRACE_RECORD_WORDS, KTRACE_RECORD_WORDS);
+    if (err < 0) {
+      ktrace_free_buffers();
+      mutex_release(&ktrace_lock);
+      return err;
+    }
+  }
+  ktrace_records = records;
+
+  ktrace_enabled = true;
+
+  mutex_release(&ktrace_lock);
+  return NO_ERROR;
+}
+
+static void ktrace_quiesce(void *arg) {}
+
+void ktrace_stop(void) {
+  ktrace_enabled = false;
+
+  /* writers run with interrupts off, once every cpu has taken an ipi none of
+   * them is still in the middle of a record */
+  mp_cpu_mask_t all;
+  mp_cpu_mask_fill(&all);
+  mp_sync_exec(&all, &ktrace_quiesce, NULL);
+}
+
+static void ktrace_for_each(evlog_dump_cb cb) {
+  mutex_acquire(&ktrace_lock);
+  if (ktrace_records) {
+    bool was_enabled = ktrace_enabled;
+    ktrace_stop();
+    for (uint i = 0; i < SMP_MAX_CPUS; i++) {
+      evlog_dump(&ktrace_log[i], cb);
+    }
+    ktrace_enabled = was_enabled;
+  }
+  mutex_release(&ktrace_lock);
+}
+
+static void ktrace_dump_cb(const uintptr_t *i) {
+  uint id = i[1] & 0xffff;
+  uint cpu = i[1] >> 16;
+  lk_bigtime_t ts = i[0];
+
+  switch (id) {
+    case KTRACE_EV_NULL:
+      /* never written */
+      break;
+    case KTRACE_EV_CONTEXT_SWITCH:
+      printf("%llu.%u: context switch from %p to %p\n", ts, cpu, (void *)i[2], (void *)i[3]);
+      break;
+    case KTRACE_EV_IRQ_ENTER:
+      printf("%llu.%u: irq entry %lu\n", ts, cpu, i[2]);
+      break;
+    case KTRACE_EV_IRQ_EXIT:
+      printf("%llu.%u: irq exit  %lu\n", ts, cpu, i[2]);
+      break;
+    case KTRACE_EV_WAIT_BLOCK:
+      printf("%llu.%u: block on wait queue %p, timeout %ld\n", ts, cpu, (void *)i[2], (long)i[3]);
+      break;
+    case KTRACE_EV_PMM_ALLOC:
+      printf("%llu.%u: pmm alloc %lu pages, got %lu\n", ts, cpu, i[2], i[3]);
+      break;
+    case KTRACE_EV_PMM_FREE:
+      printf("%llu.%u: pmm free %lu pages\n", ts, cpu, i[2]);
+      break;
+    case KTRACE_EV_BIO_READ:
+      printf("%llu.%u: bio read %lu bytes in %lu us\n", ts, cpu, i[2], i[3]);
+      break;
+    case KTRACE_EV_BIO_WRITE:
+      printf("%llu.%u: bio write %lu bytes in %lu us\n", ts, cpu, i[2], i[3]);
+      break;
+    default:
+      printf("%llu.%u: unknown id 0x%x 0x%lx 0x%lx\n", ts, cpu, id, i[2], i[3]);
+  }
+}
+
+void ktrace_dump(void) { ktrace_for_each(&ktrace_dump_cb); }
+
+/*
+ * Chrome trace event format (chrome://tracing, Perfetto). Every cpu shows up
+ * as a thread of a single "kernel" process; timestamps are already in us.
+ */
+static bool ktrace_json_first;
+
+static void ktrace_json_event(const char *name, const char *cat, const char *ph, lk_bigtime_t ts,
+                              uint cpu) {
+  printf("%s\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"%s\",\"ts\":%llu,\"pid\":0,\"tid\":%u",
+         ktrace_json_first ? "" : ",", name, cat, ph, ts, cpu);
+  ktrace_json_first = false;
+}
+
+static void ktrace_json_cb(const uintptr_t *i) {
+  uint id = i[1] & 0xffff;
+  uint cpu = i[1] >> 16;
+  lk_bigtime_t ts = i[0];
+
+  switch (id) {
+    case KTRACE_EV_NULL:
+      return;
+    case KTRACE_EV_CONTEXT_SWITCH:
+      ktrace_json_event("context_switch", "sched", "i", ts, cpu);
+      printf(",\"s\":\"t\",\"args\":{\"from\":\"%p\",\"to\":\"%p\"}}", (void *)i[2],
+             (void *)i[3]);
+      break;
+    case KTRACE_EV_IRQ_ENTER:
+      ktrace_json_event("irq", "irq", "B", ts, cpu);
+      printf(",\"args\":{\"vector\":%lu}}", i[2]);
+      break;
+    case KTRACE_EV_IRQ_EXIT:
+      ktrace_json_event("irq", "irq", "E", ts, cpu);
+      printf("}");
+      break;
+    case KTRACE_EV_WAIT_BLOCK:
+      ktrace_json_event("wait_queue_block", "sched", "i", ts, cpu);
+      printf(",\"s\":\"t\",\"args\":{\"queue\":\"%p\",\"timeout\":%ld}}", (void *)i[2],
+             (long)i[3]);
+      break;
+    case KTRACE_EV_PMM_ALLOC:
+      ktrace_json_event("pmm_alloc", "vm", "i", ts, cpu);
+      printf(",\"s\":\"t\",\"args\":{\"count\":%lu,\"allocated\":%lu}}", i[2], i[3]);
+      break;
+    case KTRACE_EV_PMM_FREE:
+      ktrace_json_event("pmm_free", "vm", "i", ts, cpu);
+      printf(",\"s\":\"t\",\"args\":{\"count\":%lu}}", i[2]);
+      break;
+    case KTRACE_EV_BIO_READ:
+    case KTRACE_EV_BIO_WRITE:
+      /* recorded at completion, turn it into a complete event */
+      ktrace_json_event(id == KTRACE_EV_BIO_READ ? "bio_read" : "bio_write", "bio", "X",
+                        ts - i[3], cpu);
+      printf(",\"dur\":%lu,\"args\":{\"bytes\":%lu}}", i[3], i[2]);
+      break;
+    default:
+      ktrace_json_event("unknown", "unknown", "i", ts, cpu);
+      printf(",\"s\":\"t\",\"args\":{\"id\":%u}}", id);
+  }
+}
+
+void ktrace_dump_json(void) {
+  ktrace_json_first = true;
+  printf("{\"traceEvents\":[");
+  for (uint i = 0; i < SMP_MAX_CPUS; i++) {
+    printf("%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":%u,"
+           "\"args\":{\"name\":\"cpu %u\"}}",
+           ktrace_json_first ? "" : ",", i, i);
+    ktrace_json_first = false;
+  }
+  ktrace_for_each(&ktrace_json_cb);
+  printf("\n]}\n");
+}
+
+static int cmd_ktrace(int argc, const cmd_args *argv, uint32_t flags) {
+  if (argc < 2) {
+  usage:
+    printf("usage:\n");
+    printf("\t%s start [records per cpu, power of 2]\n", argv[0].str);
+    printf("\t%s stop\n", argv[0].str);
+    printf("\t%s dump\n", argv[0].str);
+    printf("\t%s json\n", argv[0].str);
+    return -1;
+  }
+
+  if (!strcmp(argv[1].str, "start")) {
+    uint records = (argc > 2) ? argv[2].u : 0;
+    status_t err = ktrace_start(records);
+    if (err < 0) {
+      printf("error %d starting trace\n", err);
+      return err;
+    }
+    printf("tracing, %u records per cpu\n", ktrace_records);
+  } else if (!strcmp(argv[1].str, "stop")) {
+    ktrace_stop();
+  } else if (!strcmp(argv[1].str, "dump")) {
+    ktrace_dump();
+  } else if (!strcmp(argv[1].str, "json")) {
+    ktrace_dump_json();
+  } else {
+    printf("unrecognized command\n");
+    goto usage;
+  }
+
+  return NO_ERROR;
+}
+
+STATIC_COMMAND_START
+STATIC_COMMAND("ktrace", "kernel event trace", &cmd_ktrace)
+STATIC_COMMAND_END(ktrace);
+
+#endif  // WITH_KERNEL_KTRACE
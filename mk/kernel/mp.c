@@ -7,6 +7,7 @@
  */
 
 #include <assert.h>
+#include <stddef.h>
 #include <stdlib.h>
 
 #include <arch/atomic.h>
@@ -24,27 +25,29 @@ struct mp_state mp __CPU_ALIGN;
 
 void mp_init(void) {}
 
-void mp_reschedule(mp_cpu_mask_t target, uint flags) {
+void mp_reschedule(const mp_cpu_mask_t *target, uint flags) {
   uint local_cpu = arch_curr_cpu_num();
 
-  LTRACEF("local %d, target 0x%x\n", local_cpu, target);
+  LTRACEF("local %d, target 0x%lx\n", local_cpu, target->bits[0]);
 
   /* mask out cpus that are not active and the local cpu */
-  target &= mp.active_cpus;
+  mp_cpu_mask_t mask;
+  mp_cpu_mask_and(&mask, target, &mp.active_cpus);
 
   /* mask out cpus that are currently running realtime code */
   if ((flags & MP_RESCHEDULE_FLAG_REALTIME) == 0) {
-    target &= ~mp.realtime_cpus;
+    mp_cpu_mask_andnot(&mask, &mask, &mp.realtime_cpus);
   }
-  target &= ~(1U << local_cpu);
+  mp_cpu_mask_clear(&mask, local_cpu);
 
-  LTRACEF("local %d, post mask target now 0x%x\n", local_cpu, target);
+  LTRACEF("local %d, post mask target now 0x%lx\n", local_cpu, mask.bits[0]);
 
-  arch_mp_send_ipi(target, MP_IPI_RESCHEDULE);
+  if (!mp_cpu_mask_is_empty(&mask))
+    arch_mp_send_ipi(&mask, MP_IPI_RESCHEDULE);
 }
 
 void mp_set_curr_cpu_active(bool active) {
-  atomic_or((volatile int *)&mp.active_cpus, 1U << arch_curr_cpu_num());
+  mp_cpu_mask_set_atomic(&mp.active_cpus, arch_curr_cpu_num());
 }
 
 enum handler_return mp_mbx_reschedule_irq(void) {
@@ -54,6 +57,188 @@ enum handler_return mp_mbx_reschedule_irq(void) {
 
   THREAD_STATS_INC(reschedule_ipis);
 
-  return (mp.active_cpus & (1U << cpu)) ? INT_RESCHEDULE : INT_NO_RESCHEDULE;
+  return mp_is_cpu_active(cpu) ? INT_RESCHEDULE : INT_NO_RESCHEDULE;
+}
+
+/*
+ * Cross cpu calls. Each cpu has a lock free stack of the calls queued for it,
+ * pushed onto by any cpu and taken off all at once by its owner, which keeps
+ * it clear of ABA. Only a push onto an empty queue sends an ipi, calls made
+ * before the owner gets around to it ride along on the one already sent.
+ *
+ * A call goes onto each target's queue in a node from that target's own small
+ * pool, claimed by setting its bit in the busy mask and given back by the
+ * owner once it has taken the call off. With the pool used up the caller runs
+ * its own queue until the target frees one.
+ */
+#define MP_CALL_NODES 16
+
+struct mp_call_node {
+  struct mp_call_node *next;
+  mp_call_t *call;
+};
+
+struct mp_call_queue {
+  struct mp_call_node *head; /* last call queued */
+  uint32_t busy;             /* nodes on the queue or about to be */
+  struct mp_call_node nodes[MP_CALL_NODES];
+} __CPU_ALIGN;
+
+STATIC_ASSERT(MP_CALL_NODES <= sizeof(((struct mp_call_queue *)0)->busy) * 8);
+
+static struct mp_call_queue call_queue[SMP_MAX_CPUS];
+
+static void run_queued_calls(uint cpu);
+
+static void run_call(mp_call_t *call) {
+  call->func(call->arg);
+  __atomic_fetch_sub(&call->pending, 1, __ATOMIC_RELEASE);
+}
+
+static struct mp_call_node *claim_node(uint cpu) {
+  const uint32_t all = (MP_CALL_NODES == 32) ? ~0u : (1u << MP_CALL_NODES) - 1;
+  struct mp_call_queue *q = &call_queue[cpu];
+  uint32_t busy = __atomic_load_n(&q->busy, __ATOMIC_RELAXED);
+  for (;;) {
+    if (busy == all) {
+      /* the target may be waiting on a call of ours with interrupts disabled */
+      run_queued_calls(arch_curr_cpu_num());
+      busy = __atomic_load_n(&q->busy, __ATOMIC_RELAXED);
+      continue;
+    }
+    uint i = __builtin_ctz(~busy);
+    if (__atomic_compare_exchange_n(&q->busy, &busy, busy | (1u << i), true, __ATOMIC_ACQUIRE,
+                                    __ATOMIC_RELAXED))
+      return &q->nodes[i];
+  }
+}
+
+/* returns true if the queue was empty and the cpu needs to be told */
+static bool queue_call(uint cpu, mp_call_t *call) {
+  struct mp_call_node *node = claim_node(cpu);
+  node->call = call;
+
+  struct mp_call_node *head = __atomic_load_n(&call_queue[cpu].head, __ATOMIC_RELAXED);
+  do {
+    node->next = head;
+  } while (!__atomic_compare_exchange_n(&call_queue[cpu].head, &head, node, true, __ATOMIC_RELEASE,
+                                        __ATOMIC_RELAXED));
+  return head == NULL;
+}
+
+/* run the calls queued for the local cpu, oldest first. interrupts disabled */
+static void run_queued_calls(uint cpu) {
+  struct mp_call_queue *q = &call_queue[cpu];
+  struct mp_call_node *node = __atomic_exchange_n(&q->head, NULL, __ATOMIC_ACQUIRE);
+
+  struct mp_call_node *fifo = NULL;
+  while (node) {
+    struct mp_call_node *next = node->next;
+    node->next = fifo;
+    fifo = node;
+    node = next;
+  }
+
+  while (fifo) {
+    /* the node can be claimed again as soon as it is given back */
+    struct mp_call_node *next = fifo->next;
+    mp_call_t *call = fifo->call;
+    __atomic_fetch_and(&q->busy, ~(1u << (fifo - q->nodes)), __ATOMIC_RELEASE);
+
+    /* and the call may be gone as soon as it has run */
+    run_call(call);
+    fifo = next;
+  }
+}
+
+void mp_async_exec(const mp_cpu_mask_t *target, mp_call_t *call, mp_call_func_t func, void *arg) {
+  spin_lock_saved_state_t state;
+  arch_interrupt_save(&state, SPIN_LOCK_FLAG_INTERRUPTS);
+
+  uint local_cpu = arch_curr_cpu_num();
+
+  mp_cpu_mask_t mask;
+  mp_cpu_mask_and(&mask, target, &mp.active_cpus);
+  bool local = mp_cpu_mask_test(&mask, local_cpu);
+  mp_cpu_mask_clear(&mask, local_cpu);
+
+  call->func = func;
+  call->arg = arg;
+  call->pending = mp_cpu_mask_count(&mask) + local;
+
+  LTRACEF("local %u, target 0x%lx, call %p\n", local_cpu, mask.bits[0], call);
+
+  mp_cpu_mask_t ipi;
+  mp_cpu_mask_zero(&ipi);
+  int cpu;
+  mp_cpu_mask_for_each(cpu, &mask) {
+    if (queue_call(cpu, call))
+      mp_cpu_mask_set(&ipi, cpu);
+  }
+  if (!mp_cpu_mask_is_empty(&ipi))
+    arch_mp_send_ipi(&ipi, MP_IPI_GENERIC);
+
+  /* the local part runs while the others are on their way */
+  if (local)
+    run_call(call);
+
+  arch_interrupt_restore(state, SPIN_LOCK_FLAG_INTERRUPTS);
+}
+
+void mp_call_wait(mp_call_t *call) {
+  while (!mp_call_done(call)) {
+    /* a cpu we are waiting on may itself be waiting on us, with interrupts
+     * disabled run what it queued here by hand */
+    if (arch_ints_disabled())
+      run_queued_calls(arch_curr_cpu_num());
+  }
+}
+
+void mp_sync_exec(const mp_cpu_mask_t *target, mp_call_func_t func, void *arg) {
+  spin_lock_saved_state_t state;
+  arch_interrupt_save(&state, SPIN_LOCK_FLAG_INTERRUPTS);
+
+  mp_call_t call;
+  mp_async_exec(target, &call, func, arg);
+  mp_call_wait(&call);
+
+  arch_interrupt_restore(state, SPIN_LOCK_FLAG_INTERRUPTS);
+}
+
+enum handler_return mp_mbx_generic_irq(void) {
+  uint cpu = arch_curr_cpu_num();
+
+  LTRACEF("cpu %u\n", cpu);
+
+  THREAD_STATS_INC(generic_ipis);
+
+  run_queued_calls(cpu);
+
+  return INT_NO_RESCHEDULE;
+}
+#else
+/* only the local cpu to run on */
+void mp_async_exec(const mp_cpu_mask_t *target, mp_call_t *call, mp_call_func_t func, void *arg) {
+  call->func = func;
+  call->arg = arg;
+  call->pending = 0;
+
+  if (mp_cpu_mask_test(target, arch_curr_cpu_num())) {
+    spin_lock_saved_state_t state;
+    arch_interrupt_save(&state, SPIN_LOCK_FLAG_INTERRUPTS);
+    func(arg);
+    arch_interrupt_restore(state, SPIN_LOCK_FLAG_INTERRUPTS);
+  }
+}
+
+void mp_call_wait(mp_call_t *call) { DEBUG_ASSERT(mp_call_done(call)); }
+
+void mp_sync_exec(const mp_cpu_mask_t *target, mp_call_func_t func, void *arg) {
+  if (mp_cpu_mask_test(target, arch_curr_cpu_num())) {
+    spin_lock_saved_state_t state;
+    arch_interrupt_save(&state, SPIN_LOCK_FLAG_INTERRUPTS);
+    func(arg);
+    arch_interrupt_restore(state, SPIN_LOCK_FLAG_INTERRUPTS);
+  }
 }
 #endif
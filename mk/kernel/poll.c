@@ -0,0 +1,324 @@
+// Copyright 2025 Mist Tecnologia Ltda
+//
+// Use of this source code is governed by a MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT
+
+#include <kernel/poll.h>
+
+#include <assert.h>
+#include <lib/slab.h>
+#include <malloc.h>
+
+#include <kernel/thread.h>
+#include <lk/debug.h>
+#include <lk/err.h>
+
+#define POLLSET_MAGIC (0x706c7374)  // 'plst'
+
+/* always reported, whatever the registration asked for */
+#define POLL_ALWAYS (POLL_HUP | POLL_ERR)
+
+/* one source registered with one poll set */
+typedef struct poll_entry {
+  struct list_node source_node; /* on source->watchers */
+  struct list_node set_node;    /* on set->entries */
+  struct list_node ready_node;  /* on set->ready while there may be something to report */
+  poll_set_t *set;
+  poll_source_t *source;
+  uint events;
+  uint flags;
+  uint pending; /* notified bits not reported yet, edge triggered only */
+  void *cookie;
+} poll_entry_t;
+
+struct poll_set {
+  int magic;
+  wait_queue_t wait;
+  struct list_node entries;
+  struct list_node ready;
+};
+
+static slab_cache_t poll_entry_cache =
+    SLAB_CACHE_TYPED_INITIAL_VALUE(poll_entry_cache, "poll_entry", poll_entry_t);
+
+static void free_entries(struct list_node *list) {
+  poll_entry_t *e;
+  while ((e = list_remove_head_type(list, poll_entry_t, set_node)) != NULL) {
+    slab_cache_free(&poll_entry_cache, e);
+  }
+}
+
+// thread lock held
+static void entry_make_ready(poll_entry_t *e) {
+  if (!list_in_list(&e->ready_node)) {
+    list_add_tail(&e->set->ready, &e->ready_node);
+    wait_queue_wake_one(&e->set->wait, false, NO_ERROR);
+  }
+}
+
+// thread lock held, moves the entry to |freed|
+static void entry_unlink(poll_entry_t *e, struct list_node *freed) {
+  list_delete(&e->source_node);
+  list_delete(&e->set_node);
+  if (list_in_list(&e->ready_node))
+    list_delete(&e->ready_node);
+  list_add_tail(freed, &e->set_node);
+}
+
+// thread lock held
+static poll_entry_t *find_entry(poll_set_t *set, poll_source_t *source) {
+  poll_entry_t *e;
+  list_for_every_entry (&source->watchers, e, poll_entry_t, source_node) {
+    if (e->set == set)
+      return e;
+  }
+  return NULL;
+}
+
+// thread lock held, picks up whatever the source already has ready
+static void entry_arm(poll_entry_t *e) {
+  uint ready = e->source->query(e->source) & (e->events | POLL_ALWAYS);
+  if (ready) {
+    e->pending |= ready;
+    entry_make_ready(e);
+  }
+}
+
+void poll_source_init(poll_source_t *source, poll_query_t query) {
+  DEBUG_ASSERT(query);
+
+  list_initialize(&source->watchers);
+  source->query = query;
+}
+
+void poll_source_destroy(poll_source_t *source) {
+  struct list_node freed = LIST_INITIAL_VALUE(freed);
+
+  THREAD_LOCK(state);
+  poll_entry_t *e;
+  while ((e = list_peek_head_type(&source->watchers, poll_entry_t, source_node)) != NULL) {
+    entry_unlink(e, &freed);
+  }
+  THREAD_UNLOCK(state);
+
+  free_entries(&freed);
+}
+
+void poll_source_notify_locked(poll_source_t *source, uint events) {
+  DEBUG_ASSERT(thread_lock_held());
+
+  poll_entry_t *e;
+  list_for_every_entry (&source->watchers, e, poll_entry_t, source_node) {
+    uint ready = events & (e->events | POLL_ALWAYS);
+    if (ready) {
+      e->pending |= ready;
+      entry_make_ready(e);
+    }
+  }
+}
+
+void poll_source_notify(poll_source_t *source, uint events) {
+  /* nobody watching, which is the common case on the data path. a registration
+   * racing with this sees the new state when poll_set_add() queries the source */
+  if (list_is_empty(&source->watchers))
+    return;
+
+  THREAD_LOCK(state);
+  poll_source_notify_locked(source, events);
+  THREAD_UNLOCK(state);
+}
+
+status_t poll_set_create(poll_set_t **set) {
+  if (!set)
+    return ERR_INVALID_ARGS;
+
+  poll_set_t *ps = calloc(1, sizeof(poll_set_t));
+  if (!ps)
+    return ERR_NO_MEMORY;
+
+  ps->magic = POLLSET_MAGIC;
+  wait_queue_init(&ps->wait);
+  list_initialize(&ps->entries);
+  list_initialize(&ps->ready);
+
+  *set = ps;
+  return NO_ERROR;
+}
+
+status_t poll_set_destroy(poll_set_t *set) {
+  if (!set)
+    return ERR_INVALID_ARGS;
+
+  struct list_node freed = LIST_INITIAL_VALUE(freed);
+
+  THREAD_LOCK(state);
+  if (set->magic != POLLSET_MAGIC) {
+    THREAD_UNLOCK(state);
+    return ERR_BAD_HANDLE;
+  }
+
+  poll_entry_t *e;
+  while ((e = list_peek_head_type(&set->entries, poll_entry_t, set_node)) != NULL) {
+    entry_unlink(e, &freed);
+  }
+
+  // wake up waiters, the return code is ERR_OBJECT_DESTROYED.
+  wait_queue_destroy(&set->wait, true);
+  set->magic = 0;
+  THREAD_UNLOCK(state);
+
+  free_entries(&freed);
+  free(set);
+  return NO_ERROR;
+}
+
+status_t poll_set_add(poll_set_t *set, poll_source_t *source, uint events, uint flags,
+                      void *cookie) {
+  if (!set || !source)
+    return ERR_INVALID_ARGS;
+
+  // allocate outside the lock, assuming success.
+  poll_entry_t *e = slab_cache_alloc(&poll_entry_cache);
+  if (!e)
+    return ERR_NO_MEMORY;
+
+  e->set = set;
+  e->source = source;
+  e->events = events;
+  e->flags = flags;
+  e->pending = 0;
+  e->cookie = cookie;
+  list_clear_node(&e->ready_node);
+
+  status_t rc = NO_ERROR;
+
+  THREAD_LOCK(state);
+  if (set->magic != POLLSET_MAGIC) {
+    rc = ERR_BAD_HANDLE;
+  } else if (find_entry(set, source)) {
+    rc = ERR_ALREADY_EXISTS;
+  } else {
+    list_add_tail(&source->watchers, &e->source_node);
+    list_add_tail(&set->entries, &e->set_node);
+    entry_arm(e);
+  }
+  THREAD_UNLOCK(state);
+
+  if (rc != NO_ERROR)
+    slab_cache_free(&poll_entry_cache, e);
+  return rc;
+}
+
+status_t poll_set_modify(poll_set_t *set, poll_source_t *source, uint events, uint flags,
+                         void *cookie) {
+  if (!set || !source)
+    return ERR_INVALID_ARGS;
+
+  status_t rc = NO_ERROR;
+
+  THREAD_LOCK(state);
+  poll_entry_t *e = (set->magic == POLLSET_MAGIC) ? find_entry(set, source) : NULL;
+  if (!e) {
+    rc = ERR_NOT_FOUND;
+  } else {
+    e->events = events;
+    e->flags = flags;
+    e->cookie = cookie;
+    e->pending = 0;
+    if (list_in_list(&e->ready_node))
+      list_delete(&e->ready_node);
+    entry_arm(e);
+  }
+  THREAD_UNLOCK(state);
+
+  return rc;
+}
+
+status_t poll_set_remove(poll_set_t *set, poll_source_t *source) {
+  if (!set || !source)
+    return ERR_INVALID_ARGS;
+
+  struct list_node freed = LIST_INITIAL_VALUE(freed);
+  status_t rc = NO_ERROR;
+
+  THREAD_LOCK(state);
+  poll_entry_t *e = (set->magic == POLLSET_MAGIC) ? find_entry(set, source) : NULL;
+  if (!e) {
+    rc = ERR_NOT_FOUND;
+  } else {
+    entry_unlink(e, &freed);
+  }
+  THREAD_UNLOCK(state);
+
+  free_entries(&freed);
+  return rc;
+}
+
+// thread lock held
+static size_t collect_events(poll_set_t *set, poll_event_t *events, size_t count) {
+  /* level triggered entries that are still ready go to the back of the list
+   * once reported, so a busy source cannot starve the others */
+  struct list_node still_ready = LIST_INITIAL_VALUE(still_ready);
+  size_t n = 0;
+
+  poll_entry_t *e;
+  while (n < count && (e = list_remove_head_type(&set->ready, poll_entry_t, ready_node)) != NULL) {
+    uint ready;
+    if (e->flags & POLL_FLAG_EDGE) {
+      ready = e->pending;
+    } else {
+      ready = e->source->query(e->source) & (e->events | POLL_ALWAYS);
+      if (ready)
+        list_add_tail(&still_ready, &e->ready_node);
+    }
+    e->pending = 0;
+
+    if (ready) {
+      events[n].cookie = e->cookie;
+      events[n].events = ready;
+      n++;
+    }
+  }
+
+  while ((e = list_remove_head_type(&still_ready, poll_entry_t, ready_node)) != NULL) {
+    list_add_tail(&set->ready, &e->ready_node);
+  }
+
+  return n;
+}
+
+ssize_t poll_set_wait(poll_set_t *set, poll_event_t *events, size_t count, lk_time_t timeout) {
+  if (!set || !events || count == 0)
+    return ERR_INVALID_ARGS;
+
+  ssize_t rc;
+
+  THREAD_LOCK(state);
+  if (set->magic != POLLSET_MAGIC) {
+    rc = ERR_BAD_HANDLE;
+    goto out;
+  }
+
+  for (;;) {
+    rc = collect_events(set, events, count);
+    if (rc > 0)
+      break;
+
+    if (!timeout) {
+      rc = ERR_TIMED_OUT;
+      break;
+    }
+
+    // don't touch the set after a failed wait, it may have been destroyed.
+    status_t wr = wait_queue_block(&set->wait, timeout);
+    if (wr != NO_ERROR) {
+      rc = wr;
+      break;
+    }
+  }
+
+out:
+  THREAD_UNLOCK(state);
+  return rc;
+}
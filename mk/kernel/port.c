@@ -13,9 +13,12 @@
  *
  */
 
+#include <lib/slab.h>
 #include <malloc.h>
+#include <stdlib.h>
 #include <string.h>
 
+#include <kernel/poll.h>
 #include <kernel/port.h>
 #include <kernel/thread.h>
 #include <lk/debug.h>
@@ -39,20 +42,27 @@
 
 #define MAX_PORT_GROUP_COUNT 256
 
+// the packets of a payload port own out-of-line buffers.
+#define PORT_BUF_FLAG_PAYLOAD 0x1
+
 typedef struct {
   uint log2;
   uint avail;
   uint head;
   uint tail;
+  uint flags;
   port_packet_t packet[1];
 } port_buf_t;
 
+#define PORT_BUF_BYTES(pk_count) (sizeof(port_buf_t) + (((pk_count)-1) * sizeof(port_packet_t)))
+
 typedef struct {
   int magic;
   struct list_node node;
   port_buf_t *buf;
   struct list_node rp_list;
   port_mode_t mode;
+  uint depth;
   char name[PORT_NAME_LEN];
 } write_port_t;
 
@@ -60,6 +70,7 @@ typedef struct {
   int magic;
   wait_queue_t wait;
   struct list_node rp_list;
+  poll_source_t poll;
 } port_group_t;
 
 typedef struct {
@@ -71,24 +82,60 @@ typedef struct {
   wait_queue_t wait;
   write_port_t *wport;
   port_group_t *gport;
+  poll_source_t poll;
 } read_port_t;
 
 static struct list_node write_port_list;
 
-static port_buf_t *make_buf(bool big) {
-  uint pk_count = big ? PORT_BUFF_SIZE_BIG : PORT_BUFF_SIZE;
-  uint size = sizeof(port_buf_t) + ((pk_count - 1) * sizeof(port_packet_t));
-  port_buf_t *buf = (port_buf_t *)malloc(size);
+static slab_cache_t buf_cache =
+    SLAB_CACHE_INITIAL_VALUE(buf_cache, "port_buf", PORT_BUF_BYTES(PORT_BUFF_SIZE),
+                             __alignof__(port_buf_t), NULL, NULL);
+static slab_cache_t big_buf_cache =
+    SLAB_CACHE_INITIAL_VALUE(big_buf_cache, "port_buf_big", PORT_BUF_BYTES(PORT_BUFF_SIZE_BIG),
+                             __alignof__(port_buf_t), NULL, NULL);
+
+// the two default depths come from slab caches, anything else from the heap.
+static port_buf_t *make_buf(uint pk_count, uint flags) {
+  port_buf_t *buf;
+  if (pk_count == PORT_BUFF_SIZE) {
+    buf = (port_buf_t *)slab_cache_alloc(&buf_cache);
+  } else if (pk_count == PORT_BUFF_SIZE_BIG) {
+    buf = (port_buf_t *)slab_cache_alloc(&big_buf_cache);
+  } else {
+    buf = (port_buf_t *)malloc(PORT_BUF_BYTES(pk_count));
+  }
   if (!buf)
     return NULL;
   buf->log2 = log2_uint(pk_count);
   buf->head = buf->tail = 0;
   buf->avail = pk_count;
+  buf->flags = flags;
   return buf;
 }
 
 static inline bool buf_is_empty(port_buf_t *buf) { return buf->avail == valpow2(buf->log2); }
 
+static void free_buf(port_buf_t *buf) {
+  if (!buf)
+    return;
+
+  // unread payloads still belong to the port.
+  if (buf->flags & PORT_BUF_FLAG_PAYLOAD) {
+    for (; !buf_is_empty(buf); buf->head = modpow2(buf->head + 1, buf->log2), ++buf->avail) {
+      port_payload_free(port_packet_to_payload(&buf->packet[buf->head]).buf);
+    }
+  }
+
+  uint pk_count = valpow2(buf->log2);
+  if (pk_count == PORT_BUFF_SIZE) {
+    slab_cache_free(&buf_cache, buf);
+  } else if (pk_count == PORT_BUFF_SIZE_BIG) {
+    slab_cache_free(&big_buf_cache, buf);
+  } else {
+    free(buf);
+  }
+}
+
 static status_t buf_write(port_buf_t *buf, const port_packet_t *packets, size_t count) {
   if (buf->avail < count)
     return ERR_NOT_ENOUGH_BUFFER;
@@ -110,10 +157,43 @@ static status_t buf_read(port_buf_t *buf, port_result_t *pr) {
   return NO_ERROR;
 }
 
+// thread lock held.
+static uint read_port_poll_query(poll_source_t *source) {
+  read_port_t *rp = containerof(source, read_port_t, poll);
+  if (rp->magic != READPORT_MAGIC)
+    return POLL_HUP;
+
+  uint ready = buf_is_empty(rp->buf) ? 0 : POLL_IN;
+  if (!rp->wport)
+    ready |= POLL_HUP;
+  return ready;
+}
+
+// thread lock held.
+static uint port_group_poll_query(poll_source_t *source) {
+  port_group_t *pg = containerof(source, port_group_t, poll);
+  if (pg->magic != PORTGROUP_MAGIC)
+    return POLL_HUP;
+
+  uint ready = 0;
+  read_port_t *rp;
+  list_for_every_entry (&pg->rp_list, rp, read_port_t, g_node) {
+    if (!buf_is_empty(rp->buf))
+      ready |= POLL_IN;
+    if (!rp->wport)
+      ready |= POLL_HUP;
+  }
+  return ready;
+}
+
 // must be called before any use of ports.
 void port_init(void) { list_initialize(&write_port_list); }
 
 status_t port_create(const char *name, port_mode_t mode, port_t *port) {
+  return port_create_etc(name, mode, 0, port);
+}
+
+status_t port_create_etc(const char *name, port_mode_t mode, uint depth, port_t *port) {
   if (!name || !port)
     return ERR_INVALID_ARGS;
 
@@ -123,6 +203,15 @@ status_t port_create(const char *name, port_mode_t mode, port_t *port) {
       return ERR_INVALID_ARGS;
   }
 
+  // a payload can only have one owner.
+  if ((mode & PORT_MODE_PAYLOAD) && !(mode & PORT_MODE_UNICAST))
+    return ERR_INVALID_ARGS;
+
+  if (depth == 0)
+    depth = (mode & PORT_MODE_BIG_BUFFER) ? PORT_BUFF_SIZE_BIG : PORT_BUFF_SIZE;
+  if (!ispow2(depth) || depth > PORT_MAX_DEPTH)
+    return ERR_INVALID_ARGS;
+
   if (strlen(name) >= PORT_NAME_LEN)
     return ERR_INVALID_ARGS;
 
@@ -152,10 +241,11 @@ status_t port_create(const char *name, port_mode_t mode, port_t *port) {
 
   wp->magic = WRITEPORT_MAGIC_W;
   wp->mode = mode;
+  wp->depth = depth;
   strlcpy(wp->name, name, sizeof(wp->name));
   list_initialize(&wp->rp_list);
 
-  wp->buf = make_buf(mode & PORT_MODE_BIG_BUFFER);
+  wp->buf = make_buf(depth, (mode & PORT_MODE_PAYLOAD) ? PORT_BUF_FLAG_PAYLOAD : 0);
   if (!wp->buf) {
     free(wp);
     return ERR_NO_MEMORY;
@@ -183,11 +273,12 @@ status_t port_open(const char *name, void *ctx, port_t *port) {
   rp->magic = READPORT_MAGIC;
   wait_queue_init(&rp->wait);
   rp->ctx = ctx;
+  poll_source_init(&rp->poll, &read_port_poll_query);
 
   // |buf| might not be needed, but we always allocate outside the lock.
   // this buffer is only needed for broadcast ports, but we don't know
   // that here.
-  port_buf_t *buf = make_buf(false);  // Small is enough.
+  port_buf_t *buf = make_buf(PORT_BUFF_SIZE, 0);  // Small is enough.
   if (!buf) {
     free(rp);
     return ERR_NO_MEMORY;
@@ -229,8 +320,7 @@ status_t port_open(const char *name, void *ctx, port_t *port) {
   }
   THREAD_UNLOCK(state);
 
-  if (buf)
-    free(buf);
+  free_buf(buf);
 
   if (rc == NO_ERROR) {
     *port = (void *)rp;
@@ -259,6 +349,7 @@ status_t port_group(port_t *ports, size_t count, port_t *group) {
   pg->magic = PORTGROUP_MAGIC;
   wait_queue_init(&pg->wait);
   list_initialize(&pg->rp_list);
+  poll_source_init(&pg->poll, &port_group_poll_query);
 
   status_t rc = NO_ERROR;
 
@@ -314,6 +405,7 @@ status_t port_group_add(port_t group, port_t port) {
     // any readers that might be present.
     if (!buf_is_empty(rp->buf)) {
       wait_queue_wake_one(&pg->wait, false, NO_ERROR);
+      poll_source_notify_locked(&pg->poll, POLL_IN);
     }
   }
 
@@ -358,6 +450,11 @@ status_t port_group_remove(port_t group, port_t port) {
 }
 
 status_t port_write(port_t port, const port_packet_t *pk, size_t count) {
+  return port_write_etc(port, pk, count, 0);
+}
+
+static status_t write_internal(port_t port, const port_packet_t *pk, size_t count, uint flags,
+                               bool payload) {
   if (!port || !pk)
     return ERR_INVALID_ARGS;
 
@@ -369,6 +466,12 @@ status_t port_write(port_t port, const port_packet_t *pk, size_t count) {
     return ERR_BAD_HANDLE;
   }
 
+  if (!!(wp->mode & PORT_MODE_PAYLOAD) != payload) {
+    // payload ports only carry payloads and the other way around.
+    THREAD_UNLOCK(state);
+    return ERR_NOT_ALLOWED;
+  }
+
   status_t status = NO_ERROR;
   int awake_count = 0;
 
@@ -386,8 +489,11 @@ status_t port_write(port_t port, const port_packet_t *pk, size_t count) {
         continue;
       }
 
+      poll_source_notify_locked(&rp->poll, POLL_IN);
+
       int awaken = 0;
       if (rp->gport) {
+        poll_source_notify_locked(&rp->gport->poll, POLL_IN);
         awaken = wait_queue_wake_one(&rp->gport->wait, false, NO_ERROR);
       }
       if (!awaken) {
@@ -401,13 +507,33 @@ status_t port_write(port_t port, const port_packet_t *pk, size_t count) {
   THREAD_UNLOCK(state);
 
 #if RESCHEDULE_POLICY
-  if (awake_count)
+  // the woken readers run once the writer blocks or its quantum ends.
+  if (awake_count && !(flags & PORT_WRITE_FLAG_NORESCHED))
     thread_yield();
 #endif
 
   return status;
 }
 
+status_t port_write_etc(port_t port, const port_packet_t *pk, size_t count, uint flags) {
+  return write_internal(port, pk, count, flags, false);
+}
+
+void *port_payload_alloc(size_t len) { return malloc(len); }
+
+void port_payload_free(void *buf) { free(buf); }
+
+status_t port_write_payload(port_t port, void *buf, size_t len, uint flags) {
+  if (!buf)
+    return ERR_INVALID_ARGS;
+
+  port_packet_t pk;
+  port_payload_t payload = {.buf = buf, .len = len};
+  memcpy(pk.value, &payload, sizeof(payload));
+
+  return write_internal(port, &pk, 1, flags, true);
+}
+
 static inline status_t read_no_lock(read_port_t *rp, lk_time_t timeout, port_result_t *result) {
   status_t status = buf_read(rp->buf, result);
   result->ctx = rp->ctx;
@@ -426,6 +552,59 @@ static inline status_t read_no_lock(read_port_t *rp, lk_time_t timeout, port_res
   return read_no_lock(rp, timeout, result);
 }
 
+// reads up to |count| more packets without blocking.
+static size_t read_many_no_lock(read_port_t *rp, port_result_t *results, size_t count) {
+  size_t n = 0;
+  while (n < count && buf_read(rp->buf, &results[n]) == NO_ERROR) {
+    results[n].ctx = rp->ctx;
+    n++;
+  }
+  return n;
+}
+
+ssize_t port_read_many(port_t port, lk_time_t timeout, port_result_t *results, size_t count) {
+  if (!port || !results || !count)
+    return ERR_INVALID_ARGS;
+
+  ssize_t rc = ERR_GENERIC;
+  read_port_t *rp = (read_port_t *)port;
+
+  THREAD_LOCK(state);
+  if (rp->magic == READPORT_MAGIC) {
+    // dealing with a single port, block for the first packet only.
+    rc = read_no_lock(rp, timeout, &results[0]);
+    if (rc == NO_ERROR)
+      rc = 1 + read_many_no_lock(rp, &results[1], count - 1);
+  } else if (rp->magic == PORTGROUP_MAGIC) {
+    // dealing with a port group.
+    port_group_t *pg = (port_group_t *)port;
+    do {
+      size_t n = 0;
+      list_for_every_entry (&pg->rp_list, rp, read_port_t, g_node) {
+        n += read_many_no_lock(rp, &results[n], count - n);
+        if (n == count)
+          break;
+      }
+      if (n) {
+        rc = n;
+        break;
+      }
+      if (!timeout) {
+        rc = ERR_TIMED_OUT;
+        break;
+      }
+      // no data, block on the group waitqueue.
+      rc = wait_queue_block(&pg->wait, timeout);
+    } while (rc == NO_ERROR);
+  } else {
+    // wrong port type.
+    rc = ERR_BAD_HANDLE;
+  }
+
+  THREAD_UNLOCK(state);
+  return rc;
+}
+
 status_t port_read(port_t port, lk_time_t timeout, port_result_t *result) {
   if (!port || !result)
     return ERR_INVALID_ARGS;
@@ -486,8 +665,10 @@ status_t port_destroy(port_t port) {
     list_for_every_entry (&wp->rp_list, rp, read_port_t, w_node) {
       // wake the read and group ports.
       wait_queue_wake_all(&rp->wait, false, ERR_CANCELLED);
+      poll_source_notify_locked(&rp->poll, POLL_HUP);
       if (rp->gport) {
         wait_queue_wake_all(&rp->gport->wait, false, ERR_CANCELLED);
+        poll_source_notify_locked(&rp->gport->poll, POLL_HUP);
       }
       // remove self from reader ports.
       rp->wport = NULL;
@@ -497,7 +678,7 @@ status_t port_destroy(port_t port) {
   wp->magic = 0;
   THREAD_UNLOCK(state);
 
-  free(buf);
+  free_buf(buf);
   free(wp);
   return NO_ERROR;
 }
@@ -508,10 +689,12 @@ status_t port_close(port_t port) {
 
   read_port_t *rp = (read_port_t *)port;
   port_buf_t *buf = NULL;
+  poll_source_t *poll;
 
   THREAD_LOCK(state);
   if (rp->magic == READPORT_MAGIC) {
     // dealing with a read port.
+    poll = &rp->poll;
     if (rp->wport) {
       // remove self from write port list and reassign the bufer if last.
       list_delete(&rp->w_node);
@@ -521,6 +704,9 @@ status_t port_close(port_t port) {
       } else {
         buf = rp->buf;
       }
+    } else {
+      // the write port is gone, and whatever was left unread with it.
+      buf = rp->buf;
     }
     if (rp->gport) {
       // remove self from port group list.
@@ -533,6 +719,7 @@ status_t port_close(port_t port) {
   } else if (rp->magic == PORTGROUP_MAGIC) {
     // dealing with a port group.
     port_group_t *pg = (port_group_t *)port;
+    poll = &pg->poll;
     // wake up waiters.
     wait_queue_destroy(&pg->wait, true);
     // remove self from reader ports.
@@ -557,7 +744,22 @@ status_t port_close(port_t port) {
 
   THREAD_UNLOCK(state);
 
-  free(buf);
+  // the magic is gone, so poll sets that still watch the port only see POLL_HUP.
+  poll_source_destroy(poll);
+
+  free_buf(buf);
   free(port);
   return NO_ERROR;
 }
+
+poll_source_t *port_poll_source(port_t port) {
+  if (!port)
+    return NULL;
+
+  read_port_t *rp = (read_port_t *)port;
+  if (rp->magic == READPORT_MAGIC)
+    return &rp->poll;
+  if (rp->magic == PORTGROUP_MAGIC)
+    return &((port_group_t *)port)->poll;
+  return NULL;
+}
@@ -12,19 +12,31 @@ MODULE := $(LOCAL_DIR)
 MODULE_DEPS := \
 	lib/libc \
 	lib/heap \
-	lib/ktl
+	lib/ktl \
+	lib/slab
 
 MODULE_SRCS := \
+	$(LOCAL_DIR)/cpuset.c \
 	$(LOCAL_DIR)/debug.c \
 	$(LOCAL_DIR)/event.c \
 	$(LOCAL_DIR)/init.c \
+	$(LOCAL_DIR)/ktrace.c \
 	$(LOCAL_DIR)/mutex.c \
+	$(LOCAL_DIR)/sched_latency.c \
 	$(LOCAL_DIR)/thread.c \
 	$(LOCAL_DIR)/timer.c \
 	$(LOCAL_DIR)/semaphore.c \
 	$(LOCAL_DIR)/mp.c \
+	$(LOCAL_DIR)/poll.c \
 	$(LOCAL_DIR)/port.c
 
+# per cpu binary event trace, see kernel/ktrace.c
+WITH_KERNEL_KTRACE ?= 1
+ifeq ($(WITH_KERNEL_KTRACE),1)
+MODULE_DEPS += lib/evlog
+GLOBAL_DEFINES += WITH_KERNEL_KTRACE=1
+endif
+
 ifeq ($(WITH_KERNEL_VM),1)
 MODULE_DEPS += kernel/vm
 else
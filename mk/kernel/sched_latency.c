@@ -0,0 +1,267 @@
+// Copyright 2025 Mist Tecnologia Ltda
+//
+// Use of this source code is governed by a MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT
+
+#include <kernel/sched_latency.h>
+
+#include <platform.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <kernel/mp.h>
+#include <kernel/thread.h>
+#include <lk/console_cmd.h>
+#include <lk/debug.h>
+#include <lk/err.h>
+#include <pretty/hexdump.h>
+
+uint64_t sched_hist_count(const struct sched_hist *h) {
+  uint64_t count = 0;
+  for (uint i = 0; i < SCHED_HIST_BUCKETS; i++) {
+    count += __atomic_load_n(&h->counts[i], __ATOMIC_RELAXED);
+  }
+  return count;
+}
+
+uint64_t sched_hist_percentile(const struct sched_hist *h, uint percent) {
+  uint64_t count = sched_hist_count(h);
+  if (count == 0)
+    return 0;
+
+  /* the rank of the sample we are after, counting from 1 */
+  uint64_t rank = (count * percent + 99) / 100;
+  if (rank == 0)
+    rank = 1;
+
+  uint64_t seen = 0;
+  for (uint i = 0; i < SCHED_HIST_BUCKETS - 1; i++) {
+    seen += __atomic_load_n(&h->counts[i], __ATOMIC_RELAXED);
+    if (seen >= rank)
+      return sched_hist_bucket_min(i + 1);
+  }
+  return sched_hist_bucket_min(SCHED_HIST_BUCKETS - 1);
+}
+
+#if THREAD_STATS
+
+STATIC_ASSERT(sizeof(struct sched_latency_export_header) == 32);
+STATIC_ASSERT(sizeof(struct sched_latency_export_record) % 8 == 0);
+
+static void copy_hist(uint32_t *dst, const struct sched_hist *h) {
+  for (uint i = 0; i < SCHED_HIST_BUCKETS; i++) {
+    dst[i] = __atomic_load_n(&h->counts[i], __ATOMIC_RELAXED);
+  }
+}
+
+static uint count_threads_locked(void) {
+  uint count = 0;
+  thread_t *t;
+  list_for_every_entry (&thread_list, t, thread_t, thread_list_node) {
+    if (!(t->flags & THREAD_FLAG_IDLE))
+      count++;
+  }
+  return count;
+}
+
+ssize_t sched_latency_export(void *buf, size_t len) {
+  struct sched_latency_export_header *header = buf;
+  struct sched_latency_export_record *r = (void *)(header + 1);
+  lk_bigtime_t now = current_time_hires();
+
+  THREAD_LOCK(state);
+
+  uint records = SMP_MAX_CPUS + count_threads_locked();
+  size_t size = sizeof(*header) + records * sizeof(*r);
+  if (!buf || len < size) {
+    THREAD_UNLOCK(state);
+    return buf ? ERR_NOT_ENOUGH_BUFFER : (ssize_t)size;
+  }
+
+  memset(buf, 0, size);
+  header->magic = SCHED_LATENCY_EXPORT_MAGIC;
+  header->version = SCHED_LATENCY_EXPORT_VERSION;
+  header->header_size = sizeof(*header);
+  header->record_size = sizeof(*r);
+  header->sub_bits = SCHED_HIST_SUB_BITS;
+  header->max_shift = SCHED_HIST_MAX_SHIFT;
+  header->bucket_count = SCHED_HIST_BUCKETS;
+  header->record_count = records;
+  header->timestamp = now;
+
+  for (uint i = 0; i < SMP_MAX_CPUS; i++, r++) {
+    const struct thread_stats *s = &thread_stats[i];
+    r->type = SCHED_LATENCY_RECORD_CPU;
+    r->cpu = i;
+    snprintf(r->name, sizeof(r->name), "cpu %u", i);
+    r->run_time = mp_is_cpu_active(i) ? now - s->idle_time : 0;
+    r->schedules = s->context_switches;
+    r->preemptions = s->preempts;
+    r->involuntary_switches = s->involuntary_switches;
+    copy_hist(r->wakeup_latency, &s->wakeup_latency);
+    copy_hist(r->queue_wait, &s->queue_wait);
+  }
+
+  thread_t *t;
+  list_for_every_entry (&thread_list, t, thread_t, thread_list_node) {
+    if (t->flags & THREAD_FLAG_IDLE)
+      continue;
+
+    r->type = SCHED_LATENCY_RECORD_THREAD;
+    r->cpu = t->state == THREAD_RUNNING ? (uint32_t)thread_curr_cpu(t) : UINT32_MAX;
+    r->thread = (uintptr_t)t;
+    strlcpy(r->name, t->name, sizeof(r->name));
+    r->run_time = t->stats.total_run_time;
+    r->schedules = t->stats.schedules;
+    r->preemptions = t->stats.preemptions;
+    r->involuntary_switches = t->stats.involuntary_switches;
+    copy_hist(r->wakeup_latency, &t->stats.wakeup_latency);
+    copy_hist(r->queue_wait, &t->stats.queue_wait);
+    r++;
+  }
+
+  THREAD_UNLOCK(state);
+
+  return size;
+}
+
+void sched_latency_reset(void) {
+  THREAD_LOCK(state);
+
+  for (uint i = 0; i < SMP_MAX_CPUS; i++) {
+    thread_stats[i].involuntary_switches = 0;
+    memset(&thread_stats[i].wakeup_latency, 0, sizeof(struct sched_hist));
+    memset(&thread_stats[i].queue_wait, 0, sizeof(struct sched_hist));
+  }
+
+  thread_t *t;
+  list_for_every_entry (&thread_list, t, thread_t, thread_list_node) {
+    t->stats.preemptions = 0;
+    t->stats.involuntary_switches = 0;
+    memset(&t->stats.wakeup_latency, 0, sizeof(struct sched_hist));
+    memset(&t->stats.queue_wait, 0, sizeof(struct sched_hist));
+  }
+
+  THREAD_UNLOCK(state);
+}
+
+static void print_summary(const char *name, const struct sched_hist *wakeup,
+                          const struct sched_hist *wait, ulong preemptions, ulong involuntary) {
+  printf("%-20s %8llu %7llu %7llu %7llu %7llu  %7llu %7llu  %7lu %7lu\n", name,
+         sched_hist_count(wakeup), sched_hist_percentile(wakeup, 50),
+         sched_hist_percentile(wakeup, 90), sched_hist_percentile(wakeup, 99),
+         sched_hist_percentile(wakeup, 100), sched_hist_percentile(wait, 50),
+         sched_hist_percentile(wait, 99), preemptions, involuntary);
+}
+
+static void print_header(void) {
+  printf("%-20s %8s %7s %7s %7s %7s  %7s %7s  %7s %7s\n", "", "wakeups", "p50", "p90", "p99",
+         "max", "wait50", "wait99", "preempt", "invol");
+}
+
+static void dump_summary(bool threads) {
+  char name[32];
+
+  printf("scheduler latencies in usecs, to bucket resolution:\n");
+  print_header();
+  for (uint i = 0; i < SMP_MAX_CPUS; i++) {
+    if (!mp_is_cpu_active(i))
+      continue;
+
+    const struct thread_stats *s = &thread_stats[i];
+    snprintf(name, sizeof(name), "cpu %u", i);
+    print_summary(name, &s->wakeup_latency, &s->queue_wait, s->preempts, s->involuntary_switches);
+  }
+
+  if (!threads)
+    return;
+
+  THREAD_LOCK(state);
+  thread_t *t;
+  list_for_every_entry (&thread_list, t, thread_t, thread_list_node) {
+    if (t->flags & THREAD_FLAG_IDLE)
+      continue;
+
+    print_summary(t->name, &t->stats.wakeup_latency, &t->stats.queue_wait, t->stats.preemptions,
+                  t->stats.involuntary_switches);
+  }
+  THREAD_UNLOCK(state);
+}
+
+static void dump_hist(const struct sched_hist *wakeup, const struct sched_hist *wait) {
+  printf("%12s %10s %10s\n", "usecs >=", "wakeups", "waits");
+  for (uint i = 0; i < SCHED_HIST_BUCKETS; i++) {
+    uint32_t w = __atomic_load_n(&wakeup->counts[i], __ATOMIC_RELAXED);
+    uint32_t q = __atomic_load_n(&wait->counts[i], __ATOMIC_RELAXED);
+    if (w || q)
+      printf("%12llu %10u %10u\n", sched_hist_bucket_min(i), w, q);
+  }
+}
+
+static int cmd_schedlat(int argc, const cmd_args *argv, uint32_t flags) {
+  if (argc < 2) {
+    dump_summary(false);
+    return NO_ERROR;
+  }
+
+  if (!strcmp(argv[1].str, "threads")) {
+    dump_summary(true);
+  } else if (!strcmp(argv[1].str, "cpu") && argc == 3) {
+    if (argv[2].u >= SMP_MAX_CPUS)
+      return ERR_OUT_OF_RANGE;
+    dump_hist(&thread_stats[argv[2].u].wakeup_latency, &thread_stats[argv[2].u].queue_wait);
+  } else if (!strcmp(argv[1].str, "thread") && argc == 3) {
+    /* copy it out, the thread may exit while we print */
+    struct sched_hist wakeup, wait;
+    THREAD_LOCK(state);
+    thread_t *t = find_thread_locked(argv[2].p);
+    if (t) {
+      wakeup = t->stats.wakeup_latency;
+      wait = t->stats.queue_wait;
+    }
+    THREAD_UNLOCK(state);
+    if (!t) {
+      printf("no thread %p\n", argv[2].p);
+      return ERR_NOT_FOUND;
+    }
+    dump_hist(&wakeup, &wait);
+  } else if (!strcmp(argv[1].str, "export")) {
+    /* a few threads of slack in case more show up in between */
+    ssize_t len = sched_latency_export(NULL, 0);
+    len += 8 * sizeof(struct sched_latency_export_record);
+    void *buf = malloc(len);
+    if (!buf)
+      return ERR_NO_MEMORY;
+    len = sched_latency_export(buf, len);
+    if (len >= 0)
+      hexdump8(buf, len);
+    free(buf);
+    return len < 0 ? (int)len : NO_ERROR;
+  } else if (!strcmp(argv[1].str, "reset")) {
+    sched_latency_reset();
+  } else {
+    printf("usage:\n");
+    printf("\t%s [threads]\n", argv[0].str);
+    printf("\t%s cpu <cpu>\n", argv[0].str);
+    printf("\t%s thread <thread>\n", argv[0].str);
+    printf("\t%s export\n", argv[0].str);
+    printf("\t%s reset\n", argv[0].str);
+    return ERR_INVALID_ARGS;
+  }
+
+  return NO_ERROR;
+}
+
+STATIC_COMMAND_START
+STATIC_COMMAND("schedlat", "scheduler latency histograms", &cmd_schedlat)
+STATIC_COMMAND_END(schedlat);
+
+#else  // !THREAD_STATS
+
+ssize_t sched_latency_export(void *buf, size_t len) { return ERR_NOT_SUPPORTED; }
+
+void sched_latency_reset(void) {}
+
+#endif
@@ -17,13 +17,17 @@
  */
 #include <assert.h>
 #include <lib/heap.h>
+#include <lib/slab.h>
 #include <malloc.h>
 #include <platform.h>
 #include <printf.h>
+#include <stdlib.h>
 #include <string.h>
 #include <target.h>
 
+#include <kernel/cpuset.h>
 #include <kernel/debug.h>
+#include <kernel/ktrace.h>
 #include <kernel/mp.h>
 #include <kernel/thread.h>
 #include <kernel/timer.h>
@@ -48,6 +52,10 @@ struct thread_stats thread_stats[SMP_MAX_CPUS];
 /* global thread list */
 struct list_node thread_list;
 
+/* cache for dynamically allocated thread structures */
+static slab_cache_t thread_cache =
+    SLAB_CACHE_TYPED_INITIAL_VALUE(thread_cache, "thread", thread_t);
+
 /* master thread spinlock */
 spin_lock_t thread_lock = SPIN_LOCK_INITIAL_VALUE;
 
@@ -76,6 +84,330 @@ static void idle_thread_routine(void) __NO_RETURN;
 static timer_t preempt_timer[SMP_MAX_CPUS];
 #endif
 
+/* the cpus t may run on, the one it is pinned to or those its affinity and
+ * cpuset allow */
+static void thread_cpu_mask(const thread_t *t, mp_cpu_mask_t *mask) {
+  int pinned_cpu = thread_pinned_cpu(t);
+  if (t->flags & THREAD_FLAG_DEADLINE)
+    *mask = mp_cpu_mask_of(t->dl.cpu);
+  else if (pinned_cpu < 0)
+    *mask = t->cpus_allowed;
+  else
+    *mask = mp_cpu_mask_of(pinned_cpu);
+}
+
+static bool thread_can_run_on(const thread_t *t, uint cpu) {
+  int pinned_cpu = thread_pinned_cpu(t);
+  if (t->flags & THREAD_FLAG_DEADLINE)
+    return t->dl.cpu == cpu;
+  if (pinned_cpu < 0)
+    return mp_cpu_mask_test(&t->cpus_allowed, cpu);
+  return pinned_cpu == (int)cpu;
+}
+
+/*
+ * Weighted fair sharing, after EEVDF (Stoica and Abdel-Wahab, 1995).
+ *
+ * Threads at DEFAULT_PRIORITY and below that are not real time share the cpus
+ * in proportion to a weight that follows their priority, rather than the
+ * higher priorities starving the lower ones. Every thread in the fixed
+ * priority run queues goes before all of them.
+ *
+ * A fair thread's vruntime advances with its time on a cpu, scaled down by its
+ * weight. The virtual time V is the weighted average vruntime of the threads
+ * competing, ready or running. Those at or behind V are owed service and
+ * eligible, and of them the one with the earliest virtual deadline, the end
+ * of its current slice, runs next. A thread that blocks keeps its lag,
+ * V - vruntime, and picks up with it when it comes back.
+ *
+ * All of it is protected by the thread lock, times are in usecs.
+ */
+#define FAIR_WEIGHT_DEFAULT 1024
+#define FAIR_SLICE 10000 /* one preemption tick */
+
+/* DEFAULT_PRIORITY on down, 1.25x apart like nice levels */
+static const uint16_t fair_weights[] = {1024, 820, 655, 526, 423, 335, 272, 215,
+                                        172,  137, 110, 87,  70,  56,  45,  36};
+STATIC_ASSERT(countof(fair_weights) == DEFAULT_PRIORITY - IDLE_PRIORITY);
+
+static struct {
+  struct list_node queue; /* ready threads, by deadline */
+  int64_t base;           /* vruntimes are summed relative to this to keep the sum small */
+  int64_t sum;            /* weight * (vruntime - base) over the competing threads */
+  uint64_t load;          /* their total weight */
+} fair_rq = {
+    .queue = LIST_INITIAL_VALUE(fair_rq.queue),
+};
+
+static bool thread_is_fair(const thread_t *t) {
+  return !(t->flags & (THREAD_FLAG_REAL_TIME | THREAD_FLAG_IDLE | THREAD_FLAG_DEADLINE)) &&
+         t->priority > IDLE_PRIORITY && t->priority <= DEFAULT_PRIORITY;
+}
+
+static uint fair_weight(const thread_t *t) { return fair_weights[DEFAULT_PRIORITY - t->priority]; }
+
+static int64_t fair_scale(int64_t delta, uint weight) {
+  return delta * FAIR_WEIGHT_DEFAULT / (int64_t)weight;
+}
+
+static int64_t fair_vtime(void) {
+  if (fair_rq.load == 0)
+    return fair_rq.base;
+  return fair_rq.base + fair_rq.sum / (int64_t)fair_rq.load;
+}
+
+static void fair_add(thread_t *t) {
+  t->fair.weight = fair_weight(t);
+  fair_rq.sum += (int64_t)t->fair.weight * (t->fair.vruntime - fair_rq.base);
+  fair_rq.load += t->fair.weight;
+  t->fair.active = true;
+}
+
+static void fair_remove(thread_t *t) {
+  fair_rq.sum -= (int64_t)t->fair.weight * (t->fair.vruntime - fair_rq.base);
+  fair_rq.load -= t->fair.weight;
+  t->fair.active = false;
+}
+
+/* charge a running thread for its time on the cpu since the last update */
+static void fair_update(thread_t *t, lk_bigtime_t now) {
+  int64_t delta = (int64_t)(now - t->fair.last_update);
+  t->fair.last_update = now;
+  if (delta <= 0)
+    return;
+
+  int64_t dv = fair_scale(delta, t->fair.weight);
+  t->fair.vruntime += dv;
+  fair_rq.sum += (int64_t)t->fair.weight * dv;
+
+  /* a used up slice starts the next one */
+  if (t->fair.vruntime >= t->fair.deadline)
+    t->fair.deadline = t->fair.vruntime + fair_scale(FAIR_SLICE, t->fair.weight);
+
+  int64_t v = fair_vtime();
+  fair_rq.sum -= (int64_t)fair_rq.load * (v - fair_rq.base);
+  fair_rq.base = v;
+}
+
+/* start competing, with the lag it stopped with. bounded to a slice either way
+ * so a long sleep does not earn a long run */
+static void fair_join(thread_t *t) {
+  int64_t limit = fair_scale(FAIR_SLICE, fair_weight(t));
+  int64_t lag = t->fair.lag;
+  if (lag > limit)
+    lag = limit;
+  if (lag < -limit)
+    lag = -limit;
+
+  t->fair.vruntime = fair_vtime() - lag;
+  t->fair.deadline = t->fair.vruntime + limit;
+  fair_add(t);
+}
+
+static void fair_leave(thread_t *t) {
+  t->fair.lag = fair_vtime() - t->fair.vruntime;
+  fair_remove(t);
+}
+
+static int64_t fair_lag(const thread_t *t) {
+  return t->fair.active ? fair_vtime() - t->fair.vruntime : t->fair.lag;
+}
+
+/* put a ready thread on the fair queue if it belongs there. takes it out of
+ * the competition if it moved over to the fixed priorities */
+static bool fair_insert(thread_t *t) {
+  if (t->fair.active && t == get_current_thread())
+    fair_update(t, current_time_hires());
+
+  if (!thread_is_fair(t)) {
+    if (t->fair.active)
+      fair_leave(t);
+    return false;
+  }
+
+  if (!t->fair.active) {
+    fair_join(t);
+  } else if (t->fair.weight != fair_weight(t)) {
+    /* its priority changed */
+    fair_remove(t);
+    fair_add(t);
+  }
+
+  thread_t *next;
+  list_for_every_entry (&fair_rq.queue, next, thread_t, queue_node) {
+    if (next->fair.deadline > t->fair.deadline) {
+      list_add_before(&next->queue_node, &t->queue_node);
+      return true;
+    }
+  }
+  list_add_tail(&fair_rq.queue, &t->queue_node);
+  return true;
+}
+
+/* the eligible thread with the earliest deadline that can run here, failing
+ * that the earliest deadline */
+static thread_t *fair_pick(uint cpu) {
+  int64_t v = fair_vtime();
+  thread_t *t;
+  thread_t *first = NULL;
+  list_for_every_entry (&fair_rq.queue, t, thread_t, queue_node) {
+#if WITH_SMP
+    if (!thread_can_run_on(t, cpu))
+      continue;
+#endif
+    if (t->fair.vruntime <= v)
+      return t;
+    if (!first)
+      first = t;
+  }
+  return first;
+}
+
+/*
+ * Deadline class, partitioned EDF with a hard constant bandwidth server per
+ * thread (Abeni and Buttazzo, 1998), along the lines of SCHED_DEADLINE.
+ *
+ * Every thread in it reserves runtime / period of one cpu, admitted as long
+ * as that leaves the cpu under DL_BW_LIMIT, and only runs there. Of the ready
+ * ones the earliest absolute deadline goes first, before any other class. A
+ * thread that runs through its budget is throttled until its next period, so
+ * one that misbehaves cannot take more than it reserved.
+ */
+static void wakeup_cpu_for_thread(thread_t *t);
+
+#define DL_BW_SHIFT 20
+#define DL_BW_LIMIT ((95 << DL_BW_SHIFT) / 100)
+
+static struct list_node dl_queue = LIST_INITIAL_VALUE(dl_queue); /* by absolute deadline */
+static uint64_t dl_bw[SMP_MAX_CPUS];                             /* reserved on each cpu */
+static timer_t dl_budget_timer[SMP_MAX_CPUS];
+static bool dl_budget_armed[SMP_MAX_CPUS]; /* whoever armed it may have left the class since */
+
+static bool thread_is_deadline(const thread_t *t) { return t->flags & THREAD_FLAG_DEADLINE; }
+
+static uint64_t dl_bandwidth(lk_bigtime_t runtime, lk_bigtime_t period) {
+  return (runtime << DL_BW_SHIFT) / period;
+}
+
+/* charge a running thread for its time on the cpu since the last update */
+static void dl_update(thread_t *t, lk_bigtime_t now) {
+  t->dl.remaining -= (int64_t)(now - t->dl.last_update);
+  t->dl.last_update = now;
+
+  if (now >= t->dl.abs_deadline) {
+    /* it wanted to run past its deadline without running out of budget, it
+     * did not get the time it was promised. start over in the next period */
+    if (t->dl.remaining > 0)
+      t->dl.misses++;
+    while (t->dl.abs_deadline <= now)
+      t->dl.abs_deadline += t->dl.period;
+    t->dl.remaining = t->dl.runtime;
+  }
+}
+
+/* a thread that starts running again keeps its deadline and what is left of
+ * its budget unless that would get it more than its bandwidth */
+static void dl_wake(thread_t *t, lk_bigtime_t now) {
+  if (t->dl.abs_deadline <= now ||
+      t->dl.remaining * (int64_t)t->dl.deadline >
+          (int64_t)(t->dl.abs_deadline - now) * (int64_t)t->dl.runtime) {
+    t->dl.abs_deadline = now + t->dl.deadline;
+    t->dl.remaining = t->dl.runtime;
+  }
+}
+
+static void dl_enqueue(thread_t *t) {
+  thread_t *next;
+  list_for_every_entry (&dl_queue, next, thread_t, queue_node) {
+    if (next->dl.abs_deadline > t->dl.abs_deadline) {
+      list_add_before(&next->queue_node, &t->queue_node);
+      return;
+    }
+  }
+  list_add_tail(&dl_queue, &t->queue_node);
+}
+
+static enum handler_return dl_replenish(timer_t *timer, lk_time_t now, void *arg) {
+  thread_t *t = arg;
+
+  spin_lock(&thread_lock);
+
+  /* the overrun is paid back out of the new budget */
+  t->dl.abs_deadline += t->dl.period;
+  t->dl.remaining = MIN(t->dl.remaining + (int64_t)t->dl.runtime, (int64_t)t->dl.runtime);
+  t->dl.throttled = false;
+
+  bool local = false;
+  if (thread_is_deadline(t) && t->state == THREAD_READY) {
+    dl_enqueue(t);
+    wakeup_cpu_for_thread(t);
+    local = t->dl.cpu == arch_curr_cpu_num();
+  }
+
+  spin_unlock(&thread_lock);
+
+  return local ? INT_RESCHEDULE : INT_NO_RESCHEDULE;
+}
+
+/* put a ready thread on the deadline queue if it belongs there, or hold it
+ * back until its next period if it is out of budget */
+static bool dl_insert(thread_t *t) {
+  if (!thread_is_deadline(t))
+    return false;
+
+  lk_bigtime_t now = current_time_hires();
+  if (t == get_current_thread())
+    dl_update(t, now);
+  else
+    dl_wake(t, now);
+
+  if (t->dl.remaining <= 0) {
+    t->dl.overruns++;
+    t->dl.throttled = true;
+
+    lk_bigtime_t start = t->dl.abs_deadline - t->dl.deadline + t->dl.period;
+    lk_time_t delay = start > now ? (start - now + 999) / 1000 : 0;
+    timer_set_oneshot(&t->dl.throttle, delay, dl_replenish, t);
+    return true;
+  }
+
+  dl_enqueue(t);
+  return true;
+}
+
+static thread_t *dl_pick(uint cpu) {
+  thread_t *t;
+  list_for_every_entry (&dl_queue, t, thread_t, queue_node) {
+    if (t->dl.cpu == cpu)
+      return t;
+  }
+  return NULL;
+}
+
+/* preempt the running deadline thread when its budget runs out */
+static enum handler_return dl_budget_expired(timer_t *timer, lk_time_t now, void *arg) {
+  dl_budget_armed[arch_curr_cpu_num()] = false;
+  return thread_is_deadline(get_current_thread()) ? INT_RESCHEDULE : INT_NO_RESCHEDULE;
+}
+
+static void dl_budget_arm(uint cpu, thread_t *t) {
+  dl_budget_armed[cpu] = true;
+  timer_set_oneshot(&dl_budget_timer[cpu], (t->dl.remaining + 999) / 1000, dl_budget_expired,
+                    NULL);
+}
+
+static void dl_budget_disarm(uint cpu) {
+  if (dl_budget_armed[cpu]) {
+    timer_cancel(&dl_budget_timer[cpu]);
+    dl_budget_armed[cpu] = false;
+  }
+}
+
+static void dl_release(thread_t *t) {
+  dl_bw[t->dl.cpu] -= dl_bandwidth(t->dl.runtime, t->dl.period);
+  t->flags &= ~THREAD_FLAG_DEADLINE;
+}
+
 /* run queue manipulation */
 static void insert_in_run_queue_head(thread_t *t) {
   DEBUG_ASSERT(t->magic == THREAD_MAGIC);
@@ -84,6 +416,12 @@ static void insert_in_run_queue_head(thread_t *t) {
   DEBUG_ASSERT(arch_ints_disabled());
   DEBUG_ASSERT(spin_lock_held(&thread_lock));
 
+#if THREAD_STATS
+  t->stats.last_ready_timestamp = current_time_hires();
+#endif
+  if (fair_insert(t) || dl_insert(t))
+    return;
+
   list_add_head(&run_queue[t->priority], &t->queue_node);
   run_queue_bitmap |= (1 << t->priority);
 }
@@ -95,24 +433,40 @@ static void insert_in_run_queue_tail(thread_t *t) {
   DEBUG_ASSERT(arch_ints_disabled());
   DEBUG_ASSERT(spin_lock_held(&thread_lock));
 
+#if THREAD_STATS
+  t->stats.last_ready_timestamp = current_time_hires();
+#endif
+  if (fair_insert(t) || dl_insert(t))
+    return;
+
   list_add_tail(&run_queue[t->priority], &t->queue_node);
   run_queue_bitmap |= (1 << t->priority);
 }
 
+/* a thread that was blocked, sleeping or suspended is ready again */
+static void insert_woken_thread(thread_t *t) {
+#if THREAD_STATS
+  t->stats.woken = true;
+#endif
+  insert_in_run_queue_head(t);
+}
+
 static void wakeup_cpu_for_thread(thread_t *t) {
-  /* Wake up the core to which this thread is pinned
-   * or wake up all if thread is unpinned */
-  int pinned_cpu = thread_pinned_cpu(t);
-  if (pinned_cpu < 0)
-    mp_reschedule(MP_CPU_ALL_BUT_LOCAL, 0);
-  else
-    mp_reschedule(1U << pinned_cpu, 0);
+  /* Wake up the cores this thread is allowed to run on, a deadline thread
+   * preempts real time ones too */
+  mp_cpu_mask_t mask;
+  thread_cpu_mask(t, &mask);
+  mp_reschedule(&mask, (t->flags & THREAD_FLAG_DEADLINE) ? MP_RESCHEDULE_FLAG_REALTIME : 0);
 }
 
 static void init_thread_struct(thread_t *t, const char *name) {
   memset(t, 0, sizeof(thread_t));
   t->magic = THREAD_MAGIC;
   thread_set_pinned_cpu(t, -1);
+  t->cpuset = cpuset_root();
+  timer_initialize(&t->dl.throttle);
+  mp_cpu_mask_fill(&t->affinity);
+  t->cpus_allowed = t->cpuset->cpus;
   strlcpy(t->name, name, sizeof(t->name));
 }
 
@@ -148,7 +502,7 @@ thread_t *thread_create_etc(thread_t *t, const char *name, thread_start_routine
   unsigned int flags = 0;
 
   if (!t) {
-    t = malloc(sizeof(thread_t));
+    t = slab_cache_alloc(&thread_cache);
     if (!t)
       return NULL;
     flags |= THREAD_FLAG_FREE_STRUCT;
@@ -180,7 +534,7 @@ thread_t *thread_create_etc(thread_t *t, const char *name, thread_start_routine
     t->stack = malloc(stack_size);
     if (!t->stack) {
       if (flags & THREAD_FLAG_FREE_STRUCT)
-        free(t);
+        slab_cache_free(&thread_cache, t);
       return NULL;
     }
     flags |= THREAD_FLAG_FREE_STACK;
@@ -213,8 +567,10 @@ thread_t *thread_create_etc(thread_t *t, const char *name, thread_start_routine
   /* set up the initial stack frame */
   arch_thread_initialize(t);
 
-  /* add it to the global thread list */
+  /* add it to the global thread list, in the cpuset of its creator */
   THREAD_LOCK(state);
+  t->cpuset = current_thread->cpuset;
+  thread_update_cpus_allowed_locked(t);
   list_add_head(&thread_list, &t->thread_list_node);
   THREAD_UNLOCK(state);
 
@@ -252,14 +608,101 @@ status_t thread_set_real_time(thread_t *t) {
   return NO_ERROR;
 }
 
+/**
+ * @brief Recompute where a thread may run
+ *
+ * Called with the thread lock held after the thread's affinity or cpuset
+ * changed. A thread running on a cpu it may no longer use is preempted off of
+ * it, which may be the caller.
+ */
+void thread_update_cpus_allowed_locked(thread_t *t) {
+  DEBUG_ASSERT(spin_lock_held(&thread_lock));
+
+  mp_cpu_mask_and(&t->cpus_allowed, &t->affinity, &t->cpuset->cpus);
+  if (mp_cpu_mask_is_empty(&t->cpus_allowed)) {
+    /* the cpuset moved out from under the affinity, fall back to all of it */
+    t->cpus_allowed = t->cpuset->cpus;
+  }
+
+#if WITH_SMP
+  if (thread_pinned_cpu(t) >= 0)
+    return;
+
+  if (t->state == THREAD_READY) {
+    wakeup_cpu_for_thread(t);
+  } else if (t->state == THREAD_RUNNING && !thread_can_run_on(t, thread_curr_cpu(t))) {
+    if (t == get_current_thread()) {
+      t->state = THREAD_READY;
+      insert_in_run_queue_head(t);
+      thread_resched();
+    } else {
+      mp_cpu_mask_t mask = mp_cpu_mask_of(thread_curr_cpu(t));
+      mp_reschedule(&mask, MP_RESCHEDULE_FLAG_REALTIME);
+    }
+  }
+#endif
+}
+
+/**
+ * @brief Set the cpus a thread may run on
+ *
+ * The affinity is limited to the cpus of the thread's cpuset and has to share
+ * at least one with it. It does not apply while the thread is pinned.
+ *
+ * @return NO_ERROR on success, ERR_INVALID_ARGS if no cpu of the cpuset is in
+ * the affinity.
+ */
+status_t thread_set_affinity(thread_t *t, const mp_cpu_mask_t *affinity) {
+  DEBUG_ASSERT(t->magic == THREAD_MAGIC);
+
+  THREAD_LOCK(state);
+  status_t err = thread_set_affinity_locked(t, affinity);
+  THREAD_UNLOCK(state);
+
+  return err;
+}
+
+status_t thread_set_affinity_locked(thread_t *t, const mp_cpu_mask_t *affinity) {
+  DEBUG_ASSERT(t->magic == THREAD_MAGIC);
+  DEBUG_ASSERT(thread_lock_held());
+
+  if (!mp_cpu_mask_intersects(affinity, &t->cpuset->cpus))
+    return ERR_INVALID_ARGS;
+
+  t->affinity = *affinity;
+  thread_update_cpus_allowed_locked(t);
+  return NO_ERROR;
+}
+
+void thread_get_affinity(thread_t *t, mp_cpu_mask_t *affinity) {
+  THREAD_LOCK(state);
+  *affinity = t->affinity;
+  THREAD_UNLOCK(state);
+}
+
+/**
+ * @brief Get the cpus a thread runs on, taking pinning and its cpuset into account
+ */
+void thread_get_cpus_allowed(thread_t *t, mp_cpu_mask_t *allowed) {
+  THREAD_LOCK(state);
+  thread_get_cpus_allowed_locked(t, allowed);
+  THREAD_UNLOCK(state);
+}
+
+void thread_get_cpus_allowed_locked(thread_t *t, mp_cpu_mask_t *allowed) {
+  DEBUG_ASSERT(thread_lock_held());
+  thread_cpu_mask(t, allowed);
+}
+
 static bool thread_is_realtime(thread_t *t) {
-  return (t->flags & THREAD_FLAG_REAL_TIME) && t->priority > DEFAULT_PRIORITY;
+  return ((t->flags & THREAD_FLAG_REAL_TIME) && t->priority > DEFAULT_PRIORITY) ||
+         thread_is_deadline(t);
 }
 
 static bool thread_is_idle(thread_t *t) { return !!(t->flags & THREAD_FLAG_IDLE); }
 
 static bool thread_is_real_time_or_idle(thread_t *t) {
-  return !!(t->flags & (THREAD_FLAG_REAL_TIME | THREAD_FLAG_IDLE));
+  return !!(t->flags & (THREAD_FLAG_REAL_TIME | THREAD_FLAG_IDLE | THREAD_FLAG_DEADLINE));
 }
 
 /**
@@ -281,7 +724,7 @@ status_t thread_resume(thread_t *t) {
   THREAD_LOCK(state);
   if (t->state == THREAD_SUSPENDED) {
     t->state = THREAD_READY;
-    insert_in_run_queue_head(t);
+    insert_woken_thread(t);
     if (!ints_disabled) /* HACK, don't resced into bootstrap thread before idle thread is set up */
       resched = true;
   }
@@ -346,7 +789,7 @@ status_t thread_join(thread_t *t, int *retcode, lk_time_t timeout) {
     free(t->stack);
 
   if (t->flags & THREAD_FLAG_FREE_STRUCT)
-    free(t);
+    slab_cache_free(&thread_cache, t);
 
   return NO_ERROR;
 }
@@ -394,6 +837,11 @@ void thread_exit(int retcode) {
   current_thread->state = THREAD_DEATH;
   current_thread->retcode = retcode;
 
+  /* hand back its share of the cpu */
+  dl_budget_disarm(arch_curr_cpu_num());
+  if (thread_is_deadline(current_thread))
+    dl_release(current_thread);
+
   /* if we're detached, then do our teardown here */
   if (current_thread->flags & THREAD_FLAG_DETACHED) {
     /* remove it from the master thread list */
@@ -411,7 +859,7 @@ void thread_exit(int retcode) {
     }
 
     if (current_thread->flags & THREAD_FLAG_FREE_STRUCT)
-      heap_delayed_free(current_thread);
+      slab_cache_delayed_free(&thread_cache, current_thread);
   } else {
     /* signal if anyone is waiting */
     wait_queue_wake_all(&current_thread->retcode_wait_queue, false, 0);
@@ -428,9 +876,10 @@ static void idle_thread_routine(void) {
     arch_idle();
 }
 
-static thread_t *get_top_thread(int cpu) {
+/* first thread this cpu can run out of the fixed priority queues in mask */
+static thread_t *pick_fixed(int cpu, uint32_t mask) {
   thread_t *newthread;
-  uint32_t local_run_queue_bitmap = run_queue_bitmap;
+  uint32_t local_run_queue_bitmap = run_queue_bitmap & mask;
 
   while (local_run_queue_bitmap) {
     /* find the first (remaining) queue with a thread in it */
@@ -438,7 +887,7 @@ static thread_t *get_top_thread(int cpu) {
 
     list_for_every_entry (&run_queue[next_queue], newthread, thread_t, queue_node) {
 #if WITH_SMP
-      if (newthread->pinned_cpu < 0 || newthread->pinned_cpu == cpu)
+      if (thread_can_run_on(newthread, cpu))
 #endif
       {
         list_delete(&newthread->queue_node);
@@ -452,6 +901,39 @@ static thread_t *get_top_thread(int cpu) {
 
     local_run_queue_bitmap &= ~(1 << next_queue);
   }
+
+  return NULL;
+}
+
+static thread_t *get_top_thread(int cpu) {
+  thread_t *newthread;
+  const uint32_t idle_queue = 1u << IDLE_PRIORITY;
+
+  /* deadline threads go first */
+  newthread = dl_pick(cpu);
+  if (newthread) {
+    list_delete(&newthread->queue_node);
+    return newthread;
+  }
+
+  /* then the fixed priorities, everything in there but the idle queue is
+   * either above the fair share class or real time */
+  newthread = pick_fixed(cpu, ~idle_queue);
+  if (newthread)
+    return newthread;
+
+  /* then the fair share threads */
+  newthread = fair_pick(cpu);
+  if (newthread) {
+    list_delete(&newthread->queue_node);
+    return newthread;
+  }
+
+  /* IDLE_PRIORITY threads only get what the fair share class leaves */
+  newthread = pick_fixed(cpu, idle_queue);
+  if (newthread)
+    return newthread;
+
   /* no threads to run, select the idle thread for this cpu */
   return idle_thread(cpu);
 }
@@ -472,6 +954,7 @@ void thread_resched(void) {
 
   thread_t *current_thread = get_current_thread();
   uint cpu = arch_curr_cpu_num();
+  lk_bigtime_t now = current_time_hires();
 
   DEBUG_ASSERT(arch_ints_disabled());
   DEBUG_ASSERT(spin_lock_held(&thread_lock));
@@ -479,10 +962,27 @@ void thread_resched(void) {
 
   THREAD_STATS_INC(reschedules);
 
+  /* a fair share thread that blocked or exited stops competing, a deadline
+   * one pays for its run */
+  if (current_thread->fair.active && current_thread->state != THREAD_READY) {
+    fair_update(current_thread, now);
+    fair_leave(current_thread);
+  }
+  if (thread_is_deadline(current_thread) && current_thread->state != THREAD_READY)
+    dl_update(current_thread, now);
+  dl_budget_disarm(cpu);
+
   newthread = get_top_thread(cpu);
 
   DEBUG_ASSERT(newthread);
 
+  if (newthread->fair.active)
+    newthread->fair.last_update = now;
+  if (thread_is_deadline(newthread)) {
+    newthread->dl.last_update = now;
+    dl_budget_arm(cpu, newthread);
+  }
+
   newthread->state = THREAD_RUNNING;
 
   oldthread = current_thread;
@@ -490,6 +990,13 @@ void thread_resched(void) {
   if (newthread == oldthread)
     return;
 
+#if WITH_SMP
+  /* a thread put back in the run queue by a cpu it can no longer run on needs
+   * another one to come and pick it up */
+  if (oldthread->state == THREAD_READY && !thread_can_run_on(oldthread, cpu))
+    wakeup_cpu_for_thread(oldthread);
+#endif
+
   /* set up quantum for the new thread if it was consumed */
   if (newthread->remaining_quantum <= 0) {
     newthread->remaining_quantum = 5;  // XXX make this smarter
@@ -516,7 +1023,6 @@ void thread_resched(void) {
 #if THREAD_STATS
   THREAD_STATS_INC(context_switches);
 
-  lk_bigtime_t now = current_time_hires();
   if (thread_is_idle(oldthread)) {
     thread_stats[cpu].idle_time += now - thread_stats[cpu].last_idle_timestamp;
   } else {
@@ -527,10 +1033,29 @@ void thread_resched(void) {
   } else {
     newthread->stats.last_run_timestamp = now;
     newthread->stats.schedules++;
+
+    /* how long it sat in the run queue, and if it was just woken up how long
+     * that took to get it on a cpu */
+    lk_bigtime_t wait = now - newthread->stats.last_ready_timestamp;
+    newthread->stats.total_wait_time += wait;
+    if (wait > newthread->stats.max_wait_time)
+      newthread->stats.max_wait_time = wait;
+    sched_hist_add(&newthread->stats.queue_wait, wait);
+    sched_hist_add(&thread_stats[cpu].queue_wait, wait);
+    if (newthread->stats.woken) {
+      newthread->stats.woken = false;
+      sched_hist_add(&newthread->stats.wakeup_latency, wait);
+      sched_hist_add(&thread_stats[cpu].wakeup_latency, wait);
+    }
+  }
+  if (oldthread->stats.preempted) {
+    oldthread->stats.involuntary_switches++;
+    THREAD_STATS_INC(involuntary_switches);
   }
 #endif
 
   KEVLOG_THREAD_SWITCH(oldthread, newthread);
+  KTRACE_THREAD_SWITCH(oldthread, newthread);
 
 #if PLATFORM_HAS_DYNAMIC_TIMER
   if (thread_is_real_time_or_idle(newthread)) {
@@ -619,6 +1144,12 @@ void thread_yield(void) {
 
   THREAD_STATS_INC(yields);
 
+  /* a fair share thread lets the others go a slice ahead of it */
+  if (current_thread->fair.active) {
+    fair_update(current_thread, current_time_hires());
+    current_thread->fair.deadline += fair_scale(FAIR_SLICE, current_thread->fair.weight);
+  }
+
   /* we are yielding the cpu, so stick ourselves into the tail of the run queue and reschedule */
   current_thread->state = THREAD_READY;
   current_thread->remaining_quantum = 0;
@@ -652,14 +1183,21 @@ void thread_preempt(void) {
   DEBUG_ASSERT(current_thread->state == THREAD_RUNNING);
 
 #if THREAD_STATS
-  if (!thread_is_idle(current_thread))
+  if (!thread_is_idle(current_thread)) {
     THREAD_STATS_INC(preempts); /* only track when a meaningful preempt happens */
+    current_thread->stats.preemptions++;
+  }
 #endif
 
   KEVLOG_THREAD_PREEMPT(current_thread);
 
   THREAD_LOCK(state);
 
+#if THREAD_STATS
+  /* a switch away from here is the one that counts as involuntary */
+  current_thread->stats.preempted = !thread_is_idle(current_thread);
+#endif
+
   /* we are being preempted, so we get to go back into the front of the run queue if we have quantum
    * left */
   current_thread->state = THREAD_READY;
@@ -672,6 +1210,10 @@ void thread_preempt(void) {
   }
   thread_resched();
 
+#if THREAD_STATS
+  current_thread->stats.preempted = false;
+#endif
+
   THREAD_UNLOCK(state);
 }
 
@@ -704,7 +1246,7 @@ void thread_unblock(thread_t *t, bool resched) {
   DEBUG_ASSERT(!thread_is_idle(t));
 
   t->state = THREAD_READY;
-  insert_in_run_queue_head(t);
+  insert_woken_thread(t);
   wakeup_cpu_for_thread(t);
 
   if (resched)
@@ -717,6 +1259,17 @@ enum handler_return thread_timer_tick(struct timer *t, lk_time_t now, void *arg)
   if (thread_is_real_time_or_idle(current_thread))
     return INT_NO_RESCHEDULE;
 
+  if (current_thread->fair.active) {
+    /* at the end of a slice make way if anyone else is waiting */
+    spin_lock(&thread_lock);
+    int64_t deadline = current_thread->fair.deadline;
+    fair_update(current_thread, current_time_hires());
+    bool resched = current_thread->fair.deadline != deadline && fair_pick(arch_curr_cpu_num());
+    spin_unlock(&thread_lock);
+
+    return resched ? INT_RESCHEDULE : INT_NO_RESCHEDULE;
+  }
+
   current_thread->remaining_quantum--;
   if (current_thread->remaining_quantum <= 0) {
     return INT_RESCHEDULE;
@@ -735,7 +1288,7 @@ static enum handler_return thread_sleep_handler(timer_t *timer, lk_time_t now, v
   THREAD_LOCK(state);
 
   t->state = THREAD_READY;
-  insert_in_run_queue_head(t);
+  insert_woken_thread(t);
 
   THREAD_UNLOCK(state);
 
@@ -786,6 +1339,7 @@ void thread_init_early(void) {
 
   /* initialize the thread list */
   list_initialize(&thread_list);
+  cpuset_init_early();
 
   /* create a thread to cover the current running state */
   thread_t *t = idle_thread(0);
@@ -808,6 +1362,10 @@ void thread_init_early(void) {
  * This function is called once at boot time
  */
 void thread_init(void) {
+  for (uint i = 0; i < SMP_MAX_CPUS; i++) {
+    timer_initialize(&dl_budget_timer[i]);
+  }
+
 #if PLATFORM_HAS_DYNAMIC_TIMER
   for (uint i = 0; i < SMP_MAX_CPUS; i++) {
     timer_initialize(&preempt_timer[i]);
@@ -846,6 +1404,99 @@ void thread_set_priority(int priority) {
   THREAD_UNLOCK(state);
 }
 
+/**
+ * @brief Move a thread in or out of the deadline class
+ *
+ * The thread is guaranteed runtime usecs of cpu time within deadline usecs of
+ * the start of every period, and held to that. It is admitted on the allowed
+ * cpu with the most bandwidth left, and stays there. A runtime of 0 puts it
+ * back under its priority.
+ *
+ * @return NO_ERROR on success, ERR_INVALID_ARGS unless
+ * runtime <= deadline <= period, ERR_NO_RESOURCES if no cpu has room for it.
+ */
+status_t thread_set_deadline(thread_t *t, lk_bigtime_t runtime, lk_bigtime_t deadline,
+                             lk_bigtime_t period) {
+  DEBUG_ASSERT(t->magic == THREAD_MAGIC);
+
+  if (runtime && (deadline < runtime || period < deadline))
+    return ERR_INVALID_ARGS;
+
+  THREAD_LOCK(state);
+
+  /* give back what it had before looking for room, anywhere it is allowed */
+  bool was_deadline = thread_is_deadline(t);
+  if (was_deadline)
+    dl_release(t);
+  mp_cpu_mask_t mask;
+  thread_cpu_mask(t, &mask);
+  if (was_deadline)
+    t->flags |= THREAD_FLAG_DEADLINE;
+
+  uint64_t bw = runtime ? dl_bandwidth(runtime, period) : 0;
+  int best = -1;
+  if (runtime) {
+    /* only cpus that are up, it would never run anywhere else */
+    for (int cpu = mp_cpu_mask_first(&mask); cpu >= 0; cpu = mp_cpu_mask_next(&mask, cpu)) {
+      if (!mp_is_cpu_active(cpu))
+        continue;
+      if (dl_bw[cpu] + bw <= DL_BW_LIMIT && (best < 0 || dl_bw[cpu] < dl_bw[best]))
+        best = cpu;
+    }
+    if (best < 0) {
+      /* keep the old reservation */
+      if (thread_is_deadline(t))
+        dl_bw[t->dl.cpu] += dl_bandwidth(t->dl.runtime, t->dl.period);
+      THREAD_UNLOCK(state);
+      return ERR_NO_RESOURCES;
+    }
+  }
+
+  /* out of the queue it is in under the old parameters */
+  bool queued = t->state == THREAD_READY && !(thread_is_deadline(t) && t->dl.throttled);
+  if (queued)
+    list_delete(&t->queue_node);
+  if (thread_is_deadline(t)) {
+    timer_cancel(&t->dl.throttle);
+    if (t->dl.throttled && t->state == THREAD_READY)
+      queued = true;
+    t->dl.throttled = false;
+  }
+
+  if (runtime) {
+    lk_bigtime_t now = current_time_hires();
+    t->flags |= THREAD_FLAG_DEADLINE;
+    t->dl.runtime = runtime;
+    t->dl.deadline = deadline;
+    t->dl.period = period;
+    t->dl.cpu = best;
+    t->dl.remaining = runtime;
+    t->dl.abs_deadline = now + deadline;
+    t->dl.last_update = now;
+    dl_bw[best] += bw;
+  } else {
+    t->flags &= ~THREAD_FLAG_DEADLINE;
+  }
+
+  if (queued) {
+    insert_in_run_queue_head(t);
+    wakeup_cpu_for_thread(t);
+  } else if (t->state == THREAD_RUNNING) {
+    if (t == get_current_thread()) {
+      t->state = THREAD_READY;
+      insert_in_run_queue_head(t);
+      thread_resched();
+    } else {
+      mask = mp_cpu_mask_of(thread_curr_cpu(t));
+      mp_reschedule(&mask, MP_RESCHEDULE_FLAG_REALTIME);
+    }
+  }
+
+  THREAD_UNLOCK(state);
+
+  return NO_ERROR;
+}
+
 /**
  * @brief  Become an idle thread
  *
@@ -972,6 +1623,9 @@ void dump_thread(thread_t *t) {
   dprintf(INFO, "\tstate %s, curr_cpu %d, pinned_cpu %d, priority %d, remaining quantum %d\n",
           thread_state_to_str(t->state), t->curr_cpu, t->pinned_cpu, t->priority,
           t->remaining_quantum);
+  char cpus[64];
+  cpuset_format_cpus(&t->cpus_allowed, cpus, sizeof(cpus));
+  dprintf(INFO, "\tcpuset %s, cpus allowed %s\n", t->cpuset->name, cpus);
 #else
   dprintf(INFO, "\tstate %s, priority %d, remaining quantum %d\n", thread_state_to_str(t->state),
           t->priority, t->remaining_quantum);
@@ -983,6 +1637,16 @@ void dump_thread(thread_t *t) {
   dprintf(INFO, "\tstack %p, stack_size %zd\n", t->stack, t->stack_size);
 #endif
   dprintf(INFO, "\tentry %p, arg %p, flags 0x%x\n", t->entry, t->arg, t->flags);
+  if (thread_is_fair(t)) {
+    dprintf(INFO, "\tfair weight %u, vruntime %lld, deadline %lld, lag %lld\n", fair_weight(t),
+            t->fair.vruntime, t->fair.deadline, fair_lag(t));
+  }
+  if (thread_is_deadline(t)) {
+    dprintf(INFO, "\tdeadline runtime %llu, deadline %llu, period %llu, cpu %u%s\n", t->dl.runtime,
+            t->dl.deadline, t->dl.period, t->dl.cpu, t->dl.throttled ? ", throttled" : "");
+    dprintf(INFO, "\tdeadline remaining %lld, abs deadline %llu, misses %lu, overruns %lu\n",
+            t->dl.remaining, t->dl.abs_deadline, t->dl.misses, t->dl.overruns);
+  }
   dprintf(INFO, "\twait queue %p, wait queue ret %d\n", t->blocking_wait_queue,
           t->wait_queue_block_ret);
 #if WITH_KERNEL_VM
@@ -1020,6 +1684,15 @@ void dump_all_threads(void) {
   THREAD_UNLOCK(state);
 }
 
+thread_t *find_thread_locked(void *p) {
+  thread_t *t;
+  list_for_every_entry (&thread_list, t, thread_t, thread_list_node) {
+    if (t == p)
+      return t;
+  }
+  return NULL;
+}
+
 #if THREAD_STATS
 void dump_threads_stats(void) {
   thread_t *t;
@@ -1041,6 +1714,20 @@ void dump_threads_stats(void) {
     dprintf(INFO, "\t\tTotal run time: %lld, %u.%02u%%\n", t->stats.total_run_time, percent / 100,
             percent % 100);
     dprintf(INFO, "\t\tLast time run: %lld\n", t->stats.last_run_timestamp);
+    dprintf(INFO, "\t\tWait time: total %lld, max %lld, avg %lld\n", t->stats.total_wait_time,
+            t->stats.max_wait_time,
+            t->stats.schedules ? t->stats.total_wait_time / t->stats.schedules : 0);
+    dprintf(INFO, "\t\tWakeup latency: p50 %llu, p99 %llu, preempted %lu, involuntary %lu\n",
+            sched_hist_percentile(&t->stats.wakeup_latency, 50),
+            sched_hist_percentile(&t->stats.wakeup_latency, 99), t->stats.preemptions,
+            t->stats.involuntary_switches);
+    if (thread_is_fair(t))
+      dprintf(INFO, "\t\tFair weight %u, lag %lld\n", fair_weight(t), fair_lag(t));
+    if (thread_is_deadline(t)) {
+      dprintf(INFO, "\t\tDeadline %llu/%llu/%llu on cpu %u, misses %lu, overruns %lu\n",
+              t->dl.runtime, t->dl.deadline, t->dl.period, t->dl.cpu, t->dl.misses,
+              t->dl.overruns);
+    }
   }
   THREAD_UNLOCK(state);
 }
@@ -1102,6 +1789,8 @@ status_t wait_queue_block(wait_queue_t *wait, lk_time_t timeout) {
   if (timeout == 0)
     return ERR_TIMED_OUT;
 
+  KTRACE_WAIT_BLOCK(wait, timeout);
+
   list_add_tail(&wait->list, &current_thread->queue_node);
   wait->count++;
   current_thread->state = THREAD_BLOCKED;
@@ -1164,7 +1853,7 @@ int wait_queue_wake_one(wait_queue_t *wait, bool reschedule, status_t wait_queue
       current_thread->state = THREAD_READY;
       insert_in_run_queue_head(current_thread);
     }
-    insert_in_run_queue_head(t);
+    insert_woken_thread(t);
     wakeup_cpu_for_thread(t);
     if (reschedule) {
       thread_resched();
@@ -1192,7 +1881,8 @@ int wait_queue_wake_one(wait_queue_t *wait, bool reschedule, status_t wait_queue
 int wait_queue_wake_all(wait_queue_t *wait, bool reschedule, status_t wait_queue_error) {
   thread_t *t;
   int ret = 0;
-  uint32_t cpu_mask = 0;
+  mp_cpu_mask_t cpu_mask;
+  mp_cpu_mask_zero(&cpu_mask);
 
   thread_t *current_thread = get_current_thread();
 
@@ -1216,21 +1906,17 @@ int wait_queue_wake_all(wait_queue_t *wait, bool reschedule, status_t wait_queue
     t->state = THREAD_READY;
     t->wait_queue_block_ret = wait_queue_error;
     t->blocking_wait_queue = NULL;
-    int pinned_cpu = thread_pinned_cpu(t);
-    if (pinned_cpu < 0) {
-      /* assumes MP_CPU_ALL_BUT_LOCAL is defined as all bits on */
-      cpu_mask = MP_CPU_ALL_BUT_LOCAL;
-    } else {
-      cpu_mask |= (1U << pinned_cpu);
-    }
-    insert_in_run_queue_head(t);
+    mp_cpu_mask_t allowed;
+    thread_cpu_mask(t, &allowed);
+    mp_cpu_mask_or(&cpu_mask, &cpu_mask, &allowed);
+    insert_woken_thread(t);
     ret++;
   }
 
   DEBUG_ASSERT(wait->count == 0);
 
   if (ret > 0) {
-    mp_reschedule(cpu_mask, 0);
+    mp_reschedule(&cpu_mask, 0);
     if (reschedule) {
       thread_resched();
     }
@@ -1282,7 +1968,7 @@ status_t thread_unblock_from_wait_queue(thread_t *t, status_t wait_queue_error)
   t->blocking_wait_queue = NULL;
   t->state = THREAD_READY;
   t->wait_queue_block_ret = wait_queue_error;
-  insert_in_run_queue_head(t);
+  insert_woken_thread(t);
   wakeup_cpu_for_thread(t);
 
   return NO_ERROR;
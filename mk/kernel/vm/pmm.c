@@ -9,10 +9,15 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include <arch/ops.h>
+#include <kernel/event.h>
+#include <kernel/ktrace.h>
 #include <kernel/mutex.h>
+#include <kernel/thread.h>
 #include <kernel/vm.h>
 #include <lk/console_cmd.h>
 #include <lk/err.h>
+#include <lk/init.h>
 #include <lk/list.h>
 #include <lk/pow2.h>
 #include <lk/trace.h>
@@ -24,6 +29,28 @@
 static struct list_node arena_list = LIST_INITIAL_VALUE(arena_list);
 static mutex_t lock = MUTEX_INITIAL_VALUE(lock);
 
+/*
+ * Free pages are either dirty or known to be zeroed. Idle priority threads, one
+ * per cpu, zero dirty pages in the background so that PMM_ALLOC_FLAG_ZEROED
+ * allocations can skip the memset. Allocations that do not care take dirty
+ * pages first to leave the zeroed ones to those that do.
+ */
+static pmm_zero_stats_t zero_stats;
+static bool zero_waiting; /* a zeroing thread ran out of dirty pages */
+static event_t zero_event = EVENT_INITIAL_VALUE(zero_event, false, EVENT_FLAG_AUTOUNSIGNAL);
+
+/*
+ * NUMA. Each arena belongs to a node and each node keeps the list of nodes
+ * sorted by distance from it, itself first, so allocations can walk arenas
+ * nearest first. Until the platform says otherwise everything is on node 0
+ * and this is the plain priority ordered walk.
+ */
+static uint numa_nodes = 1;
+static uint8_t numa_distance[PMM_MAX_NUMA_NODES][PMM_MAX_NUMA_NODES]; /* 0 for the default */
+static uint8_t numa_order[PMM_MAX_NUMA_NODES][PMM_MAX_NUMA_NODES];
+static uint8_t cpu_numa_node[SMP_MAX_CPUS];
+static uint interleave_next;
+
 #define PAGE_BELONGS_TO_ARENA(page, arena)                  \
   (((uintptr_t)(page) >= (uintptr_t)(arena)->page_array) && \
    ((uintptr_t)(page) <                                     \
@@ -38,10 +65,67 @@ static mutex_t lock = MUTEX_INITIAL_VALUE(lock);
 
 struct list_node *get_arena_list(void) { return &arena_list; }
 
+/* for arches without a better way */
+__WEAK void arch_zero_page(void *ptr) { memset(ptr, 0, PAGE_SIZE); }
+
 static inline bool page_is_free(const vm_page_t *page) {
   return !(page->flags & VM_PAGE_FLAG_NONFREE);
 }
 
+static pmm_arena_t *page_to_arena(const vm_page_t *page) {
+  pmm_arena_t *a;
+  list_for_every_entry (&arena_list, a, pmm_arena_t, node) {
+    if (PAGE_BELONGS_TO_ARENA(page, a)) {
+      return a;
+    }
+  }
+  return NULL;
+}
+
+static uint distance(uint from, uint to) {
+  if (numa_distance[from][to])
+    return numa_distance[from][to];
+  return from == to ? PMM_NUMA_DISTANCE_LOCAL : PMM_NUMA_DISTANCE_REMOTE;
+}
+
+/* lock held, resort every node's fallback order after the distances or the node count changed */
+static void update_numa_order_locked(void) {
+  for (uint from = 0; from < numa_nodes; from++) {
+    uint8_t *order = numa_order[from];
+
+    /* insertion sort, leaving the node itself in front of anything as close */
+    uint count = 0;
+    order[count++] = from;
+    for (uint to = 0; to < numa_nodes; to++) {
+      if (to == from)
+        continue;
+
+      uint i = count++;
+      while (i > 1 && distance(from, order[i - 1]) > distance(from, to)) {
+        order[i] = order[i - 1];
+        i--;
+      }
+      order[i] = to;
+    }
+  }
+}
+
+static void add_numa_node_locked(uint nid) {
+  if (nid >= numa_nodes) {
+    /* read without the lock by pmm_set_cpu_numa_node() */
+    __atomic_store_n(&numa_nodes, nid + 1, __ATOMIC_RELEASE);
+    update_numa_order_locked();
+  }
+}
+
+/* lock held, the node an allocation starts from */
+static uint alloc_node_locked(uint alloc_flags) {
+  uint nid = (alloc_flags & PMM_ALLOC_FLAG_NODE_MASK) >> PMM_ALLOC_FLAG_NODE_SHIFT;
+  if (nid > 0 && nid <= numa_nodes)
+    return nid - 1;
+  return cpu_numa_node[arch_curr_cpu_num()];
+}
+
 paddr_t vm_page_to_paddr(const vm_page_t *page) {
   pmm_arena_t *a;
   list_for_every_entry (&arena_list, a, pmm_arena_t, node) {
@@ -70,6 +154,9 @@ status_t pmm_add_arena(pmm_arena_t *arena) {
   DEBUG_ASSERT(IS_PAGE_ALIGNED(arena->base));
   DEBUG_ASSERT(IS_PAGE_ALIGNED(arena->size));
   DEBUG_ASSERT(arena->size > 0);
+  DEBUG_ASSERT(arena->numa_node < PMM_MAX_NUMA_NODES);
+
+  add_numa_node_locked(arena->numa_node);
 
   /* walk the arena list and add arena based on priority order */
   pmm_arena_t *a;
@@ -87,7 +174,9 @@ done_add:
 
   /* zero out some of the structure */
   arena->free_count = 0;
+  arena->zeroed_count = 0;
   list_initialize(&arena->free_list);
+  list_initialize(&arena->zeroed_list);
 
   /* allocate an array of pages to back this one */
   size_t page_count = arena->size / PAGE_SIZE;
@@ -108,44 +197,122 @@ done_add:
   return NO_ERROR;
 }
 
-size_t pmm_alloc_pages(uint count, struct list_node *list) {
-  LTRACEF("count %u\n", count);
+/* lock held, page just came off one of a's free lists. a VM_PAGE_FLAG_ZEROED
+ * page keeps the flag until finish_alloc() */
+static void mark_allocated(pmm_arena_t *a, vm_page_t *page, uint alloc_flags) {
+  a->free_count--;
+  if (page->flags & VM_PAGE_FLAG_ZEROED)
+    a->zeroed_count--;
+  page->flags |= VM_PAGE_FLAG_NONFREE;
+
+  if (alloc_flags & PMM_ALLOC_FLAG_ZEROED) {
+    zero_stats.requested++;
+    if (page->flags & VM_PAGE_FLAG_ZEROED)
+      zero_stats.hits++;
+  }
+}
 
-  /* list must be initialized prior to calling this */
-  DEBUG_ASSERT(list);
+/* without the lock, zero a page that was asked for zeroed but came off the
+ * dirty list. the caller is about to use it, so unlike the zeroing threads
+ * this leaves it in the cache */
+static void finish_alloc(vm_page_t *page, uint alloc_flags) {
+  if ((alloc_flags & PMM_ALLOC_FLAG_ZEROED) && !(page->flags & VM_PAGE_FLAG_ZEROED))
+    memset(paddr_to_kvaddr(vm_page_to_paddr(page)), 0, PAGE_SIZE);
+  page->flags &= ~VM_PAGE_FLAG_ZEROED;
+}
 
+/* lock held, take up to count pages from the arenas on node nid in priority order */
+static uint alloc_from_node_locked(uint nid, uint count, uint alloc_flags,
+                                   struct list_node *pages) {
+  const bool zeroed = alloc_flags & PMM_ALLOC_FLAG_ZEROED;
   uint allocated = 0;
-  if (count == 0)
-    return 0;
 
-  mutex_acquire(&lock);
-
-  /* walk the arenas in order, allocating as many pages as we can from each */
   pmm_arena_t *a;
   list_for_every_entry (&arena_list, a, pmm_arena_t, node) {
+    if (a->numa_node != nid)
+      continue;
+
+    /* only memory the kernel can see can be zeroed */
+    if (zeroed && !(a->flags & PMM_ARENA_FLAG_KMAP))
+      continue;
+
+    struct list_node *first = zeroed ? &a->zeroed_list : &a->free_list;
+    struct list_node *second = zeroed ? &a->free_list : &a->zeroed_list;
+
     while (allocated < count && a->free_count > 0) {
-      vm_page_t *page = list_remove_head_type(&a->free_list, vm_page_t, node);
+      vm_page_t *page = list_remove_head_type(first, vm_page_t, node);
+      if (!page)
+        page = list_remove_head_type(second, vm_page_t, node);
       if (!page)
-        goto done;
+        return allocated;
 
-      a->free_count--;
+      mark_allocated(a, page, alloc_flags);
+      list_add_tail(pages, &page->node);
 
-      page->flags |= VM_PAGE_FLAG_NONFREE;
-      list_add_tail(list, &page->node);
+      allocated++;
+    }
 
+    if (allocated == count)
+      break;
+  }
+
+  return allocated;
+}
+
+size_t pmm_alloc_pages_etc(uint count, uint alloc_flags, struct list_node *list) {
+  LTRACEF("count %u flags 0x%x\n", count, alloc_flags);
+
+  /* list must be initialized prior to calling this */
+  DEBUG_ASSERT(list);
+
+  uint allocated = 0;
+  if (count == 0)
+    return 0;
+
+  struct list_node pages = LIST_INITIAL_VALUE(pages);
+
+  mutex_acquire(&lock);
+
+  if (alloc_flags & PMM_ALLOC_FLAG_INTERLEAVE) {
+    /* a page at a time, each from the next node or the nearest one to it with memory */
+    while (allocated < count) {
+      const uint8_t *order = numa_order[interleave_next++ % numa_nodes];
+      uint got = 0;
+      for (uint i = 0; i < numa_nodes && got == 0; i++) {
+        got = alloc_from_node_locked(order[i], 1, alloc_flags, &pages);
+      }
+      if (got == 0)
+        break;
       allocated++;
     }
+  } else {
+    /* the nodes nearest first, as many pages as we can from each */
+    const uint8_t *order = numa_order[alloc_node_locked(alloc_flags)];
+    for (uint i = 0; i < numa_nodes && allocated < count; i++) {
+      allocated += alloc_from_node_locked(order[i], count - allocated, alloc_flags, &pages);
+    }
   }
 
-done:
   mutex_release(&lock);
+
+  vm_page_t *page;
+  while ((page = list_remove_head_type(&pages, vm_page_t, node))) {
+    finish_alloc(page, alloc_flags);
+    list_add_tail(list, &page->node);
+  }
+
+  KTRACE_PMM_ALLOC(count, allocated);
   return allocated;
 }
 
-vm_page_t *pmm_alloc_page(void) {
+size_t pmm_alloc_pages(uint count, struct list_node *list) {
+  return pmm_alloc_pages_etc(count, 0, list);
+}
+
+vm_page_t *pmm_alloc_page_etc(uint alloc_flags) {
   struct list_node list = LIST_INITIAL_VALUE(list);
 
-  size_t ret = pmm_alloc_pages(1, &list);
+  size_t ret = pmm_alloc_pages_etc(1, alloc_flags, &list);
   if (ret == 0) {
     return NULL;
   }
@@ -155,6 +322,8 @@ vm_page_t *pmm_alloc_page(void) {
   return list_peek_head_type(&list, vm_page_t, node);
 }
 
+vm_page_t *pmm_alloc_page(void) { return pmm_alloc_page_etc(0); }
+
 size_t pmm_alloc_range(paddr_t address, uint count, struct list_node *list) {
   LTRACEF("address 0x%lx, count %u\n", address, count);
 
@@ -185,10 +354,10 @@ size_t pmm_alloc_range(paddr_t address, uint count, struct list_node *list) {
       DEBUG_ASSERT(list_in_list(&page->node));
 
       list_delete(&page->node);
-      page->flags |= VM_PAGE_FLAG_NONFREE;
+      mark_allocated(a, page, 0);
+      finish_alloc(page, 0);
       list_add_tail(list, &page->node);
 
-      a->free_count--;
       allocated++;
       address += PAGE_SIZE;
     }
@@ -209,6 +378,7 @@ size_t pmm_free(struct list_node *list) {
   mutex_acquire(&lock);
 
   size_t count = 0;
+  bool wake_zeroer = false;
   while (!list_is_empty(list)) {
     vm_page_t *page = list_remove_head_type(list, vm_page_t, node);
 
@@ -229,7 +399,17 @@ size_t pmm_free(struct list_node *list) {
     }
   }
 
+  if (count > 0 && zero_waiting) {
+    zero_waiting = false;
+    wake_zeroer = true;
+  }
+
   mutex_release(&lock);
+
+  if (wake_zeroer)
+    event_signal(&zero_event, false);
+
+  KTRACE_PMM_FREE(count);
   return count;
 }
 
@@ -242,13 +422,16 @@ size_t pmm_free_page(vm_page_t *page) {
   return pmm_free(&list);
 }
 
+static size_t alloc_contiguous(uint count, uint8_t alignment_log2, uint alloc_flags, paddr_t *pa,
+                               struct list_node *list);
+
 /* physically allocate a run from arenas marked as KMAP */
-void *pmm_alloc_kpages(uint count, struct list_node *list) {
-  LTRACEF("count %u\n", count);
+void *pmm_alloc_kpages_etc(uint count, uint alloc_flags, struct list_node *list) {
+  LTRACEF("count %u flags 0x%x\n", count, alloc_flags);
 
   /* fast path for single page */
   if (count == 1) {
-    vm_page_t *p = pmm_alloc_page();
+    vm_page_t *p = pmm_alloc_page_etc(alloc_flags);
     if (!p) {
       return NULL;
     }
@@ -257,13 +440,17 @@ void *pmm_alloc_kpages(uint count, struct list_node *list) {
   }
 
   paddr_t pa;
-  size_t alloc_count = pmm_alloc_contiguous(count, PAGE_SIZE_SHIFT, &pa, list);
+  size_t alloc_count = alloc_contiguous(count, PAGE_SIZE_SHIFT, alloc_flags, &pa, list);
   if (alloc_count == 0)
     return NULL;
 
   return paddr_to_kvaddr(pa);
 }
 
+void *pmm_alloc_kpages(uint count, struct list_node *list) {
+  return pmm_alloc_kpages_etc(count, 0, list);
+}
+
 size_t pmm_free_kpages(void *_ptr, uint count) {
   LTRACEF("ptr %p, count %u\n", _ptr, count);
 
@@ -287,7 +474,12 @@ size_t pmm_free_kpages(void *_ptr, uint count) {
 
 size_t pmm_alloc_contiguous(uint count, uint8_t alignment_log2, paddr_t *pa,
                             struct list_node *list) {
-  LTRACEF("count %u, align %u\n", count, alignment_log2);
+  return alloc_contiguous(count, alignment_log2, 0, pa, list);
+}
+
+static size_t alloc_contiguous(uint count, uint8_t alignment_log2, uint alloc_flags, paddr_t *pa,
+                               struct list_node *list) {
+  LTRACEF("count %u, align %u, flags 0x%x\n", count, alignment_log2, alloc_flags);
 
   if (count == 0)
     return 0;
@@ -296,83 +488,330 @@ size_t pmm_alloc_contiguous(uint count, uint8_t alignment_log2, paddr_t *pa,
 
   mutex_acquire(&lock);
 
-  pmm_arena_t *a;
-  list_for_every_entry (&arena_list, a, pmm_arena_t, node) {
-    // XXX make this a flag to only search kmap?
-    if (a->flags & PMM_ARENA_FLAG_KMAP) {
-      /* walk the list starting at alignment boundaries.
-       * calculate the starting offset into this arena, based on the
-       * base address of the arena to handle the case where the arena
-       * is not aligned on the same boundary requested.
-       */
-      paddr_t rounded_base = ROUNDUP(a->base, 1UL << alignment_log2);
-      if (rounded_base < a->base || rounded_base > a->base + a->size - 1)
-        continue;
+  /* the nodes nearest first, then the arenas on each in priority order */
+  const uint8_t *order = numa_order[alloc_node_locked(alloc_flags)];
+  for (uint n = 0; n < numa_nodes; n++) {
+    pmm_arena_t *a;
+    list_for_every_entry (&arena_list, a, pmm_arena_t, node) {
+      // XXX make this a flag to only search kmap?
+      if (a->numa_node == order[n] && (a->flags & PMM_ARENA_FLAG_KMAP)) {
+        /* walk the list starting at alignment boundaries.
+         * calculate the starting offset into this arena, based on the
+         * base address of the arena to handle the case where the arena
+         * is not aligned on the same boundary requested.
+         */
+        paddr_t rounded_base = ROUNDUP(a->base, 1UL << alignment_log2);
+        if (rounded_base < a->base || rounded_base > a->base + a->size - 1)
+          continue;
+
+        uint aligned_offset = (rounded_base - a->base) / PAGE_SIZE;
+        uint start = aligned_offset;
+        LTRACEF("starting search at aligned offset %u\n", start);
+        LTRACEF("arena base 0x%lx size %zu\n", a->base, a->size);
+
+      retry:
+        /* search while we're still within the arena and have a chance of finding a slot
+           (start + count < end of arena) */
+        while ((start < a->size / PAGE_SIZE) && ((start + count) <= a->size / PAGE_SIZE)) {
+          vm_page_t *p = &a->page_array[start];
+          for (uint i = 0; i < count; i++) {
+            if (p->flags & VM_PAGE_FLAG_NONFREE) {
+              /* this run is broken, break out of the inner loop.
+               * start over at the next alignment boundary
+               */
+              start = ROUNDUP(start - aligned_offset + i + 1,
+                              1UL << (alignment_log2 - PAGE_SIZE_SHIFT)) +
+                      aligned_offset;
+              goto retry;
+            }
+            p++;
+          }
+
+          /* we found a run */
+          LTRACEF("found run from pn %u to %u\n", start, start + count);
+
+          /* remove the pages from the run out of the free list */
+          for (uint i = start; i < start + count; i++) {
+            p = &a->page_array[i];
+            DEBUG_ASSERT(!(p->flags & VM_PAGE_FLAG_NONFREE));
+            DEBUG_ASSERT(list_in_list(&p->node));
 
-      uint aligned_offset = (rounded_base - a->base) / PAGE_SIZE;
-      uint start = aligned_offset;
-      LTRACEF("starting search at aligned offset %u\n", start);
-      LTRACEF("arena base 0x%lx size %zu\n", a->base, a->size);
-
-    retry:
-      /* search while we're still within the arena and have a chance of finding a slot
-         (start + count < end of arena) */
-      while ((start < a->size / PAGE_SIZE) && ((start + count) <= a->size / PAGE_SIZE)) {
-        vm_page_t *p = &a->page_array[start];
-        for (uint i = 0; i < count; i++) {
-          if (p->flags & VM_PAGE_FLAG_NONFREE) {
-            /* this run is broken, break out of the inner loop.
-             * start over at the next alignment boundary
-             */
-            start =
-                ROUNDUP(start - aligned_offset + i + 1, 1UL << (alignment_log2 - PAGE_SIZE_SHIFT)) +
-                aligned_offset;
-            goto retry;
+            list_delete(&p->node);
+            mark_allocated(a, p, alloc_flags);
+
+            if (list)
+              list_add_tail(list, &p->node);
           }
-          p++;
-        }
 
-        /* we found a run */
-        LTRACEF("found run from pn %u to %u\n", start, start + count);
+          if (pa)
+            *pa = a->base + start * PAGE_SIZE;
 
-        /* remove the pages from the run out of the free list */
-        for (uint i = start; i < start + count; i++) {
-          p = &a->page_array[i];
-          DEBUG_ASSERT(!(p->flags & VM_PAGE_FLAG_NONFREE));
-          DEBUG_ASSERT(list_in_list(&p->node));
+          mutex_release(&lock);
 
-          list_delete(&p->node);
-          p->flags |= VM_PAGE_FLAG_NONFREE;
-          a->free_count--;
+          for (uint i = start; i < start + count; i++) {
+            finish_alloc(&a->page_array[i], alloc_flags);
+          }
 
-          if (list)
-            list_add_tail(list, &p->node);
+          KTRACE_PMM_ALLOC(count, count);
+          return count;
         }
+      }
+    }
+  }
+
+  mutex_release(&lock);
+
+  LTRACEF("couldn't find run\n");
+  KTRACE_PMM_ALLOC(count, 0);
+  return 0;
+}
+
+void pmm_get_zero_stats(pmm_zero_stats_t *stats) {
+  mutex_acquire(&lock);
+  *stats = zero_stats;
+  stats->pool = 0;
+  pmm_arena_t *a;
+  list_for_every_entry (&arena_list, a, pmm_arena_t, node) {
+    stats->pool += a->zeroed_count;
+  }
+  mutex_release(&lock);
+}
+
+/* lock held, split a at offset, the upper part moving to tail which goes in right after it */
+static void split_arena_locked(pmm_arena_t *a, size_t offset, pmm_arena_t *tail) {
+  DEBUG_ASSERT(offset > 0 && offset < a->size && IS_PAGE_ALIGNED(offset));
+
+  tail->name = a->name;
+  tail->flags = a->flags;
+  tail->priority = a->priority;
+  tail->numa_node = a->numa_node;
+  tail->base = a->base + offset;
+  tail->size = a->size - offset;
+  tail->free_count = 0;
+  tail->zeroed_count = 0;
+  tail->page_array = a->page_array + offset / PAGE_SIZE;
+  list_initialize(&tail->free_list);
+  list_initialize(&tail->zeroed_list);
+
+  a->size = offset;
+
+  /* move the free pages over, allocated ones find their arena by address */
+  for (size_t i = 0; i < tail->size / PAGE_SIZE; i++) {
+    vm_page_t *p = &tail->page_array[i];
+    if (!page_is_free(p))
+      continue;
+
+    list_delete(&p->node);
+    a->free_count--;
+    tail->free_count++;
+    if (p->flags & VM_PAGE_FLAG_ZEROED) {
+      list_add_tail(&tail->zeroed_list, &p->node);
+      a->zeroed_count--;
+      tail->zeroed_count++;
+    } else {
+      list_add_tail(&tail->free_list, &p->node);
+    }
+  }
+
+  list_add_after(&a->node, &tail->node);
+}
+
+status_t pmm_set_numa_node(paddr_t base, size_t size, uint nid) {
+  LTRACEF("base 0x%lx size 0x%zx node %u\n", base, size, nid);
+
+  if (nid >= PMM_MAX_NUMA_NODES)
+    return ERR_INVALID_ARGS;
 
-        if (pa)
-          *pa = a->base + start * PAGE_SIZE;
+  paddr_t end = ROUNDDOWN(base + size, PAGE_SIZE);
+  base = ROUNDUP(base, PAGE_SIZE);
+  if (end <= base)
+    return NO_ERROR;
 
-        mutex_release(&lock);
+  /* only the arenas holding either end of the range may need splitting. the
+   * spares come from the heap, which can call back into the pmm, so get them
+   * before taking the lock */
+  pmm_arena_t *spare[2];
+  spare[0] = calloc(1, sizeof(pmm_arena_t));
+  spare[1] = calloc(1, sizeof(pmm_arena_t));
+  uint spares = 0;
 
-        return count;
+  mutex_acquire(&lock);
+
+  status_t err = NO_ERROR;
+  pmm_arena_t *a;
+  list_for_every_entry (&arena_list, a, pmm_arena_t, node) {
+    const paddr_t arena_end = a->base + a->size;
+    if (a->numa_node == nid || end <= a->base || base >= arena_end)
+      continue;
+
+    /* keep what is outside the range where it is, the loop gets to the split
+     * off upper part next */
+    if (a->base < base || arena_end > end) {
+      if (!spare[spares]) {
+        err = ERR_NO_MEMORY;
+        break;
       }
+      split_arena_locked(a, (a->base < base ? base : end) - a->base, spare[spares++]);
+      if (a->base < base)
+        continue;
     }
+
+    a->numa_node = nid;
   }
 
+  if (err == NO_ERROR)
+    add_numa_node_locked(nid);
+
   mutex_release(&lock);
 
-  LTRACEF("couldn't find run\n");
+  for (; spares < countof(spare); spares++) {
+    free(spare[spares]);
+  }
+  return err;
+}
+
+status_t pmm_set_numa_distance(uint from, uint to, uint distance) {
+  if (from >= PMM_MAX_NUMA_NODES || to >= PMM_MAX_NUMA_NODES || distance == 0 || distance > 255)
+    return ERR_INVALID_ARGS;
+
+  mutex_acquire(&lock);
+  numa_distance[from][to] = distance;
+  update_numa_order_locked();
+  mutex_release(&lock);
+  return NO_ERROR;
+}
+
+uint pmm_numa_distance(uint from, uint to) {
+  if (from >= PMM_MAX_NUMA_NODES || to >= PMM_MAX_NUMA_NODES)
+    return 255;
+  return distance(from, to);
+}
+
+status_t pmm_add_numa_node(uint nid) {
+  if (nid >= PMM_MAX_NUMA_NODES)
+    return ERR_INVALID_ARGS;
+
+  /* a node with cpus but no memory of its own is still a node, it allocates
+   * from the ones nearest to it */
+  mutex_acquire(&lock);
+  add_numa_node_locked(nid);
+  mutex_release(&lock);
+  return NO_ERROR;
+}
+
+status_t pmm_set_cpu_numa_node(uint cpu, uint nid) {
+  if (cpu >= SMP_MAX_CPUS || nid >= PMM_MAX_NUMA_NODES)
+    return ERR_INVALID_ARGS;
+
+  /* only a node we have not seen yet needs the lock */
+  if (nid >= __atomic_load_n(&numa_nodes, __ATOMIC_ACQUIRE)) {
+    status_t err = pmm_add_numa_node(nid);
+    if (err != NO_ERROR)
+      return err;
+  }
+
+  __atomic_store_n(&cpu_numa_node[cpu], nid, __ATOMIC_RELAXED);
+  return NO_ERROR;
+}
+
+uint pmm_cpu_numa_node(uint cpu) { return cpu < SMP_MAX_CPUS ? cpu_numa_node[cpu] : 0; }
+
+uint pmm_numa_node_count(void) { return numa_nodes; }
+
+uint pmm_page_numa_node(const vm_page_t *page) {
+  pmm_arena_t *a = page_to_arena(page);
+  return a ? a->numa_node : 0;
+}
+
+size_t pmm_numa_free_count(uint nid) {
+  size_t count = 0;
+
+  mutex_acquire(&lock);
+  pmm_arena_t *a;
+  list_for_every_entry (&arena_list, a, pmm_arena_t, node) {
+    if (a->numa_node == nid)
+      count += a->free_count;
+  }
+  mutex_release(&lock);
+  return count;
+}
+
+/* lock held, the dirty free page of kernel visible memory least likely to be in the cache,
+ * nearest to node nid first */
+static vm_page_t *take_dirty_page(uint nid) {
+  for (uint n = 0; n < numa_nodes; n++) {
+    pmm_arena_t *a;
+    list_for_every_entry (&arena_list, a, pmm_arena_t, node) {
+      if (a->numa_node != numa_order[nid][n] || !(a->flags & PMM_ARENA_FLAG_KMAP))
+        continue;
+
+      vm_page_t *page = list_remove_tail_type(&a->free_list, vm_page_t, node);
+      if (page) {
+        mark_allocated(a, page, 0);
+        return page;
+      }
+    }
+  }
+  return NULL;
+}
+
+static int zero_thread(void *arg) {
+  const uint cpu = (uint)(uintptr_t)arg;
+
+  for (;;) {
+    mutex_acquire(&lock);
+    vm_page_t *page = take_dirty_page(cpu_numa_node[cpu]);
+    if (!page)
+      zero_waiting = true;
+    mutex_release(&lock);
+
+    if (!page) {
+      event_wait(&zero_event);
+      continue;
+    }
+
+    /* taken off the free list while it is zeroed so nobody else gets it half done */
+    arch_zero_page(paddr_to_kvaddr(vm_page_to_paddr(page)));
+
+    /* look the arena up again, pmm_set_numa_node() may have split it meanwhile */
+    mutex_acquire(&lock);
+    pmm_arena_t *a = page_to_arena(page);
+    page->flags = (page->flags & ~VM_PAGE_FLAG_NONFREE) | VM_PAGE_FLAG_ZEROED;
+    list_add_tail(&a->zeroed_list, &page->node);
+    a->free_count++;
+    a->zeroed_count++;
+    zero_stats.zeroed++;
+    mutex_release(&lock);
+  }
+
   return 0;
 }
 
+/* runs on every cpu as it comes up, so there is no thread for a cpu that never does */
+static void pmm_zero_init(uint level) {
+  uint cpu = arch_curr_cpu_num();
+  char name[32];
+  snprintf(name, sizeof(name), "pmm zero %u", cpu);
+
+  thread_t *t = thread_create(name, &zero_thread, (void *)(uintptr_t)cpu, IDLE_PRIORITY,
+                              DEFAULT_STACK_SIZE);
+  if (!t)
+    return;
+  thread_set_pinned_cpu(t, cpu);
+  thread_detach_and_resume(t);
+}
+
+LK_INIT_HOOK_FLAGS(pmm_zero, &pmm_zero_init, LK_INIT_LEVEL_THREADING, LK_INIT_FLAG_ALL_CPUS);
+
 static void dump_page(const vm_page_t *page) {
   printf("page %p: address 0x%lx flags 0x%x\n", page, vm_page_to_paddr(page), page->flags);
 }
 
 static void dump_arena(const pmm_arena_t *arena, bool dump_pages) {
-  printf("arena %p: name '%s' base 0x%lx size 0x%zx priority %u flags 0x%x\n", arena, arena->name,
-         arena->base, arena->size, arena->priority, arena->flags);
-  printf("\tpage_array %p, free_count %zu\n", arena->page_array, arena->free_count);
+  printf("arena %p: name '%s' base 0x%lx size 0x%zx priority %u flags 0x%x node %u\n", arena,
+         arena->name, arena->base, arena->size, arena->priority, arena->flags, arena->numa_node);
+  printf("\tpage_array %p, free_count %zu, zeroed_count %zu\n", arena->page_array,
+         arena->free_count, arena->zeroed_count);
 
   /* dump all of the pages */
   if (dump_pages) {
@@ -415,6 +854,8 @@ static int cmd_pmm(int argc, const cmd_args *argv, uint32_t flags) {
     printf("%s alloc_contig <count> <alignment>\n", argv[0].str);
     printf("%s dump_alloced\n", argv[0].str);
     printf("%s free_alloced\n", argv[0].str);
+    printf("%s zero_stats\n", argv[0].str);
+    printf("%s numa\n", argv[0].str);
     return ERR_GENERIC;
   }
 
@@ -497,6 +938,31 @@ static int cmd_pmm(int argc, const cmd_args *argv, uint32_t flags) {
   } else if (!strcmp(argv[1].str, "free_alloced")) {
     size_t err = pmm_free(&allocated);
     printf("pmm_free returns %zu\n", err);
+  } else if (!strcmp(argv[1].str, "zero_stats")) {
+    pmm_zero_stats_t stats;
+    pmm_get_zero_stats(&stats);
+    printf("zeroed pages: %llu asked for, %llu from the pool (%llu%%), %llu zeroed in the "
+           "background, %zu in the pool\n",
+           stats.requested, stats.hits, stats.requested ? stats.hits * 100 / stats.requested : 0,
+           stats.zeroed, stats.pool);
+  } else if (!strcmp(argv[1].str, "numa")) {
+    const uint nodes = pmm_numa_node_count();
+    for (uint n = 0; n < nodes; n++) {
+      printf("node %u: %zu free pages, cpus", n, pmm_numa_free_count(n));
+      for (uint cpu = 0; cpu < SMP_MAX_CPUS; cpu++) {
+        if (pmm_cpu_numa_node(cpu) == n)
+          printf(" %u", cpu);
+      }
+      printf(", fallback");
+      for (uint i = 0; i < nodes; i++) {
+        printf(" %u", numa_order[n][i]);
+      }
+      printf("\n\tdistances");
+      for (uint to = 0; to < nodes; to++) {
+        printf(" %u", pmm_numa_distance(n, to));
+      }
+      printf("\n");
+    }
   } else {
     printf("unknown command\n");
     goto usage;
@@ -6,6 +6,7 @@ MODULE_SRCS += \
 	$(LOCAL_DIR)/bootalloc.c \
 	$(LOCAL_DIR)/pmm.c \
 	$(LOCAL_DIR)/vm.c \
+	$(LOCAL_DIR)/vm_object.c \
 	$(LOCAL_DIR)/vmm.c \
 
 MODULE_OPTIONS := extra_warnings
@@ -0,0 +1,210 @@
+// Copyright 2025 Mist Tecnologia Ltda
+//
+// Use of this source code is governed by a MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <kernel/vm.h>
+#include <lk/err.h>
+#include <lk/trace.h>
+
+#include "vm_priv.h"
+
+#define LOCAL_TRACE 0
+
+/*
+ * Copy on write works with clone chains. Cloning an anonymous object freezes
+ * it as a hidden parent of two new, empty objects: one takes its place in the
+ * region that mapped it, the other goes to the clone. Reads of pages the
+ * children do not have map the parent's page read only, a write copies it into
+ * the child, or moves it over if no other object can see the parent anymore.
+ *
+ * Reference counts are atomic so objects can be released without the vmm
+ * lock, everything else is protected by it.
+ */
+
+static vm_object_t *object_alloc(uint type, size_t size) {
+  vm_object_t *obj = calloc(1, sizeof(vm_object_t));
+  if (!obj)
+    return NULL;
+
+  obj->ref = 1;
+  obj->type = type;
+  obj->size = size;
+  return obj;
+}
+
+status_t vm_object_create_anon(size_t size, vm_object_t **obj) {
+  size = ROUNDUP(size, PAGE_SIZE);
+  if (!obj || size == 0)
+    return ERR_INVALID_ARGS;
+
+  *obj = object_alloc(VM_OBJECT_ANON, size);
+  return *obj ? NO_ERROR : ERR_NO_MEMORY;
+}
+
+status_t vm_object_create_physical(paddr_t paddr, size_t size, vm_object_t **obj) {
+  if (!obj || size == 0 || !IS_PAGE_ALIGNED(paddr) || !IS_PAGE_ALIGNED(size))
+    return ERR_INVALID_ARGS;
+
+  vm_object_t *o = object_alloc(VM_OBJECT_PHYSICAL, size);
+  if (!o)
+    return ERR_NO_MEMORY;
+
+  o->paddr = paddr;
+  *obj = o;
+  return NO_ERROR;
+}
+
+void vm_object_acquire(vm_object_t *obj) {
+  DEBUG_ASSERT(obj);
+
+  __atomic_fetch_add(&obj->ref, 1, __ATOMIC_RELAXED);
+}
+
+void vm_object_release(vm_object_t *obj) {
+  /* dropping the last reference to a clone drops one to its parent, iterate
+   * rather than recurse as chains can get long */
+  while (obj && __atomic_fetch_sub(&obj->ref, 1, __ATOMIC_ACQ_REL) == 1) {
+    LTRACEF("freeing obj %p\n", obj);
+
+    vm_object_t *parent = obj->parent;
+    if (obj->pages) {
+      for (size_t i = 0; i < obj->size / PAGE_SIZE; i++) {
+        if (obj->pages[i])
+          pmm_free_page(obj->pages[i]);
+      }
+      free(obj->pages);
+    }
+    free(obj);
+
+    obj = parent;
+  }
+}
+
+size_t vm_object_size(const vm_object_t *obj) { return obj->size; }
+
+/* interleaving goes by offset rather than round robin so where a page ends up
+ * does not depend on the order the pages are touched in */
+static uint page_alloc_flags(const vm_object_t *obj, size_t index) {
+  if (obj->alloc_flags & PMM_ALLOC_FLAG_INTERLEAVE)
+    return PMM_ALLOC_FLAG_NODE(index % pmm_numa_node_count());
+  return obj->alloc_flags;
+}
+
+vm_page_t *vm_object_page_locked(const vm_object_t *obj, size_t offset) {
+  DEBUG_ASSERT(offset < obj->size);
+
+  return obj->pages ? obj->pages[offset / PAGE_SIZE] : NULL;
+}
+
+status_t vm_object_fault_locked(vm_object_t *obj, size_t offset, bool write, paddr_t *pa,
+                                uint *how) {
+  DEBUG_ASSERT(offset < obj->size && IS_PAGE_ALIGNED(offset));
+
+  if (obj->type == VM_OBJECT_PHYSICAL) {
+    *pa = obj->paddr + offset;
+    *how = VM_OBJECT_FAULT_PRESENT;
+    return NO_ERROR;
+  }
+
+  size_t index = offset / PAGE_SIZE;
+  if (obj->pages && obj->pages[index]) {
+    *pa = vm_page_to_paddr(obj->pages[index]);
+    *how = VM_OBJECT_FAULT_PRESENT;
+    return NO_ERROR;
+  }
+
+  /* up the chain. the page can be moved rather than copied if every object
+   * between here and its owner is only referenced by the one below it */
+  vm_object_t *owner;
+  vm_page_t *p = NULL;
+  bool exclusive = true;
+  for (owner = obj->parent; owner; owner = owner->parent) {
+    if (__atomic_load_n(&owner->ref, __ATOMIC_ACQUIRE) > 1)
+      exclusive = false;
+    if (owner->pages && owner->pages[index]) {
+      p = owner->pages[index];
+      break;
+    }
+  }
+
+  if (p && !write) {
+    *pa = vm_page_to_paddr(p);
+    *how = VM_OBJECT_FAULT_SHARED;
+    return NO_ERROR;
+  }
+
+  if (!obj->pages) {
+    obj->pages = calloc(obj->size / PAGE_SIZE, sizeof(vm_page_t *));
+    if (!obj->pages)
+      return ERR_NO_MEMORY;
+  }
+
+  vm_page_t *np;
+  if (p && exclusive) {
+    owner->pages[index] = NULL;
+    np = p;
+    *how = VM_OBJECT_FAULT_REUSED;
+  } else if (p) {
+    np = pmm_alloc_page_etc(page_alloc_flags(obj, index));
+    if (!np)
+      return ERR_NO_MEMORY;
+
+    memcpy(paddr_to_kvaddr(vm_page_to_paddr(np)), paddr_to_kvaddr(vm_page_to_paddr(p)), PAGE_SIZE);
+    *how = VM_OBJECT_FAULT_COPIED;
+  } else {
+    np = pmm_alloc_page_etc(PMM_ALLOC_FLAG_ZEROED | page_alloc_flags(obj, index));
+    if (!np)
+      return ERR_NO_MEMORY;
+
+    *how = VM_OBJECT_FAULT_ZERO_FILL;
+  }
+
+  obj->pages[index] = np;
+  *pa = vm_page_to_paddr(np);
+  return NO_ERROR;
+}
+
+status_t vm_object_clone_locked(vm_object_t *obj, vm_object_t **obj_out, vm_object_t **clone_out) {
+  DEBUG_ASSERT(obj->type == VM_OBJECT_ANON);
+  DEBUG_ASSERT(obj->ref == 1);
+
+  vm_object_t *a = object_alloc(VM_OBJECT_ANON, obj->size);
+  vm_object_t *b = object_alloc(VM_OBJECT_ANON, obj->size);
+  if (!a || !b) {
+    free(a);
+    free(b);
+    return ERR_NO_MEMORY;
+  }
+
+  a->alloc_flags = obj->alloc_flags;
+  b->alloc_flags = obj->alloc_flags;
+
+  if (obj->pages) {
+    /* a inherits the caller's reference, b takes a new one */
+    a->parent = obj;
+    b->parent = obj;
+    vm_object_acquire(obj);
+  } else {
+    /* nothing of its own to freeze, keep the chain short and share its parent */
+    a->parent = obj->parent;
+    b->parent = obj->parent;
+    if (obj->parent) {
+      vm_object_acquire(obj->parent);
+      vm_object_acquire(obj->parent);
+    }
+    /* may free obj, nothing reads it from here on */
+    vm_object_release(obj);
+  }
+
+  LTRACEF("obj %p -> %p, %p\n", obj, a, b);
+
+  *obj_out = a;
+  *clone_out = b;
+  return NO_ERROR;
+}
@@ -19,3 +19,43 @@ extern uintptr_t boot_alloc_end;
 
 void vmm_init_preheap(void);
 void vmm_init(void);
+
+/* vm objects, see vm_object.c */
+#define VM_OBJECT_ANON 0
+#define VM_OBJECT_PHYSICAL 1
+
+struct vm_object {
+  int ref;
+  uint type;
+  size_t size;
+
+  /* VM_OBJECT_PHYSICAL */
+  paddr_t paddr;
+
+  /* VM_OBJECT_ANON. pages missing here are read from the parent until written,
+   * a parent is a frozen copy shared by the objects cloned from it */
+  struct vm_object *parent;
+  vm_page_t **pages; /* one slot per page, allocated on first commit */
+  uint alloc_flags;  /* NUMA placement of new pages, PMM_ALLOC_FLAG_NODE or _INTERLEAVE */
+};
+
+/* how vm_object_fault_locked() came up with the page */
+#define VM_OBJECT_FAULT_PRESENT 0   /* the object's own page */
+#define VM_OBJECT_FAULT_ZERO_FILL 1 /* a new zeroed page */
+#define VM_OBJECT_FAULT_SHARED 2    /* a parent's page, map it read only */
+#define VM_OBJECT_FAULT_COPIED 3    /* a copy of a parent's page */
+#define VM_OBJECT_FAULT_REUSED 4    /* a parent's page nobody else could see, moved over */
+
+/* the vm object routines below are called with the vmm lock held */
+
+/* find or make the page backing offset for an access, write or not */
+status_t vm_object_fault_locked(vm_object_t *obj, size_t offset, bool write, paddr_t *pa,
+                                uint *how);
+
+/* the page obj itself holds at offset, if any */
+vm_page_t *vm_object_page_locked(const vm_object_t *obj, size_t offset);
+
+/* freeze anonymous obj as the parent of two new copy on write objects, one to
+ * replace it wherever it is mapped and one for the clone. takes over the
+ * caller's reference to obj, which must not be used afterwards */
+status_t vm_object_clone_locked(vm_object_t *obj, vm_object_t **obj_out, vm_object_t **clone_out);
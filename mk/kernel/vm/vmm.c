@@ -6,6 +6,7 @@
  * https://opensource.org/licenses/MIT
  */
 #include <assert.h>
+#include <lib/slab.h>
 #include <string.h>
 
 #include <kernel/mutex.h>
@@ -21,6 +22,8 @@
 
 static struct list_node aspace_list = LIST_INITIAL_VALUE(aspace_list);
 static mutex_t vmm_lock = MUTEX_INITIAL_VALUE(vmm_lock);
+static slab_cache_t region_cache =
+    SLAB_CACHE_TYPED_INITIAL_VALUE(region_cache, "vmm_region", vmm_region_t);
 
 vmm_aspace_t _kernel_aspace;
 
@@ -96,9 +99,10 @@ static vmm_region_t *alloc_region_struct(const char *name, vaddr_t base, size_t
                                          uint arch_mmu_flags) {
   DEBUG_ASSERT(name);
 
-  vmm_region_t *r = calloc(1, sizeof(vmm_region_t));
+  vmm_region_t *r = slab_cache_alloc(&region_cache);
   if (!r)
     return NULL;
+  memset(r, 0, sizeof(*r));
 
   strlcpy(r->name, name, sizeof(r->name));
   r->base = base;
@@ -110,6 +114,23 @@ static vmm_region_t *alloc_region_struct(const char *name, vaddr_t base, size_t
   return r;
 }
 
+static void free_region_struct(vmm_region_t *r) { slab_cache_free(&region_cache, r); }
+
+/* release everything backing an unmapped region, without the vmm lock held */
+static void free_region(vmm_region_t *r) {
+  /* return physical pages if any */
+  pmm_free(&r->page_list);
+
+  if (r->pager && r->pager->close)
+    r->pager->close(r);
+
+  if (r->object)
+    vm_object_release(r->object);
+
+  /* free it */
+  free_region_struct(r);
+}
+
 /* add a region to the appropriate spot in the address space list,
  * testing to see if there's a space */
 static status_t add_region_to_aspace(vmm_aspace_t *aspace, vmm_region_t *r) {
@@ -260,7 +281,7 @@ static vmm_region_t *alloc_region(vmm_aspace_t *aspace, const char *name, size_t
     /* stick it in the list, checking to see if it fits */
     if (add_region_to_aspace(aspace, r) < 0) {
       /* didn't fit */
-      free(r);
+      free_region_struct(r);
       return NULL;
     }
   } else {
@@ -272,7 +293,7 @@ static vmm_region_t *alloc_region(vmm_aspace_t *aspace, const char *name, size_t
 
     if (vaddr == (vaddr_t)-1) {
       LTRACEF("failed to find spot\n");
-      free(r);
+      free_region_struct(r);
       return NULL;
     }
 
@@ -392,7 +413,7 @@ err_free_r: {
   DEBUG_ASSERT(r_temp == r);
 }
   mutex_release(&vmm_lock);
-  free(r);
+  free_region_struct(r);
   return err;
 }
 
@@ -473,7 +494,7 @@ err_free_r: {
   status_t err2 = vmm_remove_region_locked(aspace, r->base, &r_temp);
   DEBUG_ASSERT(err2 == NO_ERROR || err2 == ERR_NOT_FOUND);
   DEBUG_ASSERT(r_temp == r);
-  free(r);
+  free_region_struct(r);
 }
 err_free_pages:
   mutex_release(&vmm_lock);
@@ -482,6 +503,14 @@ err:
   return err;
 }
 
+/* the pmm placement policy a vmm_alloc() caller asked for */
+static uint numa_alloc_flags(uint vmm_flags) {
+  uint alloc_flags = vmm_flags & PMM_ALLOC_FLAG_NODE_MASK;
+  if (vmm_flags & VMM_FLAG_INTERLEAVE)
+    alloc_flags |= PMM_ALLOC_FLAG_INTERLEAVE;
+  return alloc_flags;
+}
+
 status_t vmm_alloc(vmm_aspace_t *aspace, const char *name, size_t size, void **ptr,
                    uint8_t align_pow2, uint vmm_flags, uint arch_mmu_flags) {
   status_t err = NO_ERROR;
@@ -491,6 +520,20 @@ status_t vmm_alloc(vmm_aspace_t *aspace, const char *name, size_t size, void **p
 
   DEBUG_ASSERT(aspace);
 
+  /* a private anonymous object, paged in on first touch */
+  if (vmm_flags & VMM_FLAG_LAZY) {
+    vm_object_t *obj;
+    err = vm_object_create_anon(size, &obj);
+    if (err < NO_ERROR)
+      return err;
+
+    obj->alloc_flags = numa_alloc_flags(vmm_flags);
+    err = vmm_map_object(aspace, name, obj, 0, vm_object_size(obj), ptr, align_pow2, vmm_flags,
+                         arch_mmu_flags);
+    vm_object_release(obj);
+    return err;
+  }
+
   size = ROUNDUP(size, PAGE_SIZE);
   if (size == 0)
     return ERR_INVALID_ARGS;
@@ -516,7 +559,10 @@ status_t vmm_alloc(vmm_aspace_t *aspace, const char *name, size_t size, void **p
   struct list_node page_list;
   list_initialize(&page_list);
 
-  size_t count = pmm_alloc_pages(size / PAGE_SIZE, &page_list);
+  uint alloc_flags = numa_alloc_flags(vmm_flags);
+  if (vmm_flags & VMM_FLAG_ZEROED)
+    alloc_flags |= PMM_ALLOC_FLAG_ZEROED;
+  size_t count = pmm_alloc_pages_etc(size / PAGE_SIZE, alloc_flags, &page_list);
   DEBUG_ASSERT(count <= size);
   if (count < size / PAGE_SIZE) {
     LTRACEF("failed to allocate enough pages (asked for %zu, got %zu)\n", size / PAGE_SIZE, count);
@@ -576,7 +622,7 @@ err2: {
 
   pmm_free(&r->page_list);
   pmm_free(&page_list);
-  free(r);
+  free_region_struct(r);
   goto err;
 
 err1:
@@ -586,6 +632,122 @@ err:
   return err;
 }
 
+status_t vmm_alloc_pager(vmm_aspace_t *aspace, const char *name, size_t size, void **ptr,
+                         uint8_t align_pow2, uint vmm_flags, uint arch_mmu_flags,
+                         const vmm_pager_ops_t *pager, void *pager_arg) {
+  LTRACEF("aspace %p name '%s' size 0x%zx ptr %p align %hhu vmm_flags 0x%x arch_mmu_flags 0x%x\n",
+          aspace, name, size, ptr ? *ptr : 0, align_pow2, vmm_flags, arch_mmu_flags);
+
+  DEBUG_ASSERT(aspace);
+  DEBUG_ASSERT(pager && pager->get_page);
+
+  size = ROUNDUP(size, PAGE_SIZE);
+  if (size == 0)
+    return ERR_INVALID_ARGS;
+
+  if (!name)
+    name = "";
+
+  vaddr_t vaddr = 0;
+
+  /* if they're asking for a specific spot, copy the address */
+  if (vmm_flags & VMM_FLAG_VALLOC_SPECIFIC) {
+    /* can't ask for a specific spot and then not provide one */
+    if (!ptr)
+      return ERR_INVALID_ARGS;
+    vaddr = (vaddr_t)*ptr;
+  }
+
+  mutex_acquire(&vmm_lock);
+
+  /* allocate a region and put it in the aspace list, the pages come later */
+  vmm_region_t *r = alloc_region(aspace, name, size, vaddr, align_pow2, vmm_flags,
+                                 VMM_REGION_FLAG_PAGER, arch_mmu_flags);
+  if (!r) {
+    mutex_release(&vmm_lock);
+    return ERR_NO_MEMORY;
+  }
+
+  r->pager = pager;
+  r->pager_arg = pager_arg;
+
+  /* return the vaddr if requested */
+  if (ptr)
+    *ptr = (void *)r->base;
+
+  mutex_release(&vmm_lock);
+  return NO_ERROR;
+}
+
+status_t vmm_map_object(vmm_aspace_t *aspace, const char *name, vm_object_t *obj, size_t offset,
+                        size_t size, void **ptr, uint8_t align_pow2, uint vmm_flags,
+                        uint arch_mmu_flags) {
+  LTRACEF("aspace %p name '%s' obj %p offset 0x%zx size 0x%zx ptr %p align %hhu vmm_flags 0x%x "
+          "arch_mmu_flags 0x%x\n",
+          aspace, name, obj, offset, size, ptr ? *ptr : 0, align_pow2, vmm_flags, arch_mmu_flags);
+
+  DEBUG_ASSERT(aspace);
+  DEBUG_ASSERT(obj);
+
+  size = ROUNDUP(size, PAGE_SIZE);
+  if (size == 0 || !IS_PAGE_ALIGNED(offset))
+    return ERR_INVALID_ARGS;
+  if (offset >= obj->size || size > obj->size - offset)
+    return ERR_OUT_OF_RANGE;
+
+  if (!name)
+    name = "";
+
+  vaddr_t vaddr = 0;
+
+  /* if they're asking for a specific spot, copy the address */
+  if (vmm_flags & VMM_FLAG_VALLOC_SPECIFIC) {
+    /* can't ask for a specific spot and then not provide one */
+    if (!ptr)
+      return ERR_INVALID_ARGS;
+    vaddr = (vaddr_t)*ptr;
+  }
+
+  uint region_flags = VMM_REGION_FLAG_OBJECT;
+  if (vmm_flags & VMM_FLAG_SHARED)
+    region_flags |= VMM_REGION_FLAG_SHARED;
+
+  mutex_acquire(&vmm_lock);
+
+  vmm_region_t *r = alloc_region(aspace, name, size, vaddr, align_pow2, vmm_flags, region_flags,
+                                 arch_mmu_flags);
+  if (!r) {
+    mutex_release(&vmm_lock);
+    return ERR_NO_MEMORY;
+  }
+
+  vm_object_acquire(obj);
+  r->object = obj;
+  r->object_offset = offset;
+
+  /* physical memory has nothing to page in, map it all now */
+  if (obj->type == VM_OBJECT_PHYSICAL) {
+    status_t err = arch_mmu_map(&aspace->arch_aspace, r->base, obj->paddr + offset,
+                                size / PAGE_SIZE, arch_mmu_flags);
+    if (err < NO_ERROR) {
+      vmm_region_t *r_temp;
+      status_t err2 = vmm_remove_region_locked(aspace, r->base, &r_temp);
+      DEBUG_ASSERT(err2 == NO_ERROR);
+      DEBUG_ASSERT(r_temp == r);
+      mutex_release(&vmm_lock);
+      free_region(r);
+      return err;
+    }
+  }
+
+  /* return the vaddr if requested */
+  if (ptr)
+    *ptr = (void *)r->base;
+
+  mutex_release(&vmm_lock);
+  return NO_ERROR;
+}
+
 static vmm_region_t *vmm_find_region(const vmm_aspace_t *aspace, vaddr_t vaddr) {
   vmm_region_t *r;
 
@@ -645,15 +807,140 @@ status_t vmm_free_region(vmm_aspace_t *aspace, vaddr_t vaddr) {
 
   DEBUG_ASSERT(r);
 
-  /* return physical pages if any */
-  pmm_free(&r->page_list);
+  free_region(r);
 
-  /* free it */
-  free(r);
+  return NO_ERROR;
+}
+
+static bool vmm_access_allowed(uint pf_flags, uint arch_mmu_flags) {
+  if ((pf_flags & VMM_PF_FLAG_WRITE) && (arch_mmu_flags & ARCH_MMU_FLAG_PERM_RO))
+    return false;
+  if ((pf_flags & VMM_PF_FLAG_USER) && !(arch_mmu_flags & ARCH_MMU_FLAG_PERM_USER))
+    return false;
+  if ((pf_flags & VMM_PF_FLAG_INSTRUCTION) && (arch_mmu_flags & ARCH_MMU_FLAG_PERM_NO_EXECUTE))
+    return false;
+  return true;
+}
+
+/* fault on a demand paged region, only missing pages are paged in */
+static status_t pager_fault_locked(vmm_aspace_t *aspace, vmm_region_t *r, vaddr_t va,
+                                   uint pf_flags) {
+  if (!(pf_flags & VMM_PF_FLAG_NOT_PRESENT))
+    return ERR_ACCESS_DENIED;
+
+  /* another thread sharing the aspace may have paged it in already. the
+   * mapping is only as good as the region's permissions checked above */
+  uint mapped_flags;
+  if (arch_mmu_query(&aspace->arch_aspace, va, NULL, &mapped_flags) == NO_ERROR) {
+    if (!vmm_access_allowed(pf_flags, mapped_flags))
+      return ERR_ACCESS_DENIED;
+    aspace->fault_stats.spurious++;
+    return NO_ERROR;
+  }
+
+  vm_page_t *p;
+  bool owned = false;
+  status_t err = r->pager->get_page(r, va - r->base, &p, &owned);
+  if (err < NO_ERROR)
+    return err;
+
+  err = arch_mmu_map(&aspace->arch_aspace, va, vm_page_to_paddr(p), 1, r->arch_mmu_flags);
+  if (err < NO_ERROR) {
+    if (owned)
+      pmm_free_page(p);
+    return err;
+  }
+
+  if (owned)
+    list_add_tail(&r->page_list, &p->node);
+
+  aspace->fault_stats.paged_in++;
+  return NO_ERROR;
+}
+
+/* fault on a region mapping an object, a missing page or a write to a page
+ * still shared with a clone */
+static status_t object_fault_locked(vmm_aspace_t *aspace, vmm_region_t *r, vaddr_t va,
+                                    uint pf_flags) {
+  uint mapped_flags;
+  bool mapped = arch_mmu_query(&aspace->arch_aspace, va, NULL, &mapped_flags) == NO_ERROR;
+  if (mapped && vmm_access_allowed(pf_flags, mapped_flags)) {
+    aspace->fault_stats.spurious++;
+    return NO_ERROR;
+  }
 
+  paddr_t pa;
+  uint how;
+  status_t err = vm_object_fault_locked(r->object, r->object_offset + (va - r->base),
+                                        pf_flags & VMM_PF_FLAG_WRITE, &pa, &how);
+  if (err < NO_ERROR)
+    return err;
+
+  uint arch_mmu_flags = r->arch_mmu_flags;
+  if (how == VM_OBJECT_FAULT_SHARED)
+    arch_mmu_flags |= ARCH_MMU_FLAG_PERM_RO;
+
+  /* a page committed to the object stays there if this fails, it goes with the object */
+  if (mapped)
+    arch_mmu_unmap(&aspace->arch_aspace, va, 1);
+  err = arch_mmu_map(&aspace->arch_aspace, va, pa, 1, arch_mmu_flags);
+  if (err < NO_ERROR)
+    return err;
+
+  switch (how) {
+    case VM_OBJECT_FAULT_ZERO_FILL:
+      aspace->fault_stats.zero_fill++;
+      break;
+    case VM_OBJECT_FAULT_COPIED:
+      aspace->fault_stats.cow_copied++;
+      break;
+    case VM_OBJECT_FAULT_REUSED:
+      aspace->fault_stats.cow_reused++;
+      break;
+    default:
+      aspace->fault_stats.paged_in++;
+      break;
+  }
   return NO_ERROR;
 }
 
+status_t vmm_page_fault_handler(vaddr_t vaddr, uint pf_flags) {
+  LTRACEF("vaddr 0x%lx pf_flags 0x%x\n", vaddr, pf_flags);
+
+  vmm_aspace_t *aspace = vaddr_to_aspace((void *)vaddr);
+  if (!aspace)
+    return ERR_NOT_FOUND;
+
+  vaddr_t va = ROUNDDOWN(vaddr, PAGE_SIZE);
+  status_t err;
+
+  mutex_acquire(&vmm_lock);
+
+  aspace->fault_stats.faults++;
+
+  vmm_region_t *r = vmm_find_region(aspace, va);
+  if (!r || !(r->flags & (VMM_REGION_FLAG_PAGER | VMM_REGION_FLAG_OBJECT))) {
+    err = ERR_NOT_FOUND;
+    goto out;
+  }
+
+  if (!vmm_access_allowed(pf_flags, r->arch_mmu_flags)) {
+    err = ERR_ACCESS_DENIED;
+    goto out;
+  }
+
+  if (r->flags & VMM_REGION_FLAG_OBJECT)
+    err = object_fault_locked(aspace, r, va, pf_flags);
+  else
+    err = pager_fault_locked(aspace, r, va, pf_flags);
+
+out:
+  if (err < NO_ERROR)
+    aspace->fault_stats.failed++;
+  mutex_release(&vmm_lock);
+  return err;
+}
+
 status_t vmm_create_aspace(vmm_aspace_t **_aspace, const char *name, uint flags) {
   status_t err;
 
@@ -721,11 +1008,7 @@ status_t vmm_free_aspace(vmm_aspace_t *aspace) {
 
   /* without the vmm lock held, free all of the pmm pages and the structure */
   while ((r = list_remove_head_type(&region_list, vmm_region_t, node))) {
-    /* return physical pages if any */
-    pmm_free(&r->page_list);
-
-    /* free it */
-    free(r);
+    free_region(r);
   }
 
   /* make sure the current thread does not map the aspace */
@@ -746,6 +1029,124 @@ status_t vmm_free_aspace(vmm_aspace_t *aspace) {
   return NO_ERROR;
 }
 
+/* give clone c of region r either a copy on write or a shared view of r's object */
+static status_t clone_object_region_locked(vmm_aspace_t *aspace, vmm_region_t *r,
+                                           vmm_aspace_t *clone, vmm_region_t *c) {
+  vm_object_t *obj = r->object;
+  c->object_offset = r->object_offset;
+
+  /* anything mapped elsewhere as well is shared memory, the clone sees the same */
+  if ((r->flags & VMM_REGION_FLAG_SHARED) || obj->type != VM_OBJECT_ANON ||
+      __atomic_load_n(&obj->ref, __ATOMIC_ACQUIRE) > 1) {
+    vm_object_acquire(obj);
+    c->object = obj;
+    if (obj->type == VM_OBJECT_PHYSICAL)
+      return arch_mmu_map(&clone->arch_aspace, c->base, obj->paddr + c->object_offset,
+                          c->size / PAGE_SIZE, c->arch_mmu_flags);
+    return NO_ERROR;
+  }
+
+  /* what the aspace can write to is about to be shared with the clone, write
+   * protect it. pages of older clone parents are mapped read only already, and
+   * the clone maps nothing, it faults in what it uses */
+  if (obj->pages) {
+    for (size_t off = 0; off < r->size; off += PAGE_SIZE) {
+      vm_page_t *p = vm_object_page_locked(obj, r->object_offset + off);
+      if (!p)
+        continue;
+
+      /* if the remap fails the next access faults it back in, read only */
+      vaddr_t va = r->base + off;
+      arch_mmu_unmap(&aspace->arch_aspace, va, 1);
+      arch_mmu_map(&aspace->arch_aspace, va, vm_page_to_paddr(p), 1,
+                   r->arch_mmu_flags | ARCH_MMU_FLAG_PERM_RO);
+    }
+  }
+
+  return vm_object_clone_locked(obj, &r->object, &c->object);
+}
+
+/* copy the pages of a region allocated up front, or map the same physical range */
+static status_t clone_physical_region_locked(vmm_aspace_t *aspace, vmm_region_t *r,
+                                             vmm_aspace_t *clone, vmm_region_t *c) {
+  paddr_t pa;
+  status_t err;
+
+  if (list_is_empty(&r->page_list)) {
+    err = arch_mmu_query(&aspace->arch_aspace, r->base, &pa, NULL);
+    if (err < NO_ERROR)
+      return err;
+    return arch_mmu_map(&clone->arch_aspace, c->base, pa, c->size / PAGE_SIZE, c->arch_mmu_flags);
+  }
+
+  for (size_t off = 0; off < r->size; off += PAGE_SIZE) {
+    if (arch_mmu_query(&aspace->arch_aspace, r->base + off, &pa, NULL) < NO_ERROR)
+      continue;
+
+    vm_page_t *p = pmm_alloc_page();
+    if (!p)
+      return ERR_NO_MEMORY;
+    list_add_tail(&c->page_list, &p->node);
+
+    memcpy(paddr_to_kvaddr(vm_page_to_paddr(p)), paddr_to_kvaddr(pa), PAGE_SIZE);
+
+    err = arch_mmu_map(&clone->arch_aspace, c->base + off, vm_page_to_paddr(p), 1,
+                       c->arch_mmu_flags);
+    if (err < NO_ERROR)
+      return err;
+  }
+  return NO_ERROR;
+}
+
+status_t vmm_clone_aspace(vmm_aspace_t *aspace, const char *name, vmm_aspace_t **_clone) {
+  LTRACEF("aspace %p name '%s'\n", aspace, name);
+
+  if (aspace->flags & VMM_ASPACE_FLAG_KERNEL)
+    return ERR_INVALID_ARGS;
+
+  vmm_aspace_t *clone;
+  status_t err = vmm_create_aspace(&clone, name, aspace->flags);
+  if (err < NO_ERROR)
+    return err;
+
+  mutex_acquire(&vmm_lock);
+
+  vmm_region_t *r;
+  list_for_every_entry (&aspace->region_list, r, vmm_region_t, node) {
+    if (r->flags & VMM_REGION_FLAG_PAGER) {
+      err = ERR_NOT_SUPPORTED;
+      break;
+    }
+
+    vmm_region_t *c = alloc_region_struct(r->name, r->base, r->size, r->flags, r->arch_mmu_flags);
+    if (!c) {
+      err = ERR_NO_MEMORY;
+      break;
+    }
+
+    /* same spots in an empty aspace, the list stays sorted. on failure whatever
+     * was set up so far is torn down with the clone */
+    list_add_tail(&clone->region_list, &c->node);
+
+    if (r->flags & VMM_REGION_FLAG_OBJECT)
+      err = clone_object_region_locked(aspace, r, clone, c);
+    else if (r->flags & VMM_REGION_FLAG_PHYSICAL)
+      err = clone_physical_region_locked(aspace, r, clone, c);
+    if (err < NO_ERROR)
+      break;
+  }
+
+  mutex_release(&vmm_lock);
+
+  if (err < NO_ERROR) {
+    vmm_free_aspace(clone);
+    return err;
+  }
+
+  *_clone = clone;
+  return NO_ERROR;
+}
+
 void vmm_context_switch(vmm_aspace_t *oldspace, vmm_aspace_t *newaspace) {
   DEBUG_ASSERT(thread_lock_held());
 
@@ -775,11 +1176,21 @@ vmm_aspace_t *vmm_set_active_aspace(vmm_aspace_t *aspace) {
 static void dump_region(const vmm_region_t *r) {
   printf("\tregion %p: name '%s' range 0x%lx - 0x%lx size 0x%zx flags 0x%x mmu_flags 0x%x\n", r,
          r->name, r->base, r->base + r->size - 1, r->size, r->flags, r->arch_mmu_flags);
+  if (r->object) {
+    printf("\t\tobject %p offset 0x%zx size 0x%zx ref %d parent %p alloc_flags 0x%x\n", r->object,
+           r->object_offset, r->object->size, r->object->ref, r->object->parent,
+           r->object->alloc_flags);
+  }
 }
 
 static void dump_aspace(const vmm_aspace_t *a) {
   printf("aspace %p: name '%s' range 0x%lx - 0x%lx size 0x%zx flags 0x%x\n", a, a->name, a->base,
          a->base + a->size - 1, a->size, a->flags);
+  printf("faults %llu: zero fill %llu paged in %llu cow copied %llu cow reused %llu spurious %llu "
+         "failed %llu\n",
+         a->fault_stats.faults, a->fault_stats.zero_fill, a->fault_stats.paged_in,
+         a->fault_stats.cow_copied, a->fault_stats.cow_reused, a->fault_stats.spurious,
+         a->fault_stats.failed);
 
   printf("regions:\n");
   vmm_region_t *r;
@@ -796,12 +1207,14 @@ static int cmd_vmm(int argc, const cmd_args *argv, uint32_t flags) {
     printf("usage:\n");
     printf("%s aspaces\n", argv[0].str);
     printf("%s alloc <size> <align_pow2>\n", argv[0].str);
+    printf("%s alloc_lazy <size> <align_pow2>\n", argv[0].str);
     printf("%s alloc_physical <paddr> <size> <align_pow2>\n", argv[0].str);
     printf("%s alloc_contig <size> <align_pow2>\n", argv[0].str);
     printf("%s free_region <address>\n", argv[0].str);
     printf("%s create_aspace\n", argv[0].str);
     printf("%s create_test_aspace\n", argv[0].str);
     printf("%s free_aspace <address>\n", argv[0].str);
+    printf("%s clone_aspace <address>\n", argv[0].str);
     printf("%s set_test_aspace <address>\n", argv[0].str);
     return ERR_GENERIC;
   }
@@ -822,6 +1235,14 @@ static int cmd_vmm(int argc, const cmd_args *argv, uint32_t flags) {
     void *ptr = (void *)0x99;
     status_t err = vmm_alloc(test_aspace, "alloc test", argv[2].u, &ptr, argv[3].u, 0, 0);
     printf("vmm_alloc returns %d, ptr %p\n", err, ptr);
+  } else if (!strcmp(argv[1].str, "alloc_lazy")) {
+    if (argc < 4)
+      goto notenoughargs;
+
+    void *ptr = (void *)0x99;
+    status_t err =
+        vmm_alloc(test_aspace, "lazy test", argv[2].u, &ptr, argv[3].u, VMM_FLAG_LAZY, 0);
+    printf("vmm_alloc returns %d, ptr %p\n", err, ptr);
   } else if (!strcmp(argv[1].str, "alloc_physical")) {
     if (argc < 4)
       goto notenoughargs;
@@ -873,6 +1294,13 @@ static int cmd_vmm(int argc, const cmd_args *argv, uint32_t flags) {
 
     status_t err = vmm_free_aspace(aspace);
     printf("vmm_free_aspace returns %d\n", err);
+  } else if (!strcmp(argv[1].str, "clone_aspace")) {
+    if (argc < 3)
+      goto notenoughargs;
+
+    vmm_aspace_t *aspace;
+    status_t err = vmm_clone_aspace((void *)argv[2].u, "clone", &aspace);
+    printf("vmm_clone_aspace returns %d, aspace %p\n", err, aspace);
   } else if (!strcmp(argv[1].str, "set_test_aspace")) {
     if (argc < 2)
       goto notenoughargs;
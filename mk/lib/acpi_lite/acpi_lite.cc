@@ -407,6 +407,32 @@ void acpi_lite_dump_tables(bool full_dump) {
   }
 }
 
+// walk the acpi_sub_table_header entries following a table's fixed size header
+static void process_sub_tables(const acpi_sdt_header* header, size_t header_size,
+                               const uint8_t search_type,
+                               void (*callback)(const void* entry, size_t entry_len)) {
+  // bytewise array of the same table
+  const uint8_t* array = reinterpret_cast<const uint8_t*>(header);
+
+  // walk the table off the end of the header, looking for the requested type
+  size_t off = header_size;
+  while (off + sizeof(acpi_sub_table_header) <= header->length) {
+    uint8_t type = array[off];
+    uint8_t length = array[off + 1];
+
+    // a zero length entry would have us loop forever
+    if (length < sizeof(acpi_sub_table_header)) {
+      break;
+    }
+
+    if (type == search_type) {
+      callback(static_cast<const void*>(&array[off]), length);
+    }
+
+    off += length;
+  }
+}
+
 status_t acpi_process_madt_entries_etc(const uint8_t search_type,
                                        const madt_entry_callback callback) {
   const acpi_madt_table* madt =
@@ -415,22 +441,19 @@ status_t acpi_process_madt_entries_etc(const uint8_t search_type,
     return ERR_NOT_FOUND;
   }
 
-  // bytewise array of the same table
-  const uint8_t* madt_array = reinterpret_cast<const uint8_t*>(madt);
-
-  // walk the table off the end of the header, looking for the requested type
-  size_t off = sizeof(*madt);
-  while (off < madt->header.length) {
-    uint8_t type = madt_array[off];
-    uint8_t length = madt_array[off + 1];
-
-    if (type == search_type) {
-      callback(static_cast<const void*>(&madt_array[off]), length);
-    }
+  process_sub_tables(&madt->header, sizeof(*madt), search_type, callback);
+  return NO_ERROR;
+}
 
-    off += length;
+status_t acpi_process_srat_entries_etc(const uint8_t search_type,
+                                       const srat_entry_callback callback) {
+  const acpi_srat_table* srat =
+      reinterpret_cast<const acpi_srat_table*>(acpi_get_table_by_sig(ACPI_SRAT_SIG));
+  if (!srat) {
+    return ERR_NOT_FOUND;
   }
 
+  process_sub_tables(&srat->header, sizeof(*srat), search_type, callback);
   return NO_ERROR;
 }
 
@@ -25,4 +25,8 @@ const struct acpi_sdt_header* acpi_get_table_by_sig(const char* sig);
 typedef void (*madt_entry_callback)(const void* entry, size_t entry_len);
 status_t acpi_process_madt_entries_etc(uint8_t search_type, const madt_entry_callback);
 
+// The same for the SRAT entries of a particular type
+typedef void (*srat_entry_callback)(const void* entry, size_t entry_len);
+status_t acpi_process_srat_entries_etc(uint8_t search_type, const srat_entry_callback);
+
 __END_CDECLS
@@ -183,6 +183,18 @@ struct acpi_srat_processor_x2apic_affinity_entry {
 } __PACKED;
 static_assert(sizeof(struct acpi_srat_processor_x2apic_affinity_entry) == 24, "");
 
+// SLIT table.
+//
+// Reference: ACPI v6.3 Section 5.2.17.
+#define ACPI_SLIT_SIG "SLIT"
+struct acpi_slit_table {
+  struct acpi_sdt_header header;
+  uint64_t locality_count;
+  // followed by a locality_count * locality_count matrix of byte sized relative
+  // distances between proximity domains, 10 being local
+} __PACKED;
+static_assert(sizeof(struct acpi_slit_table) == 44, "");
+
 // Multiple APIC Description Table (MADT) entries.
 
 // MADT entry type 0: Processor Local APIC (ACPI v6.3 Section 5.2.12.2)
@@ -8,10 +8,12 @@
 #include <assert.h>
 #include <lib/bcache.h>
 #include <lib/bio.h>
+#include <lib/slab.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/types.h>
 
+#include <arch/defines.h>
 #include <lk/debug.h>
 #include <lk/list.h>
 #include <lk/trace.h>
@@ -44,6 +46,7 @@ struct bcache {
   struct list_node lru_list;
 
   struct bcache_block *blocks;
+  slab_cache_t block_cache;
 };
 
 bcache_t bcache_create(bdev_t *dev, size_t block_size, int block_count) {
@@ -59,12 +62,18 @@ bcache_t bcache_create(bdev_t *dev, size_t block_size, int block_count) {
   list_initialize(&cache->free_list);
   list_initialize(&cache->lru_list);
 
+  // block buffers are handed to the device, keep them cache line aligned
+  if (slab_cache_init(&cache->block_cache, "bcache", block_size, CACHE_LINE, NULL, NULL) < 0) {
+    free(cache);
+    return NULL;
+  }
+
   cache->blocks = malloc(sizeof(struct bcache_block) * block_count);
   int i;
   for (i = 0; i < block_count; i++) {
     cache->blocks[i].ref_count = 0;
     cache->blocks[i].is_dirty = false;
-    cache->blocks[i].ptr = malloc(block_size);
+    cache->blocks[i].ptr = slab_cache_alloc(&cache->block_cache);
     // add to the free list
     list_add_head(&cache->free_list, &cache->blocks[i].node);
   }
@@ -97,9 +106,11 @@ void bcache_destroy(bcache_t _cache) {
     if (cache->blocks[i].is_dirty)
       printf("warning: freeing dirty block %u\n", cache->blocks[i].blocknum);
 
-    free(cache->blocks[i].ptr);
+    slab_cache_free(&cache->block_cache, cache->blocks[i].ptr);
   }
 
+  slab_cache_destroy(&cache->block_cache);
+  free(cache->blocks);
   free(cache);
 }
 
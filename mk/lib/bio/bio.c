@@ -11,6 +11,7 @@
 #include <string.h>
 
 #include <arch/atomic.h>
+#include <kernel/ktrace.h>
 #include <kernel/mutex.h>
 #include <lk/debug.h>
 #include <lk/err.h>
@@ -365,7 +366,10 @@ ssize_t bio_read(bdev_t *dev, void *buf, off_t offset, size_t len) {
   if (len == 0)
     return 0;
 
-  return dev->read(dev, buf, offset, len);
+  lk_bigtime_t start = KTRACE_TIMESTAMP();
+  ssize_t ret = dev->read(dev, buf, offset, len);
+  KTRACE_BIO_READ(start, ret);
+  return ret;
 }
 
 ssize_t bio_read_block(bdev_t *dev, void *buf, bnum_t block, uint count) {
@@ -379,7 +383,10 @@ ssize_t bio_read_block(bdev_t *dev, void *buf, bnum_t block, uint count) {
   if (count == 0)
     return 0;
 
-  return dev->read_block(dev, buf, block, count);
+  lk_bigtime_t start = KTRACE_TIMESTAMP();
+  ssize_t ret = dev->read_block(dev, buf, block, count);
+  KTRACE_BIO_READ(start, ret);
+  return ret;
 }
 
 ssize_t bio_write(bdev_t *dev, const void *buf, off_t offset, size_t len) {
@@ -393,7 +400,10 @@ ssize_t bio_write(bdev_t *dev, const void *buf, off_t offset, size_t len) {
   if (len == 0)
     return 0;
 
-  return dev->write(dev, buf, offset, len);
+  lk_bigtime_t start = KTRACE_TIMESTAMP();
+  ssize_t ret = dev->write(dev, buf, offset, len);
+  KTRACE_BIO_WRITE(start, ret);
+  return ret;
 }
 
 ssize_t bio_write_block(bdev_t *dev, const void *buf, bnum_t block, uint count) {
@@ -407,7 +417,10 @@ ssize_t bio_write_block(bdev_t *dev, const void *buf, bnum_t block, uint count)
   if (count == 0)
     return 0;
 
-  return dev->write_block(dev, buf, block, count);
+  lk_bigtime_t start = KTRACE_TIMESTAMP();
+  ssize_t ret = dev->write_block(dev, buf, block, count);
+  KTRACE_BIO_WRITE(start, ret);
+  return ret;
 }
 
 ssize_t bio_erase(bdev_t *dev, off_t offset, size_t len) {
@@ -32,6 +32,7 @@
 #if LK_DEBUGLEVEL > 0
 static int cmd_bio(int argc, const cmd_args *argv, uint32_t flags);
 static int bio_test_device(bdev_t *device);
+static int bio_bench_device(bdev_t *device, size_t io_size, uint count);
 
 STATIC_COMMAND_START
 STATIC_COMMAND("bio", "block io debug commands", &cmd_bio)
@@ -52,6 +53,7 @@ static int cmd_bio(int argc, const cmd_args *argv, uint32_t flags) {
     printf("%s ioctl <device> <request> <arg>\n", argv[0].str);
     printf("%s remove <device>\n", argv[0].str);
     printf("%s test <device>\n", argv[0].str);
+    printf("%s bench <device> [io size] [count]\n", argv[0].str);
 #if WITH_LIB_PARTITION
     printf("%s partscan <device> [offset]\n", argv[0].str);
 #endif
@@ -218,6 +220,21 @@ static int cmd_bio(int argc, const cmd_args *argv, uint32_t flags) {
     bio_close(dev);
 
     rc = err;
+  } else if (!strcmp(argv[1].str, "bench")) {
+    if (argc < 3)
+      goto notenoughargs;
+
+    size_t io_size = (argc > 3) ? argv[3].u : 4096;
+    uint count = (argc > 4) ? argv[4].u : 1000;
+
+    bdev_t *dev = bio_open(argv[2].str);
+    if (!dev) {
+      printf("error opening block device\n");
+      return -1;
+    }
+
+    rc = bio_bench_device(dev, io_size, count);
+    bio_close(dev);
 #if WITH_LIB_PARTITION
   } else if (!strcmp(argv[1].str, "partscan")) {
     if (argc < 3)
@@ -557,3 +574,39 @@ static int bio_test_device(bdev_t *device) {
 
   return 0;
 }
+
+/* random, block aligned reads in the spirit of fio randread, one request in flight */
+static int bio_bench_device(bdev_t *device, size_t io_size, uint count) {
+  if (count == 0 || io_size == 0 || io_size % device->block_size ||
+      (off_t)io_size > device->total_size) {
+    printf("io size must be a non zero multiple of the block size %zu\n", device->block_size);
+    return -1;
+  }
+
+  void *buf = memalign(DMA_ALIGNMENT, io_size);
+  if (!buf)
+    return ERR_NO_MEMORY;
+
+  const uint64_t slots = device->total_size / io_size;
+  lk_bigtime_t start = current_time_hires();
+  for (uint i = 0; i < count; i++) {
+    off_t offset = (off_t)(rand() % slots) * io_size;
+    ssize_t err = bio_read(device, buf, offset, io_size);
+    if (err != (ssize_t)io_size) {
+      printf("read error %ld at offset %lld\n", (long)err, (long long)offset);
+      free(buf);
+      return -1;
+    }
+  }
+  lk_bigtime_t elapsed = current_time_hires() - start;
+
+  free(buf);
+
+  if (elapsed == 0)
+    elapsed = 1;
+  printf("%u reads of %zu bytes in %llu us: %llu iops, %llu KB/s, %llu us per io\n", count, io_size,
+         elapsed, (uint64_t)count * 1000000 / elapsed,
+         (uint64_t)count * io_size * 1000000 / elapsed / 1024, elapsed / count);
+
+  return 0;
+}
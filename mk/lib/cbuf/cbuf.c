@@ -11,6 +11,7 @@
 #include <string.h>
 
 #include <kernel/event.h>
+#include <kernel/poll.h>
 #include <kernel/spinlock.h>
 #include <lk/debug.h>
 #include <lk/pow2.h>
@@ -20,9 +21,25 @@
 
 #define INC_POINTER(cbuf, ptr, inc) modpow2(((ptr) + (inc)), (cbuf)->len_pow2)
 
+// called with the thread lock held, a snapshot is all a poll set needs.
+static uint cbuf_poll_query(poll_source_t *source) {
+  cbuf_t *cbuf = containerof(source, cbuf_t, poll);
+
+  uint ready = 0;
+  if (cbuf_space_used(cbuf) > 0)
+    ready |= POLL_IN;
+  if (cbuf_space_avail(cbuf) > 0)
+    ready |= POLL_OUT;
+  return ready;
+}
+
 void cbuf_initialize(cbuf_t *cbuf, size_t len) { cbuf_initialize_etc(cbuf, len, malloc(len)); }
 
 void cbuf_initialize_etc(cbuf_t *cbuf, size_t len, void *buf) {
+  cbuf_initialize_etc_flags(cbuf, len, buf, 0);
+}
+
+void cbuf_initialize_etc_flags(cbuf_t *cbuf, size_t len, void *buf, uint flags) {
   DEBUG_ASSERT(cbuf);
   DEBUG_ASSERT(len > 0);
   DEBUG_ASSERT(ispow2(len));
@@ -30,9 +47,11 @@ void cbuf_initialize_etc(cbuf_t *cbuf, size_t len, void *buf) {
   cbuf->head = 0;
   cbuf->tail = 0;
   cbuf->len_pow2 = log2_uint(len);
+  cbuf->flags = flags;
   cbuf->buf = buf;
   event_init(&cbuf->event, false, 0);
   spin_lock_init(&cbuf->lock);
+  poll_source_init(&cbuf->poll, &cbuf_poll_query);
 
   LTRACEF("len %zd, len_pow2 %u\n", len, cbuf->len_pow2);
 }
@@ -46,6 +65,104 @@ size_t cbuf_space_used(cbuf_t *cbuf) {
   return modpow2((uint)(cbuf->head - cbuf->tail), cbuf->len_pow2);
 }
 
+// the (up to) two free regions following head, given a snapshot of tail.
+static size_t cbuf_free_regions(cbuf_t *cbuf, uint head, uint tail, iovec_t *regions) {
+  size_t sz = cbuf_size(cbuf);
+  size_t avail = sz - modpow2(head - tail, cbuf->len_pow2) - 1;
+  size_t first = MIN(avail, sz - head);
+
+  regions[0].iov_base = first ? (cbuf->buf + head) : NULL;
+  regions[0].iov_len = first;
+  regions[1].iov_base = (avail > first) ? cbuf->buf : NULL;
+  regions[1].iov_len = avail - first;
+  return avail;
+}
+
+/*
+ * Single producer, single consumer mode.
+ *
+ * The producer owns head and the consumer owns tail. Data is published by a
+ * release store of head and handed back by a release store of tail, and the
+ * other side picks them up with acquire loads. The event stays signaled while
+ * there is data, like in locked mode, but only the empty to non-empty and
+ * non-empty to empty transitions touch it. Each side stores its index, then
+ * looks at the other one after a full barrier, so at least one of them sees the
+ * transition: either the producer finds the consumer caught up and signals, or
+ * the consumer finds the new head and leaves the event alone.
+ */
+static void cbuf_spsc_publish(cbuf_t *cbuf, uint head, size_t len, bool canreschedule) {
+  __atomic_store_n(&cbuf->head, INC_POINTER(cbuf, head, len), __ATOMIC_RELEASE);
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+  if (__atomic_load_n(&cbuf->tail, __ATOMIC_RELAXED) == head)
+    event_signal(&cbuf->event, canreschedule);
+  poll_source_notify(&cbuf->poll, POLL_IN);
+}
+
+static void cbuf_spsc_consume(cbuf_t *cbuf, uint tail, size_t len) {
+  tail = INC_POINTER(cbuf, tail, len);
+  __atomic_store_n(&cbuf->tail, tail, __ATOMIC_RELEASE);
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+  if (__atomic_load_n(&cbuf->head, __ATOMIC_RELAXED) == tail) {
+    event_unsignal(&cbuf->event);
+
+    // the producer may have published and skipped the signal since the check
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&cbuf->head, __ATOMIC_RELAXED) != tail)
+      event_signal(&cbuf->event, false);
+  }
+  if (len > 0)
+    poll_source_notify(&cbuf->poll, POLL_OUT);
+}
+
+static size_t cbuf_write_spsc(cbuf_t *cbuf, const char *buf, size_t len, bool canreschedule) {
+  uint head = cbuf->head;
+  iovec_t regions[2];
+  cbuf_free_regions(cbuf, head, __atomic_load_n(&cbuf->tail, __ATOMIC_ACQUIRE), regions);
+
+  size_t pos = 0;
+  for (uint i = 0; i < 2 && pos < len; i++) {
+    size_t write_len = MIN(regions[i].iov_len, len - pos);
+    if (NULL == buf) {
+      memset(regions[i].iov_base, 0, write_len);
+    } else {
+      memcpy(regions[i].iov_base, buf + pos, write_len);
+    }
+    pos += write_len;
+  }
+
+  if (pos > 0)
+    cbuf_spsc_publish(cbuf, head, pos, canreschedule);
+
+  return pos;
+}
+
+static size_t cbuf_read_spsc(cbuf_t *cbuf, char *buf, size_t buflen, bool block) {
+  for (;;) {
+    if (block)
+      event_wait(&cbuf->event);
+
+    uint tail = cbuf->tail;
+    uint head = __atomic_load_n(&cbuf->head, __ATOMIC_ACQUIRE);
+    size_t used = modpow2(head - tail, cbuf->len_pow2);
+    size_t len = MIN(used, buflen);
+
+    if (NULL != buf && len > 0) {
+      size_t first = MIN(len, cbuf_size(cbuf) - tail);
+      memcpy(buf, cbuf->buf + tail, first);
+      memcpy(buf + first, cbuf->buf, len - first);
+    }
+
+    /* also run when nothing was read, a late signal from the producer may have
+     * left the event set on an empty buffer */
+    cbuf_spsc_consume(cbuf, tail, len);
+
+    if (len > 0 || !block)
+      return len;
+  }
+}
+
 size_t cbuf_write(cbuf_t *cbuf, const void *_buf, size_t len, bool canreschedule) {
   const char *buf = (const char *)_buf;
 
@@ -54,9 +171,13 @@ size_t cbuf_write(cbuf_t *cbuf, const void *_buf, size_t len, bool canreschedule
   DEBUG_ASSERT(cbuf);
   DEBUG_ASSERT(len < valpow2(cbuf->len_pow2));
 
+  if (cbuf->flags & CBUF_FLAG_SPSC)
+    return cbuf_write_spsc(cbuf, buf, len, canreschedule);
+
   spin_lock_saved_state_t state;
   spin_lock_irqsave(&cbuf->lock, state);
 
+  bool was_empty = (cbuf->head == cbuf->tail);
   size_t write_len;
   size_t pos = 0;
 
@@ -91,23 +212,77 @@ size_t cbuf_write(cbuf_t *cbuf, const void *_buf, size_t len, bool canreschedule
     pos += write_len;
   }
 
-  if (cbuf->head != cbuf->tail)
+  // only a reader of an empty buffer can be waiting
+  bool wake = was_empty && pos > 0;
+  if (wake)
     event_signal(&cbuf->event, false);
 
   spin_unlock_irqrestore(&cbuf->lock, state);
 
-  // XXX convert to only rescheduling if
-  if (canreschedule)
+  // pollers are told outside the lock, the poll code takes the thread lock
+  if (pos > 0)
+    poll_source_notify(&cbuf->poll, POLL_IN);
+
+  if (canreschedule && wake)
     thread_preempt();
 
   return pos;
 }
 
+size_t cbuf_write_reserve(cbuf_t *cbuf, iovec_t *regions) {
+  DEBUG_ASSERT(cbuf && regions);
+
+  if (cbuf->flags & CBUF_FLAG_SPSC)
+    return cbuf_free_regions(cbuf, cbuf->head, __atomic_load_n(&cbuf->tail, __ATOMIC_ACQUIRE),
+                             regions);
+
+  spin_lock_saved_state_t state;
+  spin_lock_irqsave(&cbuf->lock, state);
+  size_t ret = cbuf_free_regions(cbuf, cbuf->head, cbuf->tail, regions);
+  spin_unlock_irqrestore(&cbuf->lock, state);
+
+  return ret;
+}
+
+void cbuf_write_commit(cbuf_t *cbuf, size_t len, bool canreschedule) {
+  DEBUG_ASSERT(cbuf);
+
+  if (len == 0)
+    return;
+
+  if (cbuf->flags & CBUF_FLAG_SPSC) {
+    DEBUG_ASSERT(len <= cbuf_space_avail(cbuf));
+    cbuf_spsc_publish(cbuf, cbuf->head, len, canreschedule);
+    return;
+  }
+
+  spin_lock_saved_state_t state;
+  spin_lock_irqsave(&cbuf->lock, state);
+
+  // the reader can only have made more room since the reservation
+  DEBUG_ASSERT(len <= cbuf_space_avail(cbuf));
+
+  bool wake = (cbuf->head == cbuf->tail);
+  cbuf->head = INC_POINTER(cbuf, cbuf->head, len);
+  if (wake)
+    event_signal(&cbuf->event, false);
+
+  spin_unlock_irqrestore(&cbuf->lock, state);
+
+  poll_source_notify(&cbuf->poll, POLL_IN);
+
+  if (canreschedule && wake)
+    thread_preempt();
+}
+
 size_t cbuf_read(cbuf_t *cbuf, void *_buf, size_t buflen, bool block) {
   char *buf = (char *)_buf;
 
   DEBUG_ASSERT(cbuf);
 
+  if (cbuf->flags & CBUF_FLAG_SPSC)
+    return cbuf_read_spsc(cbuf, buf, buflen, block);
+
 retry:
   // block on the cbuf outside of the lock, which may
   // unblock us early and we'll have to double check below
@@ -154,6 +329,9 @@ retry:
 
   spin_unlock_irqrestore(&cbuf->lock, state);
 
+  if (ret > 0)
+    poll_source_notify(&cbuf->poll, POLL_OUT);
+
   // we apparently blocked but raced with another thread and found no data, retry
   if (block && ret == 0)
     goto retry;
@@ -164,10 +342,14 @@ retry:
 size_t cbuf_peek(cbuf_t *cbuf, iovec_t *regions) {
   DEBUG_ASSERT(cbuf && regions);
 
+  bool spsc = cbuf->flags & CBUF_FLAG_SPSC;
   spin_lock_saved_state_t state;
-  spin_lock_irqsave(&cbuf->lock, state);
+  if (!spsc)
+    spin_lock_irqsave(&cbuf->lock, state);
 
-  size_t ret = cbuf_space_used(cbuf);
+  size_t ret = spsc ? modpow2(__atomic_load_n(&cbuf->head, __ATOMIC_ACQUIRE) - cbuf->tail,
+                              cbuf->len_pow2)
+                    : cbuf_space_used(cbuf);
   size_t sz = cbuf_size(cbuf);
 
   DEBUG_ASSERT(cbuf->tail < sz);
@@ -184,29 +366,37 @@ size_t cbuf_peek(cbuf_t *cbuf, iovec_t *regions) {
     regions[1].iov_len = 0;
   }
 
-  spin_unlock_irqrestore(&cbuf->lock, state);
+  if (!spsc)
+    spin_unlock_irqrestore(&cbuf->lock, state);
   return ret;
 }
 
 size_t cbuf_write_char(cbuf_t *cbuf, char c, bool canreschedule) {
   DEBUG_ASSERT(cbuf);
 
+  if (cbuf->flags & CBUF_FLAG_SPSC)
+    return cbuf_write_spsc(cbuf, &c, 1, canreschedule);
+
   spin_lock_saved_state_t state;
   spin_lock_irqsave(&cbuf->lock, state);
 
   size_t ret = 0;
   if (cbuf_space_avail(cbuf) > 0) {
+    bool was_empty = (cbuf->head == cbuf->tail);
     cbuf->buf[cbuf->head] = c;
 
     cbuf->head = INC_POINTER(cbuf, cbuf->head, 1);
     ret = 1;
 
-    if (cbuf->head != cbuf->tail)
+    if (was_empty)
       event_signal(&cbuf->event, canreschedule);
   }
 
   spin_unlock_irqrestore(&cbuf->lock, state);
 
+  if (ret > 0)
+    poll_source_notify(&cbuf->poll, POLL_IN);
+
   return ret;
 }
 
@@ -214,6 +404,9 @@ size_t cbuf_read_char(cbuf_t *cbuf, char *c, bool block) {
   DEBUG_ASSERT(cbuf);
   DEBUG_ASSERT(c);
 
+  if (cbuf->flags & CBUF_FLAG_SPSC)
+    return cbuf_read_spsc(cbuf, c, 1, block);
+
 retry:
   if (block)
     event_wait(&cbuf->event);
@@ -237,6 +430,9 @@ retry:
 
   spin_unlock_irqrestore(&cbuf->lock, state);
 
+  if (ret > 0)
+    poll_source_notify(&cbuf->poll, POLL_OUT);
+
   if (block && ret == 0)
     goto retry;
 
@@ -11,18 +11,24 @@
 #include <sys/types.h>
 
 #include <kernel/event.h>
+#include <kernel/poll.h>
 #include <kernel/spinlock.h>
 #include <lk/compiler.h>
 
 __BEGIN_CDECLS
 
+/* cbuf_initialize_etc_flags() flags */
+#define CBUF_FLAG_SPSC (1U << 0) /* single producer, single consumer, no lock */
+
 typedef struct cbuf {
   uint head;
   uint tail;
   uint len_pow2;
+  uint flags;
   char *buf;
   event_t event;
   spin_lock_t lock;
+  poll_source_t poll;
 } cbuf_t;
 
 /**
@@ -49,6 +55,27 @@ void cbuf_initialize(cbuf_t *cbuf, size_t len);
  */
 void cbuf_initialize_etc(cbuf_t *cbuf, size_t len, void *buf);
 
+/**
+ * cbuf_initialize_etc_flags
+ *
+ * Like cbuf_initialize_etc, with CBUF_FLAG_* flags.
+ *
+ * With CBUF_FLAG_SPSC the cbuf takes no lock. head is only written by the
+ * producer and tail only by the consumer, with acquire/release ordering, and the
+ * reader is only woken when the buffer goes from empty to non-empty. The caller
+ * guarantees that at most one context writes (cbuf_write, cbuf_write_char,
+ * cbuf_write_reserve/commit) and at most one context reads (cbuf_read,
+ * cbuf_read_char, cbuf_peek, cbuf_reset) at any time. Either side may run in
+ * interrupt context, as long as the reader does not block there.
+ *
+ * @param[in] cbuf A pointer to the cbuf structure to allocate.
+ * @param[in] len The size of the supplied buffer, in bytes.  Must be a power
+ * of two.
+ * @param[in] buf A pointer to the memory to be used for internal storage.
+ * @param[in] flags CBUF_FLAG_* flags.
+ */
+void cbuf_initialize_etc_flags(cbuf_t *cbuf, size_t len, void *buf, uint flags);
+
 /**
  * cbuf_read
  *
@@ -78,6 +105,9 @@ size_t cbuf_read(cbuf_t *cbuf, void *buf, size_t buflen, bool block);
  * sizeof(iovec_t) * 2 bytes long.
  *
  * @return The number of bytes which were written (or skipped).
+ *
+ * Together with cbuf_read(cbuf, NULL, len, false) to consume what was looked at,
+ * this is the zero copy read side.
  */
 size_t cbuf_peek(cbuf_t *cbuf, iovec_t *regions);
 
@@ -93,12 +123,40 @@ size_t cbuf_peek(cbuf_t *cbuf, iovec_t *regions);
  * @param[in] len The maximum number of bytes to write to the cbuf.
  * @param[in] canreschedule Rescheduling policy passed through to the internal
  * event when signaling the event to indicate that there is now data in the
- * buffer to be read.
+ * buffer to be read. Only used when the buffer was empty, since nobody can be
+ * waiting for data otherwise.
  *
  * @return The number of bytes which were written (or skipped).
  */
 size_t cbuf_write(cbuf_t *cbuf, const void *buf, size_t len, bool canreschedule);
 
+/**
+ * cbuf_write_reserve
+ *
+ * Zero copy write. Fills out a pair of iovec structures describing the (up to)
+ * two contiguous free regions the producer may fill in place, in order. Nothing
+ * is visible to the reader until cbuf_write_commit(). Only one writer may hold
+ * a reservation at a time.
+ *
+ * @param[in] cbuf The cbuf instance to write to.
+ * @param[out] regions A pointer to two iovec structures.
+ *
+ * @return The number of bytes that may be written, the sum of both regions.
+ */
+size_t cbuf_write_reserve(cbuf_t *cbuf, iovec_t *regions);
+
+/**
+ * cbuf_write_commit
+ *
+ * Publish the first len bytes of the regions returned by the last
+ * cbuf_write_reserve().
+ *
+ * @param[in] cbuf The cbuf instance to write to.
+ * @param[in] len The number of bytes written, at most what was reserved.
+ * @param[in] canreschedule As for cbuf_write().
+ */
+void cbuf_write_commit(cbuf_t *cbuf, size_t len, bool canreschedule);
+
 /**
  * cbuf_space_avail
  *
@@ -138,6 +196,17 @@ static inline size_t cbuf_size(cbuf_t *cbuf) { return (1UL << cbuf->len_pow2); }
  */
 static inline void cbuf_reset(cbuf_t *cbuf) { cbuf_read(cbuf, NULL, cbuf_size(cbuf), false); }
 
+/**
+ * cbuf_poll_source
+ *
+ * @param[in] cbuf The cbuf instance to query
+ *
+ * @return The readiness source of the cbuf, to add it to a poll set. It reports
+ * POLL_IN while there is data to read and POLL_OUT while there is space to write.
+ * Remove the cbuf from any poll set before freeing it.
+ */
+static inline poll_source_t *cbuf_poll_source(cbuf_t *cbuf) { return &cbuf->poll; }
+
 /* special cases for dealing with a single char of data */
 size_t cbuf_read_char(cbuf_t *cbuf, char *c, bool block);
 size_t cbuf_write_char(cbuf_t *cbuf, char c, bool canreschedule);
@@ -5,73 +5,207 @@
  * license that can be found in the LICENSE file or at
  * https://opensource.org/licenses/MIT
  */
+#include <assert.h>
+#include <inttypes.h>
 #include <lib/dpc.h>
-#include <malloc.h>
-#include <stddef.h>
+#include <lib/slab.h>
+#include <platform.h>
+#include <stdio.h>
+#include <string.h>
 
+#include <arch/atomic.h>
+#include <arch/ops.h>
 #include <kernel/event.h>
 #include <kernel/thread.h>
+#include <lk/console_cmd.h>
 #include <lk/debug.h>
 #include <lk/err.h>
 #include <lk/init.h>
-#include <lk/list.h>
 
-struct dpc {
-  struct list_node node;
+/* set on dpcs allocated by dpc_queue(), freed once the callback returns */
+#define DPC_FLAG_FREE 0x80000000
 
-  dpc_callback cb;
-  void *arg;
+struct dpc_stats {
+  uint64_t queued;
+  uint64_t executed;
+  lk_bigtime_t total_latency;
+  lk_bigtime_t max_latency;
+  lk_bigtime_t max_runtime;
 };
 
-static struct list_node dpc_list = LIST_INITIAL_VALUE(dpc_list);
-static event_t dpc_event;
+/*
+ * Per cpu queue. Producers push onto a lock free lifo, the dpc thread
+ * takes the whole list with one exchange and reverses it, so callbacks
+ * still run in the order they were queued.
+ */
+struct dpc_queue {
+  dpc_t *head;
+  event_t event;
+  thread_t *thread;
+  struct dpc_stats stats;
+} __CPU_ALIGN;
+
+static struct dpc_queue dpc_queues[SMP_MAX_CPUS];
+static slab_cache_t dpc_cache = SLAB_CACHE_TYPED_INITIAL_VALUE(dpc_cache, "dpc", dpc_t);
+
+void dpc_init(dpc_t *dpc, dpc_callback cb, void *arg) {
+  memset(dpc, 0, sizeof(*dpc));
+  dpc->cb = cb;
+  dpc->arg = arg;
+}
 
-static int dpc_thread_routine(void *arg);
+status_t dpc_queue_etc(dpc_t *dpc, uint flags) {
+  DEBUG_ASSERT(dpc->cb);
 
-status_t dpc_queue(dpc_callback cb, void *arg, uint flags) {
-  struct dpc *dpc;
+  if (atomic_swap(&dpc->queued, 1) != 0)
+    return ERR_ALREADY_EXISTS;
 
-  dpc = malloc(sizeof(struct dpc));
+  dpc->queue_time = current_time_hires();
 
+  /* whichever cpu we end up on, the push is safe against concurrent producers */
+  struct dpc_queue *q = &dpc_queues[arch_curr_cpu_num()];
+  dpc_t *head = __atomic_load_n(&q->head, __ATOMIC_RELAXED);
+  do {
+    dpc->next = head;
+  } while (!__atomic_compare_exchange_n(&q->head, &head, dpc, true, __ATOMIC_RELEASE,
+                                        __ATOMIC_RELAXED));
+  __atomic_fetch_add(&q->stats.queued, 1, __ATOMIC_RELAXED);
+
+  /* only the transition from empty needs to wake the thread */
+  if (!head) {
+    bool resched = !(flags & DPC_FLAG_NORESCHED) && !arch_ints_disabled();
+    event_signal(&q->event, resched);
+  }
+
+  return NO_ERROR;
+}
+
+status_t dpc_queue(dpc_callback cb, void *arg, uint flags) {
+  dpc_t *dpc = slab_cache_alloc(&dpc_cache);
   if (dpc == NULL)
     return ERR_NO_MEMORY;
 
-  dpc->cb = cb;
-  dpc->arg = arg;
-  enter_critical_section();
-  list_add_tail(&dpc_list, &dpc->node);
-  event_signal(&dpc_event, (flags & DPC_FLAG_NORESCHED) ? false : true);
-  exit_critical_section();
+  dpc_init(dpc, cb, arg);
+  dpc->flags = DPC_FLAG_FREE;
 
-  return NO_ERROR;
+  return dpc_queue_etc(dpc, flags);
 }
 
-static int dpc_thread_routine(void *arg) {
-  for (;;) {
-    event_wait(&dpc_event);
+static void dpc_run(struct dpc_queue *q, dpc_t *dpc) {
+  lk_bigtime_t start = current_time_hires();
+  lk_bigtime_t latency = start - dpc->queue_time;
+
+  dpc_callback cb = dpc->cb;
+  void *arg = dpc->arg;
+  bool free_dpc = dpc->flags & DPC_FLAG_FREE;
+
+  /* from here on the owner may queue it again */
+  __atomic_store_n(&dpc->queued, 0, __ATOMIC_RELEASE);
+
+  //          dprintf("dpc calling %p, arg %p\n", cb, arg);
+  cb(arg);
 
-    enter_critical_section();
-    struct dpc *dpc = list_remove_head_type(&dpc_list, struct dpc, node);
-    if (!dpc)
-      event_unsignal(&dpc_event);
-    exit_critical_section();
+  if (free_dpc)
+    slab_cache_free(&dpc_cache, dpc);
 
-    if (dpc) {
-      //          dprintf("dpc calling %p, arg %p\n", dpc->cb, dpc->arg);
-      dpc->cb(dpc->arg);
+  lk_bigtime_t runtime = current_time_hires() - start;
 
-      free(dpc);
+  q->stats.executed++;
+  q->stats.total_latency += latency;
+  if (latency > q->stats.max_latency)
+    q->stats.max_latency = latency;
+  if (runtime > q->stats.max_runtime)
+    q->stats.max_runtime = runtime;
+}
+
+static int dpc_thread_routine(void *arg) {
+  struct dpc_queue *q = arg;
+
+  for (;;) {
+    event_wait(&q->event);
+
+    dpc_t *list;
+    while ((list = __atomic_exchange_n(&q->head, NULL, __ATOMIC_ACQUIRE))) {
+      /* reverse into queue order */
+      dpc_t *fifo = NULL;
+      while (list) {
+        dpc_t *next = list->next;
+        list->next = fifo;
+        fifo = list;
+        list = next;
+      }
+
+      while (fifo) {
+        dpc_t *next = fifo->next;
+        dpc_run(q, fifo);
+        fifo = next;
+      }
     }
   }
 
   return 0;
 }
 
-static void dpc_init(uint level) {
-  event_init(&dpc_event, false, 0);
+/* every queue can take dpcs from early on, before its cpu has a thread to run them */
+static void dpc_queues_init(uint level) {
+  for (uint i = 0; i < SMP_MAX_CPUS; i++) {
+    event_init(&dpc_queues[i].event, false, EVENT_FLAG_AUTOUNSIGNAL);
+  }
+}
+
+LK_INIT_HOOK(libdpc_queues, &dpc_queues_init, LK_INIT_LEVEL_KERNEL);
+
+/* runs on each cpu as it comes up, so cpus that never start get no thread */
+static void dpc_init_hook(uint level) {
+  uint cpu = arch_curr_cpu_num();
+  struct dpc_queue *q = &dpc_queues[cpu];
+  char name[16];
+
+  snprintf(name, sizeof(name), "dpc-%u", cpu);
+  q->thread = thread_create(name, &dpc_thread_routine, q, DPC_PRIORITY, DEFAULT_STACK_SIZE);
+  if (!q->thread)
+    panic("failed to create dpc thread for cpu %u\n", cpu);
+  thread_set_pinned_cpu(q->thread, cpu);
+  thread_detach_and_resume(q->thread);
+}
+
+LK_INIT_HOOK_FLAGS(libdpc, &dpc_init_hook, LK_INIT_LEVEL_THREADING, LK_INIT_FLAG_ALL_CPUS);
+
+static void dpc_dump_stats(void) {
+  printf("%4s %10s %10s %12s %12s %12s\n", "cpu", "queued", "executed", "avg lat us",
+         "max lat us", "max run us");
+  for (uint i = 0; i < SMP_MAX_CPUS; i++) {
+    const struct dpc_stats *s = &dpc_queues[i].stats;
+    if (!s->queued)
+      continue;
+    printf("%4u %10" PRIu64 " %10" PRIu64 " %12llu %12llu %12llu\n", i, s->queued, s->executed,
+           s->executed ? s->total_latency / s->executed : 0, s->max_latency, s->max_runtime);
+  }
+}
+
+static int cmd_dpc(int argc, const cmd_args *argv, uint32_t flags) {
+  if (argc < 2) {
+  usage:
+    printf("usage:\n");
+    printf("\t%s stats\n", argv[0].str);
+    printf("\t%s reset\n", argv[0].str);
+    return -1;
+  }
 
-  thread_detach_and_resume(
-      thread_create("dpc", &dpc_thread_routine, NULL, DPC_PRIORITY, DEFAULT_STACK_SIZE));
+  if (!strcmp(argv[1].str, "stats")) {
+    dpc_dump_stats();
+  } else if (!strcmp(argv[1].str, "reset")) {
+    for (uint i = 0; i < SMP_MAX_CPUS; i++) {
+      memset(&dpc_queues[i].stats, 0, sizeof(dpc_queues[i].stats));
+    }
+  } else {
+    printf("unrecognized command\n");
+    goto usage;
+  }
+
+  return 0;
 }
 
-LK_INIT_HOOK(libdpc, &dpc_init, LK_INIT_LEVEL_THREADING);
+STATIC_COMMAND_START
+STATIC_COMMAND("dpc", "deferred procedure call stats", &cmd_dpc)
+STATIC_COMMAND_END(dpc);
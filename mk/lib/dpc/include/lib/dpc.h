@@ -9,10 +9,54 @@
 
 #include <sys/types.h>
 
+#include <lk/compiler.h>
 #include <lk/list.h>
 
+__BEGIN_CDECLS
+
 typedef void (*dpc_callback)(void *arg);
 
 #define DPC_FLAG_NORESCHED 0x1
 
+/*
+ * A deferred procedure call. Embed one in the object that owns the work and
+ * queue it as many times as needed; no memory is allocated on the queue path.
+ * A dpc can be queued again once its callback has started running.
+ */
+typedef struct dpc {
+  struct dpc *next;
+  dpc_callback cb;
+  void *arg;
+  volatile int queued;
+  uint flags;
+  lk_bigtime_t queue_time;
+} dpc_t;
+
+#define DPC_INITIAL_VALUE(_cb, _arg) \
+  {                                  \
+      .next = NULL,                  \
+      .cb = (_cb),                   \
+      .arg = (_arg),                 \
+      .queued = 0,                   \
+      .flags = 0,                    \
+      .queue_time = 0,               \
+  }
+
+void dpc_init(dpc_t *dpc, dpc_callback cb, void *arg);
+
+/*
+ * Queue a dpc on the current cpu's dpc thread. Safe to call from interrupt
+ * context or with interrupts disabled, in which case DPC_FLAG_NORESCHED is
+ * implied. Dpcs queued before the cpu has started its dpc thread run once it
+ * has.
+ * Returns ERR_ALREADY_EXISTS if the dpc is queued and has not run yet.
+ */
+status_t dpc_queue_etc(dpc_t *dpc, uint flags);
+
+/*
+ * Queue a one-shot callback. Allocates the dpc, so it may only be called
+ * from thread context.
+ */
 status_t dpc_queue(dpc_callback, void *arg, uint flags);
+
+__END_CDECLS
@@ -2,6 +2,8 @@ LOCAL_DIR := $(GET_LOCAL_DIR)
 
 MODULE := $(LOCAL_DIR)
 
+MODULE_DEPS += lib/slab
+
 MODULE_SRCS += \
 	$(LOCAL_DIR)/dpc.c
 
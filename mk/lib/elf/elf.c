@@ -12,6 +12,9 @@
 #include <string.h>
 
 #include <arch/ops.h>
+#if WITH_KERNEL_VM
+#include <kernel/vm.h>
+#endif
 #include <lk/debug.h>
 #include <lk/err.h>
 #include <lk/trace.h>
@@ -99,12 +102,22 @@ status_t elf_open_handle_memory(elf_handle_t *handle, const void *ptr, size_t le
   return err;
 }
 
+#if WITH_KERNEL_VM
+static void elf_lazy_release(struct elf_lazy_image *image);
+#endif
+
 void elf_close_handle(elf_handle_t *handle) {
   if (!handle || !handle->open)
     return;
 
   handle->open = false;
 
+#if WITH_KERNEL_VM
+  // mapped segments may still page in through the read hook, the image frees it
+  if (handle->lazy)
+    elf_lazy_release(handle->lazy);
+  else
+#endif
   if (handle->free_read_hook_arg)
     free(handle->read_hook_arg);
 
@@ -170,11 +183,10 @@ static int verify_eheader(const void *header) {
   return NO_ERROR;
 }
 
-status_t elf_load(elf_handle_t *handle) {
-  if (!handle)
-    return ERR_INVALID_ARGS;
-  if (!handle->open)
-    return ERR_NOT_READY;
+static status_t elf_read_headers(elf_handle_t *handle) {
+  // already done by a previous load
+  if (handle->pheaders)
+    return NO_ERROR;
 
   // validate that this is an ELF file
   ssize_t readerr = handle->read_hook(handle, &handle->eheader, 0, sizeof(handle->eheader));
@@ -207,9 +219,26 @@ status_t elf_load(elf_handle_t *handle) {
                               handle->eheader.e_phnum * handle->eheader.e_phentsize);
   if (readerr < (ssize_t)(handle->eheader.e_phnum * handle->eheader.e_phentsize)) {
     LTRACEF("failed to read program headers\n");
+    free(handle->pheaders);
+    handle->pheaders = NULL;
     return ERR_NO_MEMORY;
   }
 
+  return NO_ERROR;
+}
+
+status_t elf_load(elf_handle_t *handle) {
+  if (!handle)
+    return ERR_INVALID_ARGS;
+  if (!handle->open)
+    return ERR_NOT_READY;
+
+  status_t err = elf_read_headers(handle);
+  if (err < 0)
+    return err;
+
+  ssize_t readerr;
+
   LTRACEF("program headers:\n");
   uint load_count = 0;
   for (uint i = 0; i < handle->eheader.e_phnum; i++) {
@@ -229,7 +258,7 @@ status_t elf_load(elf_handle_t *handle) {
 
       if (handle->mem_alloc_hook) {
         // TODO: pass flags re: X bit, etc
-        status_t err = handle->mem_alloc_hook(handle, &ptr, pheader->p_memsz, load_count, 0);
+        err = handle->mem_alloc_hook(handle, &ptr, pheader->p_memsz, load_count, 0);
         if (err < 0) {
           LTRACEF("mem hook failed, abort\n");
           // XXX clean up what we got so far
@@ -267,3 +296,243 @@ status_t elf_load(elf_handle_t *handle) {
 
   return NO_ERROR;
 }
+
+#if WITH_KERNEL_VM
+/*
+ * Demand paged loading.
+ *
+ * The image keeps its own copy of the handle, to call the read hook after the
+ * caller closed theirs, and of the program headers. It is referenced by the
+ * handle and by every region mapping one of its segments. The pager callbacks
+ * run with the vmm lock held, which also serializes filling the shared pages.
+ */
+struct elf_lazy_segment {
+  struct elf_lazy_image *image;
+  const elf_phdr_t *pheader;
+  vaddr_t base;  // page aligned start
+  size_t page_count;
+  vm_page_t **shared;  // read only segments: the pages read so far, mapped by everyone
+};
+
+struct elf_lazy_image {
+  int ref;
+  elf_handle_t handle;
+  elf_phdr_t *pheaders;
+  uint segment_count;
+  struct elf_lazy_segment segments[];
+};
+
+static void elf_lazy_free(struct elf_lazy_image *image) {
+  for (uint i = 0; i < image->segment_count; i++) {
+    struct elf_lazy_segment *seg = &image->segments[i];
+    if (!seg->shared)
+      continue;
+    for (size_t j = 0; j < seg->page_count; j++) {
+      if (seg->shared[j])
+        pmm_free_page(seg->shared[j]);
+    }
+    free(seg->shared);
+  }
+  free(image->pheaders);
+  free(image);
+}
+
+static void elf_lazy_release(struct elf_lazy_image *image) {
+  if (__atomic_sub_fetch(&image->ref, 1, __ATOMIC_ACQ_REL) > 0)
+    return;
+
+  if (image->handle.free_read_hook_arg)
+    free(image->handle.read_hook_arg);
+  elf_lazy_free(image);
+}
+
+static status_t elf_lazy_create(elf_handle_t *handle, struct elf_lazy_image **out) {
+  uint count = 0;
+  for (uint i = 0; i < handle->eheader.e_phnum; i++) {
+    const elf_phdr_t *pheader = &handle->pheaders[i];
+    if (pheader->p_type != PT_LOAD || pheader->p_memsz == 0)
+      continue;
+    if (pheader->p_filesz > pheader->p_memsz ||
+        pheader->p_vaddr + pheader->p_memsz < pheader->p_vaddr)
+      return ERR_NOT_VALID;
+    count++;
+  }
+
+  struct elf_lazy_image *image =
+      calloc(1, sizeof(*image) + count * sizeof(struct elf_lazy_segment));
+  if (!image)
+    return ERR_NO_MEMORY;
+
+  size_t pheaders_size = handle->eheader.e_phnum * sizeof(elf_phdr_t);
+  image->pheaders = malloc(pheaders_size);
+  if (!image->pheaders) {
+    free(image);
+    return ERR_NO_MEMORY;
+  }
+  memcpy(image->pheaders, handle->pheaders, pheaders_size);
+
+  for (uint i = 0; i < handle->eheader.e_phnum; i++) {
+    const elf_phdr_t *pheader = &image->pheaders[i];
+    if (pheader->p_type != PT_LOAD || pheader->p_memsz == 0)
+      continue;
+
+    struct elf_lazy_segment *seg = &image->segments[image->segment_count++];
+    seg->image = image;
+    seg->pheader = pheader;
+    seg->base = ROUNDDOWN((vaddr_t)pheader->p_vaddr, PAGE_SIZE);
+    seg->page_count =
+        (ROUNDUP((vaddr_t)(pheader->p_vaddr + pheader->p_memsz), PAGE_SIZE) - seg->base) /
+        PAGE_SIZE;
+
+    if (!(pheader->p_flags & PF_W)) {
+      seg->shared = calloc(seg->page_count, sizeof(vm_page_t *));
+      if (!seg->shared) {
+        elf_lazy_free(image);
+        return ERR_NO_MEMORY;
+      }
+    }
+  }
+
+  // from here on the image owns the read hook argument
+  image->handle = *handle;
+  image->handle.pheaders = image->pheaders;
+  image->handle.lazy = NULL;
+  image->ref = 1;
+
+  *out = image;
+  return NO_ERROR;
+}
+
+// whether the page at va is all bss
+static bool elf_lazy_page_is_bss(const struct elf_lazy_segment *seg, vaddr_t va) {
+  const elf_phdr_t *pheader = seg->pheader;
+  vaddr_t start = MAX(va, (vaddr_t)pheader->p_vaddr);
+  vaddr_t end = MIN(va + PAGE_SIZE, (vaddr_t)(pheader->p_vaddr + pheader->p_filesz));
+  return start >= end;
+}
+
+// the page at va holds the file data within [p_vaddr, p_vaddr + p_filesz) and zeros elsewhere.
+// a bss page comes zeroed from the pmm
+static status_t elf_lazy_fill(struct elf_lazy_segment *seg, vaddr_t va, uint8_t *kva) {
+  const elf_phdr_t *pheader = seg->pheader;
+  vaddr_t start = MAX(va, (vaddr_t)pheader->p_vaddr);
+  vaddr_t end = MIN(va + PAGE_SIZE, (vaddr_t)(pheader->p_vaddr + pheader->p_filesz));
+
+  if (start < end) {
+    memset(kva, 0, start - va);
+
+    size_t len = end - start;
+    ssize_t readerr = seg->image->handle.read_hook(&seg->image->handle, kva + (start - va),
+                                                   pheader->p_offset + (start - pheader->p_vaddr),
+                                                   len);
+    if (readerr < (ssize_t)len) {
+      LTRACEF("error %ld reading page at 0x%lx\n", readerr, va);
+      return (readerr < 0) ? readerr : ERR_IO;
+    }
+
+    memset(kva + (end - va), 0, va + PAGE_SIZE - end);
+  }
+
+  if (pheader->p_flags & PF_X)
+    arch_sync_cache_range((addr_t)kva, PAGE_SIZE);
+
+  return NO_ERROR;
+}
+
+static status_t elf_lazy_get_page(vmm_region_t *r, size_t offset, vm_page_t **page, bool *owned) {
+  struct elf_lazy_segment *seg = r->pager_arg;
+  size_t index = offset / PAGE_SIZE;
+
+  DEBUG_ASSERT(index < seg->page_count);
+
+  if (seg->shared && seg->shared[index]) {
+    *page = seg->shared[index];
+    *owned = false;
+    return NO_ERROR;
+  }
+
+  vaddr_t va = seg->base + offset;
+  vm_page_t *p = pmm_alloc_page_etc(elf_lazy_page_is_bss(seg, va) ? PMM_ALLOC_FLAG_ZEROED : 0);
+  if (!p)
+    return ERR_NO_MEMORY;
+
+  status_t err = elf_lazy_fill(seg, va, paddr_to_kvaddr(vm_page_to_paddr(p)));
+  if (err < 0) {
+    pmm_free_page(p);
+    return err;
+  }
+
+  if (seg->shared)
+    seg->shared[index] = p;
+
+  *page = p;
+  *owned = !seg->shared;
+  return NO_ERROR;
+}
+
+static void elf_lazy_close(vmm_region_t *r) {
+  struct elf_lazy_segment *seg = r->pager_arg;
+  elf_lazy_release(seg->image);
+}
+
+static const vmm_pager_ops_t elf_lazy_pager_ops = {
+    .get_page = elf_lazy_get_page,
+    .close = elf_lazy_close,
+};
+
+status_t elf_load_lazy(elf_handle_t *handle, vmm_aspace_t *aspace) {
+  if (!handle || !aspace)
+    return ERR_INVALID_ARGS;
+  if (!handle->open)
+    return ERR_NOT_READY;
+
+  status_t err = elf_read_headers(handle);
+  if (err < 0)
+    return err;
+
+  if (!handle->lazy) {
+    err = elf_lazy_create(handle, &handle->lazy);
+    if (err < 0)
+      return err;
+  }
+  struct elf_lazy_image *image = handle->lazy;
+
+  uint i;
+  for (i = 0; i < image->segment_count; i++) {
+    struct elf_lazy_segment *seg = &image->segments[i];
+
+    uint arch_mmu_flags = (aspace->flags & VMM_ASPACE_FLAG_KERNEL) ? 0 : ARCH_MMU_FLAG_PERM_USER;
+    if (!(seg->pheader->p_flags & PF_W))
+      arch_mmu_flags |= ARCH_MMU_FLAG_PERM_RO;
+    if (!(seg->pheader->p_flags & PF_X))
+      arch_mmu_flags |= ARCH_MMU_FLAG_PERM_NO_EXECUTE;
+
+    LTRACEF("segment %u at 0x%lx, %zu pages, mmu flags 0x%x\n", i, seg->base, seg->page_count,
+            arch_mmu_flags);
+
+    // the region holds a reference until it is freed
+    __atomic_add_fetch(&image->ref, 1, __ATOMIC_RELAXED);
+
+    void *ptr = (void *)seg->base;
+    err = vmm_alloc_pager(aspace, "elf", seg->page_count * PAGE_SIZE, &ptr, 0,
+                          VMM_FLAG_VALLOC_SPECIFIC, arch_mmu_flags, &elf_lazy_pager_ops, seg);
+    if (err < 0) {
+      LTRACEF("error %d mapping segment %u\n", err, i);
+      elf_lazy_release(image);
+      goto err;
+    }
+  }
+
+  // save the entry point
+  handle->entry = handle->eheader.e_entry;
+
+  return NO_ERROR;
+
+err:
+  // unmap what was mapped so far, which drops the regions' references
+  while (i-- > 0) {
+    vmm_free_region(aspace, image->segments[i].base);
+  }
+  return err;
+}
+#endif  // WITH_KERNEL_VM
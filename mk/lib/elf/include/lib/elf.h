@@ -51,6 +51,9 @@ typedef struct elf_handle {
 
   addr_t load_address;
   addr_t entry;
+
+  // demand paged image shared by every elf_load_lazy() of this handle
+  struct elf_lazy_image *lazy;
 } elf_handle_t;
 
 status_t elf_open_handle(elf_handle_t *handle, elf_read_hook_t read_hook, void *read_hook_arg,
@@ -60,4 +63,17 @@ void elf_close_handle(elf_handle_t *handle);
 
 status_t elf_load(elf_handle_t *handle);
 
+#if WITH_KERNEL_VM
+struct vmm_aspace;
+
+/* Map the PT_LOAD segments at their link addresses in aspace without reading
+ * anything. Each page is read through the read hook the first time it is
+ * touched and bss is zero filled on demand. Pages of read only segments are
+ * cached in the handle and shared by every address space it is loaded into,
+ * writable ones are private to each. The read hook has to keep working until
+ * the handle is closed and all of those address spaces are freed.
+ */
+status_t elf_load_lazy(elf_handle_t *handle, struct vmm_aspace *aspace);
+#endif
+
 __END_CDECLS
@@ -53,6 +53,15 @@ uint evlog_bump_head(evlog_t *e) {
   return index;
 }
 
+uint evlog_bump_head_atomic(evlog_t *e) {
+  uint index = __atomic_load_n(&e->head, __ATOMIC_RELAXED);
+  while (!__atomic_compare_exchange_n(&e->head, &index, INCPTR(e, index, e->unitsize), true,
+                                      __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+  }
+
+  return index;
+}
+
 void evlog_dump(evlog_t *e, evlog_dump_cb cb) {
   for (uint index = INCPTR(e, e->head, e->unitsize); index != e->head;
        index = INCPTR(e, index, e->unitsize)) {
@@ -29,6 +29,11 @@ void evlog_dump(evlog_t *e, evlog_dump_cb cb);
  */
 uint evlog_bump_head(evlog_t *e);
 
+/* same as above, but safe against concurrent writers, including ones that
+ * interrupt each other on the same cpu.
+ */
+uint evlog_bump_head_atomic(evlog_t *e);
+
 /*
  * It's assumed you're following a pattern similar to the following:
  *
@@ -112,6 +112,18 @@ const char *get_prop_string(const void *fdt, int offset, const char *prop) {
   return str;
 }
 
+// the numa-node-id property of a memory or cpu node, 0 if it has none
+uint32_t get_numa_node_id(const void *fdt, int offset) {
+  int lenp;
+  const uint8_t *prop_ptr =
+      static_cast<const uint8_t *>(fdt_getprop(fdt, offset, "numa-node-id", &lenp));
+  if (!prop_ptr || lenp < 4) {
+    return 0;
+  }
+
+  return fdt32_to_cpu(*(const uint32_t *)prop_ptr);
+}
+
 struct fdt_walk_state {
   const void *fdt;
   int offset;
@@ -244,6 +256,7 @@ status_t fdt_walk_find_cpus(const void *fdt, struct fdt_walk_cpu_info *cpu, size
         // cpu is found
         LTRACEF("found cpu id %u\n", id);
         cpu[*cpu_count].id = id;
+        cpu[*cpu_count].numa_node = get_numa_node_id(state.fdt, state.offset);
         (*cpu_count)++;
       }
     }
@@ -285,6 +298,7 @@ status_t fdt_walk_find_memory(const void *fdt, struct fdt_walk_memory_region *me
             LTRACEF("mem base %#llx len %#llx\n", base, len);
             memory[*mem_count].base = base;
             memory[*mem_count].len = len;
+            memory[*mem_count].numa_node = get_numa_node_id(state.fdt, state.offset);
             (*mem_count)++;
           }
         }
@@ -326,6 +340,7 @@ status_t fdt_walk_find_memory(const void *fdt, struct fdt_walk_memory_region *me
               LTRACEF("reserved memory base %#llx len %#llx\n", base, len);
               reserved_memory[*reserved_mem_count].base = base;
               reserved_memory[*reserved_mem_count].len = len;
+              reserved_memory[*reserved_mem_count].numa_node = 0;
               (*reserved_mem_count)++;
             }
           }
@@ -434,3 +449,34 @@ status_t fdt_walk_find_pcie_info(const void *fdt, struct fdt_walk_pcie_info *inf
 
   return _fdt_walk(fdt, walker);
 }
+
+status_t fdt_walk_find_numa_distances(const void *fdt, struct fdt_walk_numa_distance *distance,
+                                      size_t *count) {
+  const size_t max_count = *count;
+  *count = 0;
+
+  auto walker = [distance, max_count, count](const fdt_walk_state &state, const char *name) {
+    /* the distance-map node holds (from, to, distance) triplets */
+    if (strcmp(name, "distance-map") != 0 || state.depth != 1) {
+      return;
+    }
+
+    int lenp;
+    const uint32_t *prop_ptr =
+        (const uint32_t *)fdt_getprop(state.fdt, state.offset, "distance-matrix", &lenp);
+    if (!prop_ptr || lenp <= 0) {
+      return;
+    }
+
+    for (int i = 0; i + 3 <= lenp / 4 && *count < max_count; i += 3) {
+      distance[*count].from = fdt32_to_cpu(prop_ptr[i]);
+      distance[*count].to = fdt32_to_cpu(prop_ptr[i + 1]);
+      distance[*count].distance = fdt32_to_cpu(prop_ptr[i + 2]);
+      LTRACEF("numa distance %u -> %u: %u\n", distance[*count].from, distance[*count].to,
+              distance[*count].distance);
+      (*count)++;
+    }
+  };
+
+  return _fdt_walk(fdt, walker);
+}
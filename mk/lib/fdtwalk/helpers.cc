@@ -81,6 +81,7 @@ status_t fdtwalk_setup_memory(const void *fdt, paddr_t fdt_phys, paddr_t default
 #if WITH_KERNEL_VM
     mem[0].base = default_mem_base;
     mem[0].len = default_mem_size;
+    mem[0].numa_node = 0;
     mem_count = 1;
 #endif
   }
@@ -116,12 +117,29 @@ status_t fdtwalk_setup_memory(const void *fdt, paddr_t fdt_phys, paddr_t default
     arenas[i].base = mem[i].base;
     arenas[i].size = mem[i].len;
     arenas[i].flags = PMM_ARENA_FLAG_KMAP;
+    if (mem[i].numa_node < PMM_MAX_NUMA_NODES) {
+      arenas[i].numa_node = mem[i].numa_node;
+    } else {
+      printf("FDT: numa-node-id %u over the limit of %u nodes, using node 0\n", mem[i].numa_node,
+             PMM_MAX_NUMA_NODES);
+    }
     pmm_add_arena(&arenas[i]);
 #else
     novm_add_arena("fdt", mem[i].base, mem[i].len);
 #endif
   }
 
+#if WITH_KERNEL_VM
+  /* relative distances between the nodes, if the FDT has a distance-map */
+  struct fdt_walk_numa_distance distances[PMM_MAX_NUMA_NODES * PMM_MAX_NUMA_NODES];
+  size_t distance_count = countof(distances);
+  if (fdt_walk_find_numa_distances(fdt, distances, &distance_count) >= NO_ERROR) {
+    for (size_t i = 0; i < distance_count; i++) {
+      pmm_set_numa_distance(distances[i].from, distances[i].to, distances[i].distance);
+    }
+  }
+#endif
+
   /* reserve memory described by the FDT */
   for (size_t i = 0; i < reserved_mem_count; i++) {
     dprintf(INFO, "FDT: reserving memory range [%#llx, %#llx]\n", reserved_mem[i].base,
@@ -159,14 +177,26 @@ status_t fdtwalk_setup_cpus_riscv(const void *fdt) {
     if (cpu_count > 0) {
       dprintf(INFO, "FDT: found %zu cpu%c\n", cpu_count, cpu_count == 1 ? ' ' : 's');
       uint harts[SMP_MAX_CPUS - 1];
+      uint nodes[SMP_MAX_CPUS - 1];
 
       // copy from the detected cpu list to an array of harts, excluding the boot hart
       size_t hart_index = 0;
       for (size_t i = 0; i < cpu_count; i++) {
         if (cpus[i].id != riscv_current_hart()) {
+          nodes[hart_index] = cpus[i].numa_node;
           harts[hart_index++] = cpus[i].id;
         }
 
+#if WITH_KERNEL_VM
+        // the boot hart is cpu 0. the others get their cpu numbers in the order
+        // they come up, and set their own node then
+        if (cpus[i].id == riscv_current_hart()) {
+          pmm_set_cpu_numa_node(0, cpus[i].numa_node);
+        } else {
+          pmm_add_numa_node(cpus[i].numa_node);
+        }
+#endif
+
         // we can start MAX CPUS - 1 secondaries
         if (hart_index >= SMP_MAX_CPUS - 1) {
           break;
@@ -186,7 +216,7 @@ status_t fdtwalk_setup_cpus_riscv(const void *fdt) {
 
       // tell the riscv layer how many cores we have to start
       if (hart_index > 0) {
-        riscv_set_secondary_harts_to_start(harts, hart_index);
+        riscv_set_secondary_harts_to_start(harts, nodes, hart_index);
       }
 
       if (isa_string) {
@@ -219,6 +249,12 @@ status_t fdtwalk_setup_cpus_arm(const void *fdt) {
 
       LTRACEF("booting %zu cpus\n", cpu_count);
 
+#if WITH_KERNEL_VM
+      for (size_t i = 0; i < cpu_count; i++) {
+        pmm_set_cpu_numa_node(i, cpus[i].numa_node);
+      }
+#endif
+
       /* boot the secondary cpus using the Power State Coordintion Interface */
       for (size_t i = 1; i < cpu_count; i++) {
         /* note: assumes cpuids are numbered like MPIDR 0:0:0:N */
@@ -38,10 +38,19 @@ struct fdt_walk_pcie_info {
 struct fdt_walk_memory_region {
   uint64_t base;
   uint64_t len;
+  uint32_t numa_node;  // numa-node-id, 0 if not present
+};
+
+// an entry of the /distance-map node's distance-matrix
+struct fdt_walk_numa_distance {
+  uint32_t from;
+  uint32_t to;
+  uint32_t distance;
 };
 
 struct fdt_walk_cpu_info {
   uint32_t id;
+  uint32_t numa_node;  // numa-node-id, 0 if not present
 #if ARCH_RISCV
   const char *isa_string;             // pointer to riscv,isa inside device tree
   const char *isa_extensions_string;  // pointer to riscv,isa-etensions inside device tree
@@ -56,6 +65,8 @@ status_t fdt_walk_find_memory(const void *fdt, struct fdt_walk_memory_region *me
                               size_t *mem_count, struct fdt_walk_memory_region *reserved_memory,
                               size_t *reserved_mem_count);
 status_t fdt_walk_find_cpus(const void *fdt, struct fdt_walk_cpu_info *cpu, size_t *cpu_count);
+status_t fdt_walk_find_numa_distances(const void *fdt, struct fdt_walk_numa_distance *distance,
+                                      size_t *count);
 
 // Helper routines that initialize various subsystems based on device tree info
 status_t fdtwalk_setup_memory(const void *fdt, paddr_t fdt_phys, paddr_t default_mem_base,
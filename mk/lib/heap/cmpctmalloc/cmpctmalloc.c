@@ -13,6 +13,7 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include <arch/ops.h>
 #include <kernel/mutex.h>
 #include <kernel/spinlock.h>
 #include <kernel/thread.h>
@@ -24,6 +25,13 @@
 // Allocation strategy takes place with a global mutex.  Freelist entries are
 // kept in linked lists with 8 different sizes per binary order of magnitude
 // and the header size is two words with eager coalescing on free.
+//
+// Small allocations are fronted by per-cpu caches of recently freed objects,
+// one list per bucket, so that the common malloc/free pairs only take a
+// per-cpu spinlock.  Cached objects are still allocated as far as the heap is
+// concerned, and move between the caches and the heap in batches.  An object
+// freed on a different cpu than it was allocated on simply joins the freeing
+// cpu's cache; there is no ownership to hand back.
 
 #ifdef DEBUG
 #define CMPCT_DEBUG
@@ -72,10 +80,38 @@ typedef struct free_struct {
   struct free_struct *prev;
 } free_t;
 
+// Requests up to this size are served from the per-cpu caches.  That covers
+// the first CACHE_BUCKETS buckets, checked in cmpct_test_buckets().
+#define CACHE_MAX_SIZE 256
+#define CACHE_BUCKETS 24
+// Objects moved between a cache and the heap per lock acquisition, and the
+// number a bucket of a cache may hold before half of them are flushed.
+#define CACHE_BATCH 16
+#define CACHE_LIMIT (CACHE_BATCH * 2)
+
+typedef struct cache_entry {
+  struct cache_entry *next;
+} cache_entry_t;
+
+struct cache_bucket_stats {
+  ulong hits;     // allocations served from the cache
+  ulong misses;   // allocations that had to refill from the heap
+  ulong frees;    // frees that went into the cache
+  ulong flushes;  // batches returned to the heap
+};
+
+struct cpu_cache {
+  spin_lock_t lock;
+  cache_entry_t *objects[CACHE_BUCKETS];
+  uint32_t count[CACHE_BUCKETS];
+  struct cache_bucket_stats stats[CACHE_BUCKETS];
+} __CPU_ALIGN;
+
 struct heap {
   size_t size;
   size_t remaining;
   mutex_t lock;
+  bool cache_enabled;
   free_t *free_lists[NUMBER_OF_BUCKETS];
   // We have some 32 bit words that tell us whether there is an entry in the
   // freelist.
@@ -85,8 +121,12 @@ struct heap {
 
 // Heap static vars.
 static struct heap theheap;
+static struct cpu_cache cpu_caches[SMP_MAX_CPUS];
 
 static ssize_t heap_grow(size_t len, free_t **bucket);
+static void free_locked(header_t *header);
+static void cache_flush_all(void);
+static void cache_set_enabled(bool enabled);
 
 static void lock(void) { mutex_acquire(&theheap.lock); }
 
@@ -117,6 +157,8 @@ void cmpct_dump(void) {
     }
   }
   unlock();
+
+  cmpct_cache_dump();
 }
 
 // Operates in sizes that don't include the allocation header.
@@ -160,6 +202,14 @@ static int size_to_index_helper(size_t size, size_t *rounded_up_out, int adjust,
   return answer;
 }
 
+// Nominal size of the entries in a bucket, not including the header.
+static size_t bucket_to_size(int bucket) {
+  if (bucket < 15)
+    return (bucket + 1) * 8;
+  int row_column = bucket - 15 + 32;
+  return (size_t)(8 + (row_column & 7)) << (row_column >> 3);
+}
+
 // Round up size to next bucket when allocating.
 static int size_to_index_allocating(size_t size, size_t *rounded_up_out) {
   size_t rounded = ROUNDUP(size, 8);
@@ -463,6 +513,17 @@ static void cmpct_test_buckets(void) {
   }
 }
 
+static void cmpct_test_cache_buckets(void) {
+  size_t rounded;
+  // Every request that is routed to the caches must land in a cached bucket.
+  ASSERT(size_to_index_allocating(CACHE_MAX_SIZE, &rounded) == CACHE_BUCKETS - 1);
+  ASSERT(rounded == CACHE_MAX_SIZE);
+  ASSERT(size_to_index_freeing(CACHE_MAX_SIZE) == CACHE_BUCKETS - 1);
+  for (int bucket = 15; bucket < CACHE_BUCKETS; bucket++) {
+    ASSERT(size_to_index_freeing(bucket_to_size(bucket)) == bucket);
+  }
+}
+
 static void cmpct_test_get_back_newly_freed_helper(size_t size) {
   void *allocated = cmpct_alloc(size);
   if (allocated == NULL)
@@ -523,7 +584,12 @@ static void cmpct_test_return_to_os(void) {
 }
 
 void cmpct_test(void) {
+  // The tests below reason about the exact state of the free lists, so run
+  // them directly against the heap.
+  cache_set_enabled(false);
+
   cmpct_test_buckets();
+  cmpct_test_cache_buckets();
   cmpct_test_get_back_newly_freed();
   cmpct_test_return_to_os();
   cmpct_test_trim();
@@ -578,6 +644,8 @@ void cmpct_test(void) {
       cmpct_free(ptr[i]);
   }
 
+  cache_set_enabled(true);
+
   cmpct_dump();
 }
 
@@ -609,6 +677,9 @@ static void *large_alloc(size_t size) {
 }
 
 void cmpct_trim(void) {
+  // Give everything sitting in the caches back first so it can coalesce.
+  cache_flush_all();
+
   // Look at free list entries that are at least as large as one page plus a
   // header. They might be at the start or the end of a block, so we can trim
   // them and free the page(s).
@@ -675,19 +746,8 @@ void cmpct_trim(void) {
   unlock();
 }
 
-void *cmpct_alloc(size_t size) {
-  if (size == 0u)
-    return NULL;
-
-  if (size + sizeof(header_t) > (1u << HEAP_ALLOC_VIRTUAL_BITS))
-    return large_alloc(size);
-
-  size_t rounded_up;
-  int start_bucket = size_to_index_allocating(size, &rounded_up);
-
-  rounded_up += sizeof(header_t);
-
-  lock();
+// Carve an allocation out of the free lists.  Called with the lock held.
+static void *alloc_locked(size_t size, int start_bucket, size_t rounded_up) {
   int bucket = find_nonempty_bucket(start_bucket);
   if (bucket == -1) {
     // Grow heap by at least 12% if we can.
@@ -695,7 +755,6 @@ void *cmpct_alloc(size_t size) {
         MIN(1u << HEAP_ALLOC_VIRTUAL_BITS, MAX(theheap.size >> 3, MAX(HEAP_GROW_SIZE, rounded_up)));
     while (heap_grow(growby, NULL) < 0) {
       if (growby <= rounded_up) {
-        unlock();
         return NULL;
       }
       growby = MAX(growby >> 1, rounded_up);
@@ -724,6 +783,186 @@ void *cmpct_alloc(size_t size) {
   memset(result, ALLOC_FILL, size);
   memset(((char *)result) + size, PADDING_FILL, rounded_up - size - sizeof(header_t));
 #endif
+  return result;
+}
+
+static struct cpu_cache *cache_lock(spin_lock_saved_state_t *statep) {
+  // Interrupts stay off while the cache is held, which also keeps us from
+  // migrating to another cpu.
+  arch_interrupt_save(statep, SPIN_LOCK_FLAG_INTERRUPTS);
+  struct cpu_cache *cache = &cpu_caches[arch_curr_cpu_num()];
+  spin_lock(&cache->lock);
+  return cache;
+}
+
+static void cache_unlock(struct cpu_cache *cache, spin_lock_saved_state_t state) {
+  spin_unlock_restore(&cache->lock, state, SPIN_LOCK_FLAG_INTERRUPTS);
+}
+
+// Return a chain of cached objects to the heap under a single lock acquisition.
+static void cache_release_list(cache_entry_t *entry) {
+  if (entry == NULL)
+    return;
+  lock();
+  while (entry != NULL) {
+    cache_entry_t *next = entry->next;
+    free_locked((header_t *)entry - 1);
+    entry = next;
+  }
+  unlock();
+}
+
+static void *cache_alloc(int bucket, size_t size, size_t bucket_size) {
+  spin_lock_saved_state_t state;
+  struct cpu_cache *cache = cache_lock(&state);
+  cache_entry_t *entry = cache->objects[bucket];
+  if (likely(entry != NULL)) {
+    cache->objects[bucket] = entry->next;
+    cache->count[bucket]--;
+    cache->stats[bucket].hits++;
+    cache_unlock(cache, state);
+#ifdef CMPCT_DEBUG
+    memset(entry, ALLOC_FILL, size);
+#endif
+    return entry;
+  }
+  cache->stats[bucket].misses++;
+  cache_unlock(cache, state);
+
+  // Refill: one object for the caller plus a batch for the cache, all carved
+  // out under one acquisition of the heap lock.
+  size_t rounded_up = bucket_size + sizeof(header_t);
+
+  cache_entry_t *batch = NULL;
+  cache_entry_t *tail = NULL;
+  uint32_t batch_count = 0;
+  lock();
+  void *result = alloc_locked(size, bucket, rounded_up);
+  if (result != NULL) {
+    for (; batch_count < CACHE_BATCH - 1; batch_count++) {
+      cache_entry_t *e = alloc_locked(bucket_size, bucket, rounded_up);
+      if (e == NULL)
+        break;
+      if (tail == NULL)
+        tail = e;
+      e->next = batch;
+      batch = e;
+    }
+  }
+  unlock();
+
+  if (batch != NULL) {
+    // We may have moved to another cpu in the meantime, which is harmless.
+    cache = cache_lock(&state);
+    tail->next = cache->objects[bucket];
+    cache->objects[bucket] = batch;
+    cache->count[bucket] += batch_count;
+    cache_unlock(cache, state);
+  }
+
+  return result;
+}
+
+static void cache_free(void *payload, int bucket) {
+  cache_entry_t *entry = (cache_entry_t *)payload;
+#ifdef CMPCT_DEBUG
+  header_t *header = (header_t *)payload - 1;
+  memset(payload, FREE_FILL, header->size - sizeof(header_t));
+#endif
+
+  cache_entry_t *flush = NULL;
+  spin_lock_saved_state_t state;
+  struct cpu_cache *cache = cache_lock(&state);
+  entry->next = cache->objects[bucket];
+  cache->objects[bucket] = entry;
+  cache->count[bucket]++;
+  cache->stats[bucket].frees++;
+  if (unlikely(cache->count[bucket] > CACHE_LIMIT)) {
+    // Detach a batch to hand back to the heap once we drop the spinlock.
+    cache_entry_t *last = cache->objects[bucket];
+    for (int i = 1; i < CACHE_BATCH; i++)
+      last = last->next;
+    flush = cache->objects[bucket];
+    cache->objects[bucket] = last->next;
+    last->next = NULL;
+    cache->count[bucket] -= CACHE_BATCH;
+    cache->stats[bucket].flushes++;
+  }
+  cache_unlock(cache, state);
+
+  cache_release_list(flush);
+}
+
+// Empty the caches of every cpu back into the heap.
+static void cache_flush_all(void) {
+  for (uint cpu = 0; cpu < SMP_MAX_CPUS; cpu++) {
+    struct cpu_cache *cache = &cpu_caches[cpu];
+    for (int bucket = 0; bucket < CACHE_BUCKETS; bucket++) {
+      spin_lock_saved_state_t state;
+      spin_lock_irqsave(&cache->lock, state);
+      cache_entry_t *list = cache->objects[bucket];
+      cache->objects[bucket] = NULL;
+      cache->count[bucket] = 0;
+      spin_unlock_irqrestore(&cache->lock, state);
+
+      cache_release_list(list);
+    }
+  }
+}
+
+static void cache_set_enabled(bool enabled) {
+  theheap.cache_enabled = enabled;
+  if (!enabled)
+    cache_flush_all();
+}
+
+void cmpct_cache_dump(void) {
+  dprintf(INFO, "\tper-cpu cache (%s, batch %d, limit %d):\n",
+          theheap.cache_enabled ? "enabled" : "disabled", CACHE_BATCH, CACHE_LIMIT);
+  dprintf(INFO, "\t%6s %8s %12s %12s %12s %10s %5s\n", "size", "cached", "hits", "misses", "frees",
+          "flushes", "hit%");
+  for (int bucket = 0; bucket < CACHE_BUCKETS; bucket++) {
+    struct cache_bucket_stats total = {};
+    uint32_t cached = 0;
+    for (uint cpu = 0; cpu < SMP_MAX_CPUS; cpu++) {
+      struct cpu_cache *cache = &cpu_caches[cpu];
+      spin_lock_saved_state_t state;
+      spin_lock_irqsave(&cache->lock, state);
+      cached += cache->count[bucket];
+      total.hits += cache->stats[bucket].hits;
+      total.misses += cache->stats[bucket].misses;
+      total.frees += cache->stats[bucket].frees;
+      total.flushes += cache->stats[bucket].flushes;
+      spin_unlock_irqrestore(&cache->lock, state);
+    }
+    if (total.hits + total.misses + total.frees == 0)
+      continue;
+    ulong hit_rate = total.hits * 100 / MAX(1ul, total.hits + total.misses);
+    dprintf(INFO, "\t%6zu %8u %12lu %12lu %12lu %10lu %4lu%%\n", bucket_to_size(bucket), cached,
+            total.hits,
+            total.misses, total.frees, total.flushes, hit_rate);
+  }
+}
+
+void *cmpct_alloc(size_t size) {
+  if (size == 0u)
+    return NULL;
+
+  if (size + sizeof(header_t) > (1u << HEAP_ALLOC_VIRTUAL_BITS))
+    return large_alloc(size);
+
+  size_t rounded_up;
+  int start_bucket = size_to_index_allocating(size, &rounded_up);
+
+  // Key the caches by the bucket the object will be freed into, which only
+  // differs for the tiny sizes that round up to a whole free_t.
+  if (theheap.cache_enabled && start_bucket < CACHE_BUCKETS)
+    return cache_alloc(size_to_index_freeing(rounded_up), size, rounded_up);
+
+  rounded_up += sizeof(header_t);
+
+  lock();
+  void *result = alloc_locked(size, start_bucket, rounded_up);
   unlock();
   return result;
 }
@@ -754,13 +993,9 @@ void *cmpct_memalign(size_t size, size_t alignment) {
   return payload;
 }
 
-void cmpct_free(void *payload) {
-  if (payload == NULL)
-    return;
-  header_t *header = (header_t *)payload - 1;
-  DEBUG_ASSERT(!is_tagged_as_free(header));  // Double free!
+// Return an allocation to the free lists.  Called with the lock held.
+static void free_locked(header_t *header) {
   size_t size = header->size;
-  lock();
   header_t *left = header->left;
   if (left != NULL && is_tagged_as_free(left)) {
     // Coalesce with left free object.
@@ -789,6 +1024,23 @@ void cmpct_free(void *payload) {
       free_memory(header, left, size);
     }
   }
+}
+
+void cmpct_free(void *payload) {
+  if (payload == NULL)
+    return;
+  header_t *header = (header_t *)payload - 1;
+  DEBUG_ASSERT(!is_tagged_as_free(header));  // Double free!
+  size_t size = header->size - sizeof(header_t);
+  if (theheap.cache_enabled && size <= CACHE_MAX_SIZE) {
+    int bucket = size_to_index_freeing(size);
+    if (bucket < CACHE_BUCKETS) {
+      cache_free(payload, bucket);
+      return;
+    }
+  }
+  lock();
+  free_locked(header);
   unlock();
 }
 
@@ -851,4 +1103,9 @@ void cmpct_init(void) {
   theheap.remaining = 0;
 
   heap_grow(initial_alloc, NULL);
+
+  for (uint cpu = 0; cpu < SMP_MAX_CPUS; cpu++) {
+    spin_lock_init(&cpu_caches[cpu].lock);
+  }
+  theheap.cache_enabled = true;
 }
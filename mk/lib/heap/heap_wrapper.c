@@ -8,6 +8,9 @@
 #include <assert.h>
 #include <lib/heap.h>
 #include <lib/page_alloc.h>
+#if WITH_LIB_SLAB
+#include <lib/slab.h>
+#endif
 #include <stdlib.h>
 #include <string.h>
 
@@ -146,6 +149,10 @@ void heap_trim(void) {
   }
 
   HEAP_TRIM();
+
+#if WITH_LIB_SLAB
+  slab_reclaim();
+#endif
 }
 
 void *malloc(size_t size) {
@@ -307,6 +314,9 @@ static int cmd_heap(int argc, const cmd_args *argv, uint32_t flags) {
   usage:
     printf("usage:\n");
     printf("\t%s info\n", argv[0].str);
+#if WITH_LIB_HEAP_CMPCTMALLOC
+    printf("\t%s cache\n", argv[0].str);
+#endif
     printf("\t%s trace\n", argv[0].str);
     printf("\t%s trim\n", argv[0].str);
     printf("\t%s alloc <size> [alignment]\n", argv[0].str);
@@ -317,6 +327,10 @@ static int cmd_heap(int argc, const cmd_args *argv, uint32_t flags) {
 
   if (strcmp(argv[1].str, "info") == 0) {
     heap_dump();
+#if WITH_LIB_HEAP_CMPCTMALLOC
+  } else if (strcmp(argv[1].str, "cache") == 0) {
+    cmpct_cache_dump();
+#endif
   } else if (strcmp(argv[1].str, "test") == 0) {
     heap_test();
   } else if (strcmp(argv[1].str, "trace") == 0) {
@@ -18,6 +18,9 @@
 #else
 #include <kernel/novm.h>
 #endif
+#if WITH_LIB_SLAB
+#include <lib/slab.h>
+#endif
 
 /* A simple page-aligned wrapper around the pmm or novm implementation of
  * the underlying physical page allocator. Used by system heaps or any
@@ -36,7 +39,7 @@
 
 #endif
 
-void *page_alloc(size_t pages, int arena) {
+static void *page_alloc_once(size_t pages, int arena) {
 #if WITH_KERNEL_VM
   void *result = pmm_alloc_kpages(pages, NULL);
   return result;
@@ -46,6 +49,18 @@ void *page_alloc(size_t pages, int arena) {
 #endif
 }
 
+void *page_alloc(size_t pages, int arena) {
+  void *result = page_alloc_once(pages, arena);
+#if WITH_LIB_SLAB
+  // under memory pressure, give back the empty slabs and try again
+  if (unlikely(!result) && slab_reclaim() > 0) {
+    LTRACEF("retrying %zu pages after slab reclaim\n", pages);
+    result = page_alloc_once(pages, arena);
+  }
+#endif
+  return result;
+}
+
 void page_free(void *ptr, size_t pages) {
 #if WITH_KERNEL_VM
   DEBUG_ASSERT(IS_PAGE_ALIGNED((uintptr_t)ptr));
@@ -9,15 +9,34 @@
  * license that can be found in the LICENSE file or at
  * https://opensource.org/licenses/MIT
  */
+#include <stdint.h>
 #include <string.h>
 #include <sys/types.h>
 
+typedef unsigned long word;
+
+#define lsize sizeof(word)
+#define lmask (lsize - 1)
+
 int memcmp(const void *cs, const void *ct, size_t count) {
-  const unsigned char *su1, *su2;
-  signed char res = 0;
+  const unsigned char *su1 = (const unsigned char *)cs;
+  const unsigned char *su2 = (const unsigned char *)ct;
+
+  // if both buffers share alignment, skip over the matching prefix a word at a time
+  if ((((uintptr_t)su1 ^ (uintptr_t)su2) & lmask) == 0) {
+    for (; count > 0 && ((uintptr_t)su1 & lmask); ++su1, ++su2, count--)
+      if (*su1 != *su2)
+        return *su1 - *su2;
+
+    for (; count >= lsize && *(const word *)su1 == *(const word *)su2; count -= lsize) {
+      su1 += lsize;
+      su2 += lsize;
+    }
+  }
 
-  for (su1 = cs, su2 = ct; 0 < count; ++su1, ++su2, count--)
-    if ((res = *su1 - *su2) != 0)
-      break;
-  return res;
+  // find the first differing byte
+  for (; count > 0; ++su1, ++su2, count--)
+    if (*su1 != *su2)
+      return *su1 - *su2;
+  return 0;
 }
@@ -36,7 +36,11 @@ LIBC_STRING_C_DIR := $(LOCAL_DIR)
 # include the arch specific string routines
 #
 # the makefile may filter out implemented versions from the C_STRING_OPS variable
--include $(LOCAL_DIR)/arch/$(ARCH)/rules.mk
+LIBC_STRING_ARCH := $(ARCH)
+ifeq ($(ARCH),riscv)
+LIBC_STRING_ARCH := riscv$(SUBARCH)
+endif
+-include $(LOCAL_DIR)/arch/$(LIBC_STRING_ARCH)/rules.mk
 
 MODULE_SRCS += \
 	$(addprefix $(LIBC_STRING_C_DIR)/,$(addsuffix .c,$(C_STRING_OPS)))
@@ -9,16 +9,32 @@
  * license that can be found in the LICENSE file or at
  * https://opensource.org/licenses/MIT
  */
+#include <stdint.h>
 #include <string.h>
 #include <sys/types.h>
 
+typedef unsigned long word;
+
+#define lsize sizeof(word)
+#define lmask (lsize - 1)
+#define ONES ((word)-1 / 0xff)
+#define HIGHS (ONES * 0x80)
+#define HASZERO(x) (((x) - ONES) & ~(x) & HIGHS)
+
 size_t strlen(char const *s) {
-  size_t i;
+  const char *p = s;
+  const word *w;
+
+  for (; (uintptr_t)p & lmask; p++)
+    if (!*p)
+      return p - s;
+
+  // aligned word reads never cross into the next page, so they can't fault past the terminator
+  for (w = (const word *)p; !HASZERO(*w); w++)
+    ;
 
-  i = 0;
-  while (s[i]) {
-    i += 1;
-  }
+  for (p = (const char *)w; *p; p++)
+    ;
 
-  return i;
+  return p - s;
 }
@@ -14,6 +14,7 @@
 #include <stdint.h>
 #include <sys/types.h>
 
+#include <kernel/poll.h>
 #include <lk/compiler.h>
 #include <lk/list.h>
 
@@ -46,8 +47,10 @@ void minip_set_eth(tx_func_t tx_handler, void *tx_arg, const uint8_t *macaddr);
 bool minip_is_configured(void);
 status_t minip_wait_for_configured(lk_time_t timeout);
 
-/* packet rx hook to hand to ethernet driver */
-void minip_rx_driver_callback(pktbuf_t *p);
+/* packet rx hook to hand to ethernet driver.
+ * the driver keeps ownership of p unless it marked it PKTBUF_FLAG_DETACHABLE and
+ * this returns true, in which case the stack keeps p and frees it once consumed */
+bool minip_rx_driver_callback(pktbuf_t *p);
 
 /* global configuration state */
 void minip_get_macaddr(uint8_t *addr);
@@ -73,6 +76,10 @@ status_t udp_send(void *buf, size_t len, udp_socket_t *handle);
 status_t udp_send_iovec(const iovec_t *iov, uint iov_count, udp_socket_t *handle);
 status_t udp_close(udp_socket_t *handle);
 
+/* udp sockets only send, so they are always POLL_OUT. received datagrams go to the
+ * udp_listen() callback, which can queue them on a cbuf or port to poll on instead */
+poll_source_t *udp_poll_source(udp_socket_t *handle);
+
 /* tcp */
 typedef struct tcp_socket tcp_socket_t;
 
@@ -82,8 +89,20 @@ status_t tcp_accept_timeout(tcp_socket_t *listen_socket, tcp_socket_t **accept_s
                             lk_time_t timeout);
 status_t tcp_close(tcp_socket_t *socket);
 ssize_t tcp_read(tcp_socket_t *socket, void *buf, size_t len);
+
+/* zero copy read. waits for data like tcp_read(), then points up to *iov_count
+ * iovecs at up to len bytes of queued receive buffers and stores the number used
+ * in *iov_count. the data stays queued until tcp_read_zc_release() consumes it,
+ * and no other read may be issued in the meantime. returns the bytes described. */
+ssize_t tcp_read_zc(tcp_socket_t *socket, iovec_t *iov, uint *iov_count, size_t len);
+status_t tcp_read_zc_release(tcp_socket_t *socket, size_t len);
 ssize_t tcp_write(tcp_socket_t *socket, const void *buf, size_t len);
 
+/* readiness of the socket for poll sets: POLL_IN when there is data to read or,
+ * on a listening socket, a connection to accept. POLL_OUT when the tx buffer has
+ * room, POLL_HUP once the other end has closed */
+poll_source_t *tcp_poll_source(tcp_socket_t *socket);
+
 static inline status_t tcp_accept(tcp_socket_t *listen_socket, tcp_socket_t **accept_socket) {
   return tcp_accept_timeout(listen_socket, accept_socket, INFINITE_TIME);
 }
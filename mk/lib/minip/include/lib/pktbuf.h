@@ -14,11 +14,19 @@
 
 __BEGIN_CDECLS
 
-/* PAGE_SIZE minus 16 bytes of metadata in pktbuf_buf */
+/* buffers preallocated at boot, the pool grows from the page allocator past that */
 #ifndef PKTBUF_POOL_SIZE
 #define PKTBUF_POOL_SIZE 256
 #endif
 
+/* most buffers in use at once, pktbuf_alloc() waits for a free one beyond this */
+#ifndef PKTBUF_POOL_MAX
+#define PKTBUF_POOL_MAX 4096
+#endif
+
+/* largest batch handled by pktbuf_alloc_bulk() and pktbuf_free_bulk() in one pass */
+#define PKTBUF_BULK_MAX 64
+
 #ifndef PKTBUF_SIZE
 #define PKTBUF_SIZE 1536
 #endif
@@ -41,18 +49,13 @@ typedef struct pktbuf {
   u8 *buffer;
 } pktbuf_t;
 
-typedef struct pktbuf_pool_object {
-  union {
-    pktbuf_t p;
-    uint8_t b[PKTBUF_SIZE];
-  };
-} pktbuf_pool_object_t;
-
 #define PKTBUF_FLAG_CKSUM_IP_GOOD (1 << 0)
 #define PKTBUF_FLAG_CKSUM_TCP_GOOD (1 << 1)
 #define PKTBUF_FLAG_CKSUM_UDP_GOOD (1 << 2)
 #define PKTBUF_FLAG_EOF (1 << 3)
 #define PKTBUF_FLAG_CACHED (1 << 4)
+/* set by a driver on rx pktbufs the stack may keep instead of copying from */
+#define PKTBUF_FLAG_DETACHABLE (1 << 5)
 
 /* Return the physical address offset of data in the packet */
 static inline u32 pktbuf_data_phys(pktbuf_t *p) { return p->phys_base + (p->data - p->buffer); }
@@ -65,10 +68,14 @@ static inline u32 pktbuf_avail_tail(pktbuf_t *p) {
   return p->blen - (p->data - p->buffer) - p->dlen;
 }
 
-// allocate packet buffer from buffer pool
+// allocate packet buffer from buffer pool, waits if the pool is at its limit
 pktbuf_t *pktbuf_alloc(void);
 pktbuf_t *pktbuf_alloc_empty(void);
 
+// allocate up to count packet buffers without waiting, for drivers
+// refilling rx rings. returns the number stored in pkts.
+size_t pktbuf_alloc_bulk(pktbuf_t **pkts, size_t count);
+
 /* Add a buffer to an existing packet buffer */
 void pktbuf_add_buffer(pktbuf_t *p, u8 *buf, u32 len, uint32_t header_sz, uint32_t flags,
                        pktbuf_free_callback cb, void *cb_args);
@@ -77,6 +84,9 @@ void pktbuf_add_buffer(pktbuf_t *p, u8 *buf, u32 len, uint32_t header_sz, uint32
 // returns number of threads woken up
 int pktbuf_free(pktbuf_t *p, bool reschedule);
 
+// return count packet buffers to the buffer pool
+void pktbuf_free_bulk(pktbuf_t **pkts, size_t count, bool reschedule);
+
 // extend buffer by sz bytes, copied from data
 void pktbuf_append_data(pktbuf_t *p, const void *data, size_t sz);
 
@@ -112,4 +122,7 @@ void pktbuf_create_bufs(void *ptr, size_t size);
 
 void pktbuf_dump(pktbuf_t *p);
 
+// print pool usage, exhaustion and stall counters
+void pktbuf_dump_stats(void);
+
 __END_CDECLS
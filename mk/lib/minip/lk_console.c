@@ -67,6 +67,7 @@ static int cmd_minip(int argc, const cmd_args *argv, uint32_t flags) {
   minip_usage:
     printf("minip commands\n");
     printf("mi [a]rp                        dump arp table\n");
+    printf("mi [p]ktbuf                     print pktbuf pool stats\n");
     printf("mi [s]tatus                     print ip status\n");
     printf("mi [t]est [dest] [port] [cnt]   send <cnt> test packets to the dest:port\n");
   } else {
@@ -74,6 +75,9 @@ static int cmd_minip(int argc, const cmd_args *argv, uint32_t flags) {
       case 'a':
         arp_cache_dump();
         break;
+      case 'p':
+        pktbuf_dump_stats();
+        break;
 
       case 's': {
         printf("hostname: %s\n", minip_get_hostname());
@@ -115,7 +115,7 @@ void minip_build_ipv4_hdr(struct ipv4_hdr *ipv4, uint32_t dst, uint8_t proto, ui
 
 status_t minip_ipv4_send(pktbuf_t *p, uint32_t dest_addr, uint8_t proto);
 
-void tcp_input(pktbuf_t *p, uint32_t src_ip, uint32_t dst_ip);
+bool tcp_input(pktbuf_t *p, uint32_t src_ip, uint32_t dst_ip);
 void udp_input(pktbuf_t *p, uint32_t src_ip);
 
 const uint8_t *get_dest_mac(uint32_t host);
@@ -324,12 +324,13 @@ static void dump_ipv4_packet(const struct ipv4_hdr *ip) {
          ntohs(ip->flags_frags) & 0x1fff);
 }
 
-__NO_INLINE static void handle_ipv4_packet(pktbuf_t *p, const uint8_t *src_mac) {
+/* returns true if the stack kept p, see minip_rx_driver_callback() */
+__NO_INLINE static bool handle_ipv4_packet(pktbuf_t *p, const uint8_t *src_mac) {
   struct ipv4_hdr *ip;
 
   ip = (struct ipv4_hdr *)p->data;
   if (p->dlen < sizeof(struct ipv4_hdr))
-    return;
+    return false;
 
   /* print packets for us */
   if (LOCAL_TRACE) {
@@ -340,28 +341,28 @@ __NO_INLINE static void handle_ipv4_packet(pktbuf_t *p, const uint8_t *src_mac)
   if (((ip->ver_ihl >> 4) & 0xf) != 4) {
     /* not version 4 */
     LTRACEF("REJECT: not version 4\n");
-    return;
+    return false;
   }
 
   /* do we have enough buffer to hold the full header + options? */
   size_t header_len = (ip->ver_ihl & 0xf) * 4;
   if (p->dlen < header_len) {
     LTRACEF("REJECT: not enough buffer to hold header\n");
-    return;
+    return false;
   }
 
   /* compute checksum */
   if (rfc1701_chksum((void *)ip, header_len) != 0) {
     /* bad checksum */
     LTRACEF("REJECT: bad checksum\n");
-    return;
+    return false;
   }
 
   /* is the pkt_buf large enough to hold the length the header says the packet is? */
   if (htons(ip->len) > p->dlen) {
     LTRACEF("REJECT: packet exceeds size of buffer (header %d, dlen %d)\n", htons(ip->len),
             p->dlen);
-    return;
+    return false;
   }
 
   /* trim any excess bytes at the end of the packet */
@@ -371,7 +372,7 @@ __NO_INLINE static void handle_ipv4_packet(pktbuf_t *p, const uint8_t *src_mac)
 
   /* remove the header from the front of the packet_buf  */
   if (pktbuf_consume(p, header_len) == NULL) {
-    return;
+    return false;
   }
 
   /* the packet is good, we can use it to populate our arp cache */
@@ -381,7 +382,7 @@ __NO_INLINE static void handle_ipv4_packet(pktbuf_t *p, const uint8_t *src_mac)
   if (ip->dst_addr != IPV4_BCAST) {
     if (minip_ip != IPV4_NONE && ip->dst_addr != minip_ip && ip->dst_addr != minip_broadcast) {
       LTRACEF("REJECT: for another host\n");
-      return;
+      return false;
     }
   }
 
@@ -402,9 +403,9 @@ __NO_INLINE static void handle_ipv4_packet(pktbuf_t *p, const uint8_t *src_mac)
       break;
 
     case IP_PROTO_TCP:
-      tcp_input(p, ip->src_addr, ip->dst_addr);
-      break;
+      return tcp_input(p, ip->src_addr, ip->dst_addr);
   }
+  return false;
 }
 
 __NO_INLINE static int handle_arp_pkt(pktbuf_t *p) {
@@ -467,11 +468,11 @@ static void dump_eth_packet(const struct eth_hdr *eth) {
   printf(" type 0x%hx\n", htons(eth->type));
 }
 
-void minip_rx_driver_callback(pktbuf_t *p) {
+bool minip_rx_driver_callback(pktbuf_t *p) {
   struct eth_hdr *eth;
 
   if ((eth = (void *)pktbuf_consume(p, sizeof(struct eth_hdr))) == NULL) {
-    return;
+    return false;
   }
 
   if (LOCAL_TRACE) {
@@ -480,20 +481,20 @@ void minip_rx_driver_callback(pktbuf_t *p) {
 
   if (memcmp(eth->dst_mac, minip_mac, 6) != 0 && memcmp(eth->dst_mac, broadcast_mac, 6) != 0) {
     /* not for us */
-    return;
+    return false;
   }
 
   switch (htons(eth->type)) {
     case ETH_TYPE_IPV4:
       LTRACEF("ipv4 pkt\n");
-      handle_ipv4_packet(p, eth->src_mac);
-      break;
+      return handle_ipv4_packet(p, eth->src_mac);
 
     case ETH_TYPE_ARP:
       LTRACEF("arp pkt\n");
       handle_arp_pkt(p);
       break;
   }
+  return false;
 }
 
 void dump_mac_address(const uint8_t *mac) {
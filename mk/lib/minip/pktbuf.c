@@ -8,14 +8,17 @@
  */
 
 #include <assert.h>
+#include <inttypes.h>
 #include <lib/pktbuf.h>
-#include <lib/pool.h>
+#include <lib/slab.h>
 #include <malloc.h>
+#include <platform.h>
 #include <printf.h>
+#include <stdlib.h>
 #include <string.h>
 
-#include <kernel/semaphore.h>
-#include <kernel/spinlock.h>
+#include <arch/ops.h>
+#include <kernel/event.h>
 #include <kernel/thread.h>
 #include <lk/debug.h>
 #include <lk/init.h>
@@ -27,40 +30,96 @@
 
 #define LOCAL_TRACE 0
 
-static pool_t pktbuf_pool;
-static semaphore_t pktbuf_sem;
-static spin_lock_t lock;
+/*
+ * pktbuf headers and the buffers behind them come from two slab caches, so
+ * the common path only touches the current cpu's magazine. The buffer cache
+ * grows from the page allocator as needed, up to PKTBUF_POOL_MAX buffers in
+ * use; past that pktbuf_alloc() waits for one to be freed.
+ */
+static slab_cache_t pktbuf_cache = SLAB_CACHE_TYPED_INITIAL_VALUE(pktbuf_cache, "pktbuf", pktbuf_t);
+static slab_cache_t pktbuf_buf_cache =
+    SLAB_CACHE_INITIAL_VALUE(pktbuf_buf_cache, "pktbuf buf", PKTBUF_SIZE, CACHE_LINE, NULL, NULL);
+
+static event_t pktbuf_free_event = EVENT_INITIAL_VALUE(pktbuf_free_event, false,
+                                                       EVENT_FLAG_AUTOUNSIGNAL);
+
+static struct {
+  volatile int bufs_in_use;
+  int bufs_high_water;
+  volatile int waiters;
+
+  uint64_t allocs;
+  uint64_t exhausted; /* allocations that found the pool at its limit or out of memory */
+  uint64_t stalls;    /* of which the caller waited for a buffer to be freed */
+  lk_bigtime_t stall_time;
+  lk_bigtime_t max_stall_time;
+} pktbuf_stats;
+
+/* reserve count buffers against the pool limit, all or nothing */
+static bool pktbuf_reserve_bufs(int count) {
+  int in_use = __atomic_add_fetch(&pktbuf_stats.bufs_in_use, count, __ATOMIC_RELAXED);
+  if (in_use > PKTBUF_POOL_MAX) {
+    __atomic_sub_fetch(&pktbuf_stats.bufs_in_use, count, __ATOMIC_RELAXED);
+    return false;
+  }
 
-/* Take an object from the pool of pktbuf objects to act as a header or buffer.  */
-static void *get_pool_object(void) {
-  pool_t *entry;
-  spin_lock_saved_state_t state;
+  /* racy, but only ever off by a little */
+  if (in_use > pktbuf_stats.bufs_high_water)
+    pktbuf_stats.bufs_high_water = in_use;
+  return true;
+}
 
-  sem_wait(&pktbuf_sem);
-  spin_lock_irqsave(&lock, state);
-  entry = pool_alloc(&pktbuf_pool);
-  spin_unlock_irqrestore(&lock, state);
+static void pktbuf_release_bufs(int count, bool reschedule) {
+  /* pairs with the waiter bumping waiters before it rechecks bufs_in_use */
+  __atomic_sub_fetch(&pktbuf_stats.bufs_in_use, count, __ATOMIC_SEQ_CST);
 
-  return (pktbuf_pool_object_t *)entry;
+  if (unlikely(__atomic_load_n(&pktbuf_stats.waiters, __ATOMIC_SEQ_CST) > 0))
+    event_signal(&pktbuf_free_event, reschedule && !arch_ints_disabled());
 }
 
-/* Return an object to thje pktbuf object pool. */
-static void free_pool_object(pktbuf_pool_object_t *entry, bool reschedule) {
-  DEBUG_ASSERT(entry);
-  spin_lock_saved_state_t state;
+/* Take a buffer from the pool, waiting for one to be freed if wait is set and the pool is dry. */
+static void *get_pool_buf(bool wait) {
+  for (;;) {
+    if (pktbuf_reserve_bufs(1)) {
+      void *buf = slab_cache_alloc(&pktbuf_buf_cache);
+      if (buf)
+        return buf;
+      pktbuf_release_bufs(1, false);
+    }
+
+    __atomic_add_fetch(&pktbuf_stats.exhausted, 1, __ATOMIC_RELAXED);
+    if (!wait)
+      return NULL;
+
+    /* count ourselves as a waiter before the final check so a free can't slip past us */
+    __atomic_add_fetch(&pktbuf_stats.waiters, 1, __ATOMIC_SEQ_CST);
+    lk_bigtime_t start = current_time_hires();
+    if (__atomic_load_n(&pktbuf_stats.bufs_in_use, __ATOMIC_SEQ_CST) >= PKTBUF_POOL_MAX)
+      event_wait(&pktbuf_free_event);
+    else
+      thread_yield(); /* out of pages rather than over the limit, try again shortly */
+    lk_bigtime_t stall = current_time_hires() - start;
+    __atomic_sub_fetch(&pktbuf_stats.waiters, 1, __ATOMIC_SEQ_CST);
+
+    __atomic_add_fetch(&pktbuf_stats.stalls, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&pktbuf_stats.stall_time, stall, __ATOMIC_RELAXED);
+    if (stall > pktbuf_stats.max_stall_time)
+      pktbuf_stats.max_stall_time = stall;
+  }
+}
+
+/* Return a buffer to the pktbuf pool. */
+static void free_pool_buf(void *buf, bool reschedule) {
+  DEBUG_ASSERT(buf);
 
-  spin_lock_irqsave(&lock, state);
-  pool_free(&pktbuf_pool, entry);
-  spin_unlock_irqrestore(&lock, state);
-  sem_post(&pktbuf_sem, reschedule);
+  slab_cache_free(&pktbuf_buf_cache, buf);
+  pktbuf_release_bufs(1, reschedule);
 }
 
-/* Callback used internally to place a pktbuf_pool_object back in the pool after
- * it was used as a buffer for another pktbuf
+/* Callback used internally to place a buffer back in the pool after it was
+ * used by a pktbuf
  */
-static void free_pktbuf_buf_cb(void *buf, void *arg) {
-  free_pool_object((pktbuf_pool_object_t *)buf, true);
-}
+static void free_pktbuf_buf_cb(void *buf, void *arg) { free_pool_buf(buf, true); }
 
 /* Add a buffer to a pktbuf. Header space for prepending data is adjusted based on
  * header_sz. cb is called when the pktbuf is freed / released by the driver level
@@ -99,22 +158,55 @@ pktbuf_t *pktbuf_alloc(void) {
   pktbuf_t *p = NULL;
   void *buf = NULL;
 
-  p = get_pool_object();
+  p = slab_cache_alloc(&pktbuf_cache);
   if (!p) {
     return NULL;
   }
 
-  buf = get_pool_object();
+  buf = get_pool_buf(true);
   if (!buf) {
-    free_pool_object((pktbuf_pool_object_t *)p, false);
+    slab_cache_free(&pktbuf_cache, p);
     return NULL;
   }
 
+  __atomic_add_fetch(&pktbuf_stats.allocs, 1, __ATOMIC_RELAXED);
+
   memset(p, 0, sizeof(pktbuf_t));
   pktbuf_add_buffer(p, buf, PKTBUF_SIZE, PKTBUF_MAX_HDR, 0, free_pktbuf_buf_cb, NULL);
   return p;
 }
 
+size_t pktbuf_alloc_bulk(pktbuf_t **pkts, size_t count) {
+  void *bufs[PKTBUF_BULK_MAX];
+
+  count = MIN(count, PKTBUF_BULK_MAX);
+
+  /* take what the pool limit allows, never wait */
+  while (count > 0 && !pktbuf_reserve_bufs(count)) {
+    count /= 2;
+  }
+  if (count == 0) {
+    __atomic_add_fetch(&pktbuf_stats.exhausted, 1, __ATOMIC_RELAXED);
+    return 0;
+  }
+
+  size_t hdrs = slab_cache_alloc_bulk(&pktbuf_cache, (void **)pkts, count);
+  size_t n = slab_cache_alloc_bulk(&pktbuf_buf_cache, bufs, hdrs);
+  if (n < count) {
+    __atomic_add_fetch(&pktbuf_stats.exhausted, 1, __ATOMIC_RELAXED);
+    slab_cache_free_bulk(&pktbuf_cache, (void **)&pkts[n], hdrs - n);
+    pktbuf_release_bufs(count - n, false);
+  }
+
+  for (size_t i = 0; i < n; i++) {
+    memset(pkts[i], 0, sizeof(pktbuf_t));
+    pktbuf_add_buffer(pkts[i], bufs[i], PKTBUF_SIZE, PKTBUF_MAX_HDR, 0, free_pktbuf_buf_cb, NULL);
+  }
+  __atomic_add_fetch(&pktbuf_stats.allocs, n, __ATOMIC_RELAXED);
+
+  return n;
+}
+
 void pktbuf_reset(pktbuf_t *p, uint32_t header_sz) {
   DEBUG_ASSERT(p);
   DEBUG_ASSERT(p->buffer);
@@ -125,8 +217,12 @@ void pktbuf_reset(pktbuf_t *p, uint32_t header_sz) {
 }
 
 pktbuf_t *pktbuf_alloc_empty(void) {
-  pktbuf_t *p = (pktbuf_t *)get_pool_object();
+  pktbuf_t *p = slab_cache_alloc(&pktbuf_cache);
+  if (!p) {
+    return NULL;
+  }
 
+  memset(p, 0, sizeof(pktbuf_t));
   p->flags = PKTBUF_FLAG_EOF;
   return p;
 }
@@ -137,11 +233,39 @@ int pktbuf_free(pktbuf_t *p, bool reschedule) {
   if (p->cb) {
     p->cb(p->buffer, p->cb_args);
   }
-  free_pool_object((pktbuf_pool_object_t *)p, false);
+  slab_cache_free(&pktbuf_cache, p);
 
   return 1;
 }
 
+void pktbuf_free_bulk(pktbuf_t **pkts, size_t count, bool reschedule) {
+  void *bufs[PKTBUF_BULK_MAX];
+
+  while (count > 0) {
+    size_t batch = MIN(count, PKTBUF_BULK_MAX);
+
+    /* buffers from the pool go back in one go, anything else through its callback */
+    size_t nbufs = 0;
+    for (size_t i = 0; i < batch; i++) {
+      pktbuf_t *p = pkts[i];
+      DEBUG_ASSERT(p);
+      if (p->cb == free_pktbuf_buf_cb) {
+        bufs[nbufs++] = p->buffer;
+      } else if (p->cb) {
+        p->cb(p->buffer, p->cb_args);
+      }
+    }
+    if (nbufs) {
+      slab_cache_free_bulk(&pktbuf_buf_cache, bufs, nbufs);
+      pktbuf_release_bufs(nbufs, reschedule);
+    }
+    slab_cache_free_bulk(&pktbuf_cache, (void **)pkts, batch);
+
+    pkts += batch;
+    count -= batch;
+  }
+}
+
 void pktbuf_append_data(pktbuf_t *p, const void *data, size_t sz) {
   if (pktbuf_avail_tail(p) < sz) {
     panic("pktbuf_append_data: overflow");
@@ -200,27 +324,33 @@ void pktbuf_dump(pktbuf_t *p) {
          p->dlen, (uintptr_t)p->data - (uintptr_t)p->buffer, (void *)p->phys_base);
 }
 
-static void pktbuf_init(uint level) {
-  void *slab;
+void pktbuf_dump_stats(void) {
+  printf("pktbuf: %d buffers in use (high water %d, limit %d), %" PRIu64 " allocs\n",
+         pktbuf_stats.bufs_in_use, pktbuf_stats.bufs_high_water, PKTBUF_POOL_MAX,
+         pktbuf_stats.allocs);
+  printf("pktbuf: exhausted %" PRIu64 ", stalls %" PRIu64 " (avg %llu us, max %llu us)\n",
+         pktbuf_stats.exhausted, pktbuf_stats.stalls,
+         pktbuf_stats.stalls ? pktbuf_stats.stall_time / pktbuf_stats.stalls : 0,
+         pktbuf_stats.max_stall_time);
+}
 
+static void pktbuf_init(uint level) {
 #if LK_DEBUGLEVEL > 0
-  printf("pktbuf: creating %u pktbuf entries of size %zu (total %zu)\n", PKTBUF_POOL_SIZE,
-         sizeof(struct pktbuf_pool_object), PKTBUF_POOL_SIZE * sizeof(struct pktbuf_pool_object));
+  printf("pktbuf: preallocating %u buffers of size %u, growing up to %u\n", PKTBUF_POOL_SIZE,
+         PKTBUF_SIZE, PKTBUF_POOL_MAX);
 #endif
 
-#if WITH_KERNEL_VM
-  if (vmm_alloc_contiguous(vmm_get_kernel_aspace(), "pktbuf",
-                           PKTBUF_POOL_SIZE * sizeof(struct pktbuf_pool_object), &slab, 0, 0,
-                           ARCH_MMU_FLAG_CACHED) < 0) {
-    printf("Failed to initialize pktbuf hdr slab\n");
+  /* warm the buffer cache so the first packets don't wait on the page allocator */
+  void **bufs = malloc(PKTBUF_POOL_SIZE * sizeof(void *));
+  if (!bufs)
     return;
-  }
-#else
-  slab = memalign(CACHE_LINE, PKTBUF_POOL_SIZE * sizeof(pktbuf_pool_object_t));
-#endif
 
-  pool_init(&pktbuf_pool, sizeof(struct pktbuf_pool_object), CACHE_LINE, PKTBUF_POOL_SIZE, slab);
-  sem_init(&pktbuf_sem, PKTBUF_POOL_SIZE);
+  size_t n = slab_cache_alloc_bulk(&pktbuf_buf_cache, bufs, PKTBUF_POOL_SIZE);
+  if (n < PKTBUF_POOL_SIZE)
+    printf("pktbuf: only preallocated %zu buffers\n", n);
+  slab_cache_free_bulk(&pktbuf_buf_cache, bufs, n);
+
+  free(bufs);
 }
 
 LK_INIT_HOOK(pktbuf, pktbuf_init, LK_INIT_LEVEL_THREADING);
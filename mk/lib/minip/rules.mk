@@ -3,10 +3,9 @@ LOCAL_DIR := $(GET_LOCAL_DIR)
 MODULE := $(LOCAL_DIR)
 
 MODULE_DEPS := \
-	lib/cbuf \
 	lib/iovec \
 	lib/libc \
-	lib/pool
+	lib/slab
 
 MODULE_SRCS += \
 	$(LOCAL_DIR)/arp.c \
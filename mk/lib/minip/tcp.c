@@ -7,7 +7,7 @@
  */
 
 #include <assert.h>
-#include <lib/cbuf.h>
+#include <lib/slab.h>
 #include <platform.h>
 #include <stdlib.h>
 #include <string.h>
@@ -15,7 +15,9 @@
 
 #include <arch/atomic.h>
 #include <arch/ops.h>
+#include <kernel/event.h>
 #include <kernel/mutex.h>
+#include <kernel/poll.h>
 #include <kernel/semaphore.h>
 #include <lk/compiler.h>
 #include <lk/console_cmd.h>
@@ -93,8 +95,9 @@ typedef struct tcp_socket {
   uint32_t rx_win_size;
   uint32_t rx_win_low;
   uint32_t rx_win_high;
-  uint8_t *rx_buffer_raw;
-  cbuf_t rx_buffer;
+  struct list_node rx_queue;  // in order data, as a list of pktbufs
+  uint32_t rx_queue_len;      // bytes in rx_queue
+  uint32_t rx_zc_pending;     // bytes handed out by tcp_read_zc() and not yet released
   event_t rx_event;
   int rx_full_mss_count;  // number of packets we have received in a row with a full mss
   net_timer_t ack_delay_timer;
@@ -111,6 +114,9 @@ typedef struct tcp_socket {
 
   /* listen accept */
   semaphore_t accept_sem;
+
+  /* readiness for poll sets */
+  poll_source_t poll;
   struct tcp_socket *accepted;
 
   net_timer_t time_wait_timer;
@@ -121,6 +127,8 @@ typedef struct tcp_socket {
 
 #define DEFAULT_MSS (1460)
 #define DEFAULT_RX_WINDOW_SIZE (8192)
+/* segments at least this long are queued in the driver's buffer instead of copied */
+#define TCP_RX_COPYBREAK (256)
 #define DEFAULT_TX_BUFFER_SIZE (8192)
 
 #define RETRANSMIT_TIMEOUT (50)
@@ -136,6 +144,8 @@ typedef struct tcp_socket {
 
 static mutex_t tcp_socket_list_lock = MUTEX_INITIAL_VALUE(tcp_socket_list_lock);
 static struct list_node tcp_socket_list = LIST_INITIAL_VALUE(tcp_socket_list);
+static slab_cache_t tcp_socket_cache =
+    SLAB_CACHE_TYPED_INITIAL_VALUE(tcp_socket_cache, "tcp_socket", tcp_socket_t);
 
 static bool tcp_debug = false;
 
@@ -151,7 +161,7 @@ static status_t tcp_send(ipv4_addr dest_ip, uint16_t dest_port, ipv4_addr src_ip
                          uint16_t window_size);
 static status_t tcp_socket_send(tcp_socket_t *s, const void *data, size_t len, tcp_flags_t flags,
                                 const void *options, size_t options_length, uint32_t sequence);
-static void handle_data(tcp_socket_t *s, const void *data, size_t len, uint32_t sequence);
+static bool handle_data(tcp_socket_t *s, pktbuf_t *p, uint32_t sequence);
 static void send_ack(tcp_socket_t *s);
 static void handle_ack(tcp_socket_t *s, uint32_t sequence, uint32_t win_size);
 static void handle_retransmit_timeout(void *_s);
@@ -212,14 +222,47 @@ static void dump_socket(tcp_socket_t *s) {
          tcp_state_to_string(s->state), s->local_ip, s->local_port, s->remote_ip, s->remote_port,
          s->ref);
   if (s->state == STATE_ESTABLISHED || s->state == STATE_CLOSE_WAIT) {
-    printf("\trx: wsize %u wlo %u whi %u (%u)\n", s->rx_win_size, s->rx_win_low, s->rx_win_high,
-           s->rx_win_high - s->rx_win_low);
+    printf("\trx: wsize %u wlo %u whi %u (%u) queued %u zc pending %u\n", s->rx_win_size,
+           s->rx_win_low, s->rx_win_high, s->rx_win_high - s->rx_win_low, s->rx_queue_len,
+           s->rx_zc_pending);
     printf("\ttx: wlo %u whi %u (%u) highest_seq %u (%u) bufsize %u bufoff %u\n", s->tx_win_low,
            s->tx_win_high, s->tx_win_high - s->tx_win_low, s->tx_highest_seq,
            s->tx_highest_seq - s->tx_win_low, s->tx_buffer_size, s->tx_buffer_offset);
   }
 }
 
+/* called with the thread lock held, reads a snapshot of the socket without taking its lock */
+static uint tcp_poll_query(poll_source_t *source) {
+  tcp_socket_t *s = containerof(source, tcp_socket_t, poll);
+
+  uint ready = 0;
+  switch (s->state) {
+    case STATE_LISTEN:
+      if (s->accepted)
+        ready |= POLL_IN;
+      break;
+    case STATE_SYN_SENT:
+    case STATE_SYN_RCVD:
+      break;
+    case STATE_ESTABLISHED:
+    case STATE_CLOSE_WAIT:
+      if (s->tx_buffer_offset < s->tx_buffer_size)
+        ready |= POLL_OUT;
+      if (s->state == STATE_CLOSE_WAIT)
+        ready |= POLL_HUP;
+      break;
+    default:
+      ready |= POLL_HUP;
+      break;
+  }
+
+  /* queued data stays readable after the other end closes */
+  if (s->rx_queue_len > s->rx_zc_pending)
+    ready |= POLL_IN;
+
+  return ready;
+}
+
 static tcp_socket_t *lookup_socket(ipv4_addr remote_ip, ipv4_addr local_ip, uint16_t remote_port,
                                    uint16_t local_port) {
   LTRACEF_LEVEL(2, "remote ip 0x%x local ip 0x%x remote port %u local port %u\n", remote_ip,
@@ -308,11 +351,15 @@ static bool dec_socket_ref(tcp_socket_t *s) {
     event_destroy(&s->tx_event);
     event_destroy(&s->rx_event);
     event_destroy(&s->connect_event);
+    poll_source_destroy(&s->poll);
 
-    free(s->rx_buffer_raw);
+    pktbuf_t *p;
+    while ((p = list_remove_head_type(&s->rx_queue, pktbuf_t, list)) != NULL) {
+      pktbuf_free(p, false);
+    }
     free(s->tx_buffer);
 
-    free(s);
+    slab_cache_free(&tcp_socket_cache, s);
   }
   return (oldval == 1);
 }
@@ -334,7 +381,8 @@ static void tcp_timer_cancel(tcp_socket_t *s, net_timer_t *timer) {
     dec_socket_ref(s);
 }
 
-void tcp_input(pktbuf_t *p, uint32_t src_ip, uint32_t dst_ip) {
+/* returns true if p was queued on a socket, see minip_rx_driver_callback() */
+bool tcp_input(pktbuf_t *p, uint32_t src_ip, uint32_t dst_ip) {
   if (unlikely(tcp_debug))
     TRACEF("p %p (len %u), src_ip 0x%x, dst_ip 0x%x\n", p, p->dlen, src_ip, dst_ip);
 
@@ -342,7 +390,7 @@ void tcp_input(pktbuf_t *p, uint32_t src_ip, uint32_t dst_ip) {
 
   /* reject if too small */
   if (p->dlen < sizeof(tcp_header_t))
-    return;
+    return false;
 
   if (unlikely(tcp_debug) || LOCAL_TRACE) {
     dump_tcp_header(header);
@@ -352,7 +400,7 @@ void tcp_input(pktbuf_t *p, uint32_t src_ip, uint32_t dst_ip) {
   size_t header_len = ((ntohs(header->length_flags) >> 12) & 0xf) * 4;
   if (p->dlen < header_len) {
     TRACEF("REJECT: packet too large for buffer\n");
-    return;
+    return false;
   }
 
   /* checksum */
@@ -370,7 +418,7 @@ void tcp_input(pktbuf_t *p, uint32_t src_ip, uint32_t dst_ip) {
     if (checksum != 0) {
       TRACEF("REJECT: failed checksum, header says 0x%x, we got 0x%x\n", header->checksum,
              checksum);
-      return;
+      return false;
     }
   }
 
@@ -388,6 +436,8 @@ void tcp_input(pktbuf_t *p, uint32_t src_ip, uint32_t dst_ip) {
   size_t data_len = p->dlen - header_len;
   uint32_t highest_sequence = header->seq_num + ((data_len > 0) ? (data_len - 1) : 0);
 
+  bool kept = false;
+
   /* see if it matches a socket we have */
   tcp_socket_t *s = lookup_socket(src_ip, dst_ip, header->source_port, header->dest_port);
   if (!s) {
@@ -452,6 +502,7 @@ void tcp_input(pktbuf_t *p, uint32_t src_ip, uint32_t dst_ip) {
       /* save this socket and wake anyone up that is waiting to accept */
       s->accepted = accept_socket;
       sem_post(&s->accept_sem, true);
+      poll_source_notify(&s->poll, POLL_IN);
 
       /* set up a mss option for sending back */
       tcp_mss_option_t mss_option;
@@ -525,6 +576,7 @@ void tcp_input(pktbuf_t *p, uint32_t src_ip, uint32_t dst_ip) {
       send_ack(s);
 
       event_signal(&s->connect_event, true);
+      poll_source_notify(&s->poll, POLL_OUT);
 
       break;
 
@@ -538,7 +590,7 @@ void tcp_input(pktbuf_t *p, uint32_t src_ip, uint32_t dst_ip) {
 
       if (data_len > 0) {
         LTRACEF("new data, len %zu\n", data_len);
-        handle_data(s, p->data, p->dlen, header->seq_num);
+        kept = handle_data(s, p, header->seq_num);
       }
 
       if ((packet_flags & PKT_FIN) && SEQUENCE_GTE(s->rx_win_low, highest_sequence)) {
@@ -553,6 +605,7 @@ void tcp_input(pktbuf_t *p, uint32_t src_ip, uint32_t dst_ip) {
 
         /* wake up any read waiters */
         event_signal(&s->rx_event, true);
+        poll_source_notify(&s->poll, POLL_IN | POLL_HUP);
       }
       break;
 
@@ -616,9 +669,10 @@ void tcp_input(pktbuf_t *p, uint32_t src_ip, uint32_t dst_ip) {
   }
 
 done:
+  /* once the lock is dropped a reader may free p if it was queued */
   mutex_release(&s->lock);
   dec_socket_ref(s);
-  return;
+  return kept;
 
 send_reset:
   if (s) {
@@ -631,34 +685,86 @@ send_reset:
     tcp_send(src_ip, header->source_port, dst_ip, header->dest_port, NULL, 0, PKT_RST, NULL, 0, 0,
              header->ack_num, 0);
   }
+  return false;
 }
 
-static void handle_data(tcp_socket_t *s, const void *data, size_t len, uint32_t sequence) {
+/*
+ * Queue len bytes of p, starting at offset, on the receive queue. Returns the number of bytes
+ * queued, which is short only if no buffer could be allocated for a copy. Sets *kept if p
+ * itself went on the queue, in which case the driver has given it up for good.
+ */
+static size_t tcp_queue_rx_data(tcp_socket_t *s, pktbuf_t *p, size_t offset, size_t len,
+                                bool *kept) {
+  DEBUG_ASSERT(is_mutex_held(&s->lock));
+
+  /* big segments stay in the buffer the nic received them in */
+  if ((p->flags & PKTBUF_FLAG_DETACHABLE) && len >= TCP_RX_COPYBREAK) {
+    pktbuf_consume(p, offset);
+    pktbuf_consume_tail(p, p->dlen - len);
+    p->flags &= ~PKTBUF_FLAG_DETACHABLE;
+
+    list_add_tail(&s->rx_queue, &p->list);
+    s->rx_queue_len += len;
+    *kept = true;
+    return len;
+  }
+
+  /* copy small ones, packing them behind whatever is at the tail of the queue */
+  const uint8_t *data = p->data + offset;
+  size_t queued = 0;
+  while (queued < len) {
+    pktbuf_t *tail = list_peek_tail_type(&s->rx_queue, pktbuf_t, list);
+    if (!tail || pktbuf_avail_tail(tail) == 0) {
+      /* we're in the driver's rx path, so don't wait on the pool */
+      if (pktbuf_alloc_bulk(&tail, 1) == 0)
+        break;
+      pktbuf_reset(tail, 0);
+      list_add_tail(&s->rx_queue, &tail->list);
+    }
+
+    size_t chunk = MIN(pktbuf_avail_tail(tail), len - queued);
+    pktbuf_append_data(tail, data + queued, chunk);
+    queued += chunk;
+  }
+
+  s->rx_queue_len += queued;
+  return queued;
+}
+
+/* returns true if p was queued on the socket */
+static bool handle_data(tcp_socket_t *s, pktbuf_t *p, uint32_t sequence) {
+  size_t len = p->dlen;
+
   if (unlikely(tcp_debug))
-    TRACEF("data %p, len %zu, sequence %u\n", data, len, sequence);
+    TRACEF("data %p, len %zu, sequence %u\n", p->data, len, sequence);
 
   DEBUG_ASSERT(s);
   DEBUG_ASSERT(is_mutex_held(&s->lock));
-  DEBUG_ASSERT(data);
   DEBUG_ASSERT(len > 0);
 
+  bool kept = false;
+
   /* see if it matches our current window */
   uint32_t sequence_top = sequence + len - 1;
   if (SEQUENCE_LTE(sequence, s->rx_win_low) && SEQUENCE_GTE(sequence_top, s->rx_win_low)) {
     /* it intersects the bottom of our window, so it's in order */
 
-    /* copy the data we need to our cbuf */
+    /* queue the data we need */
     size_t offset = sequence - s->rx_win_low;
     size_t copy_len = MIN(s->rx_win_high - s->rx_win_low, len - offset);
 
     DEBUG_ASSERT(offset < len);
 
-    LTRACEF("copying from offset %zu, len %zu\n", offset, copy_len);
+    LTRACEF("queueing from offset %zu, len %zu\n", offset, copy_len);
 
+    /* if we ran out of buffers only the part we queued is acked, the rest gets resent */
+    copy_len = tcp_queue_rx_data(s, p, offset, copy_len, &kept);
     s->rx_win_low += copy_len;
 
-    cbuf_write(&s->rx_buffer, (uint8_t *)data + offset, copy_len, false);
-    event_signal(&s->rx_event, true);
+    if (copy_len > 0) {
+      event_signal(&s->rx_event, true);
+      poll_source_notify(&s->poll, POLL_IN);
+    }
 
     /* keep a counter if they've been sending a full mss */
     if (copy_len >= s->mss) {
@@ -681,6 +787,8 @@ static void handle_data(tcp_socket_t *s, const void *data, size_t len, uint32_t
     // duplicately ack the last thing we really got
     send_ack(s);
   }
+
+  return kept;
 }
 
 static status_t tcp_socket_send(tcp_socket_t *s, const void *data, size_t len, tcp_flags_t flags,
@@ -692,10 +800,10 @@ static status_t tcp_socket_send(tcp_socket_t *s, const void *data, size_t len, t
   DEBUG_ASSERT((options_length % 4) == 0);
 
   // calculate the new right edge of the rx window
-  uint32_t rx_win_high = s->rx_win_low + s->rx_win_size - cbuf_space_used(&s->rx_buffer) - 1;
+  uint32_t rx_win_high = s->rx_win_low + s->rx_win_size - s->rx_queue_len - 1;
 
-  LTRACEF("rx_win_low %u rx_win_size %u read_buf_len %zu, new win high %u\n", s->rx_win_low,
-          s->rx_win_size, cbuf_space_used(&s->rx_buffer), rx_win_high);
+  LTRACEF("rx_win_low %u rx_win_size %u read_buf_len %u, new win high %u\n", s->rx_win_low,
+          s->rx_win_size, s->rx_queue_len, rx_win_high);
 
   uint16_t win_size;
   if (SEQUENCE_GTE(rx_win_high, s->rx_win_high)) {
@@ -823,6 +931,7 @@ static void handle_ack(tcp_socket_t *s, uint32_t sequence, uint32_t win_size) {
 
     /* we have opened the transmit buffer */
     event_signal(&s->tx_event, true);
+    poll_source_notify(&s->poll, POLL_OUT);
   }
 }
 
@@ -938,6 +1047,7 @@ static void tcp_wakeup_waiters(tcp_socket_t *s) {
   event_signal(&s->rx_event, true);
   event_signal(&s->tx_event, true);
   event_signal(&s->connect_event, true);
+  poll_source_notify(&s->poll, POLL_IN | POLL_OUT | POLL_HUP);
 }
 
 static void tcp_remote_close(tcp_socket_t *s) {
@@ -961,15 +1071,17 @@ static void tcp_remote_close(tcp_socket_t *s) {
 static tcp_socket_t *create_tcp_socket(bool alloc_buffers) {
   tcp_socket_t *s;
 
-  s = calloc(1, sizeof(tcp_socket_t));
+  s = slab_cache_alloc(&tcp_socket_cache);
   if (!s)
     return NULL;
+  memset(s, 0, sizeof(*s));
 
   mutex_init(&s->lock);
   s->ref = 1;  // start with the ref already bumped
 
   s->state = STATE_CLOSED;
   s->rx_win_size = DEFAULT_RX_WINDOW_SIZE;
+  list_initialize(&s->rx_queue);
   event_init(&s->rx_event, false, 0);
 
   s->mss = DEFAULT_MSS;
@@ -981,14 +1093,12 @@ static tcp_socket_t *create_tcp_socket(bool alloc_buffers) {
 
   if (alloc_buffers) {
     // XXX check for error
-    s->rx_buffer_raw = malloc(s->rx_win_size);
-    cbuf_initialize_etc(&s->rx_buffer, s->rx_win_size, s->rx_buffer_raw);
-
     s->tx_buffer_size = DEFAULT_TX_BUFFER_SIZE;
     s->tx_buffer = malloc(s->tx_buffer_size);
   }
 
   sem_init(&s->accept_sem, 0);
+  poll_source_init(&s->poll, &tcp_poll_query);
   event_init(&s->connect_event, false, 0);
 
   return s;
@@ -1107,6 +1217,69 @@ status_t tcp_accept_timeout(tcp_socket_t *listen_socket, tcp_socket_t **accept_s
   return NO_ERROR;
 }
 
+/* block until there is data to read, returns with the socket locked */
+static status_t tcp_wait_rx_data(tcp_socket_t *s) {
+  for (;;) {
+    event_wait(&s->rx_event);
+
+    mutex_acquire(&s->lock);
+
+    /* the data handed out by tcp_read_zc() has to be released first */
+    if (s->rx_zc_pending > 0)
+      return ERR_BUSY;
+
+    /* hand out what is queued, even if we're closed */
+    if (s->rx_queue_len > 0)
+      return NO_ERROR;
+
+    /* check to see if we've closed */
+    if (s->state != STATE_ESTABLISHED)
+      return ERR_CHANNEL_CLOSED;
+
+    /* we must have raced with another thread */
+    event_unsignal(&s->rx_event);
+    mutex_release(&s->lock);
+  }
+}
+
+/*
+ * Remove len bytes from the head of the receive queue, copying them to buf if it isn't NULL.
+ * Buffers are returned to the pool as they empty.
+ */
+static size_t tcp_dequeue_rx_data(tcp_socket_t *s, void *buf, size_t len) {
+  DEBUG_ASSERT(is_mutex_held(&s->lock));
+
+  size_t done = 0;
+  pktbuf_t *p;
+  while (done < len && (p = list_peek_head_type(&s->rx_queue, pktbuf_t, list)) != NULL) {
+    size_t chunk = MIN(p->dlen, len - done);
+    if (buf)
+      memcpy((uint8_t *)buf + done, p->data, chunk);
+    pktbuf_consume(p, chunk);
+    done += chunk;
+
+    if (p->dlen == 0) {
+      list_delete(&p->list);
+      pktbuf_free(p, false);
+    }
+  }
+  s->rx_queue_len -= done;
+
+  /* if we've used up the last byte in the read buffer, unsignal the read event */
+  if (s->state == STATE_ESTABLISHED && s->rx_queue_len == 0) {
+    event_unsignal(&s->rx_event);
+  }
+
+  /* we've read something, make sure the other end knows that our window is opening */
+  uint32_t new_rx_win_size = s->rx_win_size - s->rx_queue_len;
+
+  /* if we've opened it enough, send an ack */
+  if (done > 0 && new_rx_win_size >= s->mss && s->rx_win_high - s->rx_win_low < s->mss)
+    send_ack(s);
+
+  return done;
+}
+
 ssize_t tcp_read(tcp_socket_t *socket, void *buf, size_t len) {
   LTRACEF("socket %p, buf %p, len %zu\n", socket, buf, len);
   if (!socket)
@@ -1119,48 +1292,83 @@ ssize_t tcp_read(tcp_socket_t *socket, void *buf, size_t len) {
   tcp_socket_t *s = socket;
   inc_socket_ref(s);
 
-  ssize_t ret = 0;
-retry:
   /* block on available data */
-  event_wait(&s->rx_event);
+  ssize_t ret = tcp_wait_rx_data(s);
+  if (ret == NO_ERROR) {
+    ret = tcp_dequeue_rx_data(s, buf, len);
+  }
 
-  mutex_acquire(&s->lock);
+  mutex_release(&s->lock);
+  dec_socket_ref(s);
 
-  /* try to read some data from the receive buffer, even if we're closed */
-  ret = cbuf_read(&s->rx_buffer, buf, len, false);
-  if (ret == 0) {
-    /* check to see if we've closed */
-    if (s->state != STATE_ESTABLISHED) {
-      ret = ERR_CHANNEL_CLOSED;
-      goto out;
-    }
+  return ret;
+}
 
-    /* we must have raced with another thread */
-    event_unsignal(&s->rx_event);
-    mutex_release(&s->lock);
-    goto retry;
+ssize_t tcp_read_zc(tcp_socket_t *socket, iovec_t *iov, uint *iov_count, size_t len) {
+  LTRACEF("socket %p, iov %p, len %zu\n", socket, iov, len);
+  if (!socket || !iov || !iov_count || *iov_count == 0)
+    return ERR_INVALID_ARGS;
+  if (len == 0) {
+    *iov_count = 0;
+    return 0;
   }
 
-  /* if we've used up the last byte in the read buffer, unsignal the read event */
-  size_t remaining_bytes = cbuf_space_used(&s->rx_buffer);
-  if (s->state == STATE_ESTABLISHED && remaining_bytes == 0) {
-    event_unsignal(&s->rx_event);
-  }
+  tcp_socket_t *s = socket;
+  inc_socket_ref(s);
 
-  /* we've read something, make sure the other end knows that our window is opening */
-  uint32_t new_rx_win_size = s->rx_win_size - remaining_bytes;
+  /* block on available data */
+  ssize_t ret = tcp_wait_rx_data(s);
+  if (ret == NO_ERROR) {
+    /* point the iovecs straight at the queued buffers */
+    uint count = 0;
+    size_t total = 0;
+    pktbuf_t *p;
+    list_for_every_entry (&s->rx_queue, p, pktbuf_t, list) {
+      if (count == *iov_count || total == len)
+        break;
 
-  /* if we've opened it enough, send an ack */
-  if (new_rx_win_size >= s->mss && s->rx_win_high - s->rx_win_low < s->mss)
-    send_ack(s);
+      size_t chunk = MIN(p->dlen, len - total);
+      iov[count].iov_base = p->data;
+      iov[count].iov_len = chunk;
+      count++;
+      total += chunk;
+    }
+
+    *iov_count = count;
+    s->rx_zc_pending = total;
+    ret = total;
+  }
 
-out:
   mutex_release(&s->lock);
   dec_socket_ref(s);
 
   return ret;
 }
 
+status_t tcp_read_zc_release(tcp_socket_t *socket, size_t len) {
+  LTRACEF("socket %p, len %zu\n", socket, len);
+  if (!socket)
+    return ERR_INVALID_ARGS;
+
+  tcp_socket_t *s = socket;
+  mutex_acquire(&s->lock);
+
+  status_t err = NO_ERROR;
+  if (len > s->rx_zc_pending) {
+    err = ERR_INVALID_ARGS;
+  } else {
+    /* whatever wasn't consumed stays queued for the next read */
+    s->rx_zc_pending = 0;
+    tcp_dequeue_rx_data(s, NULL, len);
+    if (s->rx_queue_len > 0)
+      poll_source_notify(&s->poll, POLL_IN);
+  }
+
+  mutex_release(&s->lock);
+
+  return err;
+}
+
 ssize_t tcp_write(tcp_socket_t *socket, const void *buf, size_t len) {
   LTRACEF("socket %p, buf %p, len %zu\n", socket, buf, len);
   if (!socket)
@@ -1221,6 +1429,8 @@ ssize_t tcp_write(tcp_socket_t *socket, const void *buf, size_t len) {
   return len;
 }
 
+poll_source_t *tcp_poll_source(tcp_socket_t *socket) { return &socket->poll; }
+
 status_t tcp_close(tcp_socket_t *socket) {
   if (!socket)
     return ERR_INVALID_ARGS;
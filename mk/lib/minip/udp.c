@@ -13,6 +13,7 @@
 #include <malloc.h>
 #include <stdint.h>
 
+#include <kernel/poll.h>
 #include <lk/err.h>
 #include <lk/list.h>
 #include <lk/trace.h>
@@ -35,6 +36,7 @@ typedef struct udp_socket {
   uint16_t sport;
   uint16_t dport;
   const uint8_t *mac;
+  poll_source_t poll;
 } udp_socket_t;
 
 typedef struct udp_hdr {
@@ -70,6 +72,8 @@ int udp_listen(uint16_t port, udp_callback_t cb, void *arg) {
   return 0;
 }
 
+static uint udp_poll_query(poll_source_t *source) { return POLL_OUT; }
+
 status_t udp_open(uint32_t host, uint16_t sport, uint16_t dport, udp_socket_t **handle) {
   LTRACEF("host %u.%u.%u.%u sport %u dport %u handle %p\n", IPV4_SPLIT(host), sport, dport, handle);
   udp_socket_t *socket;
@@ -94,6 +98,7 @@ status_t udp_open(uint32_t host, uint16_t sport, uint16_t dport, udp_socket_t **
   socket->sport = sport;
   socket->dport = dport;
   socket->mac = dst_mac;
+  poll_source_init(&socket->poll, &udp_poll_query);
 
   *handle = socket;
 
@@ -105,10 +110,13 @@ status_t udp_close(udp_socket_t *handle) {
     return -EINVAL;
   }
 
+  poll_source_destroy(&handle->poll);
   free(handle);
   return NO_ERROR;
 }
 
+poll_source_t *udp_poll_source(udp_socket_t *handle) { return &handle->poll; }
+
 status_t udp_send_iovec(const iovec_t *iov, uint iov_count, udp_socket_t *handle) {
   pktbuf_t *p;
   struct eth_hdr *eth;
@@ -0,0 +1,192 @@
+/**
+ * A kmem_cache style slab allocator.
+ *
+ * A slab cache hands out objects of a single fixed size and alignment carved out of naturally
+ * aligned runs of pages obtained from the page allocator. Each slab starts with a small header, so
+ * the owning slab of any object is found by rounding its address down to the slab size, and freeing
+ * never has to search.
+ *
+ * Every cache keeps a small per-cpu magazine of free objects in front of the slab lists. Allocation
+ * and freeing only touch the local magazine in the common case; the shared cache lock is taken once
+ * per half a magazine when it has to be refilled or flushed.
+ *
+ * If a constructor is supplied it is run once per object when a slab is created, and the object is
+ * expected to be handed back to the cache in its constructed state. The free list link is kept after
+ * the object in that case so the constructed state survives while the object sits in the cache.
+ *
+ * Completely free slabs are kept until slab_reclaim() (or slab_cache_reclaim()) returns them to the
+ * page allocator. page_alloc() calls slab_reclaim() on its own before failing a request.
+ *
+ * Typical usage:
+ *
+ * static slab_cache_t foo_cache = SLAB_CACHE_TYPED_INITIAL_VALUE(foo_cache, "foo", foo_t);
+ *
+ * foo_t *foo = slab_cache_alloc(&foo_cache);
+ * if (!foo) {
+ *   // Handle allocation failure.
+ * } else {
+ *   ...
+ *   slab_cache_free(&foo_cache, foo);
+ * }
+ *
+ * slab_cache_free() never blocks and may be called with interrupts disabled or spinlocks held.
+ * slab_cache_alloc() only blocks when the cache has to grow, which must happen in thread context.
+ */
+#pragma once
+
+#include <arch/defines.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <kernel/spinlock.h>
+#include <lk/compiler.h>
+#include <lk/list.h>
+
+__BEGIN_CDECLS
+
+#define SLAB_MAGAZINE_SIZE 16
+
+/**
+ * Object constructor, run once per object when its slab is created.
+ */
+typedef void (*slab_ctor_t)(void *object, void *arg);
+
+struct slab_magazine {
+  spin_lock_t lock;
+  uint count;
+  void *objects[SLAB_MAGAZINE_SIZE];
+
+  // stats
+  uint64_t hits;
+  uint64_t misses;
+};
+
+/**
+ * Slab cache type.
+ */
+typedef struct slab_cache {
+  // Private:
+  struct list_node node;
+  const char *name;
+  size_t object_size;
+  size_t align;
+  slab_ctor_t ctor;
+  void *ctor_arg;
+
+  spin_lock_t lock;
+  struct list_node partial_list;  // slabs with at least one free object, fully used first
+  struct list_node full_list;     // slabs with no free objects
+  void *delayed_free;
+
+  // computed on the first grow
+  size_t stride;
+  size_t first_offset;
+  size_t link_offset;
+  uint objects_per_slab;
+  uint slab_pages;
+
+  // stats
+  uint slab_count;
+  size_t free_objects;
+  uint64_t grows;
+  uint64_t reclaimed_pages;
+
+  struct slab_magazine magazines[SMP_MAX_CPUS];
+} slab_cache_t;
+
+/**
+ * Static initializer for a slab cache.
+ *
+ * @param cache The variable being initialized.
+ * @param name Name of the cache, for diagnostics.
+ * @param size Object size.
+ * @param align Object alignment, 0 for pointer alignment.
+ * @param ctor Optional object constructor.
+ * @param arg Argument passed to the constructor.
+ */
+#define SLAB_CACHE_INITIAL_VALUE(cache, _name, size, _align, _ctor, arg)                       \
+  {                                                                                             \
+    .node = LIST_INITIAL_CLEARED_VALUE, .name = (_name), .object_size = (size),                 \
+    .align = (_align), .ctor = (_ctor), .ctor_arg = (arg), .lock = SPIN_LOCK_INITIAL_VALUE,     \
+    .partial_list = LIST_INITIAL_VALUE((cache).partial_list),                                   \
+    .full_list = LIST_INITIAL_VALUE((cache).full_list),                                         \
+  }
+
+/**
+ * Static initializer for a slab cache of a given type, with no constructor.
+ */
+#define SLAB_CACHE_TYPED_INITIAL_VALUE(cache, name, type) \
+  SLAB_CACHE_INITIAL_VALUE(cache, name, sizeof(type), __alignof__(type), NULL, NULL)
+
+/**
+ * Initialize a slab cache at runtime.
+ *
+ * Arguments are the same as for SLAB_CACHE_INITIAL_VALUE().
+ *
+ * @return ERR_INVALID_ARGS if the object is too big for a slab, NO_ERROR otherwise.
+ */
+status_t slab_cache_init(slab_cache_t *cache, const char *name, size_t size, size_t align,
+                         slab_ctor_t ctor, void *arg);
+
+/**
+ * Release all memory held by a slab cache.
+ *
+ * All objects must have been freed back to the cache.
+ */
+void slab_cache_destroy(slab_cache_t *cache);
+
+/**
+ * Allocate an object.
+ *
+ * @return The object, or NULL if out of memory or the object is too big for a slab. The contents
+ * are undefined unless the cache has a constructor, in which case the object is in the state it was
+ * freed in.
+ */
+void *slab_cache_alloc(slab_cache_t *cache);
+
+/**
+ * Return an object to its cache.
+ */
+void slab_cache_free(slab_cache_t *cache, void *object);
+
+/**
+ * Allocate up to count objects with a single pass over the local magazine and the slab lists.
+ *
+ * Same context rules as slab_cache_alloc().
+ *
+ * @return The number of objects stored in objects, less than count only if out of memory.
+ */
+size_t slab_cache_alloc_bulk(slab_cache_t *cache, void **objects, size_t count);
+
+/**
+ * Return count objects to their cache, taking the cache lock at most once.
+ */
+void slab_cache_free_bulk(slab_cache_t *cache, void **objects, size_t count);
+
+/**
+ * Return an object to its cache at a later time.
+ *
+ * For callers that cannot touch the per-cpu magazines, such as a thread freeing its own structure
+ * in the middle of a context switch. The object is handed back on the next slow path allocation or
+ * reclaim.
+ */
+void slab_cache_delayed_free(slab_cache_t *cache, void *object);
+
+/**
+ * Flush the per-cpu magazines of a cache and release its empty slabs.
+ *
+ * @return The number of pages returned to the page allocator.
+ */
+size_t slab_cache_reclaim(slab_cache_t *cache);
+
+/**
+ * Run slab_cache_reclaim() on every cache in the system.
+ *
+ * @return The number of pages returned to the page allocator.
+ */
+size_t slab_reclaim(void);
+
+void slab_dump(void);
+
+__END_CDECLS
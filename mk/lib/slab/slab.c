@@ -0,0 +1,505 @@
+// Copyright 2025 Mist Tecnologia Ltda. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <assert.h>
+#include <inttypes.h>
+#include <lib/page_alloc.h>
+#include <lib/slab.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <arch/ops.h>
+#include <kernel/mutex.h>
+#include <kernel/spinlock.h>
+#include <lk/console_cmd.h>
+#include <lk/debug.h>
+#include <lk/err.h>
+#include <lk/trace.h>
+
+#define LOCAL_TRACE 0
+
+// a slab is grown until it holds at least this many objects, up to SLAB_MAX_PAGES
+#define SLAB_MIN_OBJECTS 8
+#define SLAB_MAX_PAGES 16
+
+// an object too big for a SLAB_MAX_PAGES slab gets one just big enough, up to this many pages
+#define SLAB_MAX_LARGE_PAGES 256
+
+// header at the start of every slab
+struct slab {
+  struct list_node node;
+  slab_cache_t *cache;
+  void *free_list;
+  uint inuse;
+};
+
+static struct list_node slab_cache_list = LIST_INITIAL_VALUE(slab_cache_list);
+static mutex_t slab_cache_list_lock = MUTEX_INITIAL_VALUE(slab_cache_list_lock);
+
+static inline void **obj_link(slab_cache_t *cache, void *obj) {
+  return (void **)((uint8_t *)obj + cache->link_offset);
+}
+
+static inline size_t slab_bytes(slab_cache_t *cache) { return (size_t)cache->slab_pages * PAGE_SIZE; }
+
+static inline struct slab *obj_to_slab(slab_cache_t *cache, void *obj) {
+  return (struct slab *)ROUNDDOWN((uintptr_t)obj, slab_bytes(cache));
+}
+
+// work out the slab geometry, called with the cache lock held
+static status_t slab_cache_setup_locked(slab_cache_t *cache) {
+  if (cache->objects_per_slab) {
+    return NO_ERROR;
+  }
+
+  // keeps the rounding below from overflowing
+  if (cache->object_size > SLAB_MAX_LARGE_PAGES * PAGE_SIZE ||
+      cache->align > SLAB_MAX_LARGE_PAGES * PAGE_SIZE) {
+    return ERR_INVALID_ARGS;
+  }
+
+  size_t align = MAX(cache->align, sizeof(void *));
+  size_t size = MAX(cache->object_size, sizeof(void *));
+
+  // a constructed object keeps its state while free, so the free list link goes after it
+  cache->link_offset = cache->ctor ? ROUNDUP(size, sizeof(void *)) : 0;
+  cache->stride = ROUNDUP(cache->ctor ? cache->link_offset + sizeof(void *) : size, align);
+  cache->first_offset = ROUNDUP(sizeof(struct slab), align);
+
+  uint pages = 1;
+  while (pages < SLAB_MAX_PAGES &&
+         (pages * PAGE_SIZE - cache->first_offset) / cache->stride < SLAB_MIN_OBJECTS) {
+    pages *= 2;
+  }
+  // slabs stay a power of two in size, objects are found from them by rounding down
+  while (pages < SLAB_MAX_LARGE_PAGES && pages * PAGE_SIZE < cache->first_offset + cache->stride) {
+    pages *= 2;
+  }
+  if (pages * PAGE_SIZE < cache->first_offset + cache->stride) {
+    return ERR_INVALID_ARGS;
+  }
+
+  cache->slab_pages = pages;
+  cache->objects_per_slab = (pages * PAGE_SIZE - cache->first_offset) / cache->stride;
+
+  LTRACEF("cache %s: size %zu stride %zu pages %u objects %u\n", cache->name, cache->object_size,
+          cache->stride, cache->slab_pages, cache->objects_per_slab);
+  return NO_ERROR;
+}
+
+// take an object off the slab lists, called with the cache lock held
+static void *slab_take_locked(slab_cache_t *cache) {
+  struct slab *slab = list_peek_head_type(&cache->partial_list, struct slab, node);
+  if (!slab) {
+    return NULL;
+  }
+
+  void *obj = slab->free_list;
+  slab->free_list = *obj_link(cache, obj);
+  slab->inuse++;
+  cache->free_objects--;
+
+  if (!slab->free_list) {
+    list_delete(&slab->node);
+    list_add_head(&cache->full_list, &slab->node);
+  }
+  return obj;
+}
+
+// put an object back on its slab, called with the cache lock held
+static void slab_put_locked(slab_cache_t *cache, void *obj) {
+  struct slab *slab = obj_to_slab(cache, obj);
+  DEBUG_ASSERT(slab->cache == cache);
+  DEBUG_ASSERT(slab->inuse > 0);
+
+  if (!slab->free_list) {
+    // was full, allocate from it next
+    list_delete(&slab->node);
+    list_add_head(&cache->partial_list, &slab->node);
+  }
+
+  *obj_link(cache, obj) = slab->free_list;
+  slab->free_list = obj;
+  slab->inuse--;
+  cache->free_objects++;
+
+  if (slab->inuse == 0) {
+    // completely free slabs go to the back so they can be reclaimed
+    list_delete(&slab->node);
+    list_add_tail(&cache->partial_list, &slab->node);
+  }
+}
+
+static void slab_drain_delayed_locked(slab_cache_t *cache) {
+  while (cache->delayed_free) {
+    void *obj = cache->delayed_free;
+    cache->delayed_free = *obj_link(cache, obj);
+    slab_put_locked(cache, obj);
+  }
+}
+
+static void slab_register(slab_cache_t *cache) {
+  if (likely(list_in_list(&cache->node))) {
+    return;
+  }
+
+  mutex_acquire(&slab_cache_list_lock);
+  if (!list_in_list(&cache->node)) {
+    list_add_tail(&slab_cache_list, &cache->node);
+  }
+  mutex_release(&slab_cache_list_lock);
+}
+
+// allocate a naturally aligned run of pages
+static void *slab_page_alloc(uint pages) {
+  if (pages == 1) {
+    return page_alloc(1, PAGE_ALLOC_ANY_ARENA);
+  }
+
+  // over allocate and trim the head and tail
+  size_t bytes = (size_t)pages * PAGE_SIZE;
+  size_t count = pages * 2 - 1;
+  uint8_t *base = page_alloc(count, PAGE_ALLOC_ANY_ARENA);
+  if (!base) {
+    return NULL;
+  }
+
+  uint8_t *aligned = (uint8_t *)ROUNDUP((uintptr_t)base, bytes);
+  size_t head = (aligned - base) / PAGE_SIZE;
+  size_t tail = count - head - pages;
+  if (head) {
+    page_free(base, head);
+  }
+  if (tail) {
+    page_free(aligned + bytes, tail);
+  }
+  return aligned;
+}
+
+static status_t slab_grow(slab_cache_t *cache) {
+  spin_lock_saved_state_t state;
+  spin_lock_irqsave(&cache->lock, state);
+  status_t err = slab_cache_setup_locked(cache);
+  spin_unlock_irqrestore(&cache->lock, state);
+  if (err < 0) {
+    return err;
+  }
+
+  slab_register(cache);
+
+  uint8_t *base = slab_page_alloc(cache->slab_pages);
+  if (!base) {
+    return ERR_NO_MEMORY;
+  }
+
+  struct slab *slab = (struct slab *)base;
+  slab->cache = cache;
+  slab->free_list = NULL;
+  slab->inuse = 0;
+
+  // build the free list back to front so objects are handed out in address order
+  for (int i = (int)cache->objects_per_slab - 1; i >= 0; i--) {
+    void *obj = base + cache->first_offset + i * cache->stride;
+    if (cache->ctor) {
+      cache->ctor(obj, cache->ctor_arg);
+    }
+    *obj_link(cache, obj) = slab->free_list;
+    slab->free_list = obj;
+  }
+
+  spin_lock_irqsave(&cache->lock, state);
+  list_add_head(&cache->partial_list, &slab->node);
+  cache->slab_count++;
+  cache->free_objects += cache->objects_per_slab;
+  cache->grows++;
+  spin_unlock_irqrestore(&cache->lock, state);
+
+  LTRACEF("cache %s: new slab %p\n", cache->name, slab);
+
+  return NO_ERROR;
+}
+
+static struct slab_magazine *magazine_lock(slab_cache_t *cache, spin_lock_saved_state_t *state) {
+  arch_interrupt_save(state, SPIN_LOCK_FLAG_INTERRUPTS);
+  struct slab_magazine *mag = &cache->magazines[arch_curr_cpu_num()];
+  spin_lock(&mag->lock);
+  return mag;
+}
+
+static void magazine_unlock(struct slab_magazine *mag, spin_lock_saved_state_t state) {
+  spin_unlock_restore(&mag->lock, state, SPIN_LOCK_FLAG_INTERRUPTS);
+}
+
+status_t slab_cache_init(slab_cache_t *cache, const char *name, size_t size, size_t align,
+                         slab_ctor_t ctor, void *arg) {
+  memset(cache, 0, sizeof(*cache));
+  cache->name = name;
+  cache->object_size = size;
+  cache->align = align;
+  cache->ctor = ctor;
+  cache->ctor_arg = arg;
+  spin_lock_init(&cache->lock);
+  list_initialize(&cache->partial_list);
+  list_initialize(&cache->full_list);
+  for (uint i = 0; i < SMP_MAX_CPUS; i++) {
+    spin_lock_init(&cache->magazines[i].lock);
+  }
+
+  // nobody else can see the cache yet
+  return slab_cache_setup_locked(cache);
+}
+
+void slab_cache_destroy(slab_cache_t *cache) {
+  slab_cache_reclaim(cache);
+
+  DEBUG_ASSERT(list_is_empty(&cache->partial_list));
+  DEBUG_ASSERT(list_is_empty(&cache->full_list));
+
+  mutex_acquire(&slab_cache_list_lock);
+  if (list_in_list(&cache->node)) {
+    list_delete(&cache->node);
+  }
+  mutex_release(&slab_cache_list_lock);
+}
+
+void *slab_cache_alloc(slab_cache_t *cache) {
+  for (;;) {
+    spin_lock_saved_state_t state;
+    struct slab_magazine *mag = magazine_lock(cache, &state);
+    if (likely(mag->count > 0)) {
+      void *obj = mag->objects[--mag->count];
+      mag->hits++;
+      magazine_unlock(mag, state);
+      return obj;
+    }
+    mag->misses++;
+
+    // refill half the magazine while holding the cache lock
+    spin_lock(&cache->lock);
+    slab_drain_delayed_locked(cache);
+    void *obj = slab_take_locked(cache);
+    if (obj) {
+      while (mag->count < SLAB_MAGAZINE_SIZE / 2) {
+        void *extra = slab_take_locked(cache);
+        if (!extra) {
+          break;
+        }
+        mag->objects[mag->count++] = extra;
+      }
+    }
+    spin_unlock(&cache->lock);
+    magazine_unlock(mag, state);
+
+    if (obj) {
+      return obj;
+    }
+
+    // growing goes to the page allocator, which may block
+    DEBUG_ASSERT(!arch_ints_disabled());
+    if (slab_grow(cache) < 0) {
+      return NULL;
+    }
+  }
+}
+
+void slab_cache_free(slab_cache_t *cache, void *object) {
+  if (!object) {
+    return;
+  }
+  DEBUG_ASSERT(obj_to_slab(cache, object)->cache == cache);
+
+  spin_lock_saved_state_t state;
+  struct slab_magazine *mag = magazine_lock(cache, &state);
+  if (unlikely(mag->count == SLAB_MAGAZINE_SIZE)) {
+    // flush the older half back to the slabs
+    spin_lock(&cache->lock);
+    for (uint i = 0; i < SLAB_MAGAZINE_SIZE / 2; i++) {
+      slab_put_locked(cache, mag->objects[i]);
+    }
+    memmove(&mag->objects[0], &mag->objects[SLAB_MAGAZINE_SIZE / 2],
+            sizeof(void *) * (SLAB_MAGAZINE_SIZE / 2));
+    mag->count -= SLAB_MAGAZINE_SIZE / 2;
+    spin_unlock(&cache->lock);
+  }
+  mag->objects[mag->count++] = object;
+  magazine_unlock(mag, state);
+}
+
+size_t slab_cache_alloc_bulk(slab_cache_t *cache, void **objects, size_t count) {
+  size_t n = 0;
+  for (;;) {
+    spin_lock_saved_state_t state;
+    struct slab_magazine *mag = magazine_lock(cache, &state);
+    while (n < count && mag->count > 0) {
+      objects[n++] = mag->objects[--mag->count];
+      mag->hits++;
+    }
+    if (n < count) {
+      // take the rest straight off the slabs, the magazine is for single objects
+      mag->misses++;
+      spin_lock(&cache->lock);
+      slab_drain_delayed_locked(cache);
+      while (n < count) {
+        void *obj = slab_take_locked(cache);
+        if (!obj) {
+          break;
+        }
+        objects[n++] = obj;
+      }
+      spin_unlock(&cache->lock);
+    }
+    magazine_unlock(mag, state);
+
+    if (n == count) {
+      return n;
+    }
+
+    DEBUG_ASSERT(!arch_ints_disabled());
+    if (slab_grow(cache) < 0) {
+      return n;
+    }
+  }
+}
+
+void slab_cache_free_bulk(slab_cache_t *cache, void **objects, size_t count) {
+  spin_lock_saved_state_t state;
+  struct slab_magazine *mag = magazine_lock(cache, &state);
+  size_t n = 0;
+  while (n < count && mag->count < SLAB_MAGAZINE_SIZE) {
+    DEBUG_ASSERT(obj_to_slab(cache, objects[n])->cache == cache);
+    mag->objects[mag->count++] = objects[n++];
+  }
+  if (n < count) {
+    // the magazine is full, the remainder goes back to the slabs
+    spin_lock(&cache->lock);
+    while (n < count) {
+      slab_put_locked(cache, objects[n++]);
+    }
+    spin_unlock(&cache->lock);
+  }
+  magazine_unlock(mag, state);
+}
+
+void slab_cache_delayed_free(slab_cache_t *cache, void *object) {
+  DEBUG_ASSERT(object);
+  DEBUG_ASSERT(obj_to_slab(cache, object)->cache == cache);
+
+  spin_lock_saved_state_t state;
+  spin_lock_irqsave(&cache->lock, state);
+  *obj_link(cache, object) = cache->delayed_free;
+  cache->delayed_free = object;
+  spin_unlock_irqrestore(&cache->lock, state);
+}
+
+size_t slab_cache_reclaim(slab_cache_t *cache) {
+  spin_lock_saved_state_t state;
+
+  // give everything sitting in the magazines back to the slabs
+  for (uint i = 0; i < SMP_MAX_CPUS; i++) {
+    struct slab_magazine *mag = &cache->magazines[i];
+    spin_lock_irqsave(&mag->lock, state);
+    spin_lock(&cache->lock);
+    while (mag->count > 0) {
+      slab_put_locked(cache, mag->objects[--mag->count]);
+    }
+    spin_unlock(&cache->lock);
+    spin_unlock_irqrestore(&mag->lock, state);
+  }
+
+  // pull the empty slabs off the tail of the partial list
+  struct list_node empty = LIST_INITIAL_VALUE(empty);
+  spin_lock_irqsave(&cache->lock, state);
+  slab_drain_delayed_locked(cache);
+  struct slab *slab;
+  while ((slab = list_peek_tail_type(&cache->partial_list, struct slab, node)) &&
+         slab->inuse == 0) {
+    list_delete(&slab->node);
+    list_add_head(&empty, &slab->node);
+    cache->slab_count--;
+    cache->free_objects -= cache->objects_per_slab;
+  }
+  spin_unlock_irqrestore(&cache->lock, state);
+
+  size_t pages = 0;
+  while ((slab = list_remove_head_type(&empty, struct slab, node))) {
+    page_free(slab, cache->slab_pages);
+    pages += cache->slab_pages;
+  }
+
+  if (pages) {
+    spin_lock_irqsave(&cache->lock, state);
+    cache->reclaimed_pages += pages;
+    spin_unlock_irqrestore(&cache->lock, state);
+    LTRACEF("cache %s: reclaimed %zu pages\n", cache->name, pages);
+  }
+
+  return pages;
+}
+
+size_t slab_reclaim(void) {
+  size_t pages = 0;
+
+  mutex_acquire(&slab_cache_list_lock);
+  slab_cache_t *cache;
+  list_for_every_entry(&slab_cache_list, cache, slab_cache_t, node) {
+    pages += slab_cache_reclaim(cache);
+  }
+  mutex_release(&slab_cache_list_lock);
+
+  return pages;
+}
+
+void slab_dump(void) {
+  printf("%-16s %6s %6s %5s %7s %7s %8s %10s %10s\n", "cache", "size", "stride", "pages",
+         "slabs", "free", "grows", "hits", "misses");
+
+  mutex_acquire(&slab_cache_list_lock);
+  slab_cache_t *cache;
+  list_for_every_entry(&slab_cache_list, cache, slab_cache_t, node) {
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    size_t cached = 0;
+    for (uint i = 0; i < SMP_MAX_CPUS; i++) {
+      hits += cache->magazines[i].hits;
+      misses += cache->magazines[i].misses;
+      cached += cache->magazines[i].count;
+    }
+    printf("%-16s %6zu %6zu %5u %7u %7zu %8" PRIu64 " %10" PRIu64 " %10" PRIu64 "\n", cache->name,
+           cache->object_size, cache->stride, cache->slab_pages, cache->slab_count,
+           cache->free_objects + cached, cache->grows, hits, misses);
+  }
+  mutex_release(&slab_cache_list_lock);
+}
+
+#if LK_DEBUGLEVEL > 1
+
+static int cmd_slab(int argc, const cmd_args *argv, uint32_t flags);
+
+STATIC_COMMAND_START
+STATIC_COMMAND("slab", "slab allocator debug commands", &cmd_slab)
+STATIC_COMMAND_END(slab);
+
+static int cmd_slab(int argc, const cmd_args *argv, uint32_t flags) {
+  if (argc < 2) {
+  usage:
+    printf("usage:\n");
+    printf("\t%s info\n", argv[0].str);
+    printf("\t%s reclaim\n", argv[0].str);
+    return -1;
+  }
+
+  if (strcmp(argv[1].str, "info") == 0) {
+    slab_dump();
+  } else if (strcmp(argv[1].str, "reclaim") == 0) {
+    size_t pages = slab_reclaim();
+    printf("reclaimed %zu pages\n", pages);
+  } else {
+    printf("unrecognized command\n");
+    goto usage;
+  }
+
+  return 0;
+}
+
+#endif
@@ -11,6 +11,7 @@
 
 #include <arch/ops.h>
 #include <arch/x86.h>
+#include <kernel/ktrace.h>
 #include <kernel/spinlock.h>
 #include <kernel/thread.h>
 #include <lk/debug.h>
@@ -104,6 +105,8 @@ enum handler_return platform_irq(x86_iframe_t *frame) {
 
   struct int_vector *handler = &int_table[vector];
 
+  KTRACE_IRQ_ENTER(vector);
+
   // edge triggered interrupts are acked beforehand
   if (handler->flags.edge) {
     if (handler->flags.type == INTC_TYPE_MSI) {
@@ -128,6 +131,8 @@ enum handler_return platform_irq(x86_iframe_t *frame) {
     }
   }
 
+  KTRACE_IRQ_EXIT(vector);
+
   return ret;
 }
 
@@ -180,13 +185,21 @@ status_t platform_allocate_interrupts(size_t count, uint align_log2, bool msi,
   spin_lock_saved_state_t state;
   spin_lock_irqsave(&lock, state);
 
-  // find a free interrupt
+  // find a run of free interrupts
   status_t err = ERR_NOT_FOUND;
+  unsigned int run = 0;
   for (unsigned int i = 0; i < INT_VECTORS; i++) {
-    if (!int_table[i].flags.allocated) {
-      int_table[i].flags.allocated = true;
-      *vector = i;
-      LTRACEF("found irq %#x\n", i);
+    if (int_table[i].flags.allocated) {
+      run = 0;
+      continue;
+    }
+    if (++run == count) {
+      unsigned int base = i + 1 - count;
+      for (unsigned int j = base; j <= i; j++) {
+        int_table[j].flags.allocated = true;
+      }
+      *vector = base;
+      LTRACEF("found irq %#x\n", base);
       err = NO_ERROR;
       break;
     }
@@ -197,6 +210,26 @@ status_t platform_allocate_interrupts(size_t count, uint align_log2, bool msi,
   return err;
 }
 
+status_t platform_free_interrupts(unsigned int vector, size_t count) {
+  LTRACEF("vector %#x count %zu\n", vector, count);
+  if (vector >= INT_VECTORS || count > INT_VECTORS - vector) {
+    return ERR_INVALID_ARGS;
+  }
+
+  spin_lock_saved_state_t state;
+  spin_lock_irqsave(&lock, state);
+
+  for (unsigned int i = vector; i < vector + count; i++) {
+    int_table[i].handler = NULL;
+    int_table[i].arg = NULL;
+    int_table[i].flags.allocated = false;
+  }
+
+  spin_unlock_irqrestore(&lock, state);
+
+  return NO_ERROR;
+}
+
 status_t platform_compute_msi_values(unsigned int vector, unsigned int cpu, bool edge,
                                      uint64_t *msi_address_out, uint16_t *msi_data_out) {
   // only handle edge triggered at the moment
@@ -0,0 +1,134 @@
+/*
+ * Copyright (c) 2025 Mist Tecnologia Ltda
+ *
+ * Use of this source code is governed by a MIT-style
+ * license that can be found in the LICENSE file or at
+ * https://opensource.org/licenses/MIT
+ */
+
+#include <inttypes.h>
+#include <lib/acpi_lite.h>
+#include <stdio.h>
+
+#include <arch/x86/feature.h>
+#include <kernel/vm.h>
+#include <lk/debug.h>
+#include <lk/trace.h>
+
+#include "platform_p.h"
+
+#define LOCAL_TRACE 0
+
+/*
+ * NUMA topology out of the ACPI SRAT and SLIT. Proximity domains are sparse 32
+ * bit numbers, they get pmm node numbers in the order they show up, memory
+ * first so that a machine that is not NUMA stays all on node 0.
+ */
+static uint32_t domains[PMM_MAX_NUMA_NODES];
+static uint domain_count;
+static uint32_t boot_apic_id;
+
+static int find_node(uint32_t domain) {
+  for (uint i = 0; i < domain_count; i++) {
+    if (domains[i] == domain)
+      return i;
+  }
+  return -1;
+}
+
+static int domain_to_node(uint32_t domain) {
+  int node = find_node(domain);
+  if (node < 0 && domain_count < countof(domains)) {
+    domains[domain_count] = domain;
+    node = domain_count++;
+  }
+  if (node < 0)
+    printf("PC: NUMA proximity domain %u over the limit of %u nodes, ignored\n", domain,
+           PMM_MAX_NUMA_NODES);
+  return node;
+}
+
+static void memory_affinity_callback(const void *_entry, size_t entry_len) {
+  const struct acpi_srat_memory_affinity_entry *entry = _entry;
+  if (!(entry->flags & ACPI_SRAT_FLAG_ENABLED))
+    return;
+
+  uint64_t base = ((uint64_t)entry->base_address_high << 32) | entry->base_address_low;
+  uint64_t length = ((uint64_t)entry->length_high << 32) | entry->length_low;
+  int node = domain_to_node(entry->proximity_domain);
+  if (node < 0 || length == 0)
+    return;
+
+  dprintf(INFO, "PC: NUMA memory [%#" PRIx64 ", %#" PRIx64 "] domain %u node %d\n", base,
+          base + length - 1, entry->proximity_domain, node);
+  pmm_set_numa_node(base, length, node);
+}
+
+/* only the boot cpu runs on this platform, the other entries just name nodes */
+static void set_cpu_node(uint32_t apic_id, uint32_t domain) {
+  int node = domain_to_node(domain);
+  LTRACEF("apic id %u domain %u node %d\n", apic_id, domain, node);
+  if (node >= 0 && apic_id == boot_apic_id)
+    pmm_set_cpu_numa_node(0, node);
+}
+
+static void processor_affinity_callback(const void *_entry, size_t entry_len) {
+  const struct acpi_srat_processor_affinity_entry *entry = _entry;
+  if (!(entry->flags & ACPI_SRAT_FLAG_ENABLED))
+    return;
+
+  uint32_t domain = entry->proximity_domain_low | (entry->proximity_domain_high[0] << 8) |
+                    (entry->proximity_domain_high[1] << 16) |
+                    ((uint32_t)entry->proximity_domain_high[2] << 24);
+  set_cpu_node(entry->apic_id, domain);
+}
+
+static void x2apic_affinity_callback(const void *_entry, size_t entry_len) {
+  const struct acpi_srat_processor_x2apic_affinity_entry *entry = _entry;
+  if (!(entry->flags & ACPI_SRAT_FLAG_ENABLED))
+    return;
+
+  set_cpu_node(entry->x2apic_id, entry->proximity_domain);
+}
+
+static void parse_slit(void) {
+  const struct acpi_slit_table *slit = (const void *)acpi_get_table_by_sig(ACPI_SLIT_SIG);
+  if (!slit)
+    return;
+
+  uint64_t count = slit->locality_count;
+  if (slit->header.length < sizeof(*slit) + count * count) {
+    printf("PC: NUMA SLIT too short for %" PRIu64 " localities, ignored\n", count);
+    return;
+  }
+
+  /* the matrix is indexed by proximity domain */
+  const uint8_t *matrix = (const uint8_t *)(slit + 1);
+  for (uint64_t from = 0; from < count; from++) {
+    for (uint64_t to = 0; to < count; to++) {
+      int from_node = find_node(from);
+      int to_node = find_node(to);
+      if (from_node >= 0 && to_node >= 0)
+        pmm_set_numa_distance(from_node, to_node, matrix[from * count + to]);
+    }
+  }
+}
+
+void platform_init_numa(void) {
+  const struct x86_cpuid_leaf *leaf = x86_get_cpuid_leaf(X86_CPUID_MODEL_FEATURES);
+  if (leaf)
+    boot_apic_id = leaf->b >> 24;
+
+  if (acpi_process_srat_entries_etc(ACPI_SRAT_TYPE_MEMORY_AFFINITY, &memory_affinity_callback) <
+      0) {
+    LTRACEF("no SRAT\n");
+    return;
+  }
+  acpi_process_srat_entries_etc(ACPI_SRAT_TYPE_PROCESSOR_AFFINITY, &processor_affinity_callback);
+  acpi_process_srat_entries_etc(ACPI_SRAT_TYPE_PROCESSOR_X2APIC_AFFINITY,
+                                &x2apic_affinity_callback);
+  parse_slit();
+
+  dprintf(INFO, "PC: NUMA %u node%s, boot cpu on node %u\n", pmm_numa_node_count(),
+          pmm_numa_node_count() == 1 ? "" : "s", pmm_cpu_numa_node(0));
+}
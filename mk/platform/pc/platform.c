@@ -35,6 +35,9 @@
 #endif
 #if WITH_LIB_MINIP
 #include <lib/minip.h>
+#if WITH_DEV_VIRTIO_NET
+#include <dev/virtio/net.h>
+#endif
 #endif
 
 #define LOCAL_TRACE 0
@@ -245,9 +248,14 @@ void platform_init(void) {
 
   platform_init_keyboard(&console_input_buf);
 
+  bool acpi_found = acpi_lite_init(0) == NO_ERROR;
+  if (acpi_found) {
+    platform_init_numa();
+  }
+
 #if WITH_DEV_BUS_PCI
   bool pci_initted = false;
-  if (acpi_lite_init(0) == NO_ERROR) {
+  if (acpi_found) {
     if (LOCAL_TRACE) {
       acpi_lite_dump_tables(false);
     }
@@ -297,7 +305,20 @@ void _start_minip(uint level) {
   status_t err = e1000_register_with_minip();
   if (err == NO_ERROR) {
     minip_start_dhcp();
+    return;
+  }
+
+#if WITH_DEV_VIRTIO_NET
+  // no e1000, try a virtio nic found on the pci bus
+  if (virtio_net_found() > 0) {
+    uint8_t mac_addr[6];
+
+    virtio_net_get_mac_addr(mac_addr);
+    minip_set_eth(virtio_net_send_minip_pkt, NULL, mac_addr);
+    virtio_net_start();
+    minip_start_dhcp();
   }
+#endif
 }
 
 LK_INIT_HOOK(start_minip, _start_minip, LK_INIT_LEVEL_APPS - 1);
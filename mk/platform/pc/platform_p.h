@@ -25,3 +25,6 @@ void pic_mask_interrupts(void);
 // local apic
 void lapic_init(void);
 void lapic_eoi(unsigned int vector);
+
+// numa topology from the acpi tables
+void platform_init_numa(void);
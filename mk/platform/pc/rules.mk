@@ -23,6 +23,7 @@ MODULE_SRCS += \
     $(LOCAL_DIR)/interrupts.c \
     $(LOCAL_DIR)/keyboard.c \
     $(LOCAL_DIR)/lapic.c \
+    $(LOCAL_DIR)/numa.c \
     $(LOCAL_DIR)/pic.c \
     $(LOCAL_DIR)/platform.c \
     $(LOCAL_DIR)/timer.c \
@@ -5,6 +5,7 @@
  * license that can be found in the LICENSE file or at
  * https://opensource.org/licenses/MIT
  */
+#include <align.h>
 #include <arch.h>
 #include <lib/fdtwalk.h>
 #include <platform.h>
@@ -136,41 +137,63 @@ status_t platform_pci_int_to_vector(unsigned int pci_int, unsigned int *vector)
   return NO_ERROR;
 }
 
-status_t platform_allocate_interrupts(size_t count, uint align_log2, bool msi,
-                                      unsigned int *vector) {
-  TRACEF("count %zu align %u msi %d\n", count, align_log2, msi);
+// list of allocated msi interrupts
+static uint64_t msi_bitmap = 0;
+static spin_lock_t msi_lock = SPIN_LOCK_INITIAL_VALUE;
 
-  // TODO: handle nonzero alignment, count > 0, and add locking
+#define MSI_COUNT (sizeof(msi_bitmap) * 8)
 
-  // list of allocated msi interrupts
-  static uint64_t msi_bitmap = 0;
+status_t platform_allocate_interrupts(size_t count, uint align_log2, bool msi,
+                                      unsigned int *vector) {
+  LTRACEF("count %zu align %u msi %d\n", count, align_log2, msi);
 
   // cannot handle allocating for anything but MSI interrupts
   if (!msi) {
     return ERR_NOT_SUPPORTED;
   }
+  if (count == 0 || count > MSI_COUNT || align_log2 >= 32) {
+    return ERR_INVALID_ARGS;
+  }
 
-  // cannot deal with alignment yet
-  DEBUG_ASSERT(align_log2 == 0);
-  DEBUG_ASSERT(count == 1);
-
-  // make a copy of the bitmap
-  int allocated = -1;
-  for (size_t i = 0; i < sizeof(msi_bitmap) * 8; i++) {
-    if ((msi_bitmap & (1UL << i)) == 0) {
-      msi_bitmap |= (1UL << i);
-      allocated = i;
+  spin_lock_saved_state_t state;
+  spin_lock_irqsave(&msi_lock, state);
+
+  // find the first aligned run of free interrupts. the alignment is of the
+  // vector itself, since that is what ends up in the msi data
+  status_t err = ERR_NOT_FOUND;
+  const size_t align = 1u << align_log2;
+  for (size_t base = ROUNDUP(MSI_INT_BASE, align) - MSI_INT_BASE; base + count <= MSI_COUNT;
+       base += align) {
+    const uint64_t mask = (count == MSI_COUNT) ? ~0ULL : ((1ULL << count) - 1) << base;
+    if ((msi_bitmap & mask) == 0) {
+      msi_bitmap |= mask;
+      *vector = base + MSI_INT_BASE;
+      LTRACEF("allocated msi at %u\n", *vector);
+      err = NO_ERROR;
       break;
     }
   }
-  if (allocated < 0) {
-    return ERR_NOT_FOUND;
+
+  spin_unlock_irqrestore(&msi_lock, state);
+
+  return err;
+}
+
+status_t platform_free_interrupts(unsigned int vector, size_t count) {
+  LTRACEF("vector %u count %zu\n", vector, count);
+  if (vector < MSI_INT_BASE || count > MSI_COUNT || vector - MSI_INT_BASE > MSI_COUNT - count) {
+    return ERR_INVALID_ARGS;
+  }
+
+  spin_lock_saved_state_t state;
+  spin_lock_irqsave(&msi_lock, state);
+
+  for (size_t i = 0; i < count; i++) {
+    msi_bitmap &= ~(1ULL << (vector - MSI_INT_BASE + i));
   }
 
-  allocated += MSI_INT_BASE;
+  spin_unlock_irqrestore(&msi_lock, state);
 
-  TRACEF("allocated msi at %u\n", allocated);
-  *vector = allocated;
   return NO_ERROR;
 }
 
@@ -152,6 +152,8 @@ status_t platform_allocate_interrupts(size_t count, uint align_log2, bool msi,
   return ERR_NOT_SUPPORTED;
 }
 
+status_t platform_free_interrupts(unsigned int vector, size_t count) { return ERR_NOT_SUPPORTED; }
+
 status_t platform_compute_msi_values(unsigned int vector, unsigned int cpu, bool edge,
                                      uint64_t *msi_address_out, uint16_t *msi_data_out) {
   return ERR_NOT_SUPPORTED;